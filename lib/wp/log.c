@@ -9,8 +9,14 @@
 #include "log.h"
 #include "spa-pod.h"
 #include "proxy.h"
+#include "error.h"
+#include "private/trace-format.h"
 #include <pipewire/pipewire.h>
 #include <spa/support/log.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 /*!
  * \defgroup wplog Debug Logging
@@ -179,8 +185,14 @@ static gsize initialized = 0;
 static gboolean use_color = FALSE;
 static gboolean output_is_journal = FALSE;
 static GPatternSpec **enabled_categories = NULL;
+static GHashTable *category_verdicts = NULL;
+static GRWLock categories_lock;
 static gint enabled_level = 4; /* MESSAGE */
 
+#define CATEGORY_ENABLED GINT_TO_POINTER (1)
+#define CATEGORY_DISABLED GINT_TO_POINTER (2)
+#define MAX_CATEGORY_VERDICTS 512
+
 struct common_fields
 {
   const gchar *log_domain;
@@ -266,37 +278,48 @@ level_index_to_spa (gint lvl_index)
   return CLAMP (lvl_index - 2, 0, 5);
 }
 
+#define DEBUG_MESSAGE_FORMAT "%s%18.18s %s%s:%s:%s:%s %s\n"
+#define DEBUG_MESSAGE_ARGS(cf) \
+      /* domain */ \
+      use_color ? DOMAIN_COLOR : "", \
+      (cf)->log_domain, \
+      /* file, line, function */ \
+      use_color ? LOCATION_COLOR : "", \
+      (cf)->file, \
+      (cf)->line, \
+      (cf)->func, \
+      use_color ? RESET_COLOR : "", \
+      /* message */ \
+      (cf)->message
+
 static inline void
-write_debug_message (FILE *s, struct common_fields *cf)
+format_time (gint64 now, gchar *time_buf, gsize size)
 {
-  gint64 now;
   time_t now_secs;
   struct tm now_tm;
-  gchar time_buf[128];
 
-  now = g_get_real_time ();
   now_secs = (time_t) (now / G_USEC_PER_SEC);
   localtime_r (&now_secs, &now_tm);
-  strftime (time_buf, sizeof (time_buf), "%H:%M:%S", &now_tm);
+  strftime (time_buf, size, "%H:%M:%S", &now_tm);
+}
+
+static inline void
+write_debug_message (FILE *s, struct common_fields *cf)
+{
+  gint64 now;
+  gchar time_buf[128];
+
+  now = g_get_real_time ();
+  format_time (now, time_buf, sizeof (time_buf));
 
-  fprintf (s, "%s%s %s.%06d %s%18.18s %s%s:%s:%s:%s %s\n",
+  fprintf (s, "%s%s %s.%06d " DEBUG_MESSAGE_FORMAT,
       /* level */
       use_color ? log_level_info[cf->log_level].color : "",
       log_level_info[cf->log_level].name,
       /* timestamp */
       time_buf,
       (gint) (now % G_USEC_PER_SEC),
-      /* domain */
-      use_color ? DOMAIN_COLOR : "",
-      cf->log_domain,
-      /* file, line, function */
-      use_color ? LOCATION_COLOR : "",
-      cf->file,
-      cf->line,
-      cf->func,
-      use_color ? RESET_COLOR : "",
-      /* message */
-      cf->message);
+      DEBUG_MESSAGE_ARGS (cf));
   fflush (s);
 }
 
@@ -405,8 +428,12 @@ wp_log_set_level (const gchar * level_str)
   gchar **tokens = NULL;
   gchar **categories = NULL;
 
+  g_rw_lock_writer_lock (&categories_lock);
+
   /* reset to defaults */
   enabled_level = 4; /* MESSAGE */
+  if (category_verdicts)
+    g_hash_table_remove_all (category_verdicts);
   if (enabled_categories) {
     GPatternSpec **pspec = enabled_categories;
     for (; *pspec != NULL; pspec++)
@@ -436,6 +463,8 @@ wp_log_set_level (const gchar * level_str)
     }
   }
 
+  g_rw_lock_writer_unlock (&categories_lock);
+
   /* set the log level also on the spa_log */
   wp_spa_log_get_instance()->level = level_index_to_spa (enabled_level);
 
@@ -446,19 +475,15 @@ wp_log_set_level (const gchar * level_str)
 }
 
 static gboolean
-is_category_enabled(const gchar *log_domain)
+match_category (const gchar *log_domain)
 {
   GPatternSpec **cat = enabled_categories;
   guint len;
   g_autofree gchar *reverse_domain = NULL;
 
-  if (!enabled_categories)
-    return true;
-
   len = strlen (log_domain);
   reverse_domain = g_strreverse (g_strndup (log_domain, len));
 
-  cat = enabled_categories;
   while (*cat && !g_pattern_match (*cat, len, log_domain, reverse_domain))
     cat++;
 
@@ -466,6 +491,573 @@ is_category_enabled(const gchar *log_domain)
   return (*cat != NULL);
 }
 
+static gboolean
+is_category_enabled(const gchar *log_domain)
+{
+  gpointer verdict = NULL;
+  gboolean enabled;
+
+  if (!enabled_categories)
+    return true;
+
+  /* fast path: the verdict of this domain is already known */
+  g_rw_lock_reader_lock (&categories_lock);
+  if (category_verdicts)
+    verdict = g_hash_table_lookup (category_verdicts, log_domain);
+  g_rw_lock_reader_unlock (&categories_lock);
+
+  if (verdict)
+    return (verdict == CATEGORY_ENABLED);
+
+  g_rw_lock_writer_lock (&categories_lock);
+  enabled = !enabled_categories || match_category (log_domain);
+
+  /* domains are normally a small fixed set; bound the cache in case
+     something logs with dynamically generated ones */
+  if (!category_verdicts)
+    category_verdicts = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, NULL);
+  if (g_hash_table_size (category_verdicts) < MAX_CATEGORY_VERDICTS)
+    g_hash_table_insert (category_verdicts, g_strdup (log_domain),
+        enabled ? CATEGORY_ENABLED : CATEGORY_DISABLED);
+  g_rw_lock_writer_unlock (&categories_lock);
+
+  return enabled;
+}
+
+/*
+ * Asynchronous writer
+ *
+ * Messages are formatted on the calling thread (except for the timestamp,
+ * which only needs the time) and pushed to a bounded multi-producer,
+ * single-consumer ring buffer, which is drained by a background thread.
+ * Producers never block: if the ring is full, the message is dropped and
+ * counted, and the writer thread reports the count when it catches up.
+ */
+
+#define ASYNC_RING_SIZE 4096 /* must be a power of 2 */
+
+struct async_record
+{
+  gint seq;
+  gint log_level;
+  gint64 time;
+  gchar *text;
+};
+
+static struct {
+  struct async_record ring[ASYNC_RING_SIZE];
+  gint enqueue_pos;
+  guint dequeue_pos;
+  guint dropped;
+  gint enabled;
+  gint sleeping;
+  gboolean stopping;
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+} async_writer;
+
+G_LOCK_DEFINE_STATIC (async_writer_control);
+
+static gboolean
+async_writer_push (gint log_level, gint64 time, gchar *text)
+{
+  guint pos = (guint) g_atomic_int_get (&async_writer.enqueue_pos);
+  struct async_record *slot;
+
+  for (;;) {
+    gint diff;
+
+    slot = &async_writer.ring[pos & (ASYNC_RING_SIZE - 1)];
+    diff = (gint) ((guint) g_atomic_int_get (&slot->seq) - pos);
+
+    if (diff == 0) {
+      /* the slot is free, try to claim it */
+      if (g_atomic_int_compare_and_exchange (&async_writer.enqueue_pos,
+              (gint) pos, (gint) (pos + 1)))
+        break;
+    } else if (diff < 0) {
+      /* the ring is full */
+      g_atomic_int_inc (&async_writer.dropped);
+      return FALSE;
+    }
+    pos = (guint) g_atomic_int_get (&async_writer.enqueue_pos);
+  }
+
+  slot->log_level = log_level;
+  slot->time = time;
+  slot->text = text;
+  g_atomic_int_set (&slot->seq, (gint) (pos + 1));
+
+  if (g_atomic_int_get (&async_writer.sleeping)) {
+    g_mutex_lock (&async_writer.lock);
+    g_cond_signal (&async_writer.cond);
+    g_mutex_unlock (&async_writer.lock);
+  }
+  return TRUE;
+}
+
+static inline struct async_record *
+async_writer_peek (void)
+{
+  guint pos = async_writer.dequeue_pos;
+  struct async_record *slot =
+      &async_writer.ring[pos & (ASYNC_RING_SIZE - 1)];
+
+  if ((gint) ((guint) g_atomic_int_get (&slot->seq) - (pos + 1)) < 0)
+    return NULL;
+  return slot;
+}
+
+/* must only be called from the writer thread, or when it is not running */
+static void
+async_writer_drain (FILE *s)
+{
+  struct async_record *slot;
+  gint64 last_secs = -1;
+  gchar time_buf[128];
+  guint dropped;
+  gboolean written = FALSE;
+
+  while ((slot = async_writer_peek ())) {
+    if (slot->time / G_USEC_PER_SEC != last_secs) {
+      last_secs = slot->time / G_USEC_PER_SEC;
+      format_time (slot->time, time_buf, sizeof (time_buf));
+    }
+
+    fprintf (s, "%s%s %s.%06d %s",
+        use_color ? log_level_info[slot->log_level].color : "",
+        log_level_info[slot->log_level].name,
+        time_buf,
+        (gint) (slot->time % G_USEC_PER_SEC),
+        slot->text);
+    g_clear_pointer (&slot->text, g_free);
+
+    /* release the slot to the producers */
+    g_atomic_int_set (&slot->seq,
+        (gint) (async_writer.dequeue_pos + ASYNC_RING_SIZE));
+    async_writer.dequeue_pos++;
+    written = TRUE;
+  }
+
+  dropped = g_atomic_int_and (&async_writer.dropped, 0);
+  if (dropped > 0) {
+    gint64 now = g_get_real_time ();
+    gint lvl = log_level_index (G_LOG_LEVEL_WARNING);
+
+    format_time (now, time_buf, sizeof (time_buf));
+    fprintf (s, "%s%s %s.%06d %s%18.18s %s%u log messages were dropped\n",
+        use_color ? log_level_info[lvl].color : "",
+        log_level_info[lvl].name,
+        time_buf,
+        (gint) (now % G_USEC_PER_SEC),
+        use_color ? DOMAIN_COLOR : "",
+        "wp-log",
+        use_color ? RESET_COLOR : "",
+        dropped);
+    written = TRUE;
+  }
+
+  if (written)
+    fflush (s);
+}
+
+static gpointer
+async_writer_thread_func (gpointer data)
+{
+  gboolean stopping = FALSE;
+
+  while (!stopping) {
+    async_writer_drain (stderr);
+
+    g_mutex_lock (&async_writer.lock);
+    g_atomic_int_set (&async_writer.sleeping, TRUE);
+    while (!async_writer_peek () && !async_writer.stopping)
+      g_cond_wait (&async_writer.cond, &async_writer.lock);
+    g_atomic_int_set (&async_writer.sleeping, FALSE);
+    stopping = async_writer.stopping;
+    g_mutex_unlock (&async_writer.lock);
+  }
+
+  async_writer_drain (stderr);
+  return NULL;
+}
+
+/* stops the writer thread and writes everything that is still queued */
+static void
+async_writer_flush (void)
+{
+  wp_log_set_async (FALSE);
+
+  /* write any messages that were pushed while the writer was stopping */
+  G_LOCK (async_writer_control);
+  async_writer_drain (stderr);
+  G_UNLOCK (async_writer_control);
+}
+
+static void
+async_writer_atexit (void)
+{
+  async_writer_flush ();
+}
+
+/*!
+ * \brief Enables or disables the asynchronous log writer
+ *
+ * When enabled, wp_log_writer_default() only formats messages and hands
+ * them over to a background thread that writes them to stderr, so that the
+ * calling thread never blocks on the output. Messages are dropped (and the
+ * number of dropped messages is reported) if the background thread cannot
+ * keep up. Fatal errors and messages sent to the journal are still written
+ * synchronously. Pending messages are flushed when the asynchronous writer
+ * is disabled, when the process exits normally and before a fatal error is
+ * written, in which case the asynchronous writer is disabled for good.
+ *
+ * This is enabled automatically by wp_init() when the WIREPLUMBER_LOG_ASYNC
+ * environment variable is set to a non-zero value.
+ *
+ * \ingroup wplog
+ * \param enable whether to enable the asynchronous writer
+ * \since 0.4.15
+ */
+void
+wp_log_set_async (gboolean enable)
+{
+  static gsize ring_initialized = 0;
+
+  if (g_once_init_enter (&ring_initialized)) {
+    for (guint i = 0; i < ASYNC_RING_SIZE; i++)
+      async_writer.ring[i].seq = i;
+    atexit (async_writer_atexit);
+    g_once_init_leave (&ring_initialized, TRUE);
+  }
+
+  G_LOCK (async_writer_control);
+
+  if (enable && !async_writer.thread) {
+    async_writer.stopping = FALSE;
+    async_writer.thread = g_thread_new ("wp-log-writer",
+        async_writer_thread_func, NULL);
+    g_atomic_int_set (&async_writer.enabled, TRUE);
+  }
+  else if (!enable && async_writer.thread) {
+    g_atomic_int_set (&async_writer.enabled, FALSE);
+
+    g_mutex_lock (&async_writer.lock);
+    async_writer.stopping = TRUE;
+    g_cond_signal (&async_writer.cond);
+    g_mutex_unlock (&async_writer.lock);
+
+    g_thread_join (async_writer.thread);
+    async_writer.thread = NULL;
+  }
+
+  G_UNLOCK (async_writer_control);
+}
+
+static inline void
+write_debug_message_async (struct common_fields *cf)
+{
+  gchar *text = g_strdup_printf (DEBUG_MESSAGE_FORMAT, DEBUG_MESSAGE_ARGS (cf));
+
+  if (!async_writer_push (cf->log_level, g_get_real_time (), text))
+    g_free (text);
+}
+
+/*
+ * Binary trace sink
+ *
+ * When a trace file is set, messages bypass the GLogWriterFunc entirely:
+ * they are formatted straight into a fixed-size slot of a memory-mapped
+ * ring file (see private/trace-format.h), together with ids that refer to
+ * the domain, code location and object type in the file's string table.
+ * Warnings and more severe messages are also written to the normal log.
+ */
+
+#define TRACE_SLOT_SIZE 512
+#define TRACE_STRINGS_SIZE (1024 * 1024)
+#define TRACE_DEFAULT_SIZE (16 * 1024 * 1024)
+
+struct trace_location
+{
+  gchar *file;
+  gchar *func;
+  gint line;
+};
+
+static struct {
+  struct wp_trace_header *header;
+  gsize size;
+  guint32 last_string_id;
+  GHashTable *domains; /* domain -> id */
+  GHashTable *locations; /* struct trace_location -> id */
+  GHashTable *types; /* GType -> id */
+  GMutex lock;
+} trace_sink;
+
+static guint
+trace_location_hash (gconstpointer key)
+{
+  const struct trace_location *l = key;
+  return (g_str_hash (l->file) * 31 + g_str_hash (l->func)) * 31 + l->line;
+}
+
+static gboolean
+trace_location_equal (gconstpointer a, gconstpointer b)
+{
+  const struct trace_location *la = a, *lb = b;
+  return la->line == lb->line && g_str_equal (la->file, lb->file) &&
+      g_str_equal (la->func, lb->func);
+}
+
+static void
+trace_location_free (gpointer data)
+{
+  struct trace_location *l = data;
+  g_free (l->file);
+  g_free (l->func);
+  g_free (l);
+}
+
+static inline gboolean
+trace_sink_is_enabled (void)
+{
+  return g_atomic_pointer_get (&trace_sink.header) != NULL;
+}
+
+/* must be called with the lock held */
+static guint32
+trace_add_string (struct wp_trace_header *h, const gchar *text)
+{
+  guint32 id = ++trace_sink.last_string_id;
+  gsize len = strlen (text);
+  gsize entry_size = wp_trace_string_entry_size (len);
+
+  /* if the table is full the id is still valid, but the decoder will not
+     be able to resolve it */
+  if (h->strings_used + entry_size <= h->strings_size) {
+    struct wp_trace_string *str = (struct wp_trace_string *)
+        ((gchar *) wp_trace_get_strings (h) + h->strings_used);
+    str->id = id;
+    str->len = len;
+    memcpy (str->text, text, len);
+    h->strings_used += entry_size;
+  }
+  return id;
+}
+
+static guint32
+trace_domain_id (struct wp_trace_header *h, const gchar *domain)
+{
+  guint32 id = GPOINTER_TO_UINT (g_hash_table_lookup (trace_sink.domains,
+      domain));
+  if (G_UNLIKELY (id == WP_TRACE_STRING_NONE)) {
+    id = trace_add_string (h, domain);
+    g_hash_table_insert (trace_sink.domains, g_strdup (domain),
+        GUINT_TO_POINTER (id));
+  }
+  return id;
+}
+
+static guint32
+trace_location_id (struct wp_trace_header *h, const gchar *file,
+    gint line, const gchar *func)
+{
+  struct trace_location key = {
+    (gchar *) (file ? file : ""), (gchar *) (func ? func : ""), line
+  };
+  guint32 id = GPOINTER_TO_UINT (g_hash_table_lookup (trace_sink.locations,
+      &key));
+  if (G_UNLIKELY (id == WP_TRACE_STRING_NONE)) {
+    g_autofree gchar *text = g_strdup_printf ("%s:%d:%s", key.file, line,
+        key.func);
+    struct trace_location *l = g_new (struct trace_location, 1);
+
+    id = trace_add_string (h, text);
+    l->file = g_strdup (key.file);
+    l->func = g_strdup (key.func);
+    l->line = line;
+    g_hash_table_insert (trace_sink.locations, l, GUINT_TO_POINTER (id));
+  }
+  return id;
+}
+
+static guint32
+trace_type_id (struct wp_trace_header *h, GType type)
+{
+  guint32 id;
+
+  if (type == 0)
+    return WP_TRACE_STRING_NONE;
+
+  id = GPOINTER_TO_UINT (g_hash_table_lookup (trace_sink.types,
+      GSIZE_TO_POINTER (type)));
+  if (G_UNLIKELY (id == WP_TRACE_STRING_NONE)) {
+    id = trace_add_string (h, g_type_name (type));
+    g_hash_table_insert (trace_sink.types, GSIZE_TO_POINTER (type),
+        GUINT_TO_POINTER (id));
+  }
+  return id;
+}
+
+static G_GNUC_PRINTF (8, 0) void
+trace_sink_write (const gchar *domain, gint level_index, const gchar *file,
+    gint line, const gchar *func, GType object_type, gconstpointer object,
+    const gchar *format, va_list args)
+{
+  struct wp_trace_header *h;
+  struct wp_trace_record *r;
+  guint32 bound_id = SPA_ID_INVALID;
+  gsize capacity;
+  gint len;
+
+  /* done without holding the lock, as this may call into the object */
+  if (object && g_type_is_a (object_type, WP_TYPE_PROXY) &&
+      (wp_object_get_active_features ((WpObject *) object) &
+          WP_PROXY_FEATURE_BOUND))
+    bound_id = wp_proxy_get_bound_id ((WpProxy *) object);
+
+  g_mutex_lock (&trace_sink.lock);
+
+  if (G_UNLIKELY (!(h = trace_sink.header))) {
+    g_mutex_unlock (&trace_sink.lock);
+    return;
+  }
+
+  r = wp_trace_get_slot (h, h->seq);
+  r->seq = 0;
+  r->time = g_get_monotonic_time ();
+  r->object = (guint64) (guintptr) object;
+  r->bound_id = bound_id;
+  r->type_id = trace_type_id (h, object_type);
+  r->domain_id = trace_domain_id (h, domain);
+  r->location_id = trace_location_id (h, file, line, func);
+  r->level = level_index;
+  r->flags = 0;
+
+  capacity = h->slot_size - sizeof (struct wp_trace_record);
+  len = g_vsnprintf (r->payload, capacity, format, args);
+  if (len < 0)
+    len = 0;
+  if ((gsize) len >= capacity) {
+    len = capacity - 1;
+    r->flags |= WP_TRACE_RECORD_FLAG_TRUNCATED;
+  }
+  r->payload_len = len;
+
+  /* publish the record */
+  r->seq = ++h->seq;
+
+  g_mutex_unlock (&trace_sink.lock);
+}
+
+/* whether a message that went to the trace sink should also be written
+   to the normal log */
+static inline gboolean
+trace_sink_also_log (gint level_index)
+{
+  return level_index <= log_level_index (G_LOG_LEVEL_WARNING);
+}
+
+static void
+trace_sink_close (void)
+{
+  if (trace_sink.header) {
+    g_atomic_pointer_set (&trace_sink.header, NULL);
+    munmap (trace_sink.header, trace_sink.size);
+  }
+  g_clear_pointer (&trace_sink.domains, g_hash_table_unref);
+  g_clear_pointer (&trace_sink.locations, g_hash_table_unref);
+  g_clear_pointer (&trace_sink.types, g_hash_table_unref);
+  trace_sink.last_string_id = WP_TRACE_STRING_NONE;
+}
+
+/*!
+ * \brief Redirects log messages to a binary trace file
+ *
+ * Instead of being formatted as text, log messages that pass the level and
+ * category filters are stored as compact binary records in \a path, which
+ * is memory-mapped and used as a ring buffer: when it is full, the oldest
+ * records are overwritten. Records hold a timestamp, the level, the domain,
+ * the code location, the object (pointer, type and bound id) and the
+ * formatted message. Warnings and more severe messages are also written to
+ * the normal log. Use the `wptrace` tool to convert the file to text or to
+ * the Chrome trace event format.
+ *
+ * This is enabled automatically by wp_init() when the WIREPLUMBER_TRACE_FILE
+ * environment variable is set to the path of the trace file.
+ *
+ * \ingroup wplog
+ * \param path (nullable): the trace file to create, or NULL to stop tracing
+ * \param size the size of the file in bytes, or 0 to use the default (16 MiB)
+ * \param error (out) (optional): return location for errors
+ * \returns TRUE on success, FALSE if the file could not be created
+ * \since 0.4.15
+ */
+gboolean
+wp_log_set_trace_file (const gchar * path, gsize size, GError ** error)
+{
+  struct wp_trace_header *h;
+  gsize min_size = WP_TRACE_HEADER_SIZE + TRACE_STRINGS_SIZE +
+      TRACE_SLOT_SIZE * 16;
+  gint fd;
+
+  g_mutex_lock (&trace_sink.lock);
+  trace_sink_close ();
+
+  if (!path) {
+    g_mutex_unlock (&trace_sink.lock);
+    return TRUE;
+  }
+
+  if (size == 0)
+    size = TRACE_DEFAULT_SIZE;
+  if (size < min_size) {
+    g_mutex_unlock (&trace_sink.lock);
+    g_set_error (error, WP_DOMAIN_LIBRARY, WP_LIBRARY_ERROR_INVALID_ARGUMENT,
+        "trace file size must be at least %" G_GSIZE_FORMAT " bytes",
+        min_size);
+    return FALSE;
+  }
+
+  fd = open (path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0 || ftruncate (fd, size) < 0 ||
+      (h = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))
+          == MAP_FAILED) {
+    gint err = errno;
+    if (fd >= 0)
+      close (fd);
+    g_mutex_unlock (&trace_sink.lock);
+    g_set_error (error, WP_DOMAIN_LIBRARY, WP_LIBRARY_ERROR_OPERATION_FAILED,
+        "failed to create trace file '%s': %s", path, g_strerror (err));
+    return FALSE;
+  }
+  close (fd);
+
+  memcpy (h->magic, WP_TRACE_MAGIC, sizeof (h->magic));
+  h->version = WP_TRACE_VERSION;
+  h->slot_size = TRACE_SLOT_SIZE;
+  h->strings_size = TRACE_STRINGS_SIZE;
+  h->n_slots = (size - WP_TRACE_HEADER_SIZE - TRACE_STRINGS_SIZE) /
+      TRACE_SLOT_SIZE;
+  h->strings_used = 0;
+  h->seq = 0;
+  h->start_realtime = g_get_real_time ();
+  h->start_monotonic = g_get_monotonic_time ();
+
+  trace_sink.size = size;
+  trace_sink.domains = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
+  trace_sink.locations = g_hash_table_new_full (trace_location_hash,
+      trace_location_equal, trace_location_free, NULL);
+  trace_sink.types = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_atomic_pointer_set (&trace_sink.header, h);
+
+  g_mutex_unlock (&trace_sink.lock);
+  return TRUE;
+}
+
 /*!
  * \brief WirePlumber's GLogWriterFunc
  *
@@ -479,6 +1071,7 @@ wp_log_writer_default (GLogLevelFlags log_level,
 {
   struct common_fields cf = {0};
   g_autofree gchar *full_message = NULL;
+  gboolean is_fatal;
 
   g_return_val_if_fail (fields != NULL, G_LOG_WRITER_UNHANDLED);
   g_return_val_if_fail (n_fields > 0, G_LOG_WRITER_UNHANDLED);
@@ -495,6 +1088,14 @@ wp_log_writer_default (GLogLevelFlags log_level,
   }
 
   cf.log_level = log_level_index (log_level);
+  is_fatal = (log_level & G_LOG_FLAG_FATAL) ||
+      cf.log_level <= log_level_index (G_LOG_LEVEL_ERROR);
+
+  /* the process aborts right after a fatal message is logged, so write
+     everything that was queued before it first; this also makes sure that
+     the fatal message itself is written synchronously */
+  if (G_UNLIKELY (is_fatal) && g_atomic_int_get (&async_writer.enabled))
+    async_writer_flush ();
 
   /* check if debug level is enabled */
   if (cf.log_level > enabled_level)
@@ -523,7 +1124,14 @@ wp_log_writer_default (GLogLevelFlags log_level,
       g_log_writer_journald (log_level, fields, n_fields, user_data) == G_LOG_WRITER_HANDLED)
     return G_LOG_WRITER_HANDLED;
 
+  if (!is_fatal && g_atomic_int_get (&async_writer.enabled)) {
+    write_debug_message_async (&cf);
+    return G_LOG_WRITER_HANDLED;
+  }
+
   write_debug_message (stderr, &cf);
+  if (is_fatal)
+    fflush (stderr);
   return G_LOG_WRITER_HANDLED;
 }
 
@@ -575,6 +1183,23 @@ wp_log_structured_standard (
     n_fields++;
   }
 
+  if (trace_sink_is_enabled ()) {
+    gint lvl = log_level_index (log_level);
+
+    if (lvl > enabled_level ||
+        !is_category_enabled (log_domain ? log_domain : "default"))
+      return;
+
+    va_start (args, message_format);
+    trace_sink_write (log_domain ? log_domain : "default", lvl, file,
+        line ? atoi (line) : 0, func, object_type, object, message_format,
+        args);
+    va_end (args);
+
+    if (!trace_sink_also_log (lvl))
+      return;
+  }
+
   va_start (args, message_format);
   fields[4].value = message = g_strdup_vprintf (message_format, args);
   va_end (args);
@@ -607,6 +1232,22 @@ wp_spa_log_logtv (void *object,
   GLogLevelFlags log_level = log_level_info[log_level_idx].log_level;
   fields[0].value = log_level_info[log_level_idx].priority;
 
+  if (trace_sink_is_enabled ()) {
+    const gchar *domain = topic ? topic->topic : "pw";
+    va_list copy;
+
+    if (log_level_idx > enabled_level || !is_category_enabled (domain))
+      return;
+
+    va_copy (copy, args);
+    trace_sink_write (domain, log_level_idx, file, line, func, 0, NULL, fmt,
+        copy);
+    va_end (copy);
+
+    if (!trace_sink_also_log (log_level_idx))
+      return;
+  }
+
   sprintf (line_str, "%d", line);
   fields[4].value = message = g_strdup_vprintf (fmt, args);
 
@@ -26,6 +26,13 @@ gboolean wp_log_level_is_enabled (GLogLevelFlags log_level) G_GNUC_PURE;
 WP_API
 void wp_log_set_level (const gchar * level_str);
 
+WP_API
+void wp_log_set_async (gboolean enable);
+
+WP_API
+gboolean wp_log_set_trace_file (const gchar * path, gsize size,
+    GError ** error);
+
 WP_API
 GLogWriterOutput wp_log_writer_default (GLogLevelFlags log_level,
     const GLogField *fields, gsize n_fields, gpointer user_data);
@@ -61,92 +61,150 @@ static guint32 signals[N_SIGNALS] = {0};
 
 /* data structure */
 
+/*
+ * Items are kept in a list in the order they were first added, which is the
+ * order in which they are iterated. In addition, they are indexed by subject
+ * and by key within each subject, so that lookups and subject removals do not
+ * need to scan all the items.
+ */
+
 struct item
 {
+  struct spa_list link;
+  struct spa_list subject_link;
   uint32_t subject;
   gchar *key;
   gchar *type;
   gchar *value;
 };
 
+struct subject_items
+{
+  struct spa_list items;
+  GHashTable *keys; /* key (owned by the item) -> struct item* */
+};
+
+typedef struct _WpMetadataPrivate WpMetadataPrivate;
+struct _WpMetadataPrivate
+{
+  struct pw_metadata *iface;
+  struct spa_hook listener;
+  struct spa_list items;
+  GHashTable *subjects; /* subject -> struct subject_items* */
+  gboolean remove_listener;
+};
+
 static void
-set_item (struct item * item, uint32_t subject, const char * key,
-    const char * type, const char * value)
+set_item (struct item * item, const char * type, const char * value)
 {
-  item->subject = subject;
-  item->key = g_strdup (key);
+  g_free (item->type);
+  g_free (item->value);
   item->type = g_strdup (type);
   item->value = g_strdup (value);
 }
 
 static void
-clear_item (struct item * item)
+free_item (struct item * item)
 {
   g_free (item->key);
   g_free (item->type);
   g_free (item->value);
-  spa_zero (*item);
+  g_slice_free (struct item, item);
+}
+
+static void
+free_subject_items (struct subject_items * s)
+{
+  g_hash_table_unref (s->keys);
+  g_slice_free (struct subject_items, s);
+}
+
+static struct item *
+find_item (WpMetadataPrivate * priv, uint32_t subject, const char * key)
+{
+  struct subject_items *s =
+      g_hash_table_lookup (priv->subjects, GUINT_TO_POINTER (subject));
+  return s ? g_hash_table_lookup (s->keys, key) : NULL;
 }
 
 static struct item *
-find_item (struct pw_array * metadata, uint32_t subject, const char * key)
+add_item (WpMetadataPrivate * priv, uint32_t subject, const char * key)
 {
+  struct subject_items *s =
+      g_hash_table_lookup (priv->subjects, GUINT_TO_POINTER (subject));
   struct item *item;
 
-  pw_array_for_each (item, metadata) {
-    if (item->subject == subject && (key == NULL || !strcmp (item->key, key))) {
-      return item;
-    }
+  if (!s) {
+    s = g_slice_new0 (struct subject_items);
+    spa_list_init (&s->items);
+    s->keys = g_hash_table_new (g_str_hash, g_str_equal);
+    g_hash_table_insert (priv->subjects, GUINT_TO_POINTER (subject), s);
   }
-  return NULL;
+
+  item = g_slice_new0 (struct item);
+  item->subject = subject;
+  item->key = g_strdup (key);
+  spa_list_append (&priv->items, &item->link);
+  spa_list_append (&s->items, &item->subject_link);
+  g_hash_table_insert (s->keys, item->key, item);
+  return item;
+}
+
+static void
+remove_item (WpMetadataPrivate * priv, struct item * item)
+{
+  struct subject_items *s =
+      g_hash_table_lookup (priv->subjects, GUINT_TO_POINTER (item->subject));
+
+  g_hash_table_remove (s->keys, item->key);
+  spa_list_remove (&item->subject_link);
+  spa_list_remove (&item->link);
+  if (spa_list_is_empty (&s->items))
+    g_hash_table_remove (priv->subjects, GUINT_TO_POINTER (item->subject));
+  free_item (item);
 }
 
 static int
-clear_subject (struct pw_array * metadata, uint32_t subject)
+clear_subject (WpMetadataPrivate * priv, uint32_t subject)
 {
-  struct item *item;
+  struct subject_items *s =
+      g_hash_table_lookup (priv->subjects, GUINT_TO_POINTER (subject));
+  struct item *item, *tmp;
   uint32_t removed = 0;
 
-  while (true) {
-    item = find_item (metadata, subject, NULL);
-    if (item == NULL)
-      break;
-    clear_item (item);
-    pw_array_remove (metadata, item);
+  if (!s)
+    return 0;
+
+  spa_list_for_each_safe (item, tmp, &s->items, subject_link) {
+    spa_list_remove (&item->link);
+    free_item (item);
     removed++;
   }
+  g_hash_table_remove (priv->subjects, GUINT_TO_POINTER (subject));
 
   return removed;
 }
 
 static void
-clear_items (struct pw_array * metadata)
+clear_items (WpMetadataPrivate * priv)
 {
-  struct item *item;
+  struct item *item, *tmp;
 
-  pw_array_consume (item, metadata) {
-    clear_item (item);
-    pw_array_remove (metadata, item);
-  }
-  pw_array_reset (metadata);
+  g_hash_table_remove_all (priv->subjects);
+  spa_list_for_each_safe (item, tmp, &priv->items, link)
+    free_item (item);
+  spa_list_init (&priv->items);
 }
 
-typedef struct _WpMetadataPrivate WpMetadataPrivate;
-struct _WpMetadataPrivate
-{
-  struct pw_metadata *iface;
-  struct spa_hook listener;
-  struct pw_array metadata;
-  gboolean remove_listener;
-};
-
 G_DEFINE_TYPE_WITH_PRIVATE (WpMetadata, wp_metadata, WP_TYPE_GLOBAL_PROXY)
 
 static void
 wp_metadata_init (WpMetadata * self)
 {
   WpMetadataPrivate *priv = wp_metadata_get_instance_private (self);
-  pw_array_init (&priv->metadata, 4096);
+  spa_list_init (&priv->items);
+  priv->subjects = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) free_subject_items);
 }
 
 static void
@@ -155,7 +213,8 @@ wp_metadata_finalize (GObject * object)
   WpMetadataPrivate *priv =
       wp_metadata_get_instance_private (WP_METADATA (object));
 
-  pw_array_clear (&priv->metadata);
+  clear_items (priv);
+  g_clear_pointer (&priv->subjects, g_hash_table_unref);
 
   G_OBJECT_CLASS (wp_metadata_parent_class)->finalize (object);
 }
@@ -213,7 +272,7 @@ metadata_event_property (void *object, uint32_t subject, const char *key,
   struct item *item = NULL;
 
   if (key == NULL) {
-    if (clear_subject (&priv->metadata, subject) > 0) {
+    if (clear_subject (priv, subject) > 0) {
       wp_debug_object (self, "remove id:%d", subject);
       g_signal_emit (self, signals[SIGNAL_CHANGED], 0, subject, NULL, NULL,
           NULL);
@@ -221,26 +280,22 @@ metadata_event_property (void *object, uint32_t subject, const char *key,
     return 0;
   }
 
-  item = find_item (&priv->metadata, subject, key);
+  item = find_item (priv, subject, key);
   if (item == NULL) {
     if (value == NULL)
       return 0;
-    item = pw_array_add (&priv->metadata, sizeof (*item));
-    if (item == NULL)
-      return -errno;
-  } else {
-    clear_item (item);
+    item = add_item (priv, subject, key);
   }
 
   if (value != NULL) {
     if (type == NULL)
       type = "string";
-    set_item (item, subject, key, type, value);
+    set_item (item, type, value);
     wp_debug_object (self, "add id:%d key:%s type:%s value:%s",
         subject, key, type, value);
   } else {
     type = NULL;
-    pw_array_remove (&priv->metadata, item);
+    remove_item (priv, item);
     wp_debug_object (self, "remove id:%d key:%s", subject, key);
   }
 
@@ -290,7 +345,7 @@ wp_metadata_pw_proxy_destroyed (WpProxy * proxy)
     spa_hook_remove (&priv->listener);
     priv->remove_listener = FALSE;
   }
-  clear_items (&priv->metadata);
+  clear_items (priv);
   wp_object_update_features (WP_OBJECT (self), 0, WP_METADATA_FEATURE_DATA);
 
   WP_PROXY_CLASS (wp_metadata_parent_class)->pw_proxy_destroyed (proxy);
@@ -322,38 +377,56 @@ wp_metadata_class_init (WpMetadataClass * klass)
 struct metadata_iterator_data
 {
   WpMetadata *metadata;
-  const struct item *item;
+  struct spa_list *head;
+  struct spa_list *pos;
   guint32 subject;
 };
 
+static struct spa_list *
+metadata_iterator_get_head (WpMetadata * self, guint32 subject)
+{
+  WpMetadataPrivate *priv = wp_metadata_get_instance_private (self);
+  struct subject_items *s;
+
+  if (subject == PW_ID_ANY)
+    return &priv->items;
+
+  s = g_hash_table_lookup (priv->subjects, GUINT_TO_POINTER (subject));
+  return s ? &s->items : NULL;
+}
+
+static inline const struct item *
+metadata_iterator_item (struct metadata_iterator_data * it_data,
+    struct spa_list * pos)
+{
+  return (it_data->subject == PW_ID_ANY) ?
+      spa_list_entry (pos, struct item, link) :
+      spa_list_entry (pos, struct item, subject_link);
+}
+
 static void
 metadata_iterator_reset (WpIterator *it)
 {
   struct metadata_iterator_data *it_data = wp_iterator_get_user_data (it);
-  WpMetadataPrivate *priv =
-      wp_metadata_get_instance_private (it_data->metadata);
 
-  it_data->item = pw_array_first (&priv->metadata);
+  it_data->head =
+      metadata_iterator_get_head (it_data->metadata, it_data->subject);
+  it_data->pos = it_data->head ? it_data->head->next : NULL;
 }
 
 static gboolean
 metadata_iterator_next (WpIterator *it, GValue *item)
 {
   struct metadata_iterator_data *it_data = wp_iterator_get_user_data (it);
-  WpMetadataPrivate *priv =
-      wp_metadata_get_instance_private (it_data->metadata);
-
-  while (pw_array_check (&priv->metadata, it_data->item)) {
-    if ((it_data->subject == PW_ID_ANY ||
-            it_data->subject == it_data->item->subject)) {
-      g_value_init (item, G_TYPE_POINTER);
-      g_value_set_pointer (item, (gpointer) it_data->item);
-      it_data->item++;
-      return TRUE;
-    }
-    it_data->item++;
-  }
-  return FALSE;
+
+  if (!it_data->head || it_data->pos == it_data->head)
+    return FALSE;
+
+  g_value_init (item, G_TYPE_POINTER);
+  g_value_set_pointer (item,
+      (gpointer) metadata_iterator_item (it_data, it_data->pos));
+  it_data->pos = it_data->pos->next;
+  return TRUE;
 }
 
 static gboolean
@@ -361,19 +434,17 @@ metadata_iterator_fold (WpIterator *it, WpIteratorFoldFunc func, GValue *ret,
     gpointer data)
 {
   struct metadata_iterator_data *it_data = wp_iterator_get_user_data (it);
-  WpMetadataPrivate *priv =
-      wp_metadata_get_instance_private (it_data->metadata);
-  const struct item *i;
-
-  pw_array_for_each (i, &priv->metadata) {
-    if ((it_data->subject == PW_ID_ANY ||
-            it_data->subject == it_data->item->subject)) {
-      g_auto (GValue) item = G_VALUE_INIT;
-      g_value_init (&item, G_TYPE_POINTER);
-      g_value_set_pointer (&item, (gpointer) i);
-      if (!func (&item, ret, data))
-        return FALSE;
-    }
+  struct spa_list *head =
+      metadata_iterator_get_head (it_data->metadata, it_data->subject);
+  struct spa_list *pos;
+
+  for (pos = head ? head->next : NULL; pos && pos != head; pos = pos->next) {
+    g_auto (GValue) item = G_VALUE_INIT;
+    g_value_init (&item, G_TYPE_POINTER);
+    g_value_set_pointer (&item,
+        (gpointer) metadata_iterator_item (it_data, pos));
+    if (!func (&item, ret, data))
+      return FALSE;
   }
   return TRUE;
 }
@@ -413,19 +484,17 @@ static const WpIteratorMethods metadata_iterator_methods = {
 WpIterator *
 wp_metadata_new_iterator (WpMetadata * self, guint32 subject)
 {
-  WpMetadataPrivate *priv;
   g_autoptr (WpIterator) it = NULL;
   struct metadata_iterator_data *it_data;
 
   g_return_val_if_fail (self != NULL, NULL);
-  priv = wp_metadata_get_instance_private (self);
 
   it = wp_iterator_new (&metadata_iterator_methods,
       sizeof (struct metadata_iterator_data));
   it_data = wp_iterator_get_user_data (it);
   it_data->metadata = g_object_ref (self);
-  it_data->item = pw_array_first (&priv->metadata);
   it_data->subject = subject;
+  metadata_iterator_reset (it);
   return g_steal_pointer (&it);
 }
 
@@ -461,7 +530,8 @@ wp_metadata_iterator_item_extract (const GValue * item, guint32 * subject,
  *
  * \ingroup wpmetadata
  * \param self a metadata object
- * \param subject the metadata subject id
+ * \param subject the metadata subject id, or PW_ID_ANY to find \a key
+ *   in any subject
  * \param key the metadata key name
  * \param type (out)(optional): the metadata type name
  * \returns the metadata string value, or NULL if not found.
@@ -470,20 +540,33 @@ const gchar *
 wp_metadata_find (WpMetadata * self, guint32 subject, const gchar * key,
   const gchar ** type)
 {
-  g_autoptr (WpIterator) it = NULL;
-  g_auto (GValue) val = G_VALUE_INIT;
-  it = wp_metadata_new_iterator (self, subject);
-  for (; wp_iterator_next (it, &val); g_value_unset (&val)) {
-    const gchar *k = NULL, *t = NULL, *v = NULL;
-    wp_metadata_iterator_item_extract (&val, NULL, &k, &t, &v);
-    if (g_strcmp0 (k, key) == 0) {
-      if (type)
-        *type = t;
-      g_value_unset (&val);
-      return v;
+  WpMetadataPrivate *priv;
+  const struct item *item;
+
+  g_return_val_if_fail (WP_IS_METADATA (self), NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  priv = wp_metadata_get_instance_private (self);
+
+  if (subject == PW_ID_ANY) {
+    /* any subject; return the first match in iteration order */
+    struct item *i;
+    item = NULL;
+    spa_list_for_each (i, &priv->items, link) {
+      if (g_str_equal (i->key, key)) {
+        item = i;
+        break;
+      }
     }
+  } else {
+    item = find_item (priv, subject, key);
   }
-  return NULL;
+
+  if (!item)
+    return NULL;
+  if (type)
+    *type = item->type;
+  return item->value;
 }
 
 /*!
@@ -16,6 +16,7 @@
 #include "private/pipewire-object-mixin.h"
 
 #include <pipewire/impl.h>
+#include <spa/utils/string.h>
 
 /*! \defgroup wpnode WpNode */
 /*!
@@ -53,7 +54,8 @@
  * \endcode
  *
  * Emitted when the node's ports change. This is only emitted when
- * WP_NODE_FEATURE_PORTS is enabled.
+ * WP_NODE_FEATURE_PORTS is enabled. Ports that are still being prepared
+ * when this feature is enabled are announced with this signal as well.
  *
  * Flags: G_SIGNAL_RUN_LAST
  * \endparblock
@@ -99,7 +101,9 @@ static guint32 signals[N_SIGNALS] = {0};
 struct _WpNode
 {
   WpGlobalProxy parent;
-  WpObjectManager *ports_om;
+  /* the id that this node is registered with in the ports index,
+     or SPA_ID_INVALID if WP_NODE_FEATURE_PORTS is not enabled */
+  guint32 ports_node_id;
 };
 
 static void wp_node_pw_object_mixin_priv_interface_init (
@@ -114,6 +118,7 @@ G_DEFINE_TYPE_WITH_CODE (WpNode, wp_node, WP_TYPE_GLOBAL_PROXY,
 static void
 wp_node_init (WpNode * self)
 {
+  self->ports_node_id = SPA_ID_INVALID;
 }
 
 static void
@@ -149,16 +154,348 @@ wp_node_get_property (GObject * object, guint property_id,
   }
 }
 
+/*
+ * Ports index:
+ *
+ * All the nodes of a core that have WP_NODE_FEATURE_PORTS enabled share
+ * a single object manager that collects all the ports, which are then
+ * grouped by their "node.id" global property. This avoids having one object
+ * manager per node, which would require checking every new port against
+ * the interests of all the nodes.
+ *
+ * The object manager only binds the ports with the minimal features; the
+ * ports of the nodes that use the index are then activated with all their
+ * features, and WP_NODE_FEATURE_PORTS is only enabled on a node after all
+ * its known ports are ready.
+ */
+
+typedef struct {
+  WpObjectManager *om;
+  gboolean started;
+  /* node id -> GPtrArray<WpPort*> */
+  GHashTable *ports;
+  /* WpPort* -> node id */
+  GHashTable *port_node_ids;
+  /* node id -> GPtrArray<WpNode*>, the nodes that use this index */
+  GHashTable *nodes;
+  /* node id -> number of ports that are being activated */
+  GHashTable *preparing;
+  /* set of node ids whose ports changed since ports-changed was emitted */
+  GHashTable *dirty;
+  GSource *idle_source;
+} WpNodePortsIndex;
+
+G_DEFINE_QUARK (WpNodePortsIndex, wp_node_ports_index)
+
+static void
+wp_node_ports_index_free (WpNodePortsIndex * self)
+{
+  if (self->idle_source) {
+    g_source_destroy (self->idle_source);
+    g_clear_pointer (&self->idle_source, g_source_unref);
+  }
+  if (self->om)
+    g_signal_handlers_disconnect_by_data (self->om, self);
+  g_clear_object (&self->om);
+  g_clear_pointer (&self->dirty, g_hash_table_unref);
+  g_clear_pointer (&self->preparing, g_hash_table_unref);
+  g_clear_pointer (&self->nodes, g_hash_table_unref);
+  g_clear_pointer (&self->port_node_ids, g_hash_table_unref);
+  g_clear_pointer (&self->ports, g_hash_table_unref);
+  g_slice_free (WpNodePortsIndex, self);
+}
+
+static WpNodePortsIndex *
+wp_node_ports_index_peek (WpCore * core)
+{
+  return g_object_get_qdata (G_OBJECT (core), wp_node_ports_index_quark ());
+}
+
+static guint32
+port_get_node_id (WpPort * port)
+{
+  g_autoptr (WpProperties) props =
+      wp_global_proxy_get_global_properties (WP_GLOBAL_PROXY (port));
+  const gchar *str = props ? wp_properties_get (props, PW_KEY_NODE_ID) : NULL;
+  guint32 node_id;
+
+  if (!str || !spa_atou32 (str, &node_id, 10))
+    return SPA_ID_INVALID;
+  return node_id;
+}
+
+static gboolean
+port_is_ready (WpPort * port)
+{
+  WpObjectFeatures supported =
+      wp_object_get_supported_features (WP_OBJECT (port));
+  return (wp_object_get_active_features (WP_OBJECT (port)) & supported)
+      == supported;
+}
+
+static void
+wp_node_ports_index_emit_ports_changed (WpNodePortsIndex * self)
+{
+  g_autoptr (GPtrArray) nodes = g_ptr_array_new_with_free_func (g_object_unref);
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init (&iter, self->dirty);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    GPtrArray *n = g_hash_table_lookup (self->nodes, key);
+    for (guint i = 0; n && i < n->len; i++)
+      g_ptr_array_add (nodes, g_object_ref (g_ptr_array_index (n, i)));
+  }
+  g_hash_table_remove_all (self->dirty);
+
+  /* the nodes are ref'ed, as signal handlers may drop them */
+  for (guint i = 0; i < nodes->len; i++) {
+    WpNode *node = g_ptr_array_index (nodes, i);
+    if (node->ports_node_id != SPA_ID_INVALID &&
+        (wp_object_get_active_features (WP_OBJECT (node)) &
+            WP_NODE_FEATURE_PORTS))
+      g_signal_emit (node, signals[SIGNAL_PORTS_CHANGED], 0);
+  }
+}
+
+static gboolean
+wp_node_ports_index_idle_emit (WpNodePortsIndex * self)
+{
+  g_clear_pointer (&self->idle_source, g_source_unref);
+  wp_node_ports_index_emit_ports_changed (self);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+wp_node_ports_index_schedule_emit (WpNodePortsIndex * self, WpCore * core,
+    guint32 node_id)
+{
+  g_hash_table_add (self->dirty, GUINT_TO_POINTER (node_id));
+  if (!self->idle_source)
+    wp_core_idle_add (core, &self->idle_source,
+        G_SOURCE_FUNC (wp_node_ports_index_idle_emit), self, NULL);
+}
+
+/* enables WP_NODE_FEATURE_PORTS on the nodes with this id that are waiting
+   for it, if none of their ports is still being activated */
+static void
+wp_node_ports_index_check_ready (WpNodePortsIndex * self, guint32 node_id)
+{
+  g_autoptr (GPtrArray) nodes = NULL;
+  GPtrArray *n;
+
+  if (!wp_object_manager_is_installed (self->om) ||
+      g_hash_table_contains (self->preparing, GUINT_TO_POINTER (node_id)))
+    return;
+
+  n = g_hash_table_lookup (self->nodes, GUINT_TO_POINTER (node_id));
+  if (!n)
+    return;
+
+  nodes = g_ptr_array_new_with_free_func (g_object_unref);
+  for (guint i = 0; i < n->len; i++) {
+    WpNode *node = g_ptr_array_index (n, i);
+    if (!(wp_object_get_active_features (WP_OBJECT (node)) &
+            WP_NODE_FEATURE_PORTS))
+      g_ptr_array_add (nodes, g_object_ref (node));
+  }
+
+  for (guint i = 0; i < nodes->len; i++)
+    wp_object_update_features (g_ptr_array_index (nodes, i),
+        WP_NODE_FEATURE_PORTS, 0);
+}
+
+static void
+on_port_activated (WpObject * port, GAsyncResult * res, gpointer data)
+{
+  guint32 node_id = GPOINTER_TO_UINT (data);
+  g_autoptr (GError) error = NULL;
+  g_autoptr (WpCore) core = NULL;
+  WpNodePortsIndex *self;
+  GPtrArray *ports;
+  guint pending;
+
+  if (!wp_object_activate_finish (port, res, &error))
+    wp_debug_object (port, "port activation failed: %s", error->message);
+
+  core = wp_object_get_core (port);
+  self = core ? wp_node_ports_index_peek (core) : NULL;
+  if (!self)
+    return;
+
+  pending = GPOINTER_TO_UINT (
+      g_hash_table_lookup (self->preparing, GUINT_TO_POINTER (node_id)));
+  if (pending > 1)
+    g_hash_table_insert (self->preparing, GUINT_TO_POINTER (node_id),
+        GUINT_TO_POINTER (pending - 1));
+  else
+    g_hash_table_remove (self->preparing, GUINT_TO_POINTER (node_id));
+
+  /* new ports become visible to the node only once they are ready */
+  if (!error && g_hash_table_contains (self->port_node_ids, port)) {
+    ports = g_hash_table_lookup (self->ports, GUINT_TO_POINTER (node_id));
+    if (!ports) {
+      ports = g_ptr_array_new_with_free_func (g_object_unref);
+      g_hash_table_insert (self->ports, GUINT_TO_POINTER (node_id), ports);
+    }
+    if (!g_ptr_array_find (ports, port, NULL)) {
+      g_ptr_array_add (ports, g_object_ref (port));
+      wp_node_ports_index_schedule_emit (self, core, node_id);
+    }
+  }
+
+  wp_node_ports_index_check_ready (self, node_id);
+}
+
+static void
+wp_node_ports_index_activate_port (WpNodePortsIndex * self, WpPort * port,
+    guint32 node_id)
+{
+  guint pending = GPOINTER_TO_UINT (
+      g_hash_table_lookup (self->preparing, GUINT_TO_POINTER (node_id)));
+
+  g_hash_table_insert (self->preparing, GUINT_TO_POINTER (node_id),
+      GUINT_TO_POINTER (pending + 1));
+  wp_object_activate (WP_OBJECT (port), WP_OBJECT_FEATURES_ALL, NULL,
+      (GAsyncReadyCallback) on_port_activated, GUINT_TO_POINTER (node_id));
+}
+
+/* activates the known ports of a node that are not ready yet; this is
+   needed when the node id was not used by any node when they were added */
+static void
+wp_node_ports_index_prepare_node (WpNodePortsIndex * self, guint32 node_id)
+{
+  GPtrArray *ports =
+      g_hash_table_lookup (self->ports, GUINT_TO_POINTER (node_id));
+
+  for (guint i = 0; ports && i < ports->len; i++) {
+    WpPort *port = g_ptr_array_index (ports, i);
+    if (!port_is_ready (port))
+      wp_node_ports_index_activate_port (self, port, node_id);
+  }
+  wp_node_ports_index_check_ready (self, node_id);
+}
+
+static void
+wp_node_ports_index_on_port_added (WpObjectManager * om, WpPort * port,
+    WpNodePortsIndex * self)
+{
+  guint32 node_id = port_get_node_id (port);
+  GPtrArray *ports;
+
+  if (node_id == SPA_ID_INVALID)
+    return;
+
+  g_hash_table_insert (self->port_node_ids, port, GUINT_TO_POINTER (node_id));
+
+  /* ports of nodes that use the index are added once they are ready */
+  if (g_hash_table_contains (self->nodes, GUINT_TO_POINTER (node_id)) &&
+      !port_is_ready (port)) {
+    wp_node_ports_index_activate_port (self, port, node_id);
+    return;
+  }
+
+  ports = g_hash_table_lookup (self->ports, GUINT_TO_POINTER (node_id));
+  if (!ports) {
+    ports = g_ptr_array_new_with_free_func (g_object_unref);
+    g_hash_table_insert (self->ports, GUINT_TO_POINTER (node_id), ports);
+  }
+  g_ptr_array_add (ports, g_object_ref (port));
+  g_hash_table_add (self->dirty, GUINT_TO_POINTER (node_id));
+}
+
 static void
-wp_node_on_ports_om_installed (WpObjectManager *ports_om, WpNode * self)
+wp_node_ports_index_on_port_removed (WpObjectManager * om, WpPort * port,
+    WpNodePortsIndex * self)
 {
-  wp_object_update_features (WP_OBJECT (self), WP_NODE_FEATURE_PORTS, 0);
+  gpointer node_id;
+  GPtrArray *ports;
+
+  if (!g_hash_table_lookup_extended (self->port_node_ids, port, NULL,
+          &node_id))
+    return;
+  g_hash_table_remove (self->port_node_ids, port);
+
+  ports = g_hash_table_lookup (self->ports, node_id);
+  if (ports && g_ptr_array_remove (ports, port)) {
+    if (ports->len == 0)
+      g_hash_table_remove (self->ports, node_id);
+    g_hash_table_add (self->dirty, node_id);
+  }
 }
 
 static void
-wp_node_emit_ports_changed (WpObjectManager *ports_om, WpNode * self)
+wp_node_ports_index_on_objects_changed (WpObjectManager * om,
+    WpNodePortsIndex * self)
 {
-  g_signal_emit (self, signals[SIGNAL_PORTS_CHANGED], 0);
+  wp_node_ports_index_emit_ports_changed (self);
+}
+
+static void
+wp_node_ports_index_on_installed (WpObjectManager * om,
+    WpNodePortsIndex * self)
+{
+  g_autoptr (GArray) node_ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init (&iter, self->nodes);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    guint32 node_id = GPOINTER_TO_UINT (key);
+    g_array_append_val (node_ids, node_id);
+  }
+
+  for (guint i = 0; i < node_ids->len; i++)
+    wp_node_ports_index_prepare_node (self,
+        g_array_index (node_ids, guint32, i));
+}
+
+static WpNodePortsIndex *
+wp_node_ports_index_ensure (WpCore * core)
+{
+  WpNodePortsIndex *self = wp_node_ports_index_peek (core);
+
+  if (G_LIKELY (self))
+    return self;
+
+  self = g_slice_new0 (WpNodePortsIndex);
+  self->ports = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) g_ptr_array_unref);
+  self->port_node_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->nodes = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) g_ptr_array_unref);
+  self->preparing = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->dirty = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  self->om = wp_object_manager_new ();
+  wp_object_manager_add_interest (self->om, WP_TYPE_PORT, NULL);
+  wp_object_manager_request_object_features (self->om,
+      WP_TYPE_PORT, WP_PIPEWIRE_OBJECT_FEATURES_MINIMAL);
+
+  g_signal_connect (self->om, "object-added",
+      G_CALLBACK (wp_node_ports_index_on_port_added), self);
+  g_signal_connect (self->om, "object-removed",
+      G_CALLBACK (wp_node_ports_index_on_port_removed), self);
+  g_signal_connect (self->om, "objects-changed",
+      G_CALLBACK (wp_node_ports_index_on_objects_changed), self);
+  g_signal_connect (self->om, "installed",
+      G_CALLBACK (wp_node_ports_index_on_installed), self);
+
+  g_object_set_qdata_full (G_OBJECT (core), wp_node_ports_index_quark (),
+      self, (GDestroyNotify) wp_node_ports_index_free);
+  return self;
+}
+
+static GPtrArray *
+wp_node_peek_ports (WpNode * self)
+{
+  g_autoptr (WpCore) core = wp_object_get_core (WP_OBJECT (self));
+  WpNodePortsIndex *index = core ? wp_node_ports_index_peek (core) : NULL;
+
+  if (!index || self->ports_node_id == SPA_ID_INVALID)
+    return NULL;
+  return g_hash_table_lookup (index->ports,
+      GUINT_TO_POINTER (self->ports_node_id));
 }
 
 static void
@@ -166,24 +503,59 @@ wp_node_enable_feature_ports (WpNode * self)
 {
   g_autoptr (WpCore) core = wp_object_get_core (WP_OBJECT (self));
   guint32 bound_id = wp_proxy_get_bound_id (WP_PROXY (self));
+  WpNodePortsIndex *index;
+  GPtrArray *nodes;
 
   wp_debug_object (self, "enabling WP_NODE_FEATURE_PORTS, bound_id:%u",
       bound_id);
 
-  self->ports_om = wp_object_manager_new ();
-  wp_object_manager_add_interest (self->ports_om,
-      WP_TYPE_PORT,
-      WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, PW_KEY_NODE_ID, "=u", bound_id,
-      NULL);
-  wp_object_manager_request_object_features (self->ports_om,
-      WP_TYPE_PORT, WP_OBJECT_FEATURES_ALL);
+  index = wp_node_ports_index_ensure (core);
+  self->ports_node_id = bound_id;
 
-  g_signal_connect_object (self->ports_om, "installed",
-      G_CALLBACK (wp_node_on_ports_om_installed), self, 0);
-  g_signal_connect_object (self->ports_om, "objects-changed",
-      G_CALLBACK (wp_node_emit_ports_changed), self, 0);
+  nodes = g_hash_table_lookup (index->nodes, GUINT_TO_POINTER (bound_id));
+  if (!nodes) {
+    nodes = g_ptr_array_new ();
+    g_hash_table_insert (index->nodes, GUINT_TO_POINTER (bound_id), nodes);
+  }
+  g_ptr_array_add (nodes, self);
+
+  /* the first node installs the shared object manager; the feature is
+     enabled for all waiting nodes once it is installed and their ports
+     are ready */
+  if (!index->started) {
+    index->started = TRUE;
+    wp_core_install_object_manager (core, index->om);
+  }
+  else if (wp_object_manager_is_installed (index->om)) {
+    /* announce the ports that were already known */
+    if (g_hash_table_contains (index->ports, GUINT_TO_POINTER (bound_id)))
+      wp_node_ports_index_schedule_emit (index, core, bound_id);
+
+    wp_node_ports_index_prepare_node (index, bound_id);
+  }
+}
 
-  wp_core_install_object_manager (core, self->ports_om);
+static void
+wp_node_disable_feature_ports (WpNode * self)
+{
+  g_autoptr (WpCore) core = NULL;
+  WpNodePortsIndex *index;
+
+  if (self->ports_node_id == SPA_ID_INVALID)
+    return;
+
+  core = wp_object_get_core (WP_OBJECT (self));
+  index = core ? wp_node_ports_index_peek (core) : NULL;
+  if (index) {
+    gpointer key = GUINT_TO_POINTER (self->ports_node_id);
+    GPtrArray *nodes = g_hash_table_lookup (index->nodes, key);
+    if (nodes) {
+      g_ptr_array_remove_fast (nodes, self);
+      if (nodes->len == 0)
+        g_hash_table_remove (index->nodes, key);
+    }
+  }
+  self->ports_node_id = SPA_ID_INVALID;
 }
 
 static WpObjectFeatures
@@ -229,8 +601,7 @@ wp_node_deactivate (WpObject * object, WpObjectFeatures features)
   wp_pw_object_mixin_deactivate (object, features);
 
   if (features & WP_NODE_FEATURE_PORTS) {
-    WpNode *self = WP_NODE (object);
-    g_clear_object (&self->ports_om);
+    wp_node_disable_feature_ports (WP_NODE (object));
     wp_object_update_features (object, 0, WP_NODE_FEATURE_PORTS);
   }
 
@@ -257,12 +628,22 @@ wp_node_pw_proxy_destroyed (WpProxy * proxy)
 
   wp_pw_object_mixin_handle_pw_proxy_destroyed (proxy);
 
-  g_clear_object (&self->ports_om);
+  wp_node_disable_feature_ports (self);
   wp_object_update_features (WP_OBJECT (self), 0, WP_NODE_FEATURE_PORTS);
 
   WP_PROXY_CLASS (wp_node_parent_class)->pw_proxy_destroyed (proxy);
 }
 
+static void
+wp_node_finalize (GObject * object)
+{
+  /* in case the object was destroyed while WP_NODE_FEATURE_PORTS
+     was still being enabled */
+  wp_node_disable_feature_ports (WP_NODE (object));
+
+  G_OBJECT_CLASS (wp_node_parent_class)->finalize (object);
+}
+
 static void
 wp_node_class_init (WpNodeClass * klass)
 {
@@ -270,6 +651,7 @@ wp_node_class_init (WpNodeClass * klass)
   WpObjectClass *wpobject_class = (WpObjectClass *) klass;
   WpProxyClass *proxy_class = (WpProxyClass *) klass;
 
+  object_class->finalize = wp_node_finalize;
   object_class->get_property = wp_node_get_property;
 
   wpobject_class->get_supported_features = wp_node_get_supported_features;
@@ -486,11 +868,14 @@ wp_node_get_n_output_ports (WpNode * self, guint * max)
 guint
 wp_node_get_n_ports (WpNode * self)
 {
+  GPtrArray *ports;
+
   g_return_val_if_fail (WP_IS_NODE (self), 0);
   g_return_val_if_fail (wp_object_get_active_features (WP_OBJECT (self)) &
           WP_NODE_FEATURE_PORTS, 0);
 
-  return wp_object_manager_get_n_objects (self->ports_om);
+  ports = wp_node_peek_ports (self);
+  return ports ? ports->len : 0;
 }
 
 /*!
@@ -510,7 +895,8 @@ wp_node_new_ports_iterator (WpNode * self)
   g_return_val_if_fail (wp_object_get_active_features (WP_OBJECT (self)) &
           WP_NODE_FEATURE_PORTS, NULL);
 
-  return wp_object_manager_new_iterator (self->ports_om);
+  return wp_node_new_ports_filtered_iterator_full (self,
+      wp_object_interest_new_type (WP_TYPE_PORT));
 }
 
 /*!
@@ -553,12 +939,29 @@ WpIterator *
 wp_node_new_ports_filtered_iterator_full (WpNode * self,
     WpObjectInterest * interest)
 {
+  g_autoptr (WpObjectInterest) i = interest;
+  g_autoptr (GError) error = NULL;
+  GPtrArray *ports, *result;
+
   g_return_val_if_fail (WP_IS_NODE (self), NULL);
   g_return_val_if_fail (wp_object_get_active_features (WP_OBJECT (self)) &
           WP_NODE_FEATURE_PORTS, NULL);
 
-  return wp_object_manager_new_filtered_iterator_full (self->ports_om,
-      interest);
+  if (G_UNLIKELY (!wp_object_interest_validate (interest, &error))) {
+    wp_critical_object (self, "interest validation failed: %s",
+        error->message);
+    return NULL;
+  }
+
+  ports = wp_node_peek_ports (self);
+  result = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint idx = 0; ports && idx < ports->len; idx++) {
+    WpPort *port = g_ptr_array_index (ports, idx);
+    if (wp_object_interest_matches (interest, port))
+      g_ptr_array_add (result, g_object_ref (port));
+  }
+  return wp_iterator_new_ptr_array (result, WP_TYPE_PORT);
 }
 
 /*!
@@ -600,12 +1003,27 @@ wp_node_lookup_port (WpNode * self, ...)
 WpPort *
 wp_node_lookup_port_full (WpNode * self, WpObjectInterest * interest)
 {
+  g_autoptr (WpObjectInterest) i = interest;
+  g_autoptr (GError) error = NULL;
+  GPtrArray *ports;
+
   g_return_val_if_fail (WP_IS_NODE (self), NULL);
   g_return_val_if_fail (wp_object_get_active_features (WP_OBJECT (self)) &
           WP_NODE_FEATURE_PORTS, NULL);
 
-  return (WpPort *)
-      wp_object_manager_lookup_full (self->ports_om, interest);
+  if (G_UNLIKELY (!wp_object_interest_validate (interest, &error))) {
+    wp_critical_object (self, "interest validation failed: %s",
+        error->message);
+    return NULL;
+  }
+
+  ports = wp_node_peek_ports (self);
+  for (guint idx = 0; ports && idx < ports->len; idx++) {
+    WpPort *port = g_ptr_array_index (ports, idx);
+    if (wp_object_interest_matches (interest, port))
+      return g_object_ref (port);
+  }
+  return NULL;
 }
 
 /*!
@@ -14,6 +14,7 @@
 #include "proxy-interfaces.h"
 #include "log.h"
 #include "error.h"
+#include "private/registry.h"
 
 #include <pipewire/pipewire.h>
 
@@ -30,6 +31,18 @@
  * are satisfied.
  */
 
+/* a constraint value or a subject, in the native type of subject_type */
+typedef union
+{
+  gboolean b;
+  gint i;
+  guint u;
+  gint64 x;
+  guint64 t;
+  gdouble d;
+  const gchar *s;
+} ConstraintValue;
+
 struct constraint
 {
   WpConstraintType type;
@@ -37,6 +50,18 @@ struct constraint
   gchar subject_type; /* a basic GVariantType as a single char */
   gchar *subject;
   GVariant *value;
+
+  /* compiled by _validate(), so that matching does not need to decode
+     the GVariant value on every check */
+  ConstraintValue min; /* the value of =/!, or the lower bound of ~ */
+  ConstraintValue max; /* the upper bound of ~ */
+  GHashTable *set; /* the values of c, unless they are doubles */
+  GArray *list; /* storage for the values of c, if they are not strings */
+  GPatternSpec *pattern; /* the pattern of # */
+
+  /* cached result of the last pspec lookup of a G_PROPERTY subject */
+  GObjectClass *pspec_class;
+  GParamSpec *pspec;
 };
 
 struct _WpObjectInterest
@@ -233,6 +258,7 @@ wp_object_interest_add_constraint (WpObjectInterest * self,
 
   c = pw_array_add (&self->constraints, sizeof (struct constraint));
   g_return_if_fail (c != NULL);
+  memset (c, 0, sizeof (struct constraint));
   c->type = type;
   c->verb = verb;
   /* subject_type is filled in by _validate() */
@@ -257,6 +283,16 @@ wp_object_interest_ref (WpObjectInterest *self)
   return self;
 }
 
+static void
+constraint_clear_compiled (struct constraint * c)
+{
+  g_clear_pointer (&c->set, g_hash_table_unref);
+  g_clear_pointer (&c->list, g_array_unref);
+  g_clear_pointer (&c->pattern, g_pattern_spec_free);
+  c->pspec_class = NULL;
+  c->pspec = NULL;
+}
+
 static void
 wp_object_interest_free (WpObjectInterest * self)
 {
@@ -265,6 +301,7 @@ wp_object_interest_free (WpObjectInterest * self)
   g_return_if_fail (self != NULL);
 
   pw_array_for_each (c, &self->constraints) {
+    constraint_clear_compiled (c);
     g_clear_pointer (&c->subject, g_free);
     g_clear_pointer (&c->value, g_variant_unref);
   }
@@ -286,6 +323,103 @@ wp_object_interest_unref (WpObjectInterest * self)
     wp_object_interest_free (self);
 }
 
+static void
+variant_to_constraint_value (gchar subj_type, GVariant * variant,
+    ConstraintValue * val)
+{
+  switch (subj_type) {
+    case 'b': val->b = g_variant_get_boolean (variant); break;
+    case 'i': val->i = g_variant_get_int32 (variant); break;
+    case 'u': val->u = g_variant_get_uint32 (variant); break;
+    case 'x': val->x = g_variant_get_int64 (variant); break;
+    case 't': val->t = g_variant_get_uint64 (variant); break;
+    case 'd': val->d = g_variant_get_double (variant); break;
+    case 's': val->s = g_variant_get_string (variant, NULL); break;
+    default: g_return_if_reached ();
+  }
+}
+
+/* integer list values are all stored as gint64 in the set; the subject
+   type is the same for all of them, so this does not create collisions */
+static inline gint64
+constraint_value_to_int64 (gchar subj_type, const ConstraintValue * val)
+{
+  switch (subj_type) {
+    case 'i': return val->i;
+    case 'u': return val->u;
+    case 'x': return val->x;
+    case 't': return (gint64) val->t;
+    default: g_return_val_if_reached (0);
+  }
+}
+
+static void
+constraint_compile (struct constraint * c)
+{
+  constraint_clear_compiled (c);
+
+  switch (c->verb) {
+    case WP_CONSTRAINT_VERB_EQUALS:
+    case WP_CONSTRAINT_VERB_NOT_EQUALS:
+      variant_to_constraint_value (c->subject_type, c->value, &c->min);
+      break;
+
+    case WP_CONSTRAINT_VERB_IN_RANGE: {
+      g_autoptr (GVariant) min = g_variant_get_child_value (c->value, 0);
+      g_autoptr (GVariant) max = g_variant_get_child_value (c->value, 1);
+      variant_to_constraint_value (c->subject_type, min, &c->min);
+      variant_to_constraint_value (c->subject_type, max, &c->max);
+      break;
+    }
+    case WP_CONSTRAINT_VERB_IN_LIST: {
+      gsize i, n_children = g_variant_n_children (c->value);
+
+      if (c->subject_type == 's') {
+        c->set = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        for (i = 0; i < n_children; i++) {
+          g_autoptr (GVariant) child = g_variant_get_child_value (c->value, i);
+          g_hash_table_add (c->set, g_variant_dup_string (child, NULL));
+        }
+      }
+      /* doubles are compared approximately, so they cannot be hashed */
+      else if (c->subject_type == 'd') {
+        c->list = g_array_sized_new (FALSE, FALSE, sizeof (gdouble),
+            n_children);
+        for (i = 0; i < n_children; i++) {
+          g_autoptr (GVariant) child = g_variant_get_child_value (c->value, i);
+          gdouble d = g_variant_get_double (child);
+          g_array_append_val (c->list, d);
+        }
+      }
+      else {
+        c->list = g_array_sized_new (FALSE, FALSE, sizeof (gint64),
+            n_children);
+        for (i = 0; i < n_children; i++) {
+          g_autoptr (GVariant) child = g_variant_get_child_value (c->value, i);
+          ConstraintValue val;
+          gint64 x;
+
+          variant_to_constraint_value (c->subject_type, child, &val);
+          x = constraint_value_to_int64 (c->subject_type, &val);
+          g_array_append_val (c->list, x);
+        }
+
+        /* the keys point to the array, which is not resized anymore */
+        c->set = g_hash_table_new (g_int64_hash, g_int64_equal);
+        for (i = 0; i < c->list->len; i++)
+          g_hash_table_add (c->set, &g_array_index (c->list, gint64, i));
+      }
+      break;
+    }
+    case WP_CONSTRAINT_VERB_MATCHES:
+      c->pattern = g_pattern_spec_new (g_variant_get_string (c->value, NULL));
+      break;
+
+    default:
+      break;
+  }
+}
+
 /*!
  * \brief Validates the interest, ensuring that the interest GType
  * is a valid object and that all the constraints have been expressed properly.
@@ -400,6 +534,13 @@ wp_object_interest_validate (WpObjectInterest * self, GError ** error)
           return FALSE;
         }
 
+        if (g_variant_n_children (c->value) == 0) {
+          g_set_error (error, WP_DOMAIN_LIBRARY, WP_LIBRARY_ERROR_INVARIANT,
+              "WP_CONSTRAINT_VERB_IN_LIST requires a non-empty tuple"
+              " (actual type was '%s')", g_variant_get_type_string (c->value));
+          return FALSE;
+        }
+
         for (tuple_type = value_type = g_variant_type_first (value_type);
             tuple_type != NULL;
             tuple_type = g_variant_type_next (tuple_type)) {
@@ -505,11 +646,126 @@ wp_object_interest_validate (WpObjectInterest * self, GError ** error)
     /* cache the type that the property must have */
     if (value_type)
       c->subject_type = *g_variant_type_peek_string (value_type);
+
+    constraint_compile (c);
   }
 
   return (self->valid = TRUE);
 }
 
+/*
+ * \brief Gets the GType that this interest is declared on
+ *
+ * \param self the object interest
+ * \returns the GType of the interest
+ */
+GType
+wp_object_interest_get_gtype (WpObjectInterest * self)
+{
+  g_return_val_if_fail (self != NULL, G_TYPE_INVALID);
+  return self->gtype;
+}
+
+static gboolean
+constraint_get_index_value (struct constraint * c, gchar ** value,
+    gboolean * numeric)
+{
+  switch (c->subject_type) {
+    case 's':
+      *value = g_strdup (c->min.s);
+      *numeric = FALSE;
+      return TRUE;
+    case 'i':
+      *value = g_strdup_printf ("%d", c->min.i);
+      *numeric = TRUE;
+      return TRUE;
+    case 'u':
+      *value = g_strdup_printf ("%u", c->min.u);
+      *numeric = TRUE;
+      return TRUE;
+    case 'x':
+      *value = g_strdup_printf ("%" G_GINT64_FORMAT, c->min.x);
+      *numeric = TRUE;
+      return TRUE;
+    case 't':
+      *value = g_strdup_printf ("%" G_GUINT64_FORMAT, c->min.t);
+      *numeric = TRUE;
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/*
+ * \brief Finds a constraint that can be used to index this interest
+ *
+ * This looks for the first WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY constraint
+ * with the WP_CONSTRAINT_VERB_EQUALS verb and a string or integer value.
+ * Objects can only match the interest if their global property \a subject
+ * is set to \a value, so WpRegistry uses this to skip object managers that
+ * cannot possibly be interested in a new object.
+ *
+ * \param self the object interest; must be valid
+ * \param subject (out) (transfer none): the subject of the constraint
+ * \param value (out) (transfer full): the value of the constraint, in the
+ *   decimal string format in case it is an integer
+ * \param numeric (out): whether the value was an integer
+ * \returns TRUE if such a constraint was found, FALSE otherwise
+ */
+gboolean
+wp_object_interest_find_index_key (WpObjectInterest * self,
+    const gchar ** subject, gchar ** value, gboolean * numeric)
+{
+  struct constraint *c;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (self->valid, FALSE);
+
+  pw_array_for_each (c, &self->constraints) {
+    if (c->type == WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY &&
+        c->verb == WP_CONSTRAINT_VERB_EQUALS &&
+        constraint_get_index_value (c, value, numeric)) {
+      *subject = c->subject;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/*
+ * \brief Finds the value of an "equals" constraint on a specific subject
+ *
+ * Like wp_object_interest_find_index_key(), but for the first
+ * WP_CONSTRAINT_VERB_EQUALS constraint of the given \a type on \a subject.
+ * WpObjectManager uses this to answer lookups from its indexes.
+ *
+ * \param self the object interest; must be valid
+ * \param type the constraint type
+ * \param subject the subject of the constraint
+ * \param value (out) (transfer full): the value of the constraint, in the
+ *   decimal string format in case it is an integer
+ * \param numeric (out): whether the value was an integer
+ * \returns TRUE if such a constraint was found, FALSE otherwise
+ */
+gboolean
+wp_object_interest_find_equals_value (WpObjectInterest * self,
+    WpConstraintType type, const gchar * subject, gchar ** value,
+    gboolean * numeric)
+{
+  struct constraint *c;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (self->valid, FALSE);
+
+  pw_array_for_each (c, &self->constraints) {
+    if (c->type == type && c->verb == WP_CONSTRAINT_VERB_EQUALS &&
+        !g_strcmp0 (c->subject, subject) &&
+        constraint_get_index_value (c, value, numeric))
+      return TRUE;
+  }
+  return FALSE;
+}
+
 G_GNUC_CONST static GType
 subject_type_to_gtype (gchar type)
 {
@@ -526,42 +782,43 @@ subject_type_to_gtype (gchar type)
 }
 
 static inline gboolean
-property_string_to_gvalue (gchar subj_type, const gchar * str, GValue * val)
+property_string_to_value (gchar subj_type, const gchar * str,
+    ConstraintValue * val)
 {
-  g_value_init (val, subject_type_to_gtype (subj_type));
-
   switch (subj_type) {
     case 'b':
       if (!strcmp (str, "true") || !strcmp (str, "1"))
-        g_value_set_boolean (val, TRUE);
+        val->b = TRUE;
       else if (!strcmp (str, "false") || !strcmp (str, "0"))
-        g_value_set_boolean (val, FALSE);
+        val->b = FALSE;
       else {
         wp_trace ("failed to convert '%s' to boolean", str);
+        val->b = FALSE;
         return FALSE;
       }
       break;
     case 's':
-      g_value_set_static_string (val, str);
+      val->s = str;
       break;
 
-#define CASE_NUMBER(l, T, convert) \
+#define CASE_NUMBER(l, f, T, convert) \
     case l: { \
       g##T number; \
       errno = 0; \
       number = convert; \
       if (errno != 0) { \
         wp_trace ("failed to convert '%s' to " #T, str); \
+        val->f = 0; \
         return FALSE; \
       } \
-      g_value_set_##T (val, number); \
+      val->f = number; \
       break; \
     }
-    CASE_NUMBER ('i', int, strtol (str, NULL, 10))
-    CASE_NUMBER ('u', uint, strtoul (str, NULL, 10))
-    CASE_NUMBER ('x', int64, strtoll (str, NULL, 10))
-    CASE_NUMBER ('t', uint64, strtoull (str, NULL, 10))
-    CASE_NUMBER ('d', double, strtod (str, NULL))
+    CASE_NUMBER ('i', i, int, strtol (str, NULL, 10))
+    CASE_NUMBER ('u', u, uint, strtoul (str, NULL, 10))
+    CASE_NUMBER ('x', x, int64, strtoll (str, NULL, 10))
+    CASE_NUMBER ('t', t, uint64, strtoull (str, NULL, 10))
+    CASE_NUMBER ('d', d, double, strtod (str, NULL))
 #undef CASE_NUMBER
     default:
       g_return_val_if_reached (FALSE);
@@ -569,91 +826,99 @@ property_string_to_gvalue (gchar subj_type, const gchar * str, GValue * val)
   return TRUE;
 }
 
-static inline gboolean
-constraint_verb_equals (gchar subj_type, const GValue * subj_val,
-    GVariant * check_val)
+static inline void
+gvalue_to_constraint_value (gchar subj_type, const GValue * gval,
+    ConstraintValue * val)
 {
   switch (subj_type) {
-    case 'd': {
-      gdouble a = g_value_get_double (subj_val);
-      gdouble b = g_variant_get_double (check_val);
-      return G_APPROX_VALUE (a, b, FLT_EPSILON);
-    }
-    case 's':
-      return !g_strcmp0 (g_value_get_string (subj_val),
-                         g_variant_get_string (check_val, NULL));
-#define CASE_BASIC(l, T, R) \
-    case l: \
-      return (g_value_get_##T (subj_val) == g_variant_get_##R (check_val));
-    CASE_BASIC ('b', boolean, boolean)
-    CASE_BASIC ('i', int, int32)
-    CASE_BASIC ('u', uint, uint32)
-    CASE_BASIC ('x', int64, int64)
-    CASE_BASIC ('t', uint64, uint64)
-#undef CASE_BASIC
-    default:
-      g_return_val_if_reached (FALSE);
+    case 'b': val->b = g_value_get_boolean (gval); break;
+    case 'i': val->i = g_value_get_int (gval); break;
+    case 'u': val->u = g_value_get_uint (gval); break;
+    case 'x': val->x = g_value_get_int64 (gval); break;
+    case 't': val->t = g_value_get_uint64 (gval); break;
+    case 'd': val->d = g_value_get_double (gval); break;
+    case 's': val->s = g_value_get_string (gval); break;
+    default: g_return_if_reached ();
   }
 }
 
 static inline gboolean
-constraint_verb_matches (gchar subj_type, const GValue * subj_val,
-    GVariant * check_val)
+constraint_values_equal (gchar subj_type, const ConstraintValue * a,
+    const ConstraintValue * b)
 {
   switch (subj_type) {
-    case 's': {
-      const gchar *check_str = g_variant_get_string (check_val, NULL);
-      const gchar *subj_str = g_value_get_string (subj_val);
-      if (!check_str || !subj_str)
+    case 'b': return (!a->b == !b->b);
+    case 'i': return (a->i == b->i);
+    case 'u': return (a->u == b->u);
+    case 'x': return (a->x == b->x);
+    case 't': return (a->t == b->t);
+    case 'd': return G_APPROX_VALUE (a->d, b->d, FLT_EPSILON);
+    case 's': return !g_strcmp0 (a->s, b->s);
+    default: g_return_val_if_reached (FALSE);
+  }
+}
+
+static inline gboolean
+constraint_verb_equals (const struct constraint * c,
+    const ConstraintValue * subj_val)
+{
+  return constraint_values_equal (c->subject_type, subj_val, &c->min);
+}
+
+static inline gboolean
+constraint_verb_matches (const struct constraint * c,
+    const ConstraintValue * subj_val)
+{
+  switch (c->subject_type) {
+    case 's':
+      if (!subj_val->s)
         return FALSE;
-      return g_pattern_match_simple (check_str, subj_str);
-    }
+      return g_pattern_match_string (c->pattern, subj_val->s);
     default:
       g_return_val_if_reached (FALSE);
   }
-  return TRUE;
 }
 
 static inline gboolean
-constraint_verb_in_list (gchar subj_type, const GValue * subj_val,
-    GVariant * check_val)
+constraint_verb_in_list (const struct constraint * c,
+    const ConstraintValue * subj_val)
 {
-  GVariantIter iter;
-  g_autoptr (GVariant) child = NULL;
-
-  g_variant_iter_init (&iter, check_val);
-  while ((child = g_variant_iter_next_value (&iter))) {
-    if (constraint_verb_equals (subj_type, subj_val, child))
-      return TRUE;
-    g_variant_unref (child);
+  switch (c->subject_type) {
+    case 's':
+      return subj_val->s && g_hash_table_contains (c->set, subj_val->s);
+    case 'd': {
+      guint i;
+      for (i = 0; i < c->list->len; i++) {
+        gdouble d = g_array_index (c->list, gdouble, i);
+        if (G_APPROX_VALUE (subj_val->d, d, FLT_EPSILON))
+          return TRUE;
+      }
+      return FALSE;
+    }
+    default: {
+      gint64 x = constraint_value_to_int64 (c->subject_type, subj_val);
+      return g_hash_table_contains (c->set, &x);
+    }
   }
-  return FALSE;
 }
 
 static inline gboolean
-constraint_verb_in_range (gchar subj_type, const GValue * subj_val,
-    GVariant * check_val)
+constraint_verb_in_range (const struct constraint * c,
+    const ConstraintValue * subj_val)
 {
-  switch (subj_type) {
-#define CASE_RANGE(l, t, T) \
-    case l: { \
-      g##T val, min, max; \
-      g_variant_get (check_val, "("#t#t")", &min, &max); \
-      val = g_value_get_##T (subj_val); \
-      if (val < min || val > max) \
-        return FALSE; \
-      break; \
-    }
-    CASE_RANGE('i', i, int)
-    CASE_RANGE('u', u, uint)
-    CASE_RANGE('x', x, int64)
-    CASE_RANGE('t', t, uint64)
-    CASE_RANGE('d', d, double)
+  switch (c->subject_type) {
+#define CASE_RANGE(l, f) \
+    case l: \
+      return !(subj_val->f < c->min.f || subj_val->f > c->max.f);
+    CASE_RANGE('i', i)
+    CASE_RANGE('u', u)
+    CASE_RANGE('x', x)
+    CASE_RANGE('t', t)
+    CASE_RANGE('d', d)
 #undef CASE_RANGE
     default:
       g_return_val_if_reached (FALSE);
   }
-  return TRUE;
 }
 
 /*!
@@ -775,6 +1040,7 @@ wp_object_interest_matches_full (WpObjectInterest * self,
   pw_array_for_each (c, &self->constraints) {
     WpProperties *lookup_props = pw_global_props;
     g_auto (GValue) value = G_VALUE_INIT;
+    ConstraintValue subj_val = { 0 };
     gboolean exists = FALSE;
 
     /* return early if the match failed and CHECK_ALL is not specified */
@@ -795,16 +1061,24 @@ wp_object_interest_matches_full (WpObjectInterest * self,
           exists = !!(lookup_str = wp_properties_get (lookup_props, c->subject));
 
         if (exists && c->subject_type)
-          property_string_to_gvalue (c->subject_type, lookup_str, &value);
+          property_string_to_value (c->subject_type, lookup_str, &subj_val);
         break;
       }
       case WP_CONSTRAINT_TYPE_G_PROPERTY: {
         GType value_type;
         GParamSpec *pspec = NULL;
 
-        if (object)
-          exists = !!(pspec = g_object_class_find_property (
-              G_OBJECT_GET_CLASS (object), c->subject));
+        if (object) {
+          GObjectClass *klass = G_OBJECT_GET_CLASS (object);
+
+          /* interests are typically matched against many objects of the
+             same class, so remember the last lookup */
+          if (c->pspec_class != klass) {
+            c->pspec = g_object_class_find_property (klass, c->subject);
+            c->pspec_class = klass;
+          }
+          exists = !!(pspec = c->pspec);
+        }
 
         if (exists && c->subject_type) {
           g_value_init (&value, pspec->value_type);
@@ -827,6 +1101,8 @@ wp_object_interest_matches_full (WpObjectInterest * self,
               continue;
             }
           }
+
+          gvalue_to_constraint_value (c->subject_type, &value, &subj_val);
         }
 
         break;
@@ -839,28 +1115,23 @@ wp_object_interest_matches_full (WpObjectInterest * self,
        according to the operation defined by the verb */
     switch (c->verb) {
       case WP_CONSTRAINT_VERB_EQUALS:
-        if (!exists ||
-            !constraint_verb_equals (c->subject_type, &value, c->value))
+        if (!exists || !constraint_verb_equals (c, &subj_val))
           result &= ~(1 << c->type);
         break;
       case WP_CONSTRAINT_VERB_NOT_EQUALS:
-        if (exists &&
-            constraint_verb_equals (c->subject_type, &value, c->value))
+        if (exists && constraint_verb_equals (c, &subj_val))
           result &= ~(1 << c->type);
         break;
       case WP_CONSTRAINT_VERB_MATCHES:
-        if (!exists ||
-            !constraint_verb_matches (c->subject_type, &value, c->value))
+        if (!exists || !constraint_verb_matches (c, &subj_val))
           result &= ~(1 << c->type);
         break;
       case WP_CONSTRAINT_VERB_IN_LIST:
-        if (!exists ||
-            !constraint_verb_in_list (c->subject_type, &value, c->value))
+        if (!exists || !constraint_verb_in_list (c, &subj_val))
           result &= ~(1 << c->type);
         break;
       case WP_CONSTRAINT_VERB_IN_RANGE:
-        if (!exists ||
-            !constraint_verb_in_range (c->subject_type, &value, c->value))
+        if (!exists || !constraint_verb_in_range (c, &subj_val))
           result &= ~(1 << c->type);
         break;
       case WP_CONSTRAINT_VERB_IS_PRESENT:
@@ -11,6 +11,7 @@
 #include "object-manager.h"
 #include "log.h"
 #include "proxy-interfaces.h"
+#include "session-item.h"
 #include "private/registry.h"
 
 #include <pipewire/pipewire.h>
@@ -126,6 +127,29 @@
  *
  * Flags: G_SIGNAL_RUN_FIRST
  * \endparblock
+ *
+ * \par objects-batch
+ * \parblock
+ * \code
+ * void
+ * objects_batch_callback (WpObjectManager * self,
+ *                         GPtrArray * added,
+ *                         GPtrArray * removed,
+ *                         gpointer user_data)
+ * \endcode
+ *
+ * Emitted in batched mode (see wp_object_manager_set_batched()), right before
+ * \c objects-changed, with all the objects that have been added and removed
+ * since the last emission. An object that was added and removed again
+ * within the same batch does not appear in either array.
+ *
+ * Parameters:
+ * - `added` - (element-type GObject): the objects that were added
+ * - `removed` - (element-type GObject): the objects that were removed;
+ *   they are kept alive until the signal handlers return
+ *
+ * Flags: G_SIGNAL_RUN_FIRST
+ * \endparblock
  */
 
 struct _WpObjectManager
@@ -139,11 +163,30 @@ struct _WpObjectManager
   GHashTable *features;
   /* objects that we are interested in, without a ref */
   GPtrArray *objects;
+  /* object -> WpObjectManagerEntry*, for removal and indexed lookups */
+  GHashTable *entries;
+  /* bound id -> GPtrArray<GObject*>, for proxies */
+  GHashTable *bound_id_index;
+  /* proxies that were not bound yet when they were added */
+  GPtrArray *unbound;
+  /* element-type: WpObjectManagerPropIndex*; indexes on global properties */
+  GPtrArray *prop_indexes;
+  /* global proxies whose global properties were unknown when they were added */
+  GPtrArray *no_props;
 
   gboolean installed;
   gboolean changed;
   guint pending_objects;
   GSource *idle_source;
+
+  /* batched mode: added/removed objects, with a ref, that are delivered
+     all together right before objects-changed */
+  gboolean batched;
+  GPtrArray *batch_added;
+  GPtrArray *batch_removed;
+
+  /* last WpRegistry dispatch that this manager was picked as a candidate for */
+  guint dispatch_seq;
 };
 
 enum {
@@ -155,14 +198,252 @@ enum {
   SIGNAL_OBJECT_ADDED,
   SIGNAL_OBJECT_REMOVED,
   SIGNAL_OBJECTS_CHANGED,
+  SIGNAL_OBJECTS_BATCH,
   SIGNAL_INSTALLED,
   LAST_SIGNAL,
 };
 
 static guint signals[LAST_SIGNAL] = { 0 };
 
+static void wp_registry_index_interest (WpRegistry * self,
+    WpObjectManager * om, WpObjectInterest * interest);
+
 G_DEFINE_TYPE (WpObjectManager, wp_object_manager, G_TYPE_OBJECT)
 
+/*
+ * Object indexes:
+ *
+ * Managed objects are indexed by their bound id, if they are proxies, and by
+ * the value of some global properties (object.serial and any keys added with
+ * wp_object_manager_add_index_key()), if they are global proxies. Lookups
+ * that have an "equals" constraint on one of these use the index to find the
+ * candidate objects and check the full interest only on those.
+ */
+
+typedef struct {
+  /* position in WpObjectManager.objects */
+  guint index;
+  /* the bound id under which the object is indexed, or SPA_ID_INVALID */
+  guint32 bound_id;
+  /* the global properties under which the object is indexed, if any */
+  WpProperties *global_props;
+} WpObjectManagerEntry;
+
+typedef struct {
+  gchar *key;
+  /* value -> GPtrArray<GObject*> */
+  GHashTable *values;
+  /* objects with a value like "042", which can still match an integer
+     constraint on 42; these are checked in all integer lookups */
+  GPtrArray *irregular;
+} WpObjectManagerPropIndex;
+
+static void
+wp_object_manager_entry_free (WpObjectManagerEntry * e)
+{
+  g_clear_pointer (&e->global_props, wp_properties_unref);
+  g_slice_free (WpObjectManagerEntry, e);
+}
+
+static WpObjectManagerPropIndex *
+wp_object_manager_prop_index_new (const gchar * key)
+{
+  WpObjectManagerPropIndex *pi = g_slice_new0 (WpObjectManagerPropIndex);
+  pi->key = g_strdup (key);
+  pi->values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) g_ptr_array_unref);
+  pi->irregular = g_ptr_array_new ();
+  return pi;
+}
+
+static void
+wp_object_manager_prop_index_free (WpObjectManagerPropIndex * pi)
+{
+  g_clear_pointer (&pi->key, g_free);
+  g_clear_pointer (&pi->values, g_hash_table_unref);
+  g_clear_pointer (&pi->irregular, g_ptr_array_unref);
+  g_slice_free (WpObjectManagerPropIndex, pi);
+}
+
+/* values in this form are converted to the same number by all the strto*l()
+   functions that are used for matching, so they can be looked up directly */
+static inline gboolean
+is_plain_number (const gchar * str)
+{
+  gsize i;
+
+  if (str[0] == '0')
+    return str[1] == '\0';
+
+  for (i = 0; str[i] != '\0'; i++) {
+    if (i >= 9 || !g_ascii_isdigit (str[i]))
+      return FALSE;
+  }
+  return i > 0;
+}
+
+static void
+index_bucket_add (GHashTable * index, gpointer key, gpointer object)
+{
+  GPtrArray *bucket = g_hash_table_lookup (index, key);
+  if (!bucket) {
+    bucket = g_ptr_array_new ();
+    g_hash_table_insert (index, key, bucket);
+  }
+  g_ptr_array_add (bucket, object);
+}
+
+static void
+index_bucket_remove (GHashTable * index, gconstpointer key, gpointer object)
+{
+  GPtrArray *bucket = g_hash_table_lookup (index, key);
+  if (bucket && g_ptr_array_remove_fast (bucket, object) && bucket->len == 0)
+    g_hash_table_remove (index, key);
+}
+
+static void
+wp_object_manager_prop_index_add (WpObjectManagerPropIndex * pi,
+    WpProperties * props, gpointer object)
+{
+  const gchar *value = wp_properties_get (props, pi->key);
+
+  if (!value)
+    return;
+
+  if (g_hash_table_contains (pi->values, value))
+    index_bucket_add (pi->values, (gpointer) value, object);
+  else
+    index_bucket_add (pi->values, g_strdup (value), object);
+
+  if (!is_plain_number (value))
+    g_ptr_array_add (pi->irregular, object);
+}
+
+static void
+wp_object_manager_prop_index_remove (WpObjectManagerPropIndex * pi,
+    WpProperties * props, gpointer object)
+{
+  const gchar *value = wp_properties_get (props, pi->key);
+
+  if (!value)
+    return;
+
+  index_bucket_remove (pi->values, value, object);
+  if (!is_plain_number (value))
+    g_ptr_array_remove_fast (pi->irregular, object);
+}
+
+static void
+wp_object_manager_index_object (WpObjectManager * self, gpointer object,
+    WpObjectManagerEntry * e)
+{
+  e->bound_id = SPA_ID_INVALID;
+
+  if (WP_IS_PROXY (object)) {
+    if (wp_object_get_active_features (WP_OBJECT (object)) &
+            WP_PROXY_FEATURE_BOUND)
+      e->bound_id = wp_proxy_get_bound_id (WP_PROXY (object));
+
+    if (e->bound_id != SPA_ID_INVALID)
+      index_bucket_add (self->bound_id_index, GUINT_TO_POINTER (e->bound_id),
+          object);
+    else
+      g_ptr_array_add (self->unbound, object);
+  }
+
+  if (WP_IS_GLOBAL_PROXY (object)) {
+    e->global_props =
+        wp_global_proxy_get_global_properties (WP_GLOBAL_PROXY (object));
+
+    if (e->global_props) {
+      for (guint i = 0; i < self->prop_indexes->len; i++)
+        wp_object_manager_prop_index_add (
+            g_ptr_array_index (self->prop_indexes, i), e->global_props, object);
+    } else {
+      g_ptr_array_add (self->no_props, object);
+    }
+  }
+}
+
+static void
+wp_object_manager_unindex_object (WpObjectManager * self, gpointer object,
+    WpObjectManagerEntry * e)
+{
+  if (WP_IS_PROXY (object)) {
+    if (e->bound_id != SPA_ID_INVALID)
+      index_bucket_remove (self->bound_id_index,
+          GUINT_TO_POINTER (e->bound_id), object);
+    else
+      g_ptr_array_remove_fast (self->unbound, object);
+  }
+
+  if (WP_IS_GLOBAL_PROXY (object)) {
+    if (e->global_props) {
+      for (guint i = 0; i < self->prop_indexes->len; i++)
+        wp_object_manager_prop_index_remove (
+            g_ptr_array_index (self->prop_indexes, i), e->global_props, object);
+    } else {
+      g_ptr_array_remove_fast (self->no_props, object);
+    }
+  }
+}
+
+/*
+ * Finds the objects that may match a lookup \a interest, using the indexes.
+ * Returns FALSE if the interest cannot be answered from an index, otherwise
+ * \a candidates is filled with up to 3 arrays (or NULL) that contain all the
+ * objects that may match.
+ */
+static gboolean
+wp_object_manager_find_candidates (WpObjectManager * self,
+    WpObjectInterest * interest, GPtrArray * candidates[3])
+{
+  GType gtype = wp_object_interest_get_gtype (interest);
+  gboolean numeric = FALSE;
+
+  if (!g_type_is_a (gtype, WP_TYPE_PROXY))
+    return FALSE;
+
+  /* on global proxies, object.id is always the same as the bound id */
+  {
+    g_autofree gchar *value = NULL;
+    guint64 id;
+
+    if ((wp_object_interest_find_equals_value (interest,
+              WP_CONSTRAINT_TYPE_G_PROPERTY, "bound-id", &value, &numeric) ||
+          (g_type_is_a (gtype, WP_TYPE_GLOBAL_PROXY) &&
+           wp_object_interest_find_equals_value (interest,
+              WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, PW_KEY_OBJECT_ID,
+              &value, &numeric))) &&
+        g_ascii_string_to_unsigned (value, 10, 0, SPA_ID_INVALID - 1, &id,
+            NULL)) {
+      candidates[0] = g_hash_table_lookup (self->bound_id_index,
+          GUINT_TO_POINTER ((guint32) id));
+      candidates[1] = self->unbound;
+      candidates[2] = NULL;
+      return TRUE;
+    }
+  }
+
+  if (!g_type_is_a (gtype, WP_TYPE_GLOBAL_PROXY))
+    return FALSE;
+
+  for (guint i = 0; i < self->prop_indexes->len; i++) {
+    WpObjectManagerPropIndex *pi = g_ptr_array_index (self->prop_indexes, i);
+    g_autofree gchar *value = NULL;
+
+    if (wp_object_interest_find_equals_value (interest,
+            WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, pi->key, &value, &numeric)) {
+      candidates[0] = g_hash_table_lookup (pi->values, value);
+      candidates[1] = numeric ? pi->irregular : NULL;
+      candidates[2] = self->no_props;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
 static void
 wp_object_manager_init (WpObjectManager * self)
 {
@@ -171,9 +452,22 @@ wp_object_manager_init (WpObjectManager * self)
       (GDestroyNotify) wp_object_interest_unref);
   self->features = g_hash_table_new (g_direct_hash, g_direct_equal);
   self->objects = g_ptr_array_new ();
+  self->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) wp_object_manager_entry_free);
+  self->bound_id_index = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) g_ptr_array_unref);
+  self->unbound = g_ptr_array_new ();
+  self->prop_indexes = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) wp_object_manager_prop_index_free);
+  self->no_props = g_ptr_array_new ();
+  g_ptr_array_add (self->prop_indexes,
+      wp_object_manager_prop_index_new (PW_KEY_OBJECT_SERIAL));
   self->installed = FALSE;
   self->changed = FALSE;
   self->pending_objects = 0;
+  self->batched = FALSE;
+  self->batch_added = g_ptr_array_new_with_free_func (g_object_unref);
+  self->batch_removed = g_ptr_array_new_with_free_func (g_object_unref);
 }
 
 static void
@@ -185,6 +479,13 @@ wp_object_manager_finalize (GObject * object)
     g_source_destroy (self->idle_source);
     g_clear_pointer (&self->idle_source, g_source_unref);
   }
+  g_clear_pointer (&self->batch_added, g_ptr_array_unref);
+  g_clear_pointer (&self->batch_removed, g_ptr_array_unref);
+  g_clear_pointer (&self->no_props, g_ptr_array_unref);
+  g_clear_pointer (&self->prop_indexes, g_ptr_array_unref);
+  g_clear_pointer (&self->unbound, g_ptr_array_unref);
+  g_clear_pointer (&self->bound_id_index, g_hash_table_unref);
+  g_clear_pointer (&self->entries, g_hash_table_unref);
   g_clear_pointer (&self->objects, g_ptr_array_unref);
   g_clear_pointer (&self->features, g_hash_table_unref);
   g_clear_pointer (&self->interests, g_ptr_array_unref);
@@ -235,6 +536,10 @@ wp_object_manager_class_init (WpObjectManagerClass * klass)
       "objects-changed", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_FIRST,
       0, NULL, NULL, NULL, G_TYPE_NONE, 0);
 
+  signals[SIGNAL_OBJECTS_BATCH] = g_signal_new (
+      "objects-batch", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_FIRST,
+      0, NULL, NULL, NULL, G_TYPE_NONE, 2, G_TYPE_PTR_ARRAY, G_TYPE_PTR_ARRAY);
+
   signals[SIGNAL_INSTALLED] = g_signal_new (
       "installed", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_FIRST,
       0, NULL, NULL, NULL, G_TYPE_NONE, 0);
@@ -265,6 +570,62 @@ wp_object_manager_is_installed (WpObjectManager * self)
   return self->installed;
 }
 
+/*!
+ * \brief Enables or disables batched mode.
+ *
+ * In batched mode, the \c object-added and \c object-removed signals are
+ * not emitted. Instead, the added and removed objects are accumulated and
+ * delivered all together with the \c objects-batch signal, once per idle
+ * cycle, right before \c objects-changed. This is useful for handlers that
+ * have a significant cost per invocation and can process changes in bulk.
+ *
+ * This should be called before installing the object manager.
+ *
+ * \ingroup wpobjectmanager
+ * \param self the object manager
+ * \param batched TRUE to enable batched mode, FALSE to disable it
+ * \since 0.4.15
+ */
+void
+wp_object_manager_set_batched (WpObjectManager * self, gboolean batched)
+{
+  g_return_if_fail (WP_IS_OBJECT_MANAGER (self));
+  self->batched = batched;
+}
+
+/*!
+ * \brief Indexes the managed global proxies by the value of the global
+ * property \a key.
+ *
+ * wp_object_manager_lookup() and wp_object_manager_lookup_full() use this
+ * index when the lookup interest has a WP_CONSTRAINT_VERB_EQUALS constraint
+ * on this global property (WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY) and a type
+ * that descends from WpGlobalProxy, so that they do not need to check all the
+ * managed objects. The "bound-id" GObject property, the "object.id" and the
+ * "object.serial" global properties are always indexed.
+ *
+ * This must be called before installing the object manager.
+ *
+ * \ingroup wpobjectmanager
+ * \param self the object manager
+ * \param key the global property to index
+ * \since 0.4.15
+ */
+void
+wp_object_manager_add_index_key (WpObjectManager * self, const gchar * key)
+{
+  g_return_if_fail (WP_IS_OBJECT_MANAGER (self));
+  g_return_if_fail (key != NULL);
+  g_return_if_fail (self->objects->len == 0);
+
+  for (guint i = 0; i < self->prop_indexes->len; i++) {
+    WpObjectManagerPropIndex *pi = g_ptr_array_index (self->prop_indexes, i);
+    if (g_str_equal (pi->key, key))
+      return;
+  }
+  g_ptr_array_add (self->prop_indexes, wp_object_manager_prop_index_new (key));
+}
+
 /*!
  * \brief Equivalent to:
  * \code
@@ -320,6 +681,13 @@ wp_object_manager_add_interest_full (WpObjectManager *self,
     return;
   }
   g_ptr_array_add (self->interests, interest);
+
+  /* if already installed, make the registry aware of the new interest */
+  {
+    g_autoptr (WpCore) core = g_weak_ref_get (&self->core);
+    if (core)
+      wp_registry_index_interest (wp_core_get_registry (core), self, interest);
+  }
 }
 
 static void
@@ -596,10 +964,29 @@ wp_object_manager_lookup_full (WpObjectManager * self,
     WpObjectInterest * interest)
 {
   g_auto (GValue) ret = G_VALUE_INIT;
-  g_autoptr (WpIterator) it =
-      wp_object_manager_new_filtered_iterator_full (self, interest);
+  g_autoptr (WpIterator) it = NULL;
+  GPtrArray *candidates[3] = { NULL, NULL, NULL };
 
-  if (wp_iterator_next (it, &ret))
+  g_return_val_if_fail (WP_IS_OBJECT_MANAGER (self), NULL);
+
+  /* lookups by bound id or by an indexed global property only need to check
+     the objects that are stored in the index under that value */
+  if (wp_object_interest_validate (interest, NULL) &&
+      wp_object_manager_find_candidates (self, interest, candidates)) {
+    g_autoptr (WpObjectInterest) i = interest;
+
+    for (guint c = 0; c < G_N_ELEMENTS (candidates); c++) {
+      for (guint j = 0; candidates[c] && j < candidates[c]->len; j++) {
+        gpointer obj = g_ptr_array_index (candidates[c], j);
+        if (wp_object_interest_matches (i, obj))
+          return g_object_ref (obj);
+      }
+    }
+    return NULL;
+  }
+
+  it = wp_object_manager_new_filtered_iterator_full (self, interest);
+  if (it && wp_iterator_next (it, &ret))
     return g_value_dup_object (&ret);
 
   return NULL;
@@ -638,8 +1025,8 @@ wp_object_manager_is_interested_in_global (WpObjectManager * self,
     /* and consider the manager interested if the type and the globals match...
        if pw_properties / g_properties fail, that's ok because they are not
        known yet (the proxy is likely NULL and properties not yet retrieved) */
-    if (match & (WP_INTEREST_MATCH_GTYPE |
-                 WP_INTEREST_MATCH_PW_GLOBAL_PROPERTIES)) {
+    if (SPA_FLAG_IS_SET (match, WP_INTEREST_MATCH_GTYPE |
+                                WP_INTEREST_MATCH_PW_GLOBAL_PROPERTIES)) {
       gpointer ft = g_hash_table_lookup (self->features,
           GSIZE_TO_POINTER (global->type));
       *wanted_features = (WpObjectFeatures) GPOINTER_TO_UINT (ft);
@@ -656,11 +1043,33 @@ wp_object_manager_is_interested_in_global (WpObjectManager * self,
   return FALSE;
 }
 
+static void
+wp_object_manager_emit_batch (WpObjectManager * self)
+{
+  g_autoptr (GPtrArray) added = NULL;
+  g_autoptr (GPtrArray) removed = NULL;
+
+  if (self->batch_added->len == 0 && self->batch_removed->len == 0)
+    return;
+
+  /* start a new batch, in case the handlers cause more changes */
+  added = g_steal_pointer (&self->batch_added);
+  removed = g_steal_pointer (&self->batch_removed);
+  self->batch_added = g_ptr_array_new_with_free_func (g_object_unref);
+  self->batch_removed = g_ptr_array_new_with_free_func (g_object_unref);
+
+  wp_trace_object (self, "emit objects-batch (added:%u, removed:%u)",
+      added->len, removed->len);
+  g_signal_emit (self, signals[SIGNAL_OBJECTS_BATCH], 0, added, removed);
+}
+
 static gboolean
 idle_emit_objects_changed (WpObjectManager * self)
 {
   g_clear_pointer (&self->idle_source, g_source_unref);
 
+  wp_object_manager_emit_batch (self);
+
   if (G_UNLIKELY (!self->installed)) {
     wp_trace_object (self, "installed");
     g_signal_emit (self, signals[SIGNAL_INSTALLED], 0);
@@ -729,9 +1138,22 @@ static void
 wp_object_manager_add_object (WpObjectManager * self, gpointer object)
 {
   if (wp_object_manager_is_interested_in_object (self, object)) {
+    WpObjectManagerEntry *e;
+
+    if (G_UNLIKELY (g_hash_table_contains (self->entries, object)))
+      return;
+
     wp_trace_object (self, "added: " WP_OBJECT_FORMAT, WP_OBJECT_ARGS (object));
+    e = g_slice_new0 (WpObjectManagerEntry);
+    e->index = self->objects->len;
+    wp_object_manager_index_object (self, object, e);
+    g_hash_table_insert (self->entries, object, e);
     g_ptr_array_add (self->objects, object);
-    g_signal_emit (self, signals[SIGNAL_OBJECT_ADDED], 0, object);
+    if (!self->batched)
+      g_signal_emit (self, signals[SIGNAL_OBJECT_ADDED], 0, object);
+    /* removed and added back within the same batch; nothing changed */
+    else if (!g_ptr_array_remove_fast (self->batch_removed, object))
+      g_ptr_array_add (self->batch_added, g_object_ref (object));
     self->changed = TRUE;
   }
 }
@@ -740,10 +1162,26 @@ wp_object_manager_add_object (WpObjectManager * self, gpointer object)
 static void
 wp_object_manager_rm_object (WpObjectManager * self, gpointer object)
 {
-  guint index;
-  if (g_ptr_array_find (self->objects, object, &index)) {
+  WpObjectManagerEntry *e = g_hash_table_lookup (self->entries, object);
+
+  if (e) {
+    guint index = e->index;
+
+    /* the last object is moved in the place of the removed one */
     g_ptr_array_remove_index_fast (self->objects, index);
-    g_signal_emit (self, signals[SIGNAL_OBJECT_REMOVED], 0, object);
+    if (index < self->objects->len) {
+      WpObjectManagerEntry *moved = g_hash_table_lookup (self->entries,
+          g_ptr_array_index (self->objects, index));
+      moved->index = index;
+    }
+    wp_object_manager_unindex_object (self, object, e);
+    g_hash_table_remove (self->entries, object);
+
+    if (!self->batched)
+      g_signal_emit (self, signals[SIGNAL_OBJECT_REMOVED], 0, object);
+    /* added and removed again within the same batch; nothing changed */
+    else if (!g_ptr_array_remove_fast (self->batch_added, object))
+      g_ptr_array_add (self->batch_removed, g_object_ref (object));
     self->changed = TRUE;
   }
 }
@@ -849,11 +1287,225 @@ wp_object_manager_add_global (WpObjectManager * self, WpGlobal * global)
 #undef G_LOG_DOMAIN
 #define G_LOG_DOMAIN "wp-registry"
 
+/*
+ * Interest index:
+ *
+ * Every interest of every installed object manager is stored in one of
+ * two indexes:
+ *
+ * - if the interest has an "equals" constraint on a PipeWire global property
+ *   with a string or integer value, the manager is stored in om_props_index,
+ *   under the subject and the value of that constraint
+ * - otherwise, the manager is stored in om_types_index, under the GType
+ *   of the interest
+ *
+ * When a new object appears, only the managers that are found through these
+ * indexes are checked for interest. The rest of them cannot possibly be
+ * interested, since none of their interests can match the object.
+ */
+
+typedef struct {
+  /* canonical value -> GPtrArray<WpObjectManager*> */
+  GHashTable *values;
+  /* number of entries in values that come from integer constraints */
+  guint n_numeric;
+} WpRegistryPropsIndex;
+
+static void
+wp_registry_props_index_free (WpRegistryPropsIndex * self)
+{
+  g_clear_pointer (&self->values, g_hash_table_unref);
+  g_slice_free (WpRegistryPropsIndex, self);
+}
+
+static void
+wp_registry_index_interest (WpRegistry * self, WpObjectManager * om,
+    WpObjectInterest * interest)
+{
+  const gchar *subject = NULL;
+  g_autofree gchar *value = NULL;
+  gboolean numeric = FALSE;
+  GPtrArray *bucket;
+
+  /* prevent bad things when called after wp_registry_clear() */
+  if (G_UNLIKELY (!self->om_props_index))
+    return;
+
+  if (wp_object_interest_find_index_key (interest, &subject, &value,
+          &numeric)) {
+    WpRegistryPropsIndex *pi =
+        g_hash_table_lookup (self->om_props_index, subject);
+
+    if (!pi) {
+      pi = g_slice_new0 (WpRegistryPropsIndex);
+      pi->values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+          (GDestroyNotify) g_ptr_array_unref);
+      g_hash_table_insert (self->om_props_index, g_strdup (subject), pi);
+    }
+
+    bucket = g_hash_table_lookup (pi->values, value);
+    if (!bucket) {
+      bucket = g_ptr_array_new ();
+      g_hash_table_insert (pi->values, g_steal_pointer (&value), bucket);
+    }
+    if (numeric)
+      pi->n_numeric++;
+  }
+  else {
+    GType gtype = wp_object_interest_get_gtype (interest);
+
+    bucket = g_hash_table_lookup (self->om_types_index,
+        GSIZE_TO_POINTER (gtype));
+    if (!bucket) {
+      bucket = g_ptr_array_new ();
+      g_hash_table_insert (self->om_types_index, GSIZE_TO_POINTER (gtype),
+          bucket);
+    }
+  }
+
+  g_ptr_array_add (bucket, om);
+}
+
+static void
+wp_registry_unindex_interest (WpRegistry * self, WpObjectManager * om,
+    WpObjectInterest * interest)
+{
+  const gchar *subject = NULL;
+  g_autofree gchar *value = NULL;
+  gboolean numeric = FALSE;
+  GPtrArray *bucket;
+
+  if (wp_object_interest_find_index_key (interest, &subject, &value,
+          &numeric)) {
+    WpRegistryPropsIndex *pi =
+        g_hash_table_lookup (self->om_props_index, subject);
+
+    if (!pi || !(bucket = g_hash_table_lookup (pi->values, value)))
+      return;
+
+    if (g_ptr_array_remove_fast (bucket, om) && numeric)
+      pi->n_numeric--;
+    if (bucket->len == 0)
+      g_hash_table_remove (pi->values, value);
+    if (g_hash_table_size (pi->values) == 0)
+      g_hash_table_remove (self->om_props_index, subject);
+  }
+  else {
+    GType gtype = wp_object_interest_get_gtype (interest);
+
+    bucket = g_hash_table_lookup (self->om_types_index,
+        GSIZE_TO_POINTER (gtype));
+    if (!bucket)
+      return;
+
+    g_ptr_array_remove_fast (bucket, om);
+    if (bucket->len == 0)
+      g_hash_table_remove (self->om_types_index, GSIZE_TO_POINTER (gtype));
+  }
+}
+
+static void
+wp_registry_index_object_manager (WpRegistry * self, WpObjectManager * om)
+{
+  for (guint i = 0; i < om->interests->len; i++)
+    wp_registry_index_interest (self, om,
+        g_ptr_array_index (om->interests, i));
+}
+
+static void
+wp_registry_unindex_object_manager (WpRegistry * self, WpObjectManager * om)
+{
+  for (guint i = 0; i < om->interests->len; i++)
+    wp_registry_unindex_interest (self, om,
+        g_ptr_array_index (om->interests, i));
+}
+
+static void
+collect_candidates (WpRegistry * self, GPtrArray * bucket,
+    GPtrArray * candidates)
+{
+  for (guint i = 0; i < bucket->len; i++) {
+    WpObjectManager *om = g_ptr_array_index (bucket, i);
+    if (om->dispatch_seq != self->dispatch_seq) {
+      om->dispatch_seq = self->dispatch_seq;
+      g_ptr_array_add (candidates, g_object_ref (om));
+    }
+  }
+}
+
+/*
+ * \brief Finds the object managers that may be interested in an object
+ *
+ * \param self the registry
+ * \param type the type of the object
+ * \param props (nullable): the global properties of the object
+ * \returns (transfer full) (element-type WpObjectManager*): the candidate
+ *   object managers, each one included only once
+ */
+static GPtrArray *
+wp_registry_find_candidate_object_managers (WpRegistry * self, GType type,
+    WpProperties * props)
+{
+  GPtrArray *candidates = g_ptr_array_new_with_free_func (g_object_unref);
+  GHashTableIter iter;
+  gpointer key, value;
+
+  if (G_UNLIKELY (++self->dispatch_seq == 0))
+    self->dispatch_seq = 1;
+
+  g_hash_table_iter_init (&iter, self->om_types_index);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    if (g_type_is_a (type, (GType) GPOINTER_TO_SIZE (key)))
+      collect_candidates (self, value, candidates);
+  }
+
+  if (!props)
+    return candidates;
+
+  g_hash_table_iter_init (&iter, self->om_props_index);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    WpRegistryPropsIndex *pi = value;
+    const gchar *str = wp_properties_get (props, key);
+    GPtrArray *bucket;
+
+    if (!str)
+      continue;
+
+    /* a value like "042" can still match an integer constraint on 42;
+       fall back to checking all the managers that are indexed on this key */
+    if (pi->n_numeric > 0 && !is_plain_number (str)) {
+      GHashTableIter viter;
+      g_hash_table_iter_init (&viter, pi->values);
+      while (g_hash_table_iter_next (&viter, NULL, (gpointer *) &bucket))
+        collect_candidates (self, bucket, candidates);
+    }
+    else if ((bucket = g_hash_table_lookup (pi->values, str))) {
+      collect_candidates (self, bucket, candidates);
+    }
+  }
+
+  return candidates;
+}
+
+static WpProperties *
+get_object_global_properties (gpointer object)
+{
+  if (WP_IS_GLOBAL_PROXY (object))
+    return wp_global_proxy_get_global_properties (WP_GLOBAL_PROXY (object));
+  if (WP_IS_SESSION_ITEM (object))
+    return wp_session_item_get_properties (WP_SESSION_ITEM (object));
+  return NULL;
+}
+
 static void
 wp_registry_notify_add_object (WpRegistry *self, gpointer object)
 {
-  for (guint i = 0; i < self->object_managers->len; i++) {
-    WpObjectManager *om = g_ptr_array_index (self->object_managers, i);
+  g_autoptr (WpProperties) props = get_object_global_properties (object);
+  g_autoptr (GPtrArray) oms = wp_registry_find_candidate_object_managers (
+      self, G_OBJECT_TYPE (object), props);
+
+  for (guint i = 0; i < oms->len; i++) {
+    WpObjectManager *om = g_ptr_array_index (oms, i);
     wp_object_manager_add_object (om, object);
     wp_object_manager_maybe_objects_changed (om);
   }
@@ -873,31 +1525,113 @@ static void
 object_manager_destroyed (gpointer data, GObject * om)
 {
   WpRegistry *self = data;
+  wp_registry_unindex_object_manager (self, WP_OBJECT_MANAGER (om));
   g_ptr_array_remove_fast (self->object_managers, om);
 }
 
-/* find the subclass of WpPipewireGloabl that can handle
-   the given pipewire interface type of the given version */
-static inline GType
-find_proxy_instance_type (const char * type, guint32 version)
+/*
+ * Proxy type table:
+ *
+ * Maps a PipeWire interface type and version to the WpGlobalProxy subclass
+ * that handles it. It is built lazily from the children of WpGlobalProxy and
+ * rebuilt when a lookup fails and new children have been registered since,
+ * so that subclasses registered later (by modules, for instance) are found.
+ */
+
+typedef struct {
+  const gchar *type;
+  guint32 version;
+} ProxyTypeKey;
+
+static void
+proxy_type_key_free (ProxyTypeKey * key)
+{
+  g_free ((gchar *) key->type);
+  g_free (key);
+}
+
+static guint
+proxy_type_key_hash (gconstpointer key)
+{
+  const ProxyTypeKey *k = key;
+  return g_str_hash (k->type) ^ k->version;
+}
+
+static gboolean
+proxy_type_key_equal (gconstpointer a, gconstpointer b)
 {
-  g_autofree GType *children;
-  guint n_children;
+  const ProxyTypeKey *ka = a, *kb = b;
+  return ka->version == kb->version && g_str_equal (ka->type, kb->type);
+}
+
+G_LOCK_DEFINE_STATIC (proxy_types);
+static GHashTable *proxy_types = NULL; /* ProxyTypeKey* -> GType */
+static guint proxy_types_n_children = 0;
 
-  children = g_type_children (WP_TYPE_GLOBAL_PROXY, &n_children);
+/* must be called with the proxy_types lock held */
+static void
+proxy_types_rebuild (GType * children, guint n_children)
+{
+  if (!proxy_types)
+    proxy_types = g_hash_table_new_full (proxy_type_key_hash,
+        proxy_type_key_equal, (GDestroyNotify) proxy_type_key_free, NULL);
+  else
+    g_hash_table_remove_all (proxy_types);
 
   for (guint i = 0; i < n_children; i++) {
     WpProxyClass *klass = (WpProxyClass *) g_type_class_ref (children[i]);
-    if (g_strcmp0 (klass->pw_iface_type, type) == 0 &&
-        klass->pw_iface_version == version) {
-      g_type_class_unref (klass);
-      return children[i];
+
+    if (klass->pw_iface_type) {
+      ProxyTypeKey key = { klass->pw_iface_type, klass->pw_iface_version };
+
+      /* keep the first match, like a linear search would */
+      if (!g_hash_table_contains (proxy_types, &key)) {
+        ProxyTypeKey *k = g_new (ProxyTypeKey, 1);
+        k->type = g_strdup (key.type);
+        k->version = key.version;
+        g_hash_table_insert (proxy_types, k, GSIZE_TO_POINTER (children[i]));
+      }
     }
 
     g_type_class_unref (klass);
   }
+  proxy_types_n_children = n_children;
+}
+
+/* find the subclass of WpGlobalProxy that can handle
+   the given pipewire interface type of the given version */
+static inline GType
+find_proxy_instance_type (const char * type, guint32 version)
+{
+  ProxyTypeKey key = { type, version };
+  gpointer value = NULL;
+  GType ret = WP_TYPE_GLOBAL_PROXY;
+
+  if (!type)
+    return ret;
+
+  G_LOCK (proxy_types);
+
+  if (proxy_types &&
+      g_hash_table_lookup_extended (proxy_types, &key, NULL, &value)) {
+    ret = (GType) GPOINTER_TO_SIZE (value);
+  }
+  else {
+    /* not found; check if more subclasses have been registered since the
+       table was built and rebuild it in that case */
+    g_autofree GType *children;
+    guint n_children;
+
+    children = g_type_children (WP_TYPE_GLOBAL_PROXY, &n_children);
+    if (!proxy_types || n_children != proxy_types_n_children) {
+      proxy_types_rebuild (children, n_children);
+      if (g_hash_table_lookup_extended (proxy_types, &key, NULL, &value))
+        ret = (GType) GPOINTER_TO_SIZE (value);
+    }
+  }
 
-  return WP_TYPE_GLOBAL_PROXY;
+  G_UNLOCK (proxy_types);
+  return ret;
 }
 
 /* called by the registry when a global appears */
@@ -961,6 +1695,11 @@ wp_registry_init (WpRegistry *self)
       g_ptr_array_new_with_free_func ((GDestroyNotify) wp_global_unref);
   self->objects = g_ptr_array_new_with_free_func (g_object_unref);
   self->object_managers = g_ptr_array_new ();
+  self->om_types_index = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, (GDestroyNotify) g_ptr_array_unref);
+  self->om_props_index = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) wp_registry_props_index_free);
+  self->dispatch_seq = 0;
 }
 
 void
@@ -996,6 +1735,9 @@ wp_registry_clear (WpRegistry *self)
       g_object_weak_unref (om, object_manager_destroyed, self);
     }
   }
+
+  g_clear_pointer (&self->om_types_index, g_hash_table_unref);
+  g_clear_pointer (&self->om_props_index, g_hash_table_unref);
 }
 
 void
@@ -1094,19 +1836,24 @@ expose_tmp_globals (WpCore *core, GAsyncResult *res, WpRegistry *self)
     g_ptr_array_index (self->globals, g->id) = wp_global_ref (g);
   }
 
-  /* notify object managers */
-  for (guint i = 0; i < self->object_managers->len; i++) {
-    WpObjectManager *om = g_ptr_array_index (self->object_managers, i);
+  /* notify object managers that may be interested */
+  for (guint i = 0; i < tmp_globals->len; i++) {
+    WpGlobal *g = g_ptr_array_index (tmp_globals, i);
+    g_autoptr (GPtrArray) oms = NULL;
 
-    for (guint i = 0; i < tmp_globals->len; i++) {
-      WpGlobal *g = g_ptr_array_index (tmp_globals, i);
+    /* if global was already removed, drop it */
+    if (g->flags == 0 || g->id == SPA_ID_INVALID)
+      continue;
 
-      /* if global was already removed, drop it */
-      if (g->flags == 0 || g->id == SPA_ID_INVALID)
-        continue;
+    oms = wp_registry_find_candidate_object_managers (self, g->type,
+        g->properties);
+    for (guint j = 0; j < oms->len && g->flags != 0; j++)
+      wp_object_manager_add_global (g_ptr_array_index (oms, j), g);
+  }
 
-      wp_object_manager_add_global (om, g);
-    }
+  /* all managers need to re-evaluate, as they may now be installed */
+  for (guint i = 0; i < self->object_managers->len; i++) {
+    WpObjectManager *om = g_ptr_array_index (self->object_managers, i);
     wp_object_manager_maybe_objects_changed (om);
   }
 }
@@ -1289,6 +2036,7 @@ wp_core_install_object_manager (WpCore * self, WpObjectManager * om)
 
   g_object_weak_ref (G_OBJECT (om), object_manager_destroyed, reg);
   g_ptr_array_add (reg->object_managers, om);
+  wp_registry_index_object_manager (reg, om);
   g_weak_ref_set (&om->core, self);
 
   /* add pre-existing objects to the object manager,
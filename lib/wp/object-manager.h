@@ -32,6 +32,13 @@ WpObjectManager * wp_object_manager_new (void);
 WP_API
 gboolean wp_object_manager_is_installed (WpObjectManager * self);
 
+WP_API
+void wp_object_manager_set_batched (WpObjectManager * self, gboolean batched);
+
+WP_API
+void wp_object_manager_add_index_key (WpObjectManager * self,
+    const gchar * key);
+
 /* interest */
 
 WP_API
@@ -12,6 +12,7 @@
 #include "core.h"
 #include "spa-type.h"
 #include "spa-pod.h"
+#include "private/spa-pod-private.h"
 #include "log.h"
 #include "error.h"
 
@@ -104,34 +105,46 @@ wp_pw_object_mixin_get_param_info (WpPipewireObject * obj)
   return g_variant_builder_end (&b);
 }
 
+/* removes \a task from the pending enum_params tasks; returns FALSE if it
+   was not there, which means that it has already been completed */
+static gboolean
+enum_params_task_remove (WpPwObjectMixinData * d, GTask * task)
+{
+  gpointer seq = g_task_get_source_tag (task);
+
+  if (!d->enum_params_tasks ||
+      g_hash_table_lookup (d->enum_params_tasks, seq) != task)
+    return FALSE;
+
+  g_hash_table_remove (d->enum_params_tasks, seq);
+  return TRUE;
+}
+
 static void
 enum_params_done (WpCore * core, GAsyncResult * res, gpointer data)
 {
   g_autoptr (GTask) task = G_TASK (data);
-  GList *taskl = NULL;
   g_autoptr (GError) error = NULL;
   gpointer instance = g_task_get_source_object (G_TASK (data));
-  GPtrArray *params = g_task_get_task_data (task);
+  WpSpaPodBuilder *params = g_task_get_task_data (task);
   WpPwObjectMixinData *d = wp_pw_object_mixin_get_data (instance);
 
   /* finish the sync task */
   wp_core_sync_finish (core, res, &error);
 
-  /* return if task was previously removed from the list */
-  taskl = g_list_find (d->enum_params_tasks, task);
-  if (!taskl)
+  /* return if task was previously removed from the table; the ref is held
+     by the g_autoptr */
+  if (!enum_params_task_remove (d, task))
     return;
 
-  /* remove the task from the stored list; ref is held by the g_autoptr */
-  d->enum_params_tasks = g_list_delete_link (d->enum_params_tasks, taskl);
-
   wp_debug_object (instance, "got %u params, %s, task " WP_OBJECT_FORMAT,
-      params->len, error ? "with error" : "ok", WP_OBJECT_ARGS (task));
+      wp_spa_pod_builder_get_n_pods (params), error ? "with error" : "ok",
+      WP_OBJECT_ARGS (task));
 
   if (error)
     g_task_return_error (task, g_steal_pointer (&error));
   else {
-    g_task_return_pointer (task, g_ptr_array_ref (params),
+    g_task_return_pointer (task, wp_spa_pod_builder_end_pods (params),
         (GDestroyNotify) g_ptr_array_unref);
   }
 }
@@ -145,11 +158,8 @@ enum_params_error (WpProxy * proxy, int seq, int res, const gchar *msg,
   if (SPA_RESULT_ASYNC_SEQ (t_seq) == SPA_RESULT_ASYNC_SEQ (seq)) {
     gpointer instance = g_task_get_source_object (task);
     WpPwObjectMixinData *d = wp_pw_object_mixin_get_data (instance);
-    GList *taskl = NULL;
 
-    taskl = g_list_find (d->enum_params_tasks, task);
-    if (taskl) {
-      d->enum_params_tasks = g_list_delete_link (d->enum_params_tasks, taskl);
+    if (enum_params_task_remove (d, task)) {
       g_task_return_new_error (task, WP_DOMAIN_LIBRARY,
           WP_LIBRARY_ERROR_OPERATION_FAILED, "%s", msg);
     }
@@ -184,9 +194,6 @@ wp_pw_object_mixin_enum_params_unchecked (gpointer obj,
     }
   }
 
-  if (!params)
-    params = g_ptr_array_new_with_free_func ((GDestroyNotify) wp_spa_pod_unref);
-
   /* create task */
   task = g_task_new (obj, cancellable, callback, user_data);
 
@@ -201,6 +208,9 @@ wp_pw_object_mixin_enum_params_unchecked (gpointer obj,
   }
 
   if (iface->enum_params_sync) {
+    if (!params)
+      params = g_ptr_array_new_with_free_func (
+          (GDestroyNotify) wp_spa_pod_unref);
     g_task_return_pointer (task, params, (GDestroyNotify) g_ptr_array_unref);
   } else {
     g_autoptr (WpCore) core = wp_object_get_core (WP_OBJECT (obj));
@@ -209,10 +219,14 @@ wp_pw_object_mixin_enum_params_unchecked (gpointer obj,
     g_signal_connect_object (obj, "error", G_CALLBACK (enum_params_error),
         task, 0);
 
-    /* store */
-    g_task_set_task_data (task, params, (GDestroyNotify) g_ptr_array_unref);
+    /* store; the params are collected in a single buffer until the
+       enumeration is done */
+    g_task_set_task_data (task, wp_spa_pod_builder_new_raw (),
+        (GDestroyNotify) wp_spa_pod_builder_unref);
     g_task_set_source_tag (task, GINT_TO_POINTER (seq));
-    d->enum_params_tasks = g_list_append (d->enum_params_tasks, task);
+    if (!d->enum_params_tasks)
+      d->enum_params_tasks = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_hash_table_insert (d->enum_params_tasks, GINT_TO_POINTER (seq), task);
 
     /* call sync */
     wp_core_sync (core, cancellable, (GAsyncReadyCallback) enum_params_done,
@@ -358,9 +372,11 @@ wp_pw_object_mixin_data_free (gpointer data)
   WpPwObjectMixinData *d = data;
   spa_hook_list_clean (&d->hooks);
   g_clear_pointer (&d->properties, wp_properties_unref);
-  g_list_free_full (d->params, wp_pw_object_mixin_param_store_free);
+  g_clear_pointer (&d->params, g_hash_table_unref);
   g_clear_pointer (&d->subscribed_ids, g_array_unref);
-  g_warn_if_fail (d->enum_params_tasks == NULL);
+  g_warn_if_fail (!d->enum_params_tasks ||
+      g_hash_table_size (d->enum_params_tasks) == 0);
+  g_clear_pointer (&d->enum_params_tasks, g_hash_table_unref);
   g_slice_free (WpPwObjectMixinData, d);
 }
 
@@ -402,19 +418,17 @@ wp_pw_object_mixin_param_store_free (gpointer data)
   g_slice_free (WpPwObjectMixinParamStore, p);
 }
 
-static gint
-param_store_has_id (gconstpointer param, gconstpointer id)
+static inline WpPwObjectMixinParamStore *
+wp_pw_object_mixin_find_param_store (WpPwObjectMixinData * data, guint32 id)
 {
-  guint32 param_id = ((const WpPwObjectMixinParamStore *) param)->param_id;
-  return (param_id == GPOINTER_TO_UINT (id)) ? 0 : 1;
+  return data->params ?
+      g_hash_table_lookup (data->params, GUINT_TO_POINTER (id)) : NULL;
 }
 
 GPtrArray *
 wp_pw_object_mixin_get_stored_params (WpPwObjectMixinData * data, guint32 id)
 {
-  GList *link = g_list_find_custom (data->params, GUINT_TO_POINTER (id),
-      param_store_has_id);
-  WpPwObjectMixinParamStore *s = link ? link->data : NULL;
+  WpPwObjectMixinParamStore *s = wp_pw_object_mixin_find_param_store (data, id);
   return (s && s->params) ? g_ptr_array_ref (s->params) : NULL;
 }
 
@@ -422,24 +436,21 @@ void
 wp_pw_object_mixin_store_param (WpPwObjectMixinData * data, guint32 id,
     guint32 flags, gpointer param)
 {
-  GList *link = g_list_find_custom (data->params, GUINT_TO_POINTER (id),
-      param_store_has_id);
-  WpPwObjectMixinParamStore *s = link ? link->data : NULL;
+  WpPwObjectMixinParamStore *s = wp_pw_object_mixin_find_param_store (data, id);
   gint16 index = (gint16) (flags & 0xffff);
 
-  /* if the link exists, data must also exist */
-  g_warn_if_fail (!link || link->data);
-
   if (!s) {
     if (flags & WP_PW_OBJECT_MIXIN_STORE_PARAM_REMOVE)
       return;
     s = wp_pw_object_mixin_param_store_new ();
     s->param_id = id;
-    data->params = g_list_append (data->params, s);
+    if (!data->params)
+      data->params = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+          NULL, wp_pw_object_mixin_param_store_free);
+    g_hash_table_insert (data->params, GUINT_TO_POINTER (id), s);
   }
   else if (s && (flags & WP_PW_OBJECT_MIXIN_STORE_PARAM_REMOVE)) {
-    wp_pw_object_mixin_param_store_free (s);
-    data->params = g_list_delete_link (data->params, link);
+    g_hash_table_remove (data->params, GUINT_TO_POINTER (id));
     return;
   }
 
@@ -574,6 +585,31 @@ wp_pw_object_mixin_activate_get_next_step (WpObject * object,
   /* returning to STEP_NONE is handled by WpFeatureActivationTransition */
 }
 
+/* compares \a params with the stored params of \a id and returns FALSE
+   if they are the same; otherwise, \a changed is set to the indices that
+   differ, including the ones that do not exist anymore */
+static gboolean
+wp_pw_object_mixin_diff_params (WpPwObjectMixinData * d, guint32 id,
+    GPtrArray * params, GArray ** changed)
+{
+  WpPwObjectMixinParamStore *s = wp_pw_object_mixin_find_param_store (d, id);
+  guint old_len = (s && s->params) ? s->params->len : 0;
+  guint len = MAX (old_len, params->len);
+
+  *changed = g_array_sized_new (FALSE, FALSE, sizeof (guint32),
+      MAX (len, 1));
+
+  for (guint32 i = 0; i < len; i++) {
+    if (i >= old_len || i >= params->len ||
+        !wp_spa_pod_equal (g_ptr_array_index (s->params, i),
+            g_ptr_array_index (params, i)))
+      g_array_append_val (*changed, i);
+  }
+
+  /* the first time, there is always a change, even if there are no params */
+  return !s || (*changed)->len > 0;
+}
+
 static void
 enum_params_for_cache_done (GObject * object, GAsyncResult * res, gpointer data)
 {
@@ -581,6 +617,7 @@ enum_params_for_cache_done (GObject * object, GAsyncResult * res, gpointer data)
   guint32 param_id = GPOINTER_TO_UINT (data);
   g_autoptr (GError) error = NULL;
   g_autoptr (GPtrArray) params = NULL;
+  g_autoptr (GArray) changed = NULL;
   const gchar *name = NULL;
 
   params = g_task_propagate_pointer (G_TASK (res), &error);
@@ -592,8 +629,15 @@ enum_params_for_cache_done (GObject * object, GAsyncResult * res, gpointer data)
   name = wp_spa_id_value_short_name (wp_spa_id_value_from_number (
         "Spa:Enum:ParamId", param_id));
 
-  wp_debug_object (object, "cached params id:%u (%s), n_params:%u", param_id,
-      name, params->len);
+  /* compare with the cached params, if any, to find which ones changed */
+  if (!wp_pw_object_mixin_diff_params (d, param_id, params, &changed)) {
+    wp_debug_object (object, "params id:%u (%s) are unchanged, n_params:%u",
+        param_id, name, params->len);
+    return;
+  }
+
+  wp_debug_object (object, "cached params id:%u (%s), n_params:%u, "
+      "n_changed:%u", param_id, name, params->len, changed->len);
 
   wp_pw_object_mixin_store_param (d, param_id,
       WP_PW_OBJECT_MIXIN_STORE_PARAM_ARRAY |
@@ -601,6 +645,9 @@ enum_params_for_cache_done (GObject * object, GAsyncResult * res, gpointer data)
       WP_PW_OBJECT_MIXIN_STORE_PARAM_APPEND,
       g_steal_pointer (&params));
 
+  g_signal_emit_by_name (object, "params-updated", name,
+      g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32, changed->data,
+          changed->len, sizeof (guint32)));
   g_signal_emit_by_name (object, "params-changed", name);
 }
 
@@ -699,17 +746,17 @@ wp_pw_object_mixin_handle_pw_proxy_destroyed (WpProxy * proxy)
     }
   }
 
-  /* cancel enum_params tasks */
-  {
-    GList *link;
-    for (link = g_list_first (d->enum_params_tasks);
-         link; link = g_list_first (d->enum_params_tasks)) {
-      GTask *task = G_TASK (link->data);
-      d->enum_params_tasks = g_list_delete_link (d->enum_params_tasks, link);
-      g_task_return_new_error (task,
+  /* cancel enum_params tasks; they are removed from the table first, as
+     returning may start new ones */
+  if (d->enum_params_tasks) {
+    GList *tasks = g_hash_table_get_values (d->enum_params_tasks);
+    g_hash_table_remove_all (d->enum_params_tasks);
+    for (GList *link = tasks; link; link = g_list_next (link)) {
+      g_task_return_new_error (G_TASK (link->data),
           WP_DOMAIN_LIBRARY, WP_LIBRARY_ERROR_OPERATION_FAILED,
           "pipewire proxy destroyed before finishing");
     }
+    g_list_free (tasks);
   }
 
   wp_object_update_features (WP_OBJECT (proxy), 0,
@@ -801,33 +848,24 @@ wp_pw_object_mixin_handle_event_info (gpointer instance, gconstpointer update)
       WP_PIPEWIRE_OBJECT_FEATURE_INFO, 0);
 }
 
-static gint
-task_has_seq (gconstpointer task, gconstpointer seq)
-{
-  gpointer t_seq = g_task_get_source_tag (G_TASK (task));
-  return (GPOINTER_TO_INT (t_seq) == GPOINTER_TO_INT (seq)) ? 0 : 1;
-}
-
 void
 wp_pw_object_mixin_handle_event_param (gpointer instance, int seq,
     uint32_t id, uint32_t index, uint32_t next, const struct spa_pod *param)
 {
   WpPwObjectMixinData *d = wp_pw_object_mixin_get_data (instance);
-  g_autoptr (WpSpaPod) w_param = wp_spa_pod_new_wrap_const (param);
-  GList *list;
-  GTask *task;
-
-  list = g_list_find_custom (d->enum_params_tasks, GINT_TO_POINTER (seq),
-      task_has_seq);
-  task = list ? G_TASK (list->data) : NULL;
-
-  wp_trace_boxed (WP_TYPE_SPA_POD, w_param,
-      WP_OBJECT_FORMAT " param id:%u, index:%u",
-      WP_OBJECT_ARGS (instance), id, index);
+  GTask *task = d->enum_params_tasks ?
+      g_hash_table_lookup (d->enum_params_tasks, GINT_TO_POINTER (seq)) : NULL;
+
+  if (wp_log_level_is_enabled (WP_LOG_LEVEL_TRACE)) {
+    g_autoptr (WpSpaPod) w_param = wp_spa_pod_new_wrap_const (param);
+    wp_trace_boxed (WP_TYPE_SPA_POD, w_param,
+        WP_OBJECT_FORMAT " param id:%u, index:%u",
+        WP_OBJECT_ARGS (instance), id, index);
+  }
 
   if (task) {
-    GPtrArray *array = g_task_get_task_data (task);
-    g_ptr_array_add (array, wp_spa_pod_copy (w_param));
+    WpSpaPodBuilder *params = g_task_get_task_data (task);
+    wp_spa_pod_builder_append_spa_pod (params, param);
   } else {
     /* this should never happen */
     wp_warning_object (instance,
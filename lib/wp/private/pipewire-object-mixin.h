@@ -126,8 +126,8 @@ struct _WpPwObjectMixinData
   struct spa_hook listener;
   struct spa_hook_list hooks;
   WpProperties *properties;
-  GList *enum_params_tasks;  /* element-type: GTask* */
-  GList *params;             /* element-type: WpPwObjectMixinParamStore* */
+  GHashTable *enum_params_tasks; /* seq -> GTask* */
+  GHashTable *params;       /* param id -> WpPwObjectMixinParamStore* */
   GArray *subscribed_ids;    /* element-type: guint32 */
 };
 
@@ -11,6 +11,7 @@
 
 #include "core.h"
 #include "global-proxy.h"
+#include "object-interest.h"
 
 #include <pipewire/pipewire.h>
 
@@ -30,6 +31,12 @@ struct _WpRegistry
   GPtrArray *tmp_globals; // elementy-type: WpGlobal*
   GPtrArray *objects; // element-type: GObject*
   GPtrArray *object_managers; // element-type: WpObjectManager*
+
+  /* interest index, used to find the object managers that may be interested
+     in a new object without checking the interests of all of them */
+  GHashTable *om_types_index; // GType -> GPtrArray<WpObjectManager*>
+  GHashTable *om_props_index; // subject -> WpRegistryPropsIndex*
+  guint dispatch_seq;
 };
 
 void wp_registry_init (WpRegistry *self);
@@ -53,6 +60,15 @@ WpCore * wp_registry_get_core (WpRegistry * self) G_GNUC_CONST;
 
 WpRegistry * wp_core_get_registry (WpCore * self) G_GNUC_CONST;
 
+/* object interest */
+
+GType wp_object_interest_get_gtype (WpObjectInterest * self);
+gboolean wp_object_interest_find_index_key (WpObjectInterest * self,
+    const gchar ** subject, gchar ** value, gboolean * numeric);
+gboolean wp_object_interest_find_equals_value (WpObjectInterest * self,
+    WpConstraintType type, const gchar * subject, gchar ** value,
+    gboolean * numeric);
+
 /* global */
 
 typedef enum {
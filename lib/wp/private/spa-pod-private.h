@@ -0,0 +1,38 @@
+/* WirePlumber
+ *
+ * Copyright © 2021 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __WIREPLUMBER_PRIVATE_SPA_POD_PRIVATE_H__
+#define __WIREPLUMBER_PRIVATE_SPA_POD_PRIVATE_H__
+
+#include "spa-pod.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Raw builders collect a sequence of independent pods in a single buffer.
+ * wp_spa_pod_builder_end_pods() returns them as WpSpaPod objects that all
+ * keep the same buffer alive, instead of owning one copy each. They are
+ * exported only for the unit tests.
+ */
+
+WP_PRIVATE_API WP_API
+WpSpaPodBuilder * wp_spa_pod_builder_new_raw (void);
+
+WP_PRIVATE_API WP_API
+void wp_spa_pod_builder_append_spa_pod (WpSpaPodBuilder *self,
+    const struct spa_pod *pod);
+
+WP_PRIVATE_API WP_API
+guint wp_spa_pod_builder_get_n_pods (WpSpaPodBuilder *self);
+
+/* (transfer full) (element-type WpSpaPod) */
+WP_PRIVATE_API WP_API
+GPtrArray * wp_spa_pod_builder_end_pods (WpSpaPodBuilder *self);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,106 @@
+/* WirePlumber
+ *
+ * Copyright © 2021 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef __WIREPLUMBER_TRACE_FORMAT_H__
+#define __WIREPLUMBER_TRACE_FORMAT_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Binary trace file format, shared between the trace sink in log.c and
+ * the wptrace decoder.
+ *
+ * The file consists of a header page, followed by an append-only string
+ * table and a ring of fixed-size record slots. Records refer to domains,
+ * code locations and type names by the id of their entry in the string
+ * table. A record is valid when its seq field is non-zero; the record with
+ * sequence number N (starting from 1) lives in slot (N - 1) % n_slots.
+ */
+
+#define WP_TRACE_MAGIC "WPTRACE"
+#define WP_TRACE_VERSION 1
+#define WP_TRACE_HEADER_SIZE 4096
+
+#define WP_TRACE_STRING_NONE 0
+
+#define WP_TRACE_RECORD_FLAG_TRUNCATED (1 << 0)
+
+struct wp_trace_header
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 slot_size;
+  guint32 n_slots;
+  guint32 strings_size;
+  /* number of bytes in the string table; updated after an entry is
+     completely written */
+  guint32 strings_used;
+  guint32 reserved;
+  /* number of records written so far */
+  guint64 seq;
+  /* clocks at the time the file was created, in microseconds */
+  gint64 start_realtime;
+  gint64 start_monotonic;
+};
+
+struct wp_trace_string
+{
+  guint32 id;
+  guint32 len;
+  /* followed by len bytes of text and padding up to 4-byte alignment */
+  gchar text[];
+};
+
+struct wp_trace_record
+{
+  /* written last, after the rest of the record */
+  guint64 seq;
+  /* monotonic time, in microseconds */
+  gint64 time;
+  guint64 object;
+  guint32 bound_id;
+  guint32 type_id;
+  guint32 domain_id;
+  guint32 location_id;
+  guint16 level;
+  guint16 payload_len;
+  guint32 flags;
+  gchar payload[];
+};
+
+static inline gsize
+wp_trace_string_entry_size (guint32 len)
+{
+  return sizeof (struct wp_trace_string) + ((len + 3) & ~3u);
+}
+
+static inline gsize
+wp_trace_file_size (const struct wp_trace_header * h)
+{
+  return WP_TRACE_HEADER_SIZE + (gsize) h->strings_size +
+      (gsize) h->slot_size * h->n_slots;
+}
+
+static inline const struct wp_trace_string *
+wp_trace_get_strings (const struct wp_trace_header * h)
+{
+  return (const struct wp_trace_string *)
+      ((const gchar *) h + WP_TRACE_HEADER_SIZE);
+}
+
+static inline struct wp_trace_record *
+wp_trace_get_slot (const struct wp_trace_header * h, guint64 index)
+{
+  return (struct wp_trace_record *) ((gchar *) h + WP_TRACE_HEADER_SIZE +
+      h->strings_size + (gsize) h->slot_size * (index % h->n_slots));
+}
+
+G_END_DECLS
+
+#endif
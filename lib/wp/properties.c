@@ -49,6 +49,22 @@ enum {
   FLAG_NO_OWNERSHIP = (1<<2),
 };
 
+/* sets with fewer items than this are searched linearly */
+#define INDEX_MIN_ITEMS 16
+
+/*
+ * Hash table view of the dictionary, mapping each key to its position in
+ * the items array. It is built on the first lookup in a large enough set and
+ * dropped whenever the set is modified through the WpProperties API.
+ * The items pointer and count are kept to detect a dictionary that was
+ * changed behind our back, in which case the index is not used.
+ */
+typedef struct {
+  const struct spa_dict_item *items;
+  guint32 n_items;
+  GHashTable *table; /* key -> GUINT_TO_POINTER (position + 1) */
+} PropertiesIndex;
+
 struct _WpProperties
 {
   grefcount ref;
@@ -57,10 +73,76 @@ struct _WpProperties
     struct pw_properties *props;
     const struct spa_dict *dict;
   };
+  PropertiesIndex *index;
 };
 
 G_DEFINE_BOXED_TYPE(WpProperties, wp_properties, wp_properties_ref, wp_properties_unref)
 
+static void
+properties_index_free (PropertiesIndex * index)
+{
+  g_hash_table_unref (index->table);
+  g_slice_free (PropertiesIndex, index);
+}
+
+static PropertiesIndex *
+properties_index_new (const struct spa_dict * dict)
+{
+  PropertiesIndex *index = g_slice_new (PropertiesIndex);
+
+  index->items = dict->items;
+  index->n_items = dict->n_items;
+  index->table = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* insert backwards, so that the first of duplicate keys wins,
+     like in spa_dict_lookup() */
+  for (guint32 i = dict->n_items; i > 0; i--)
+    g_hash_table_insert (index->table, (gpointer) dict->items[i - 1].key,
+        GUINT_TO_POINTER (i));
+  return index;
+}
+
+static inline void
+wp_properties_invalidate_index (WpProperties * self)
+{
+  g_clear_pointer (&self->index, properties_index_free);
+}
+
+static const gchar *
+wp_properties_lookup (WpProperties * self, const gchar * key)
+{
+  const struct spa_dict *dict = wp_properties_peek_dict (self);
+  PropertiesIndex *index;
+  gpointer pos;
+
+  /* small or sorted sets are fast enough to search directly; wrapped
+     pw_properties may change without notice, so they are never indexed */
+  if (dict->n_items < INDEX_MIN_ITEMS ||
+      (dict->flags & SPA_DICT_FLAG_SORTED) ||
+      (self->flags & (FLAG_IS_DICT | FLAG_NO_OWNERSHIP)) == FLAG_NO_OWNERSHIP)
+    return spa_dict_lookup (dict, key);
+
+  /* lookups do not require exclusive access, so the index may be built
+     concurrently; the first one to be installed wins */
+  index = g_atomic_pointer_get (&self->index);
+  if (!index) {
+    PropertiesIndex *new_index = properties_index_new (dict);
+    if (g_atomic_pointer_compare_and_exchange (&self->index, NULL, new_index))
+      index = new_index;
+    else {
+      properties_index_free (new_index);
+      index = g_atomic_pointer_get (&self->index);
+    }
+  }
+
+  if (G_UNLIKELY (index->items != dict->items ||
+                  index->n_items != dict->n_items))
+    return spa_dict_lookup (dict, key);
+
+  pos = g_hash_table_lookup (index->table, key);
+  return pos ? dict->items[GPOINTER_TO_UINT (pos) - 1].value : NULL;
+}
+
 /*!
  * \brief Creates a new empty properties set
  * \ingroup wpproperties
@@ -295,6 +377,7 @@ wp_properties_copy (WpProperties * other)
 static void
 wp_properties_free (WpProperties * self)
 {
+  wp_properties_invalidate_index (self);
   if (!(self->flags & FLAG_NO_OWNERSHIP))
     pw_properties_free (self->props);
   g_slice_free (WpProperties, self);
@@ -372,6 +455,7 @@ wp_properties_update (WpProperties * self, WpProperties * props)
   g_return_val_if_fail (!(self->flags & FLAG_IS_DICT), -EINVAL);
   g_return_val_if_fail (!(self->flags & FLAG_NO_OWNERSHIP), -EINVAL);
 
+  wp_properties_invalidate_index (self);
   return pw_properties_update (self->props, wp_properties_peek_dict (props));
 }
 
@@ -394,6 +478,7 @@ wp_properties_update_from_dict (WpProperties * self,
   g_return_val_if_fail (!(self->flags & FLAG_IS_DICT), -EINVAL);
   g_return_val_if_fail (!(self->flags & FLAG_NO_OWNERSHIP), -EINVAL);
 
+  wp_properties_invalidate_index (self);
   return pw_properties_update (self->props, dict);
 }
 
@@ -416,6 +501,7 @@ wp_properties_add (WpProperties * self, WpProperties * props)
   g_return_val_if_fail (!(self->flags & FLAG_IS_DICT), -EINVAL);
   g_return_val_if_fail (!(self->flags & FLAG_NO_OWNERSHIP), -EINVAL);
 
+  wp_properties_invalidate_index (self);
   return pw_properties_add (self->props, wp_properties_peek_dict (props));
 }
 
@@ -439,6 +525,7 @@ wp_properties_add_from_dict (WpProperties * self,
   g_return_val_if_fail (!(self->flags & FLAG_IS_DICT), -EINVAL);
   g_return_val_if_fail (!(self->flags & FLAG_NO_OWNERSHIP), -EINVAL);
 
+  wp_properties_invalidate_index (self);
   return pw_properties_add (self->props, dict);
 }
 
@@ -530,6 +617,7 @@ wp_properties_update_keys_array (WpProperties * self, WpProperties * props,
   g_return_val_if_fail (!(self->flags & FLAG_IS_DICT), -EINVAL);
   g_return_val_if_fail (!(self->flags & FLAG_NO_OWNERSHIP), -EINVAL);
 
+  wp_properties_invalidate_index (self);
   return pw_properties_update_keys (self->props,
       wp_properties_peek_dict (props), keys);
 }
@@ -624,6 +712,7 @@ wp_properties_add_keys_array (WpProperties * self, WpProperties * props,
   g_return_val_if_fail (!(self->flags & FLAG_IS_DICT), -EINVAL);
   g_return_val_if_fail (!(self->flags & FLAG_NO_OWNERSHIP), -EINVAL);
 
+  wp_properties_invalidate_index (self);
   return pw_properties_add_keys (self->props,
       wp_properties_peek_dict (props), keys);
 }
@@ -643,7 +732,7 @@ wp_properties_get (WpProperties * self, const gchar * key)
   g_return_val_if_fail (self != NULL, NULL);
   g_return_val_if_fail (key != NULL, NULL);
 
-  return spa_dict_lookup (wp_properties_peek_dict (self), key);
+  return wp_properties_lookup (self, key);
 }
 
 /*!
@@ -669,6 +758,7 @@ wp_properties_set (WpProperties * self, const gchar * key,
   g_return_val_if_fail (!(self->flags & FLAG_IS_DICT), -EINVAL);
   g_return_val_if_fail (!(self->flags & FLAG_NO_OWNERSHIP), -EINVAL);
 
+  wp_properties_invalidate_index (self);
   return pw_properties_set (self->props, key, value);
 }
 
@@ -719,6 +809,7 @@ wp_properties_setf_valist (WpProperties * self, const gchar * key,
   g_return_val_if_fail (!(self->flags & FLAG_IS_DICT), -EINVAL);
   g_return_val_if_fail (!(self->flags & FLAG_NO_OWNERSHIP), -EINVAL);
 
+  wp_properties_invalidate_index (self);
   return pw_properties_setva (self->props, key, format, args);
 }
 
@@ -956,6 +1047,7 @@ wp_properties_sort (WpProperties * self)
   g_return_if_fail (!(self->flags & FLAG_IS_DICT));
   g_return_if_fail (!(self->flags & FLAG_NO_OWNERSHIP));
 
+  wp_properties_invalidate_index (self);
   return spa_dict_qsort (&self->props->dict);
 }
 
@@ -54,6 +54,29 @@
  *
  * Flags: G_SIGNAL_RUN_FIRST
  * \endparblock
+ *
+ * \par params-updated
+ * \parblock
+ * \code
+ * params_updated_callback (WpPipewireObject * self,
+ *                          const gchar *id,
+ *                          GVariant *indices,
+ *                          gpointer user_data)
+ * \endcode
+ *
+ * Emitted right before params-changed on proxies that cache params, with
+ * the positions of the cached params that changed. Params are compared with
+ * the previously cached ones and neither signal is emitted if none of them
+ * has changed.
+ *
+ * Parameters:
+ * - `id` - the parameter id as a string (ex "Props", "EnumRoute")
+ * - `indices` - the indices of the params that were added, removed or
+ *   modified, as an array of unsigned integers (GVariant type "au")
+ *
+ * Flags: G_SIGNAL_RUN_FIRST
+ * \since 0.4.15
+ * \endparblock
  */
 
 G_DEFINE_INTERFACE (WpPipewireObject, wp_pipewire_object, WP_TYPE_PROXY)
@@ -78,6 +101,10 @@ wp_pipewire_object_default_init (WpPipewireObjectInterface * iface)
 
   g_signal_new ("params-changed", G_TYPE_FROM_INTERFACE (iface),
       G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_STRING);
+
+  g_signal_new ("params-updated", G_TYPE_FROM_INTERFACE (iface),
+      G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 2, G_TYPE_STRING,
+      G_TYPE_VARIANT);
 }
 
 /*!
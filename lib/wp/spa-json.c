@@ -8,6 +8,8 @@
 
 #define G_LOG_DOMAIN "wp-spa-json"
 
+#include <math.h>
+
 #include <spa/utils/defs.h>
 #include <spa/utils/json.h>
 
@@ -64,12 +66,19 @@ struct _WpSpaJson
 
 G_DEFINE_BOXED_TYPE (WpSpaJson, wp_spa_json, wp_spa_json_ref, wp_spa_json_unref)
 
+#define WP_SPA_JSON_BUILDER_MAX_NESTING 64
+
 struct _WpSpaJsonBuilder
 {
   gboolean add_separator;
   gchar *data;
   size_t size;
   size_t max_size;
+
+  /* containers opened with _open_array() and _open_object(); bit N of
+     nest_objects is set if the container at depth N+1 is an object */
+  guint nest_depth;
+  guint64 nest_objects;
 };
 
 G_DEFINE_BOXED_TYPE (WpSpaJsonBuilder, wp_spa_json_builder,
@@ -932,6 +941,18 @@ wp_spa_json_builder_unref (WpSpaJsonBuilder *self)
   g_rc_box_release_full (self, (GDestroyNotify) wp_spa_json_builder_free);
 }
 
+static WpSpaJsonBuilder *
+wp_spa_json_builder_new_container (gchar open, size_t size)
+{
+  WpSpaJsonBuilder *self = g_rc_box_new0 (WpSpaJsonBuilder);
+  self->add_separator = FALSE;
+  self->data = g_new0 (gchar, size);
+  self->max_size = size;
+  self->data[0] = open;
+  self->size = 1;
+  return self;
+}
+
 /*!
  * \brief Creates a spa json builder of type array
  *
@@ -941,13 +962,26 @@ wp_spa_json_builder_unref (WpSpaJsonBuilder *self)
 WpSpaJsonBuilder *
 wp_spa_json_builder_new_array (void)
 {
-  WpSpaJsonBuilder *self = g_rc_box_new0 (WpSpaJsonBuilder);
-  self->add_separator = FALSE;
-  self->data = g_new0 (gchar, WP_SPA_JSON_BUILDER_INIT_SIZE);
-  self->max_size = WP_SPA_JSON_BUILDER_INIT_SIZE;
-  self->data[0] = '[';
-  self->size = 1;
-  return self;
+  return wp_spa_json_builder_new_container ('[',
+      WP_SPA_JSON_BUILDER_INIT_SIZE);
+}
+
+/*!
+ * \brief Creates a spa json builder of type array with a preallocated buffer
+ *
+ * When the final size of the json is known or can be estimated, this avoids
+ * growing the buffer of the builder while adding values.
+ *
+ * \ingroup wpspajson
+ * \param size_hint the expected size of the json data, in bytes
+ * \returns (transfer full): the new spa json builder
+ * \since 0.4.15
+ */
+WpSpaJsonBuilder *
+wp_spa_json_builder_new_array_sized (size_t size_hint)
+{
+  return wp_spa_json_builder_new_container ('[',
+      MAX (size_hint + 1, WP_SPA_JSON_BUILDER_INIT_SIZE));
 }
 
 /*!
@@ -959,20 +993,43 @@ wp_spa_json_builder_new_array (void)
 WpSpaJsonBuilder *
 wp_spa_json_builder_new_object (void)
 {
-  WpSpaJsonBuilder *self = g_rc_box_new0 (WpSpaJsonBuilder);
-  self->add_separator = FALSE;
-  self->data = g_new0 (gchar, WP_SPA_JSON_BUILDER_INIT_SIZE);
-  self->max_size = WP_SPA_JSON_BUILDER_INIT_SIZE;
-  self->data[0] = '{';
-  self->size = 1;
-  return self;
+  return wp_spa_json_builder_new_container ('{',
+      WP_SPA_JSON_BUILDER_INIT_SIZE);
+}
+
+/*!
+ * \brief Creates a spa json builder of type object with a preallocated buffer
+ *
+ * When the final size of the json is known or can be estimated, this avoids
+ * growing the buffer of the builder while adding values.
+ *
+ * \ingroup wpspajson
+ * \param size_hint the expected size of the json data, in bytes
+ * \returns (transfer full): the new spa json builder
+ * \since 0.4.15
+ */
+WpSpaJsonBuilder *
+wp_spa_json_builder_new_object_sized (size_t size_hint)
+{
+  return wp_spa_json_builder_new_container ('{',
+      MAX (size_hint + 1, WP_SPA_JSON_BUILDER_INIT_SIZE));
+}
+
+static gchar
+builder_get_container (WpSpaJsonBuilder *self)
+{
+  if (self->nest_depth > 0)
+    return (self->nest_objects &
+        (G_GUINT64_CONSTANT (1) << (self->nest_depth - 1))) ? '{' : '[';
+  return self->data[0];
 }
 
 static void
 ensure_separator (WpSpaJsonBuilder *self, gboolean for_property)
 {
-  gboolean insert = (self->data[0] == '{' && for_property) ||
-      (self->data[0] == '[' && !for_property);
+  gchar container = builder_get_container (self);
+  gboolean insert = (container == '{' && for_property) ||
+      (container == '[' && !for_property);
   if (insert) {
     if (self->add_separator) {
       ensure_allocated_max_size (self, 2);
@@ -1087,6 +1144,52 @@ wp_spa_json_builder_add_float (WpSpaJsonBuilder *self, float value)
   builder_add_formatted (self, "%.6f", value);
 }
 
+/*!
+ * \brief Adds a 64-bit integer value into the builder
+ *
+ * \ingroup wpspajson
+ * \param self the spa json builder object
+ * \param value the integer value
+ * \since 0.4.15
+ */
+void
+wp_spa_json_builder_add_int64 (WpSpaJsonBuilder *self, gint64 value)
+{
+  ensure_separator (self, FALSE);
+  ensure_allocated_max_size (self, 24);
+  builder_add_formatted (self, "%" G_GINT64_FORMAT, value);
+}
+
+/*!
+ * \brief Adds a double precision floating point value into the builder
+ *
+ * Unlike wp_spa_json_builder_add_float(), the value is written with as many
+ * digits as needed to parse it back to the same double, and it always
+ * contains a decimal point or an exponent, so that it is never parsed back
+ * as an integer. Infinity and NaN have no json representation and are
+ * written as null.
+ *
+ * \ingroup wpspajson
+ * \param self the spa json builder object
+ * \param value the double value
+ * \since 0.4.15
+ */
+void
+wp_spa_json_builder_add_double (WpSpaJsonBuilder *self, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  if (!isfinite (value)) {
+    wp_spa_json_builder_add_null (self);
+    return;
+  }
+
+  g_ascii_dtostr (buf, sizeof (buf), value);
+  ensure_separator (self, FALSE);
+  ensure_allocated_max_size (self, sizeof (buf) + 2);
+  builder_add_formatted (self, "%s%s", buf, strpbrk (buf, ".eE") ? "" : ".0");
+}
+
 /*!
  * \brief Adds a string value into the builder
  *
@@ -1125,6 +1228,82 @@ wp_spa_json_builder_add_json (WpSpaJsonBuilder *self, WpSpaJson *json)
   builder_add_json (self, json);
 }
 
+static void
+builder_open (WpSpaJsonBuilder *self, gchar open)
+{
+  guint64 bit = G_GUINT64_CONSTANT (1) << self->nest_depth;
+
+  g_return_if_fail (self->nest_depth < WP_SPA_JSON_BUILDER_MAX_NESTING);
+
+  ensure_separator (self, FALSE);
+  ensure_allocated_max_size (self, 1);
+  self->data[self->size++] = open;
+
+  if (open == '{')
+    self->nest_objects |= bit;
+  else
+    self->nest_objects &= ~bit;
+  self->nest_depth++;
+  self->add_separator = FALSE;
+}
+
+/*!
+ * \brief Opens a nested array in the builder
+ *
+ * Values added after this call are added into the nested array, until it is
+ * closed with wp_spa_json_builder_close(). This allows building nested json
+ * in a single buffer, without building and copying a separate json for each
+ * nested container.
+ *
+ * \ingroup wpspajson
+ * \param self the spa json builder object
+ * \since 0.4.15
+ */
+void
+wp_spa_json_builder_open_array (WpSpaJsonBuilder *self)
+{
+  builder_open (self, '[');
+}
+
+/*!
+ * \brief Opens a nested object in the builder
+ *
+ * Properties and values added after this call are added into the nested
+ * object, until it is closed with wp_spa_json_builder_close().
+ *
+ * \ingroup wpspajson
+ * \param self the spa json builder object
+ * \since 0.4.15
+ */
+void
+wp_spa_json_builder_open_object (WpSpaJsonBuilder *self)
+{
+  builder_open (self, '{');
+}
+
+/*!
+ * \brief Closes the innermost nested array or object of the builder
+ *
+ * \ingroup wpspajson
+ * \param self the spa json builder object
+ * \since 0.4.15
+ */
+void
+wp_spa_json_builder_close (WpSpaJsonBuilder *self)
+{
+  gchar close;
+
+  g_return_if_fail (self->nest_depth > 0);
+
+  close = (builder_get_container (self) == '{') ? '}' : ']';
+  ensure_allocated_max_size (self, 1);
+  self->data[self->size++] = close;
+  self->nest_depth--;
+
+  /* the closed container is a value of its parent */
+  self->add_separator = TRUE;
+}
+
 /*!
  * \brief Adds values into the builder
  *
@@ -1155,7 +1334,7 @@ wp_spa_json_builder_add_valist (WpSpaJsonBuilder *self, va_list args)
     const char *format = NULL;
 
     /* add property key if object */
-    if (self->data[0] == '{') {
+    if (builder_get_container (self) == '{') {
       const gchar *key = va_arg(args, const gchar *);
       if (!key)
         return;
@@ -1172,17 +1351,12 @@ wp_spa_json_builder_add_valist (WpSpaJsonBuilder *self, va_list args)
   } while (TRUE);
 }
 
-/*!
- * \brief Ends the builder process and returns the constructed spa json object
- *
- * \ingroup wpspajson
- * \param self the spa json builder object
- * \returns (transfer full): the constructed spa json object
- */
-WpSpaJson *
-wp_spa_json_builder_end (WpSpaJsonBuilder *self)
+static void
+builder_finish (WpSpaJsonBuilder *self)
 {
-  /* close */
+  while (self->nest_depth > 0)
+    wp_spa_json_builder_close (self);
+
   switch (self->data[0]) {
     case '[':  /* array */
       ensure_allocated_max_size (self, 2);
@@ -1197,10 +1371,52 @@ wp_spa_json_builder_end (WpSpaJsonBuilder *self)
     default:
       break;
   }
+}
 
+/*!
+ * \brief Ends the builder process and returns the constructed spa json object
+ *
+ * \ingroup wpspajson
+ * \param self the spa json builder object
+ * \returns (transfer full): the constructed spa json object
+ */
+WpSpaJson *
+wp_spa_json_builder_end (WpSpaJsonBuilder *self)
+{
+  builder_finish (self);
   return wp_spa_json_new_from_builder (wp_spa_json_builder_ref (self));
 }
 
+/*!
+ * \brief Ends the builder process and returns the constructed json string
+ *
+ * Unlike wp_spa_json_builder_end(), the buffer of the builder is handed
+ * over to the caller without being copied or wrapped in a WpSpaJson. The
+ * builder is left empty and cannot be used to add more values afterwards.
+ * This must not be called on a builder that has already been ended with
+ * wp_spa_json_builder_end(), as the returned WpSpaJson references the same
+ * buffer.
+ *
+ * \ingroup wpspajson
+ * \param self the spa json builder object
+ * \param size (out) (optional): the location to store the size of the
+ *   returned string, without the terminating null byte
+ * \returns (transfer full): the constructed json string
+ * \since 0.4.15
+ */
+gchar *
+wp_spa_json_builder_end_take (WpSpaJsonBuilder *self, size_t *size)
+{
+  g_return_val_if_fail (self->data, NULL);
+
+  builder_finish (self);
+  if (size)
+    *size = self->size;
+  self->size = 0;
+  self->max_size = 0;
+  return g_steal_pointer (&self->data);
+}
+
 /*!
  * \brief Increases the reference count of a spa json parser
  *
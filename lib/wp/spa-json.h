@@ -169,9 +169,15 @@ void wp_spa_json_builder_unref (WpSpaJsonBuilder *self);
 WP_API
 WpSpaJsonBuilder *wp_spa_json_builder_new_array (void);
 
+WP_API
+WpSpaJsonBuilder *wp_spa_json_builder_new_array_sized (size_t size_hint);
+
 WP_API
 WpSpaJsonBuilder *wp_spa_json_builder_new_object (void);
 
+WP_API
+WpSpaJsonBuilder *wp_spa_json_builder_new_object_sized (size_t size_hint);
+
 WP_API
 void wp_spa_json_builder_add_property (WpSpaJsonBuilder *self, const gchar *key);
 
@@ -187,12 +193,27 @@ void wp_spa_json_builder_add_int (WpSpaJsonBuilder *self, gint value);
 WP_API
 void wp_spa_json_builder_add_float (WpSpaJsonBuilder *self, float value);
 
+WP_API
+void wp_spa_json_builder_add_int64 (WpSpaJsonBuilder *self, gint64 value);
+
+WP_API
+void wp_spa_json_builder_add_double (WpSpaJsonBuilder *self, gdouble value);
+
 WP_API
 void wp_spa_json_builder_add_string (WpSpaJsonBuilder *self, const gchar *value);
 
 WP_API
 void wp_spa_json_builder_add_json (WpSpaJsonBuilder *self, WpSpaJson *json);
 
+WP_API
+void wp_spa_json_builder_open_array (WpSpaJsonBuilder *self);
+
+WP_API
+void wp_spa_json_builder_open_object (WpSpaJsonBuilder *self);
+
+WP_API
+void wp_spa_json_builder_close (WpSpaJsonBuilder *self);
+
 WP_API
 void wp_spa_json_builder_add (WpSpaJsonBuilder *self, ...)
     G_GNUC_NULL_TERMINATED;
@@ -203,6 +224,9 @@ void wp_spa_json_builder_add_valist (WpSpaJsonBuilder *self, va_list args);
 WP_API
 WpSpaJson *wp_spa_json_builder_end (WpSpaJsonBuilder *self);
 
+WP_API
+gchar *wp_spa_json_builder_end_take (WpSpaJsonBuilder *self, size_t *size);
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (WpSpaJsonBuilder, wp_spa_json_builder_unref)
 
 /*!
@@ -10,13 +10,20 @@
 
 #include "spa-pod.h"
 #include "spa-type.h"
+#include "private/spa-pod-private.h"
 
 #include <spa/utils/type-info.h>
 #include <spa/pod/builder.h>
 #include <spa/pod/parser.h>
 #include <spa/pod/filter.h>
 
-#define WP_SPA_POD_BUILDER_REALLOC_STEP_SIZE 64
+/* builders start with an inline buffer of this size and double it on
+   overflow; most of the pods that WirePlumber builds fit in it */
+#define WP_SPA_POD_BUILDER_INLINE_SIZE 256
+/* the number of nested frames a builder can have open without allocating */
+#define WP_SPA_POD_BUILDER_INLINE_DEPTH 4
+/* the maximum number of unused builders kept per thread for reuse */
+#define WP_SPA_POD_BUILDER_CACHE_SIZE 16
 #define WP_SPA_POD_ID_PROPERTY_NAME_MAX 16
 
 /*! \defgroup wpspapod WpSpaPod */
@@ -32,7 +39,8 @@
 
 enum {
   FLAG_NO_OWNERSHIP = (1 << 0),
-  FLAG_CONSTANT = (1 << 1)
+  FLAG_CONSTANT = (1 << 1),
+  FLAG_OWNED_DATA = (1 << 2), /* pod is a copy of exactly its own size */
 };
 
 typedef enum {
@@ -75,19 +83,37 @@ struct _WpSpaPod
       enum spa_control_type type;
     } data_control;          /* Only used for control pods */
   } static_pod;              /* Only used for statically allocated pods */
-  WpSpaPodBuilder *builder;  /* Only used for dynamically allocated pods */
+  WpSpaPodBuilder *builder;  /* Only used for pods built with a builder */
   struct spa_pod *pod;
 };
 
 G_DEFINE_BOXED_TYPE (WpSpaPod, wp_spa_pod, wp_spa_pod_ref, wp_spa_pod_unref)
 
+typedef struct {
+  struct spa_pod_frame frame;
+  WpSpaType type;
+} WpSpaPodBuilderFrame;
+
 struct _WpSpaPodBuilder
 {
+  grefcount ref;
   struct spa_pod_builder builder;
   struct spa_pod_frame frame;
   WpSpaType type;
   size_t size;
   guint8 *buf;
+
+  /* number of pods appended with wp_spa_pod_builder_append_spa_pod() */
+  guint n_pods;
+
+  /* nested frames, pushed with wp_spa_pod_builder_push_*(); the spa
+     builder links them by pointer, so the ones that do not fit inline are
+     allocated one by one, to never move them */
+  guint depth;
+  WpSpaPodBuilderFrame frames[WP_SPA_POD_BUILDER_INLINE_DEPTH];
+  GPtrArray *extra_frames; /* element-type: WpSpaPodBuilderFrame* */
+
+  guint8 inline_buf[WP_SPA_POD_BUILDER_INLINE_SIZE];
 };
 
 G_DEFINE_BOXED_TYPE (WpSpaPodBuilder, wp_spa_pod_builder,
@@ -108,9 +134,16 @@ static int
 wp_spa_pod_builder_overflow (gpointer data, uint32_t size)
 {
   WpSpaPodBuilder *self = data;
-  const uint32_t next_size = self->size + WP_SPA_POD_BUILDER_REALLOC_STEP_SIZE;
+  const uint32_t next_size = self->size * 2;
   const uint32_t new_size = size > next_size ? size : next_size;
-  self->buf = g_realloc (self->buf, new_size);
+
+  /* the frames refer to the data by offset, so moving it is fine */
+  if (self->buf == self->inline_buf) {
+    self->buf = g_malloc (new_size);
+    memcpy (self->buf, self->inline_buf, self->builder.state.offset);
+  } else {
+    self->buf = g_realloc (self->buf, new_size);
+  }
   self->builder.data = self->buf;
   self->builder.size = new_size;
   self->size = new_size;
@@ -122,20 +155,90 @@ static const struct spa_pod_builder_callbacks builder_callbacks = {
   .overflow = wp_spa_pod_builder_overflow
 };
 
+/*
+ * Builders are short-lived: most of them are created, filled and ended
+ * within a single function, and they are freed together with the last pod
+ * that was built with them. To avoid going to the allocator twice for each
+ * of them (plus reallocations as the pod grows), the buffer is inline for
+ * small pods and released builders are kept in a per-thread free list,
+ * from which new builders are taken.
+ */
+typedef struct {
+  guint n_items;
+  WpSpaPodBuilder *items[WP_SPA_POD_BUILDER_CACHE_SIZE];
+} WpSpaPodBuilderCache;
+
+static void
+wp_spa_pod_builder_cache_free (WpSpaPodBuilderCache *cache)
+{
+  for (guint i = 0; i < cache->n_items; i++)
+    g_free (cache->items[i]);
+  g_free (cache);
+}
+
+static GPrivate builder_cache =
+    G_PRIVATE_INIT ((GDestroyNotify) wp_spa_pod_builder_cache_free);
+
+static WpSpaPodBuilderCache *
+wp_spa_pod_builder_get_cache (void)
+{
+  WpSpaPodBuilderCache *cache = g_private_get (&builder_cache);
+  if (G_UNLIKELY (!cache)) {
+    cache = g_new0 (WpSpaPodBuilderCache, 1);
+    g_private_set (&builder_cache, cache);
+  }
+  return cache;
+}
+
 static WpSpaPodBuilder *
 wp_spa_pod_builder_new (size_t size, WpSpaType type)
 {
-  WpSpaPodBuilder *self = g_rc_box_new0 (WpSpaPodBuilder);
-  self->size = size;
-  self->buf = g_new0 (guint8, self->size);
-  self->builder = SPA_POD_BUILDER_INIT (self->buf, self->size);
+  WpSpaPodBuilderCache *cache = wp_spa_pod_builder_get_cache ();
+  WpSpaPodBuilder *self;
+
+  if (cache->n_items > 0)
+    self = cache->items[--cache->n_items];
+  else
+    self = g_new (WpSpaPodBuilder, 1);
+
+  g_ref_count_init (&self->ref);
   self->type = type;
+  self->n_pods = 0;
+  self->depth = 0;
+  self->extra_frames = NULL;
+  if (size > WP_SPA_POD_BUILDER_INLINE_SIZE) {
+    self->size = size;
+    self->buf = g_malloc0 (self->size);
+  } else {
+    self->size = WP_SPA_POD_BUILDER_INLINE_SIZE;
+    self->buf = self->inline_buf;
+    memset (self->buf, 0, self->size);
+  }
+  self->builder = SPA_POD_BUILDER_INIT (self->buf, self->size);
+  memset (&self->frame, 0, sizeof (self->frame));
 
   spa_pod_builder_set_callbacks (&self->builder, &builder_callbacks, self);
 
   return self;
 }
 
+static inline WpSpaPodBuilderFrame *
+wp_spa_pod_builder_get_frame (WpSpaPodBuilder *self, guint index)
+{
+  if (index < WP_SPA_POD_BUILDER_INLINE_DEPTH)
+    return &self->frames[index];
+  return g_ptr_array_index (self->extra_frames,
+      index - WP_SPA_POD_BUILDER_INLINE_DEPTH);
+}
+
+/* the type of the innermost open frame */
+static inline WpSpaType
+wp_spa_pod_builder_get_frame_type (WpSpaPodBuilder *self)
+{
+  return self->depth > 0 ?
+      wp_spa_pod_builder_get_frame (self, self->depth - 1)->type : self->type;
+}
+
 /*!
  * \brief Increases the reference count of a spa pod object
  * \ingroup wpspapod
@@ -153,6 +256,8 @@ static void
 wp_spa_pod_free (WpSpaPod *self)
 {
   g_clear_pointer (&self->builder, wp_spa_pod_builder_unref);
+  if (self->flags & FLAG_OWNED_DATA)
+    g_free (self->pod);
   self->pod = NULL;
   g_slice_free (WpSpaPod, self);
 }
@@ -178,14 +283,13 @@ wp_spa_pod_new (const struct spa_pod *pod, WpSpaPodType type, guint32 flags)
   self->flags = flags;
   self->type = type;
 
-  /* Copy the reference if no ownership, otherwise copy the pod */
+  /* Copy the reference if no ownership, otherwise copy the pod; copies do
+     not need a builder, as they are never extended */
   if (self->flags & FLAG_NO_OWNERSHIP) {
     self->pod = (struct spa_pod *)pod;
   } else {
-    self->builder = wp_spa_pod_builder_new (
-      SPA_ROUND_UP_N (sizeof (*pod) + pod->size, 8), pod->type);
-    self->pod = self->builder->builder.data;
-    spa_pod_builder_primitive (&self->builder->builder, pod);
+    self->flags |= FLAG_OWNED_DATA;
+    self->pod = g_memdup (pod, SPA_POD_SIZE (pod));
   }
 
   /* Set the prop table if it is an object */
@@ -562,15 +666,15 @@ wp_spa_pod_new_string (const char *value)
   WpSpaPod *self = g_slice_new0 (WpSpaPod);
   g_ref_count_init (&self->ref);
   self->type = WP_SPA_POD_REGULAR;
+  self->flags = FLAG_OWNED_DATA;
 
   struct spa_pod_string p = SPA_POD_INIT_String (len + 1);
-  self->builder = wp_spa_pod_builder_new (
-      SPA_ROUND_UP_N (sizeof (p) + len + 1, 8), SPA_TYPE_String);
+  guint8 *data = g_malloc (sizeof (p) + len + 1);
 
-  self->pod = self->builder->builder.data;
-
-  spa_pod_builder_raw (&self->builder->builder, &p, sizeof(p));
-  spa_pod_builder_write_string (&self->builder->builder, str, len);
+  memcpy (data, &p, sizeof (p));
+  memcpy (data + sizeof (p), str, len);
+  data[sizeof (p) + len] = '\0';
+  self->pod = (struct spa_pod *) data;
   return self;
 }
 
@@ -588,15 +692,14 @@ wp_spa_pod_new_bytes (gconstpointer value, guint32 len)
   WpSpaPod *self = g_slice_new0 (WpSpaPod);
   g_ref_count_init (&self->ref);
   self->type = WP_SPA_POD_REGULAR;
+  self->flags = FLAG_OWNED_DATA;
   const struct spa_pod_bytes p = SPA_POD_INIT_Bytes (len);
-  self->builder = wp_spa_pod_builder_new (
-      SPA_ROUND_UP_N (sizeof (p) + p.pod.size, 8),
-      SPA_TYPE_Bytes);
-
-  self->pod = self->builder->builder.data;
+  guint8 *data = g_malloc (sizeof (p) + len);
 
-  spa_pod_builder_raw (&self->builder->builder, &p, sizeof(p));
-  spa_pod_builder_raw_padded (&self->builder->builder, value, len);
+  memcpy (data, &p, sizeof (p));
+  if (len > 0)
+    memcpy (data + sizeof (p), value, len);
+  self->pod = (struct spa_pod *) data;
   return self;
 }
 
@@ -1860,13 +1963,24 @@ wp_spa_pod_filter (WpSpaPod *self, WpSpaPod *filter)
 WpSpaPodBuilder *
 wp_spa_pod_builder_ref (WpSpaPodBuilder *self)
 {
-  return (WpSpaPodBuilder *) g_rc_box_acquire ((gpointer) self);
+  g_ref_count_inc (&self->ref);
+  return self;
 }
 
 static void
 wp_spa_pod_builder_free (WpSpaPodBuilder *self)
 {
-  g_clear_pointer (&self->buf, g_free);
+  WpSpaPodBuilderCache *cache = wp_spa_pod_builder_get_cache ();
+
+  if (self->buf != self->inline_buf)
+    g_free (self->buf);
+  self->buf = NULL;
+  g_clear_pointer (&self->extra_frames, g_ptr_array_unref);
+
+  if (cache->n_items < WP_SPA_POD_BUILDER_CACHE_SIZE)
+    cache->items[cache->n_items++] = self;
+  else
+    g_free (self);
 }
 
 /*!
@@ -1879,7 +1993,8 @@ wp_spa_pod_builder_free (WpSpaPodBuilder *self)
 void
 wp_spa_pod_builder_unref (WpSpaPodBuilder *self)
 {
-  g_rc_box_release_full (self, (GDestroyNotify) wp_spa_pod_builder_free);
+  if (g_ref_count_dec (&self->ref))
+    wp_spa_pod_builder_free (self);
 }
 
 /*!
@@ -1890,8 +2005,7 @@ wp_spa_pod_builder_unref (WpSpaPodBuilder *self)
 WpSpaPodBuilder *
 wp_spa_pod_builder_new_array (void)
 {
-  WpSpaPodBuilder *self = wp_spa_pod_builder_new (
-      WP_SPA_POD_BUILDER_REALLOC_STEP_SIZE, SPA_TYPE_Array);
+  WpSpaPodBuilder *self = wp_spa_pod_builder_new (0, SPA_TYPE_Array);
   spa_pod_builder_push_array (&self->builder, &self->frame);
   return self;
 }
@@ -1912,8 +2026,7 @@ wp_spa_pod_builder_new_choice (const char *choice_type)
   g_return_val_if_fail (type != NULL, NULL);
 
   /* Construct the builder */
-  self = wp_spa_pod_builder_new (WP_SPA_POD_BUILDER_REALLOC_STEP_SIZE,
-      SPA_TYPE_Choice);
+  self = wp_spa_pod_builder_new (0, SPA_TYPE_Choice);
 
   /* Push the array */
   spa_pod_builder_push_choice (&self->builder, &self->frame,
@@ -1922,6 +2035,28 @@ wp_spa_pod_builder_new_choice (const char *choice_type)
   return self;
 }
 
+static gboolean
+lookup_object_type (const char *type_name, const char *id_name,
+    WpSpaType *type, guint32 *id)
+{
+  WpSpaIdTable table;
+  WpSpaIdValue id_val;
+
+  /* Find the type */
+  *type = wp_spa_type_from_name (type_name);
+  g_return_val_if_fail (wp_spa_type_is_object (*type), FALSE);
+
+  /* Find the id */
+  table = wp_spa_type_get_object_id_values_table (*type);
+  g_return_val_if_fail (table != NULL, FALSE);
+
+  id_val = wp_spa_id_table_find_value_from_short_name (table, id_name);
+  g_return_val_if_fail (id_val != NULL, FALSE);
+
+  *id = wp_spa_id_value_number (id_val);
+  return TRUE;
+}
+
 /*!
  * \brief Creates a spa pod builder of type object
  *
@@ -1935,26 +2070,16 @@ wp_spa_pod_builder_new_object (const char *type_name, const char *id_name)
 {
   WpSpaPodBuilder *self = NULL;
   WpSpaType type;
-  WpSpaIdTable table;
-  WpSpaIdValue id;
+  guint32 id;
 
-  /* Find the type */
-  type = wp_spa_type_from_name (type_name);
-  g_return_val_if_fail (wp_spa_type_is_object (type), NULL);
-
-  /* Find the id */
-  table = wp_spa_type_get_object_id_values_table (type);
-  g_return_val_if_fail (table != NULL, NULL);
-
-  id = wp_spa_id_table_find_value_from_short_name (table, id_name);
-  g_return_val_if_fail (id != NULL, NULL);
+  if (!lookup_object_type (type_name, id_name, &type, &id))
+    return NULL;
 
   /* Construct the builder */
-  self = wp_spa_pod_builder_new (WP_SPA_POD_BUILDER_REALLOC_STEP_SIZE, type);
+  self = wp_spa_pod_builder_new (0, type);
 
   /* Push the object */
-  spa_pod_builder_push_object (&self->builder, &self->frame, type,
-      wp_spa_id_value_number (id));
+  spa_pod_builder_push_object (&self->builder, &self->frame, type, id);
 
   return self;
 }
@@ -1969,8 +2094,7 @@ WpSpaPodBuilder *
 wp_spa_pod_builder_new_struct (void)
 {
   WpSpaPodBuilder *self = NULL;
-  self = wp_spa_pod_builder_new (WP_SPA_POD_BUILDER_REALLOC_STEP_SIZE,
-      SPA_TYPE_Struct);
+  self = wp_spa_pod_builder_new (0, SPA_TYPE_Struct);
   spa_pod_builder_push_struct (&self->builder, &self->frame);
   return self;
 }
@@ -1985,8 +2109,7 @@ WpSpaPodBuilder *
 wp_spa_pod_builder_new_sequence (guint unit)
 {
   WpSpaPodBuilder *self = NULL;
-  self = wp_spa_pod_builder_new (WP_SPA_POD_BUILDER_REALLOC_STEP_SIZE,
-      SPA_TYPE_Sequence);
+  self = wp_spa_pod_builder_new (0, SPA_TYPE_Sequence);
   spa_pod_builder_push_sequence (&self->builder, &self->frame, unit);
   return self;
 }
@@ -2197,7 +2320,8 @@ wp_spa_pod_builder_add_property (WpSpaPodBuilder *self, const char *key)
   if (g_str_has_prefix (key, "id-")) {
     g_return_if_fail (sscanf (key, "id-%08x", &key_id) == 1);
   } else {
-    WpSpaIdTable table = wp_spa_type_get_values_table (self->type);
+    WpSpaIdTable table = wp_spa_type_get_values_table (
+        wp_spa_pod_builder_get_frame_type (self));
     WpSpaIdValue id = wp_spa_id_table_find_value_from_short_name (table, key);
     g_return_if_fail (id != NULL);
     key_id = wp_spa_id_value_number (id);
@@ -2262,7 +2386,8 @@ wp_spa_pod_builder_add (WpSpaPodBuilder *self, ...)
 void
 wp_spa_pod_builder_add_valist (WpSpaPodBuilder *self, va_list args)
 {
-  WpSpaIdTable table = wp_spa_type_get_values_table (self->type);
+  WpSpaType frame_type = wp_spa_pod_builder_get_frame_type (self);
+  WpSpaIdTable table = wp_spa_type_get_values_table (frame_type);
 
   do {
     WpSpaIdValue key = NULL;
@@ -2271,7 +2396,7 @@ wp_spa_pod_builder_add_valist (WpSpaPodBuilder *self, va_list args)
     struct spa_pod_frame f;
     gboolean choice;
 
-    if (wp_spa_type_is_object (self->type)) {
+    if (wp_spa_type_is_object (frame_type)) {
       guint key_id;
       const char *key_name = va_arg(args, const char *);
       if (!key_name)
@@ -2285,7 +2410,7 @@ wp_spa_pod_builder_add_valist (WpSpaPodBuilder *self, va_list args)
       }
       spa_pod_builder_prop (&self->builder, key_id, 0);
     }
-    else if (self->type == SPA_TYPE_Sequence) {
+    else if (frame_type == SPA_TYPE_Sequence) {
       guint32 offset = va_arg(args, uint32_t);
       if (offset == 0)
         return;
@@ -2351,6 +2476,119 @@ wp_spa_pod_builder_add_valist (WpSpaPodBuilder *self, va_list args)
   } while (TRUE);
 }
 
+static struct spa_pod_frame *
+wp_spa_pod_builder_push_frame (WpSpaPodBuilder *self, WpSpaType type)
+{
+  WpSpaPodBuilderFrame *f;
+
+  /* frames past the inline ones are kept until the builder is freed, so
+     that re-opening the same depth does not allocate again */
+  if (self->depth >= WP_SPA_POD_BUILDER_INLINE_DEPTH) {
+    guint extra = self->depth - WP_SPA_POD_BUILDER_INLINE_DEPTH;
+    if (!self->extra_frames)
+      self->extra_frames = g_ptr_array_new_with_free_func (g_free);
+    if (extra >= self->extra_frames->len)
+      g_ptr_array_add (self->extra_frames, g_new0 (WpSpaPodBuilderFrame, 1));
+  }
+
+  f = wp_spa_pod_builder_get_frame (self, self->depth++);
+  f->type = type;
+  return &f->frame;
+}
+
+/*!
+ * \brief Opens a nested array in the builder
+ *
+ * The values added after this call go into the array, until it is closed
+ * with wp_spa_pod_builder_pop(). Building nested pods this way writes
+ * them directly in the buffer of \a self, instead of building them
+ * separately and copying them with wp_spa_pod_builder_add_pod().
+ *
+ * \ingroup wpspapod
+ * \param self the spa pod builder object
+ * \since 0.4.15
+ */
+void
+wp_spa_pod_builder_push_array (WpSpaPodBuilder *self)
+{
+  spa_pod_builder_push_array (&self->builder,
+      wp_spa_pod_builder_push_frame (self, SPA_TYPE_Array));
+}
+
+/*!
+ * \brief Opens a nested choice in the builder
+ *
+ * \ingroup wpspapod
+ * \param self the spa pod builder object
+ * \param choice_type the name of the choice type ("Range", "Step", ...)
+ * \since 0.4.15
+ */
+void
+wp_spa_pod_builder_push_choice (WpSpaPodBuilder *self, const char *choice_type)
+{
+  WpSpaIdValue type = wp_spa_id_value_from_short_name (
+      SPA_TYPE_INFO_Choice, choice_type);
+  g_return_if_fail (type != NULL);
+
+  spa_pod_builder_push_choice (&self->builder,
+      wp_spa_pod_builder_push_frame (self, SPA_TYPE_Choice),
+      wp_spa_id_value_number (type), 0);
+}
+
+/*!
+ * \brief Opens a nested object in the builder
+ *
+ * \ingroup wpspapod
+ * \param self the spa pod builder object
+ * \param type_name the type name of the object type
+ * \param id_name the Id name of the object
+ * \since 0.4.15
+ */
+void
+wp_spa_pod_builder_push_object (WpSpaPodBuilder *self, const char *type_name,
+    const char *id_name)
+{
+  WpSpaType type;
+  guint32 id;
+
+  if (!lookup_object_type (type_name, id_name, &type, &id))
+    return;
+
+  spa_pod_builder_push_object (&self->builder,
+      wp_spa_pod_builder_push_frame (self, type), type, id);
+}
+
+/*!
+ * \brief Opens a nested struct in the builder
+ *
+ * \ingroup wpspapod
+ * \param self the spa pod builder object
+ * \since 0.4.15
+ */
+void
+wp_spa_pod_builder_push_struct (WpSpaPodBuilder *self)
+{
+  spa_pod_builder_push_struct (&self->builder,
+      wp_spa_pod_builder_push_frame (self, SPA_TYPE_Struct));
+}
+
+/*!
+ * \brief Closes the innermost nested pod that was opened with one of the
+ * wp_spa_pod_builder_push_*() functions
+ *
+ * \ingroup wpspapod
+ * \param self the spa pod builder object
+ * \since 0.4.15
+ */
+void
+wp_spa_pod_builder_pop (WpSpaPodBuilder *self)
+{
+  g_return_if_fail (self->depth > 0);
+
+  spa_pod_builder_pop (&self->builder,
+      &wp_spa_pod_builder_get_frame (self, --self->depth)->frame);
+}
+
 /*!
  * \brief Ends the builder process and returns the constructed spa pod object
  *
@@ -2363,6 +2601,13 @@ wp_spa_pod_builder_end (WpSpaPodBuilder *self)
 {
   WpSpaPod *ret = NULL;
 
+  /* Close any nested pods that were left open */
+  if (G_UNLIKELY (self->depth > 0)) {
+    g_critical ("%u nested pods were not closed", self->depth);
+    while (self->depth > 0)
+      wp_spa_pod_builder_pop (self);
+  }
+
   /* Construct the pod */
   ret = g_slice_new0 (WpSpaPod);
   g_ref_count_init (&ret->ref);
@@ -2378,6 +2623,70 @@ wp_spa_pod_builder_end (WpSpaPodBuilder *self)
   return ret;
 }
 
+/* raw builders, see private/spa-pod-private.h */
+
+WpSpaPodBuilder *
+wp_spa_pod_builder_new_raw (void)
+{
+  return wp_spa_pod_builder_new (0, SPA_TYPE_None);
+}
+
+void
+wp_spa_pod_builder_append_spa_pod (WpSpaPodBuilder *self,
+    const struct spa_pod *pod)
+{
+  g_return_if_fail (self->depth == 0);
+
+  /* this writes the pod padded to 8 bytes, so they can be walked later */
+  spa_pod_builder_primitive (&self->builder, pod);
+  self->n_pods++;
+}
+
+guint
+wp_spa_pod_builder_get_n_pods (WpSpaPodBuilder *self)
+{
+  return self->n_pods;
+}
+
+GPtrArray *
+wp_spa_pod_builder_end_pods (WpSpaPodBuilder *self)
+{
+  GPtrArray *pods = g_ptr_array_new_full (self->n_pods,
+      (GDestroyNotify) wp_spa_pod_unref);
+  uint32_t offset = self->builder.state.offset;
+
+  g_return_val_if_fail (self->depth == 0, pods);
+
+  /* the pods keep the buffer alive for as long as they are cached, so drop
+     the unused space that was left over by growing it */
+  if (self->buf != self->inline_buf && offset > 0 && offset < self->size) {
+    self->buf = g_realloc (self->buf, offset);
+    self->builder.data = self->buf;
+    self->builder.size = offset;
+    self->size = offset;
+  }
+
+  offset = 0;
+  for (guint i = 0; i < self->n_pods; i++) {
+    struct spa_pod *pod = SPA_MEMBER (self->buf, offset, struct spa_pod);
+    WpSpaPod *p = g_slice_new0 (WpSpaPod);
+
+    g_ref_count_init (&p->ref);
+    p->type = WP_SPA_POD_REGULAR;
+    p->pod = pod;
+    p->builder = wp_spa_pod_builder_ref (self);
+
+    if (pod->type == SPA_TYPE_Object)
+      p->static_pod.data_property.table = wp_spa_type_get_values_table (
+          ((struct spa_pod_object *) pod)->body.type);
+
+    g_ptr_array_add (pods, p);
+    offset += SPA_ROUND_UP_N (SPA_POD_SIZE (pod), 8);
+  }
+
+  return pods;
+}
+
 /*!
  * \brief Increases the reference count of a spa pod parser
  * \ingroup wpspapod
@@ -2707,6 +3016,57 @@ wp_spa_pod_parser_get (WpSpaPodParser *self, ...)
   return res;
 }
 
+/* collects the value of \a pod, according to \a format, into the next
+   variable argument; \a key is the object property of \a pod, if any */
+static gboolean
+spa_pod_collect_value (const struct spa_pod *pod, WpSpaIdValue key,
+    const char *format, va_list *args)
+{
+  bool optional;
+
+  if ((optional = (*format == '?')))
+    format++;
+
+  if (!pod || !spa_pod_parser_can_collect (pod, *format)) {
+    if (!optional)
+      return FALSE;
+
+    SPA_POD_PARSER_SKIP (*format, *args);
+  } else {
+    if (pod->type == SPA_TYPE_Choice && *format != 'V' &&
+        SPA_POD_CHOICE_TYPE(pod) == SPA_CHOICE_None)
+      pod = SPA_POD_CHOICE_CHILD(pod);
+
+    switch (*format) {
+    case 'P':  /* Pod */
+    case 'V':  /* Choice */
+    case 'O':  /* Object */
+    case 'T':  /* Struct */
+      *va_arg(*args, WpSpaPod**) = wp_spa_pod_new_wrap_copy (pod);
+      break;
+    case 'K': { /* Id as string - WirePlumber extension */
+      const char ** idstr = va_arg(*args, const char **);
+      uint32_t id = SPA_POD_VALUE(struct spa_pod_id, pod);
+      if (key) {
+        WpSpaIdTable id_table = NULL;
+        wp_spa_id_value_get_value_type (key, &id_table);
+        WpSpaIdValue id_val = wp_spa_id_table_find_value (id_table, id);
+        *idstr = wp_spa_id_value_short_name (id_val);
+      }
+      break;
+    }
+    case 'b':
+      *va_arg(*args, gboolean*) =
+          SPA_POD_VALUE(struct spa_pod_bool, pod) ? TRUE : FALSE;
+      break;
+    default:
+      SPA_POD_PARSER_COLLECT (pod, *format, *args);
+      break;
+    }
+  }
+  return TRUE;
+}
+
 /*!
  * \brief This is the `va_list` version of wp_spa_pod_parser_get()
  *
@@ -2720,25 +3080,37 @@ wp_spa_pod_parser_get_valist (WpSpaPodParser *self, va_list args)
 {
   const struct spa_pod_prop *prop = NULL;
   WpSpaIdTable table = wp_spa_type_get_values_table (self->type);
+  gboolean res = TRUE;
+  va_list ap;
+
+  /* a va_list argument cannot be passed on by address portably */
+  va_copy (ap, args);
 
   do {
     WpSpaIdValue key = NULL;
-    bool optional;
     const struct spa_pod *pod = NULL;
     const char *format;
 
     if (wp_spa_type_is_object (self->type)) {
       guint key_id;
       const struct spa_pod_object *object;
-      const char *key_name = va_arg(args, const char *);
+      const char *key_name = va_arg(ap, const char *);
       if (!key_name)
         break;
 
       if (g_str_has_prefix (key_name, "id-")) {
-        g_return_val_if_fail (sscanf (key_name, "id-%08x", &key_id) == 1, FALSE);
+        if (sscanf (key_name, "id-%08x", &key_id) != 1) {
+          g_critical ("invalid property key: %s", key_name);
+          res = FALSE;
+          break;
+        }
       } else {
         key = wp_spa_id_table_find_value_from_short_name (table, key_name);
-        g_return_val_if_fail (key != NULL, FALSE);
+        if (!key) {
+          g_critical ("unknown property key: %s", key_name);
+          res = FALSE;
+          break;
+        }
         key_id = wp_spa_id_value_number (key);
       }
 
@@ -2748,55 +3120,20 @@ wp_spa_pod_parser_get_valist (WpSpaPodParser *self, va_list args)
       pod = prop ? &prop->value : NULL;
     }
 
-    if ((format = va_arg(args, char *)) == NULL)
+    if ((format = va_arg(ap, char *)) == NULL)
       break;
 
     if (self->type == SPA_TYPE_Struct)
       pod = spa_pod_parser_next (&self->parser);
 
-    if ((optional = (*format == '?')))
-      format++;
-
-    if (!pod || !spa_pod_parser_can_collect (pod, *format)) {
-      if (!optional)
-        return FALSE;
-
-      SPA_POD_PARSER_SKIP (*format, args);
-    } else {
-      if (pod->type == SPA_TYPE_Choice && *format != 'V' &&
-          SPA_POD_CHOICE_TYPE(pod) == SPA_CHOICE_None)
-        pod = SPA_POD_CHOICE_CHILD(pod);
-
-      switch (*format) {
-      case 'P':  /* Pod */
-      case 'V':  /* Choice */
-      case 'O':  /* Object */
-      case 'T':  /* Struct */
-        *va_arg(args, WpSpaPod**) = wp_spa_pod_new_wrap_copy (pod);
-        break;
-      case 'K': { /* Id as string - WirePlumber extension */
-        const char ** idstr = va_arg(args, const char **);
-        uint32_t id = SPA_POD_VALUE(struct spa_pod_id, pod);
-        if (key) {
-          WpSpaIdTable id_table = NULL;
-          wp_spa_id_value_get_value_type (key, &id_table);
-          WpSpaIdValue id_val = wp_spa_id_table_find_value (id_table, id);
-          *idstr = wp_spa_id_value_short_name (id_val);
-        }
-        break;
-      }
-      case 'b':
-        *va_arg(args, gboolean*) =
-            SPA_POD_VALUE(struct spa_pod_bool, pod) ? TRUE : FALSE;
-        break;
-      default:
-        SPA_POD_PARSER_COLLECT (pod, *format, args);
-        break;
-      }
+    if (!spa_pod_collect_value (pod, key, format, &ap)) {
+      res = FALSE;
+      break;
     }
   } while (TRUE);
 
-  return TRUE;
+  va_end (ap);
+  return res;
 }
 
 /*!
@@ -2811,6 +3148,373 @@ wp_spa_pod_parser_end (WpSpaPodParser *self)
   spa_pod_parser_pop (&self->parser, &self->frame);
 }
 
+/*!
+ * \struct WpSpaPodParseSpec
+ *
+ * A parse spec is a precompiled list of object property keys. The key
+ * names are resolved only once, when the spec is created, and all the
+ * requested properties are then extracted from an object pod with a single
+ * walk over its properties, regardless of the order in which they appear.
+ * This makes parsing many keys out of a large object linear in the number
+ * of its properties, instead of quadratic as with WpSpaPodParser.
+ *
+ * \since 0.4.15
+ */
+
+/* specs with more keys than this use a hash table to map ids to keys */
+#define PARSE_SPEC_LINEAR_MAX 8
+
+struct _WpSpaPodParseSpec
+{
+  WpSpaType type;
+  guint n_keys;
+  guint32 *ids;
+  WpSpaIdValue *keys; /* NULL for keys given in the "id-%08x" form */
+  gchar **names;
+  GHashTable *slots; /* id -> index + 1 */
+};
+
+G_DEFINE_BOXED_TYPE (WpSpaPodParseSpec, wp_spa_pod_parse_spec,
+    wp_spa_pod_parse_spec_ref, wp_spa_pod_parse_spec_unref)
+
+static void
+wp_spa_pod_parse_spec_free (WpSpaPodParseSpec *self)
+{
+  g_clear_pointer (&self->ids, g_free);
+  g_clear_pointer (&self->keys, g_free);
+  g_clear_pointer (&self->names, g_strfreev);
+  g_clear_pointer (&self->slots, g_hash_table_unref);
+}
+
+/*!
+ * \brief Creates a parse spec for the given keys of an object type
+ *
+ * \ingroup wpspapod
+ * \param type_name the type name of the objects to parse,
+ *   ex. "Spa:Pod:Object:Param:Route"
+ * \param key the short name of the first property to parse
+ * \param ... the short names of further properties to parse, followed by NULL
+ * \returns (transfer full) (nullable): the new parse spec, or NULL if the
+ *   type or one of the keys is not known, or if a key is given more than once
+ * \since 0.4.15
+ */
+WpSpaPodParseSpec *
+wp_spa_pod_parse_spec_new (const char *type_name, const char *key, ...)
+{
+  g_autoptr (GPtrArray) keys = g_ptr_array_new ();
+  va_list args;
+
+  va_start (args, key);
+  for (; key; key = va_arg (args, const char *))
+    g_ptr_array_add (keys, (gpointer) key);
+  va_end (args);
+  g_ptr_array_add (keys, NULL);
+
+  return wp_spa_pod_parse_spec_new_keys (type_name,
+      (const char * const *) keys->pdata);
+}
+
+/*!
+ * \brief Creates a parse spec for the given keys of an object type
+ *
+ * Keys can be given either by their short name or in the "id-%08x" form,
+ * like with wp_spa_pod_parser_get().
+ *
+ * \ingroup wpspapod
+ * \param type_name the type name of the objects to parse
+ * \param keys (array zero-terminated=1) (nullable): the short names of the
+ *   properties to parse; if NULL, all the known properties of the type
+ * \returns (transfer full) (nullable): the new parse spec, or NULL if the
+ *   type or one of the keys is not known, or if a key is given more than once
+ * \since 0.4.15
+ */
+WpSpaPodParseSpec *
+wp_spa_pod_parse_spec_new_keys (const char *type_name,
+    const char * const *keys)
+{
+  g_autoptr (WpSpaPodParseSpec) self = NULL;
+  g_autoptr (GPtrArray) all_keys = NULL;
+  WpSpaType type;
+  WpSpaIdTable table;
+
+  g_return_val_if_fail (type_name != NULL, NULL);
+
+  type = wp_spa_type_from_name (type_name);
+  g_return_val_if_fail (wp_spa_type_is_object (type), NULL);
+  table = wp_spa_type_get_values_table (type);
+
+  if (!keys) {
+    g_autoptr (WpIterator) it = NULL;
+    g_auto (GValue) item = G_VALUE_INIT;
+
+    all_keys = g_ptr_array_new ();
+    if (table) {
+      it = wp_spa_id_table_new_iterator (table);
+      for (; wp_iterator_next (it, &item); g_value_unset (&item))
+        g_ptr_array_add (all_keys, (gpointer) wp_spa_id_value_short_name (
+                g_value_get_pointer (&item)));
+    }
+    g_ptr_array_add (all_keys, NULL);
+    keys = (const char * const *) all_keys->pdata;
+  }
+
+  self = g_rc_box_new0 (WpSpaPodParseSpec);
+  self->type = type;
+  self->n_keys = g_strv_length ((gchar **) keys);
+  self->ids = g_new (guint32, self->n_keys);
+  self->keys = g_new0 (WpSpaIdValue, self->n_keys);
+  self->names = g_strdupv ((gchar **) keys);
+
+  for (guint i = 0; i < self->n_keys; i++) {
+    if (g_str_has_prefix (keys[i], "id-")) {
+      if (sscanf (keys[i], "id-%08x", &self->ids[i]) != 1) {
+        g_critical ("invalid property key: %s", keys[i]);
+        return NULL;
+      }
+    } else {
+      self->keys[i] = table ?
+          wp_spa_id_table_find_value_from_short_name (table, keys[i]) : NULL;
+      if (!self->keys[i]) {
+        g_critical ("unknown property key for %s: %s", type_name, keys[i]);
+        return NULL;
+      }
+      self->ids[i] = wp_spa_id_value_number (self->keys[i]);
+    }
+  }
+
+  /* each property is stored in a single slot, so a key that is given twice
+     would never get a value; the first one wins among the known keys */
+  if (self->n_keys > PARSE_SPEC_LINEAR_MAX)
+    self->slots = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  for (guint i = 0; i < self->n_keys; i++) {
+    gboolean duplicate = FALSE;
+
+    if (self->slots) {
+      duplicate = g_hash_table_contains (self->slots,
+          GUINT_TO_POINTER (self->ids[i]));
+      if (!duplicate)
+        g_hash_table_insert (self->slots, GUINT_TO_POINTER (self->ids[i]),
+            GUINT_TO_POINTER (i + 1));
+    } else {
+      for (guint j = 0; j < i && !duplicate; j++)
+        duplicate = (self->ids[j] == self->ids[i]);
+    }
+
+    if (duplicate && !all_keys) {
+      g_critical ("duplicate property key for %s: %s", type_name, keys[i]);
+      return NULL;
+    }
+  }
+
+  return g_steal_pointer (&self);
+}
+
+/*!
+ * \brief Increases the reference count of a parse spec
+ * \ingroup wpspapod
+ * \param self a parse spec
+ * \returns (transfer full): \a self with an additional reference count on it
+ * \since 0.4.15
+ */
+WpSpaPodParseSpec *
+wp_spa_pod_parse_spec_ref (WpSpaPodParseSpec *self)
+{
+  return (WpSpaPodParseSpec *) g_rc_box_acquire ((gpointer) self);
+}
+
+/*!
+ * \brief Decreases the reference count on \a self and frees it when the ref
+ * count reaches zero.
+ *
+ * \ingroup wpspapod
+ * \param self (transfer full): a parse spec
+ * \since 0.4.15
+ */
+void
+wp_spa_pod_parse_spec_unref (WpSpaPodParseSpec *self)
+{
+  g_rc_box_release_full (self, (GDestroyNotify) wp_spa_pod_parse_spec_free);
+}
+
+/*!
+ * \brief Gets the number of keys of a parse spec
+ * \ingroup wpspapod
+ * \param self a parse spec
+ * \returns the number of keys that \a self extracts
+ * \since 0.4.15
+ */
+guint
+wp_spa_pod_parse_spec_get_n_keys (WpSpaPodParseSpec *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+  return self->n_keys;
+}
+
+/*!
+ * \brief Gets the name of a key of a parse spec
+ * \ingroup wpspapod
+ * \param self a parse spec
+ * \param index the position of the key
+ * \returns (nullable): the name of the key at \a index, as it was given
+ * \since 0.4.15
+ */
+const char *
+wp_spa_pod_parse_spec_get_key (WpSpaPodParseSpec *self, guint index)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (index < self->n_keys, NULL);
+  return self->names[index];
+}
+
+static inline gint
+wp_spa_pod_parse_spec_find_slot (WpSpaPodParseSpec *self, guint32 id)
+{
+  if (self->slots)
+    return GPOINTER_TO_INT (
+        g_hash_table_lookup (self->slots, GUINT_TO_POINTER (id))) - 1;
+
+  for (guint i = 0; i < self->n_keys; i++) {
+    if (self->ids[i] == id)
+      return i;
+  }
+  return -1;
+}
+
+/* walks the properties of \a pod once, storing the value of each key of
+   the spec in the matching position of \a found */
+static gboolean
+wp_spa_pod_parse_spec_walk (WpSpaPodParseSpec *self, WpSpaPod *pod,
+    const char **id_name, const struct spa_pod **found)
+{
+  const struct spa_pod_object *object;
+  const struct spa_pod_prop *prop;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (pod != NULL, FALSE);
+  g_return_val_if_fail (wp_spa_pod_is_object (pod), FALSE);
+
+  if (wp_spa_pod_get_spa_type (pod) != self->type)
+    return FALSE;
+
+  object = (const struct spa_pod_object *) pod->pod;
+  if (id_name) {
+    WpSpaIdTable table = wp_spa_type_get_object_id_values_table (self->type);
+    *id_name = wp_spa_id_value_short_name (
+        wp_spa_id_table_find_value (table, object->body.id));
+  }
+
+  memset (found, 0, self->n_keys * sizeof (const struct spa_pod *));
+  SPA_POD_OBJECT_FOREACH (object, prop) {
+    gint slot = wp_spa_pod_parse_spec_find_slot (self, prop->key);
+    if (slot >= 0 && !found[slot])
+      found[slot] = &prop->value;
+  }
+  return TRUE;
+}
+
+/*!
+ * \brief Extracts the values of all the keys of a parse spec from an object
+ *
+ * \ingroup wpspapod
+ * \param self a parse spec
+ * \param pod an object pod of the type of the spec
+ * \param id_name (out) (optional): the Id name of the object
+ * \param values (out caller-allocates) (array): an array of
+ *   wp_spa_pod_parse_spec_get_n_keys() pods, where the values are stored in
+ *   the order of the keys; keys that are not present are set to NULL
+ * \returns TRUE if the pod could be parsed, FALSE if it is not an object of
+ *   the type of the spec
+ * \since 0.4.15
+ */
+gboolean
+wp_spa_pod_parse_spec_collect (WpSpaPodParseSpec *self, WpSpaPod *pod,
+    const char **id_name, WpSpaPod **values)
+{
+  const struct spa_pod **found;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (values != NULL || self->n_keys == 0, FALSE);
+
+  found = g_newa (const struct spa_pod *, MAX (self->n_keys, 1));
+  if (!wp_spa_pod_parse_spec_walk (self, pod, id_name, found))
+    return FALSE;
+
+  for (guint i = 0; i < self->n_keys; i++)
+    values[i] = found[i] ? wp_spa_pod_new_wrap_copy (found[i]) : NULL;
+  return TRUE;
+}
+
+/*!
+ * \brief Extracts values from an object pod using a parse spec
+ *
+ * The variable arguments are a format string and a pointer to store the
+ * value, as with wp_spa_pod_parser_get(), for each key of the spec in
+ * order, but without the key names.
+ *
+ * \ingroup wpspapod
+ * \param self a parse spec
+ * \param pod an object pod of the type of the spec
+ * \param id_name (out) (optional): the Id name of the object
+ * \param ... (out): a list of format strings and value pointers, followed by
+ *   NULL
+ * \returns TRUE if the values were obtained, FALSE otherwise
+ * \since 0.4.15
+ */
+gboolean
+wp_spa_pod_parse_spec_get (WpSpaPodParseSpec *self, WpSpaPod *pod,
+    const char **id_name, ...)
+{
+  gboolean res;
+  va_list args;
+
+  va_start (args, id_name);
+  res = wp_spa_pod_parse_spec_get_valist (self, pod, id_name, args);
+  va_end (args);
+
+  return res;
+}
+
+/*!
+ * \brief This is the `va_list` version of wp_spa_pod_parse_spec_get()
+ *
+ * \ingroup wpspapod
+ * \param self a parse spec
+ * \param pod an object pod of the type of the spec
+ * \param id_name (out) (optional): the Id name of the object
+ * \param args the variable arguments passed to wp_spa_pod_parse_spec_get()
+ * \returns TRUE if the values were obtained, FALSE otherwise
+ * \since 0.4.15
+ */
+gboolean
+wp_spa_pod_parse_spec_get_valist (WpSpaPodParseSpec *self, WpSpaPod *pod,
+    const char **id_name, va_list args)
+{
+  const struct spa_pod **found;
+  gboolean res = TRUE;
+  va_list ap;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  found = g_newa (const struct spa_pod *, MAX (self->n_keys, 1));
+  if (!wp_spa_pod_parse_spec_walk (self, pod, id_name, found))
+    return FALSE;
+
+  va_copy (ap, args);
+  for (guint i = 0; i < self->n_keys; i++) {
+    const char *format = va_arg (ap, const char *);
+    if (!format)
+      break;
+    if (!spa_pod_collect_value (found[i], self->keys[i], format, &ap)) {
+      res = FALSE;
+      break;
+    }
+  }
+  va_end (ap);
+
+  return res;
+}
+
 struct _WpSpaPodIterator
 {
   WpSpaPod *pod;
@@ -389,6 +389,23 @@ void wp_spa_pod_builder_add (WpSpaPodBuilder *self, ...) G_GNUC_NULL_TERMINATED;
 WP_API
 void wp_spa_pod_builder_add_valist (WpSpaPodBuilder *self, va_list args);
 
+WP_API
+void wp_spa_pod_builder_push_array (WpSpaPodBuilder *self);
+
+WP_API
+void wp_spa_pod_builder_push_choice (WpSpaPodBuilder *self,
+    const char *choice_type);
+
+WP_API
+void wp_spa_pod_builder_push_object (WpSpaPodBuilder *self,
+    const char *type_name, const char *id_name);
+
+WP_API
+void wp_spa_pod_builder_push_struct (WpSpaPodBuilder *self);
+
+WP_API
+void wp_spa_pod_builder_pop (WpSpaPodBuilder *self);
+
 WP_API
 WpSpaPod *wp_spa_pod_builder_end (WpSpaPodBuilder *self);
 
@@ -476,6 +493,52 @@ void wp_spa_pod_parser_end (WpSpaPodParser *self);
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (WpSpaPodParser, wp_spa_pod_parser_unref)
 
 
+/*!
+ * \brief The WpSpaPodParseSpec GType
+ * \ingroup wpspapod
+ */
+#define WP_TYPE_SPA_POD_PARSE_SPEC (wp_spa_pod_parse_spec_get_type ())
+WP_API
+GType wp_spa_pod_parse_spec_get_type (void);
+
+typedef struct _WpSpaPodParseSpec WpSpaPodParseSpec;
+
+WP_API
+WpSpaPodParseSpec *wp_spa_pod_parse_spec_new (const char *type_name,
+    const char *key, ...) G_GNUC_NULL_TERMINATED;
+
+WP_API
+WpSpaPodParseSpec *wp_spa_pod_parse_spec_new_keys (const char *type_name,
+    const char * const *keys);
+
+WP_API
+WpSpaPodParseSpec *wp_spa_pod_parse_spec_ref (WpSpaPodParseSpec *self);
+
+WP_API
+void wp_spa_pod_parse_spec_unref (WpSpaPodParseSpec *self);
+
+WP_API
+guint wp_spa_pod_parse_spec_get_n_keys (WpSpaPodParseSpec *self);
+
+WP_API
+const char *wp_spa_pod_parse_spec_get_key (WpSpaPodParseSpec *self,
+    guint index);
+
+WP_API
+gboolean wp_spa_pod_parse_spec_collect (WpSpaPodParseSpec *self,
+    WpSpaPod *pod, const char **id_name, WpSpaPod **values);
+
+WP_API
+gboolean wp_spa_pod_parse_spec_get (WpSpaPodParseSpec *self, WpSpaPod *pod,
+    const char **id_name, ...) G_GNUC_NULL_TERMINATED;
+
+WP_API
+gboolean wp_spa_pod_parse_spec_get_valist (WpSpaPodParseSpec *self,
+    WpSpaPod *pod, const char **id_name, va_list args);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (WpSpaPodParseSpec, wp_spa_pod_parse_spec_unref)
+
+
 G_END_DECLS
 
 #endif
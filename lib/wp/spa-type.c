@@ -79,6 +79,159 @@ static const WpSpaIdTableInfo static_id_tables[] = {
   { NULL, NULL }
 };
 
+/*
+ * Name lookups used to walk the type tree and the id tables with strcmp().
+ * Instead, the static type tree is indexed by name and by type on first use
+ * and the dynamic types and id tables are indexed as they are registered.
+ * Id tables that are reachable from the type tree or that were registered
+ * are also indexed by (short) value name, lazily, on their first lookup;
+ * other tables are still searched linearly, as they may not be static.
+ * The first match of a linear search always wins, so the indexes keep the
+ * first entry of duplicate names.
+ */
+typedef struct {
+  GHashTable *names; /* full name -> spa_type_info* */
+  GHashTable *short_names; /* short name -> spa_type_info* */
+} IdTableIndex;
+
+static GRWLock index_lock;
+static GHashTable *root_type_names = NULL; /* name -> spa_type_info* */
+static GHashTable *root_type_ids = NULL; /* type -> spa_type_info* */
+static GHashTable *static_id_table_names = NULL; /* name -> WpSpaIdTable */
+static GHashTable *extra_type_names = NULL; /* name -> type */
+static GHashTable *extra_id_table_names = NULL; /* name -> WpSpaIdTable */
+static GHashTable *id_table_indexes = NULL; /* WpSpaIdTable -> IdTableIndex* */
+
+static inline void
+insert_first (GHashTable * table, gconstpointer key, gconstpointer value)
+{
+  if (!g_hash_table_contains (table, key))
+    g_hash_table_insert (table, (gpointer) key, (gpointer) value);
+}
+
+static void
+id_table_index_free (IdTableIndex * index)
+{
+  if (index) {
+    g_hash_table_unref (index->names);
+    g_hash_table_unref (index->short_names);
+    g_slice_free (IdTableIndex, index);
+  }
+}
+
+static IdTableIndex *
+id_table_index_new (WpSpaIdTable table)
+{
+  IdTableIndex *index = g_slice_new (IdTableIndex);
+  const struct spa_type_info *info;
+
+  index->names = g_hash_table_new (g_str_hash, g_str_equal);
+  index->short_names = g_hash_table_new (g_str_hash, g_str_equal);
+  for (info = table; info->name; info++) {
+    insert_first (index->names, info->name, info);
+    insert_first (index->short_names, spa_debug_type_short_name (info->name),
+        info);
+  }
+  return index;
+}
+
+/* marks \a table and all the tables that it refers to as indexable */
+static void
+collect_id_tables (WpSpaIdTable table)
+{
+  const struct spa_type_info *info;
+
+  if (!table || g_hash_table_contains (id_table_indexes, table))
+    return;
+
+  g_hash_table_insert (id_table_indexes, (gpointer) table, NULL);
+  for (info = table; info->name; info++)
+    collect_id_tables (info->values);
+}
+
+/* same traversal order as spa_debug_type_find(); names are looked up in the
+   same way, but unlike spa_debug_type_find_type(), without stepping into
+   id values / object fields */
+static void
+index_type_tree (const struct spa_type_info * info)
+{
+  for (; info->name; info++) {
+    if (info->type == SPA_ID_INVALID) {
+      if (info->values)
+        index_type_tree (info->values);
+    } else {
+      insert_first (root_type_ids, GUINT_TO_POINTER (info->type), info);
+    }
+    insert_first (root_type_names, info->name, info);
+  }
+}
+
+/* must be called with the write lock held */
+static void
+ensure_root_index (void)
+{
+  if (root_type_names)
+    return;
+
+  root_type_names = g_hash_table_new (g_str_hash, g_str_equal);
+  root_type_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  static_id_table_names = g_hash_table_new (g_str_hash, g_str_equal);
+  if (!id_table_indexes)
+    id_table_indexes = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+        NULL, (GDestroyNotify) id_table_index_free);
+
+  index_type_tree (SPA_TYPE_ROOT);
+  collect_id_tables (SPA_TYPE_ROOT);
+
+  for (const WpSpaIdTableInfo *t = static_id_tables; t->name; t++) {
+    insert_first (static_id_table_names, t->name, t->values);
+    collect_id_tables (t->values);
+  }
+}
+
+static inline void
+index_read_lock (void)
+{
+  g_rw_lock_reader_lock (&index_lock);
+  if (G_UNLIKELY (!root_type_names)) {
+    g_rw_lock_reader_unlock (&index_lock);
+    g_rw_lock_writer_lock (&index_lock);
+    ensure_root_index ();
+    g_rw_lock_writer_unlock (&index_lock);
+    g_rw_lock_reader_lock (&index_lock);
+  }
+}
+
+static inline void
+index_read_unlock (void)
+{
+  g_rw_lock_reader_unlock (&index_lock);
+}
+
+/* returns NULL if \a table is not indexable; must be called with the read
+   lock held, which may be dropped temporarily to build the index */
+static IdTableIndex *
+get_id_table_index (WpSpaIdTable table)
+{
+  gpointer index = NULL;
+
+  if (!g_hash_table_lookup_extended (id_table_indexes, table, NULL, &index))
+    return NULL;
+
+  if (G_UNLIKELY (!index)) {
+    g_rw_lock_reader_unlock (&index_lock);
+    g_rw_lock_writer_lock (&index_lock);
+    if (g_hash_table_lookup_extended (id_table_indexes, table, NULL, &index) &&
+        !index) {
+      index = id_table_index_new (table);
+      g_hash_table_insert (id_table_indexes, (gpointer) table, index);
+    }
+    g_rw_lock_writer_unlock (&index_lock);
+    g_rw_lock_reader_lock (&index_lock);
+  }
+  return index;
+}
+
 GType wp_spa_type_get_type (void)
 {
   static gsize id__volatile = 0;
@@ -104,46 +257,34 @@ wp_spa_type_info_find_by_type (WpSpaType type)
   g_return_val_if_fail (type != WP_SPA_TYPE_INVALID, NULL);
   g_return_val_if_fail (type != 0, NULL);
 
-  if (extra_types)
-    info = spa_debug_type_find (
-        (const struct spa_type_info *) extra_types->data, type);
-  else
-    info = spa_debug_type_find (SPA_TYPE_ROOT, type);
+  index_read_lock ();
+  info = g_hash_table_lookup (root_type_ids, GUINT_TO_POINTER (type));
 
-  return info;
-}
-
-/* similar to spa_debug_type_find() and unlike spa_debug_type_find_type(),
-   which steps into id values / object fields */
-static const struct spa_type_info *
-_spa_type_find_by_name (const struct spa_type_info * info, const char * name)
-{
-  const struct spa_type_info * res;
+  /* dynamic types are numbered after their position in extra_types */
+  if (!info && extra_types && type > SPA_TYPE_VENDOR_WirePlumber &&
+      type - SPA_TYPE_VENDOR_WirePlumber < extra_types->len)
+    info = &g_array_index (extra_types, struct spa_type_info,
+        type - SPA_TYPE_VENDOR_WirePlumber);
+  index_read_unlock ();
 
-  while (info->name) {
-    if (info->type == SPA_ID_INVALID) {
-      if (info->values && (res = _spa_type_find_by_name (info->values, name)))
-        return res;
-    }
-    if (strcmp (info->name, name) == 0)
-      return info;
-    info++;
-  }
-  return NULL;
+  return info;
 }
 
 static const struct spa_type_info *
 wp_spa_type_info_find_by_name (const gchar *name)
 {
   const struct spa_type_info *info = NULL;
+  gpointer type;
 
   g_return_val_if_fail (name != NULL, NULL);
 
-  if (extra_types)
-    info = _spa_type_find_by_name (
-        (const struct spa_type_info *) extra_types->data, name);
-  else
-    info = _spa_type_find_by_name (SPA_TYPE_ROOT, name);
+  index_read_lock ();
+  info = g_hash_table_lookup (root_type_names, name);
+  if (!info && extra_type_names &&
+      (type = g_hash_table_lookup (extra_type_names, name)))
+    info = &g_array_index (extra_types, struct spa_type_info,
+        GPOINTER_TO_UINT (type) - SPA_TYPE_VENDOR_WirePlumber);
+  index_read_unlock ();
 
   return info;
 }
@@ -350,25 +491,21 @@ WpSpaIdTable
 wp_spa_id_table_from_name (const gchar *name)
 {
   g_return_val_if_fail (name != NULL, NULL);
-  const WpSpaIdTableInfo *info = NULL;
+  WpSpaIdTable table = NULL;
+
+  index_read_lock ();
 
   /* first look in dynamic id tables */
-  if (extra_id_tables) {
-    info = (const WpSpaIdTableInfo *) extra_id_tables->data;
-    while (info && info->name) {
-      if (strcmp (info->name, name) == 0)
-        return info->values;
-      info++;
-    }
-  }
+  if (extra_id_table_names)
+    table = g_hash_table_lookup (extra_id_table_names, name);
 
   /* then look at the well-known static ones */
-  info = static_id_tables;
-  while (info && info->name) {
-    if (strcmp (info->name, name) == 0)
-      return info->values;
-    info++;
-  }
+  if (!table)
+    table = g_hash_table_lookup (static_id_table_names, name);
+
+  index_read_unlock ();
+  if (table)
+    return table;
 
   /* then look into types, hoping to find an object type */
   const struct spa_type_info *tinfo = wp_spa_type_info_find_by_name (name);
@@ -434,6 +571,16 @@ wp_spa_id_table_find_value_from_name (WpSpaIdTable table, const gchar * name)
   g_return_val_if_fail (table != NULL, NULL);
 
   const struct spa_type_info *info = table;
+  IdTableIndex *index;
+
+  index_read_lock ();
+  index = get_id_table_index (table);
+  if (index)
+    info = g_hash_table_lookup (index->names, name);
+  index_read_unlock ();
+  if (index)
+    return info;
+
   while (info && info->name) {
     if (!strcmp (info->name, name))
       return info;
@@ -457,6 +604,16 @@ wp_spa_id_table_find_value_from_short_name (WpSpaIdTable table,
   g_return_val_if_fail (table != NULL, NULL);
 
   const struct spa_type_info *info = table;
+  IdTableIndex *index;
+
+  index_read_lock ();
+  index = get_id_table_index (table);
+  if (index)
+    info = g_hash_table_lookup (index->short_names, short_name);
+  index_read_unlock ();
+  if (index)
+    return info;
+
   while (info && info->name) {
     if (!strcmp (spa_debug_type_short_name (info->name), short_name))
       return info;
@@ -672,14 +829,25 @@ wp_spa_id_value_array_get_item_type (WpSpaIdValue id, WpSpaIdTable * table)
 void
 wp_spa_dynamic_type_init (void)
 {
+  g_rw_lock_writer_lock (&index_lock);
+
   extra_types = g_array_new (TRUE, FALSE, sizeof (struct spa_type_info));
   extra_id_tables = g_array_new (TRUE, FALSE, sizeof (WpSpaIdTableInfo));
+  extra_type_names = g_hash_table_new (g_str_hash, g_str_equal);
+  extra_id_table_names = g_hash_table_new (g_str_hash, g_str_equal);
 
   /* init to chain up to spa types */
   struct spa_type_info info = {
       SPA_ID_INVALID, SPA_ID_INVALID, "spa_types", SPA_TYPE_ROOT
   };
   g_array_append_val (extra_types, info);
+
+  ensure_root_index ();
+  /* the chain-up entry is found by name when walking extra_types */
+  insert_first (extra_type_names, info.name,
+      GUINT_TO_POINTER (SPA_TYPE_VENDOR_WirePlumber));
+
+  g_rw_lock_writer_unlock (&index_lock);
 }
 
 /*!
@@ -694,8 +862,16 @@ wp_spa_dynamic_type_init (void)
 void
 wp_spa_dynamic_type_deinit (void)
 {
+  g_rw_lock_writer_lock (&index_lock);
   g_clear_pointer (&extra_types, g_array_unref);
   g_clear_pointer (&extra_id_tables, g_array_unref);
+  g_clear_pointer (&extra_type_names, g_hash_table_unref);
+  g_clear_pointer (&extra_id_table_names, g_hash_table_unref);
+  g_clear_pointer (&root_type_names, g_hash_table_unref);
+  g_clear_pointer (&root_type_ids, g_hash_table_unref);
+  g_clear_pointer (&static_id_table_names, g_hash_table_unref);
+  g_clear_pointer (&id_table_indexes, g_hash_table_unref);
+  g_rw_lock_writer_unlock (&index_lock);
 }
 
 /*!
@@ -719,11 +895,16 @@ wp_spa_dynamic_type_register (const gchar *name, WpSpaType parent,
     const struct spa_type_info * values)
 {
   struct spa_type_info info;
+
+  g_rw_lock_writer_lock (&index_lock);
   info.type = SPA_TYPE_VENDOR_WirePlumber + extra_types->len;
   info.name = name;
   info.parent = parent;
   info.values = values;
   g_array_append_val (extra_types, info);
+  insert_first (extra_type_names, name, GUINT_TO_POINTER (info.type));
+  collect_id_tables (values);
+  g_rw_lock_writer_unlock (&index_lock);
   return info.type;
 }
 
@@ -746,8 +927,13 @@ wp_spa_dynamic_id_table_register (const gchar *name,
     const struct spa_type_info * values)
 {
   WpSpaIdTableInfo info;
+
+  g_rw_lock_writer_lock (&index_lock);
   info.name = name;
   info.values = values;
   g_array_append_val (extra_id_tables, info);
+  insert_first (extra_id_table_names, name, values);
+  collect_id_tables (values);
+  g_rw_lock_writer_unlock (&index_lock);
   return values;
 }
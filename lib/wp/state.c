@@ -10,6 +10,8 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 
 #include "log.h"
 #include "state.h"
@@ -17,6 +19,17 @@
 
 #define ESCAPED_CHARACTER '\\'
 
+/* the journal is compacted into the state file when it grows larger than
+   the state file itself, but never before reaching this size */
+#define JOURNAL_COMPACT_MIN_SIZE (64 * 1024)
+
+/* every full save increments a generation number that is stored in the
+   state file; the journal records the generation it applies to in its
+   first line, so that a journal left behind by an interrupted save is never
+   replayed over a newer state file */
+#define GENERATION_GROUP "WpState"
+#define GENERATION_KEY "journal-generation"
+
 static char *
 escape_string (const gchar *str)
 {
@@ -115,6 +128,14 @@ compress_string (const gchar *str)
  *
  * The WpState class saves and loads properties from a file
  *
+ * The state can either be saved as a whole, with wp_state_save(), or
+ * incrementally, with wp_state_save_keys(). Incremental saves append the
+ * changed keys to a journal file that is stored next to the state file and
+ * is replayed by wp_state_load(). When the journal grows larger than the
+ * state file, it is compacted by rewriting the state file atomically. The
+ * journal is bound to the state file that it was written for and is
+ * discarded if that file is replaced.
+ *
  * \gproperties
  * \gproperty{name, gchar *, G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY,
  *   The file name where the state will be stored.}
@@ -133,7 +154,10 @@ struct _WpState
   gchar *name;
 
   gchar *location;
-  GKeyFile *keyfile;
+  gchar *journal_location;
+  goffset location_size;
+  goffset journal_size;
+  gint64 generation;
 };
 
 G_DEFINE_TYPE (WpState, wp_state, G_TYPE_OBJECT)
@@ -170,11 +194,44 @@ get_new_location (const char *name)
 static void
 wp_state_ensure_location (WpState *self)
 {
-  if (!self->location)
+  if (!self->location) {
     self->location = get_new_location (self->name);
+    self->journal_location = g_strconcat (self->location, ".journal", NULL);
+  }
   g_return_if_fail (self->location);
 }
 
+static goffset
+get_file_size (const gchar *location)
+{
+  GStatBuf st;
+  return (g_stat (location, &st) == 0) ? st.st_size : 0;
+}
+
+static void
+wp_state_remove_journal (WpState *self)
+{
+  if (remove (self->journal_location) < 0 && errno != ENOENT)
+    wp_warning_object (self, "failed to remove %s: %s",
+        self->journal_location, g_strerror (errno));
+  self->journal_size = 0;
+}
+
+/* the generation of the state file; 0 if it does not exist or if it was
+   written before generations were introduced */
+static gint64
+wp_state_get_generation (WpState *self)
+{
+  if (self->generation < 0) {
+    g_autoptr (GKeyFile) keyfile = g_key_file_new ();
+    self->generation = g_key_file_load_from_file (keyfile, self->location,
+        G_KEY_FILE_NONE, NULL) ?
+        g_key_file_get_int64 (keyfile, GENERATION_GROUP, GENERATION_KEY, NULL)
+        : 0;
+  }
+  return self->generation;
+}
+
 static void
 wp_state_set_property (GObject * object, guint property_id,
     const GValue * value, GParamSpec * pspec)
@@ -215,6 +272,7 @@ wp_state_finalize (GObject * object)
 
   g_clear_pointer (&self->name, g_free);
   g_clear_pointer (&self->location, g_free);
+  g_clear_pointer (&self->journal_location, g_free);
 
   G_OBJECT_CLASS (wp_state_parent_class)->finalize (object);
 }
@@ -222,6 +280,9 @@ wp_state_finalize (GObject * object)
 static void
 wp_state_init (WpState * self)
 {
+  self->location_size = -1;
+  self->journal_size = -1;
+  self->generation = -1;
 }
 
 static void
@@ -295,10 +356,16 @@ wp_state_clear (WpState *self)
   wp_state_ensure_location (self);
   if (remove (self->location) < 0)
     wp_warning ("failed to remove %s: %s", self->location, g_strerror (errno));
+  self->location_size = 0;
+  self->generation = 0;
+  wp_state_remove_journal (self);
 }
 
 /*!
  * \brief Saves new properties in the state, overwriting all previous data.
+ *
+ * This also discards any journal written by wp_state_save_keys().
+ *
  * \ingroup wpstate
  * \param self the state
  * \param props (transfer none): the properties to save
@@ -311,6 +378,9 @@ wp_state_save (WpState *self, WpProperties *props, GError ** error)
   g_autoptr (GKeyFile) keyfile = g_key_file_new ();
   g_autoptr (WpIterator) it = NULL;
   g_auto (GValue) item = G_VALUE_INIT;
+  g_autofree gchar *data = NULL;
+  gsize length = 0;
+  gint64 generation;
   GError *err = NULL;
 
   g_return_val_if_fail (WP_IS_STATE (self), FALSE);
@@ -319,6 +389,11 @@ wp_state_save (WpState *self, WpProperties *props, GError ** error)
 
   wp_info_object (self, "saving state into %s", self->location);
 
+  /* a new generation makes the current journal stale as soon as the new
+     state file is in place */
+  generation = wp_state_get_generation (self) + 1;
+  g_key_file_set_int64 (keyfile, GENERATION_GROUP, GENERATION_KEY, generation);
+
   /* Set the properties */
   for (it = wp_properties_new_iterator (props);
       wp_iterator_next (it, &item);
@@ -331,20 +406,233 @@ wp_state_save (WpState *self, WpProperties *props, GError ** error)
       g_key_file_set_string (keyfile, self->name, escaped_key, val);
   }
 
-  if (!g_key_file_save_to_file (keyfile, self->location, &err)) {
+  /* this writes a temporary file and renames it over the old one */
+  data = g_key_file_to_data (keyfile, &length, NULL);
+  if (!g_file_set_contents (self->location, data, length, &err)) {
     g_propagate_prefixed_error (error, err, "could not save %s: ", self->name);
     return FALSE;
   }
+  self->location_size = length;
+  self->generation = generation;
+
+  /* the journal is now part of the state file; if this is interrupted or
+     fails, the journal is discarded on the next load, as its generation no
+     longer matches the one of the state file */
+  wp_state_remove_journal (self);
+
+  return TRUE;
+}
+
+static void
+append_journal_entry (GString *str, const gchar *key, const gchar *val)
+{
+  g_autofree gchar *escaped_key = g_strescape (key, NULL);
+
+  if (val) {
+    g_autofree gchar *escaped_val = g_strescape (val, NULL);
+    g_string_append_printf (str, "S\t%s\t%s\n", escaped_key, escaped_val);
+  } else {
+    g_string_append_printf (str, "D\t%s\n", escaped_key);
+  }
+}
+
+/* drops a partially written entry from the end of the journal, so that
+   new entries are not appended to it; returns the size of the journal */
+static goffset
+truncate_journal (WpState *self, const gchar *data, gsize length)
+{
+  const gchar *last = g_strrstr_len (data, length, "\n");
+  gsize valid = last ? (gsize) (last - data) + 1 : 0;
+
+  if (valid < length) {
+    wp_message_object (self, "dropping partial entry at the end of %s",
+        self->journal_location);
+    if (truncate (self->journal_location, valid) < 0) {
+      wp_warning_object (self, "failed to truncate %s: %s",
+          self->journal_location, g_strerror (errno));
+      return -1;
+    }
+  }
+  return valid;
+}
+
+/* checks the generation line at the start of the journal and returns the
+   size of that line, or -1 if the journal belongs to an older state file;
+   journals without it were written for generation 0 */
+static gssize
+check_journal_generation (WpState *self, const gchar *data, gsize length)
+{
+  gint64 generation = 0;
+  gssize header_len = 0;
+
+  if (length > 2 && data[0] == 'G' && data[1] == '\t') {
+    const gchar *end = memchr (data, '\n', length);
+    if (end) {
+      generation = g_ascii_strtoll (data + 2, NULL, 10);
+      header_len = end - data + 1;
+    }
+  }
+
+  if (generation != wp_state_get_generation (self)) {
+    wp_info_object (self, "discarding stale journal %s",
+        self->journal_location);
+    wp_state_remove_journal (self);
+    return -1;
+  }
+  return header_len;
+}
+
+static goffset
+get_journal_size (WpState *self)
+{
+  g_autofree gchar *data = NULL;
+  gsize length = 0;
+  goffset size;
+
+  if (!g_file_get_contents (self->journal_location, &data, &length, NULL))
+    return 0;
+  size = truncate_journal (self, data, length);
+  if (size > 0 && check_journal_generation (self, data, size) < 0)
+    return 0;
+  return size;
+}
+
+/*!
+ * \brief Saves only the given keys of the state
+ *
+ * Instead of rewriting the whole state file, this appends the values that
+ * the given \a keys have in \a props to a journal, so that the cost of
+ * saving is proportional to the number of changed keys and not to the size
+ * of the state. Keys that are listed in \a keys but are not present in
+ * \a props are removed from the state; keys of \a props that are not listed
+ * in \a keys are ignored.
+ *
+ * When the journal becomes larger than the state file, the state is
+ * compacted by loading it, applying the changed keys and saving it with
+ * wp_state_save().
+ *
+ * \ingroup wpstate
+ * \param self the state
+ * \param props (transfer none): the properties holding the new values of
+ *   the changed keys
+ * \param keys (array zero-terminated=1): the keys that have changed since
+ *   the last save
+ * \param error (out)(optional): return location for a GError, or NULL
+ * \returns TRUE if the keys could be saved, FALSE otherwise
+ * \since 0.4.15
+ */
+gboolean
+wp_state_save_keys (WpState *self, WpProperties *props,
+    const gchar * const * keys, GError ** error)
+{
+  g_autoptr (GString) entries = NULL;
+  FILE *f;
+
+  g_return_val_if_fail (WP_IS_STATE (self), FALSE);
+  g_return_val_if_fail (props, FALSE);
+  g_return_val_if_fail (keys, FALSE);
+  wp_state_ensure_location (self);
+
+  if (!keys[0])
+    return TRUE;
+
+  if (self->location_size < 0)
+    self->location_size = get_file_size (self->location);
+  if (self->journal_size < 0)
+    self->journal_size = get_journal_size (self);
+
+  entries = g_string_new (NULL);
+  if (self->journal_size == 0)
+    g_string_append_printf (entries, "G\t%" G_GINT64_FORMAT "\n",
+        wp_state_get_generation (self));
+  for (guint i = 0; keys[i]; i++)
+    append_journal_entry (entries, keys[i], wp_properties_get (props, keys[i]));
+
+  /* compact instead of appending if the journal has grown too much */
+  if (self->journal_size < 0 || self->journal_size + entries->len >
+          MAX (JOURNAL_COMPACT_MIN_SIZE, self->location_size)) {
+    g_autoptr (WpProperties) state = wp_state_load (self);
+
+    wp_debug_object (self, "compacting journal %s", self->journal_location);
+    for (guint i = 0; keys[i]; i++)
+      wp_properties_set (state, keys[i], wp_properties_get (props, keys[i]));
+    return wp_state_save (self, state, error);
+  }
+
+  wp_trace_object (self, "saving %" G_GSIZE_FORMAT " bytes into %s",
+      entries->len, self->journal_location);
+
+  f = fopen (self->journal_location, "a");
+  if (!f || fwrite (entries->str, 1, entries->len, f) != entries->len ||
+      fclose (g_steal_pointer (&f)) != 0) {
+    int errsv = errno;
+    if (f)
+      fclose (f);
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+        "could not save %s: %s", self->name, g_strerror (errsv));
+    /* drop what was written of these entries, so that the next ones do not
+       get appended to a partial entry */
+    if (truncate (self->journal_location, self->journal_size) < 0)
+      self->journal_size = -1;
+    return FALSE;
+  }
+  self->journal_size += entries->len;
 
   return TRUE;
 }
 
+static void
+replay_journal (WpState *self, WpProperties *props)
+{
+  g_autofree gchar *data = NULL;
+  gsize length = 0;
+  gssize header_len;
+  gchar *line, *next;
+
+  if (!g_file_get_contents (self->journal_location, &data, &length, NULL)) {
+    self->journal_size = 0;
+    return;
+  }
+  self->journal_size = truncate_journal (self, data, length);
+  if (length == 0 ||
+      (header_len = check_journal_generation (self, data, length)) < 0)
+    return;
+
+  for (line = data + header_len; line < data + length; line = next) {
+    gchar **fields;
+    gchar *end = memchr (line, '\n', data + length - line);
+
+    /* ignore a partially written last entry */
+    if (!end)
+      break;
+    *end = '\0';
+    next = end + 1;
+
+    fields = g_strsplit (line, "\t", 3);
+    if (fields[0] && fields[1]) {
+      g_autofree gchar *key = g_strcompress (fields[1]);
+
+      if (g_str_equal (fields[0], "S") && fields[2]) {
+        g_autofree gchar *val = g_strcompress (fields[2]);
+        wp_properties_set (props, key, val);
+      } else if (g_str_equal (fields[0], "D")) {
+        wp_properties_set (props, key, NULL);
+      } else {
+        wp_warning_object (self, "invalid entry in %s",
+            self->journal_location);
+      }
+    }
+    g_strfreev (fields);
+  }
+}
+
 /*!
  * \brief Loads the state data from the file system
  *
  * This function will never fail. If it cannot load the state, for any reason,
  * it will simply return an empty WpProperties, behaving as if there was no
- * previous state stored.
+ * previous state stored. Keys that were saved with wp_state_save_keys() are
+ * loaded from the journal on top of the state file.
  *
  * \ingroup wpstate
  * \param self the state
@@ -361,14 +649,18 @@ wp_state_load (WpState *self)
   wp_state_ensure_location (self);
 
   /* Open */
+  self->generation = 0;
   if (!g_key_file_load_from_file (keyfile, self->location,
       G_KEY_FILE_NONE, NULL))
-    return g_steal_pointer (&props);
+    goto journal;
+
+  self->generation =
+      g_key_file_get_int64 (keyfile, GENERATION_GROUP, GENERATION_KEY, NULL);
 
   /* Load all keys */
   keys = g_key_file_get_keys (keyfile, self->name, NULL, NULL);
   if (!keys)
-    return g_steal_pointer (&props);
+    goto journal;
 
   for (guint i = 0; keys[i]; i++) {
     g_autofree gchar *compressed_key = NULL;
@@ -384,5 +676,7 @@ wp_state_load (WpState *self)
 
   g_strfreev (keys);
 
+journal:
+  replay_journal (self, props);
   return g_steal_pointer (&props);
 }
@@ -38,6 +38,10 @@ void wp_state_clear (WpState *self);
 WP_API
 gboolean wp_state_save (WpState *self, WpProperties *props, GError ** error);
 
+WP_API
+gboolean wp_state_save_keys (WpState *self, WpProperties *props,
+    const gchar * const * keys, GError ** error);
+
 WP_API
 WpProperties * wp_state_load (WpState *self);
 
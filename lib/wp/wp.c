@@ -33,6 +33,17 @@ wp_init (WpInitFlags flags)
 
   /* Initialize the logging system */
   wp_log_set_level (g_getenv ("WIREPLUMBER_DEBUG"));
+  if (flags & WP_INIT_SET_GLIB_LOG) {
+    const gchar *log_async = g_getenv ("WIREPLUMBER_LOG_ASYNC");
+    if (log_async && atoi (log_async) != 0)
+      wp_log_set_async (TRUE);
+  }
+  if (g_getenv ("WIREPLUMBER_TRACE_FILE")) {
+    g_autoptr (GError) error = NULL;
+    if (!wp_log_set_trace_file (g_getenv ("WIREPLUMBER_TRACE_FILE"), 0,
+            &error))
+      wp_warning ("%s", error->message);
+  }
   wp_info ("WirePlumber " WIREPLUMBER_VERSION " initializing");
 
   /* set PIPEWIRE_DEBUG and the spa_log interface that pipewire will use */
@@ -30,12 +30,48 @@ enum {
   PROP_ECHO_CANCEL_SOURCE_NAME,
 };
 
+/* the media classes that can provide each default node, in order of
+   preference, and the direction of the ports that they must have */
+static const gchar * MEDIA_CLASSES[N_DEFAULT_NODES][5] = {
+  [AUDIO_SINK] = { "Audio/Sink", "Audio/Duplex", NULL },
+  [AUDIO_SOURCE] = { "Audio/Source", "Audio/Source/Virtual", "Audio/Duplex",
+      "Audio/Sink", NULL },
+  [VIDEO_SOURCE] = { "Video/Source", "Video/Source/Virtual", NULL },
+};
+
+static const WpDirection PORT_DIRECTION[N_DEFAULT_NODES] = {
+  [AUDIO_SINK] = WP_DIRECTION_INPUT,
+  [AUDIO_SOURCE] = WP_DIRECTION_OUTPUT,
+  [VIDEO_SOURCE] = WP_DIRECTION_OUTPUT,
+};
+
 typedef struct _WpDefaultNode WpDefaultNode;
 struct _WpDefaultNode
 {
   gchar *value;
   gchar *config_value;
   gchar *prev_config_value[N_PREV_CONFIGS];
+  /* element-type: NodeInfo*, in the order that the nodes appeared */
+  GPtrArray *candidates;
+};
+
+/* A node, or the ports of a node that has not appeared yet, keyed by the
+   bound id of the node in WpDefaultNodes.nodes */
+typedef struct _NodeInfo NodeInfo;
+struct _NodeInfo
+{
+  WpNode *node;
+  guint32 id;
+  /* bitmask of the default node types that this node can be */
+  guint types;
+  guint n_ports[2];
+};
+
+typedef struct _PortInfo PortInfo;
+struct _PortInfo
+{
+  guint32 node_id;
+  WpDirection direction;
 };
 
 struct _WpDefaultNodes
@@ -48,6 +84,12 @@ struct _WpDefaultNodes
   WpObjectManager *rescan_om;
   GSource *timeout_source;
 
+  /* incremental rescan state */
+  GHashTable *nodes; /* node bound id -> NodeInfo */
+  GHashTable *ports; /* WpPort* -> PortInfo */
+  guint dirty; /* bitmask of the default node types to re-evaluate */
+  gboolean rescan_pending;
+
   /* properties */
   guint save_interval_ms;
   gboolean use_persistent_storage;
@@ -59,6 +101,13 @@ G_DECLARE_FINAL_TYPE (WpDefaultNodes, wp_default_nodes,
                       WP, DEFAULT_NODES, WpPlugin)
 G_DEFINE_TYPE (WpDefaultNodes, wp_default_nodes, WP_TYPE_PLUGIN)
 
+static void
+node_info_free (NodeInfo * info)
+{
+  g_clear_object (&info->node);
+  g_free (info);
+}
+
 static void
 wp_default_nodes_init (WpDefaultNodes * self)
 {
@@ -255,26 +304,21 @@ static WpNode *
 find_best_media_class_node (WpDefaultNodes * self, const gchar *media_class,
     const WpDefaultNode *def, WpDirection direction, gint *priority)
 {
-  g_autoptr (WpIterator) it = NULL;
-  g_auto (GValue) val = G_VALUE_INIT;
   gint highest_prio = 0;
   WpNode *res = NULL;
 
   g_return_val_if_fail (media_class, NULL);
 
-  it = wp_object_manager_new_filtered_iterator (self->rescan_om, WP_TYPE_NODE,
-      WP_CONSTRAINT_TYPE_PW_PROPERTY, PW_KEY_MEDIA_CLASS, "=s", media_class,
-      NULL);
+  for (guint c = 0; c < def->candidates->len; c++) {
+    NodeInfo *info = g_ptr_array_index (def->candidates, c);
+    WpNode *node = info->node;
+    const gchar *node_media_class = wp_pipewire_object_get_property (
+        WP_PIPEWIRE_OBJECT (node), PW_KEY_MEDIA_CLASS);
+
+    if (g_strcmp0 (node_media_class, media_class) != 0)
+      continue;
 
-  for (; wp_iterator_next (it, &val); g_value_unset (&val)) {
-    WpNode *node = g_value_get_object (&val);
-    g_autoptr (WpPort) port = wp_object_manager_lookup (self->rescan_om,
-          WP_TYPE_PORT, WP_CONSTRAINT_TYPE_PW_PROPERTY, PW_KEY_NODE_ID,
-          "=u", wp_proxy_get_bound_id (WP_PROXY (node)),
-          WP_CONSTRAINT_TYPE_PW_PROPERTY, PW_KEY_PORT_DIRECTION,
-          "=s", direction == WP_DIRECTION_INPUT ? "in" : "out",
-          NULL);
-    if (port) {
+    if (info->n_ports[direction] > 0) {
       const gchar *name = wp_pipewire_object_get_property (
           WP_PIPEWIRE_OBJECT (node), PW_KEY_NODE_NAME);
       const gchar *prio_str = wp_pipewire_object_get_property (
@@ -337,38 +381,10 @@ find_best_node (WpDefaultNodes * self, gint node_t)
 {
   const WpDefaultNode *def = &self->defaults[node_t];
 
-  switch (node_t) {
-  case AUDIO_SINK: {
-    const gchar *media_classes[] = {
-        "Audio/Sink",
-        "Audio/Duplex",
-        NULL};
-    return find_best_media_classes_node (self, media_classes, def,
-        WP_DIRECTION_INPUT);
-  }
-  case AUDIO_SOURCE: {
-    const gchar *media_classes[] = {
-        "Audio/Source",
-        "Audio/Source/Virtual",
-        "Audio/Duplex",
-        "Audio/Sink",
-        NULL};
-    return find_best_media_classes_node (self, media_classes, def,
-        WP_DIRECTION_OUTPUT);
-  }
-  case VIDEO_SOURCE: {
-    const gchar *media_classes[] = {
-        "Video/Source",
-        "Video/Source/Virtual",
-        NULL};
-    return find_best_media_classes_node (self, media_classes, def,
-        WP_DIRECTION_OUTPUT);
-  }
-  default:
-    break;
-  }
+  g_return_val_if_fail (node_t >= 0 && node_t < N_DEFAULT_NODES, NULL);
 
-  return NULL;
+  return find_best_media_classes_node (self, MEDIA_CLASSES[node_t], def,
+      PORT_DIRECTION[node_t]);
 }
 
 static void
@@ -409,7 +425,12 @@ sync_rescan (WpCore * core, GAsyncResult * res, WpDefaultNodes * self)
 {
   g_autoptr (WpMetadata) metadata = NULL;
   g_autoptr (GError) error = NULL;
+  guint dirty;
 
+  self->rescan_pending = FALSE;
+
+  /* the dirty types are kept until a rescan actually runs, so that they
+     are not lost if it cannot run now */
   if (!wp_core_sync_finish (core, res, &error)) {
     wp_warning_object (self, "core sync error: %s", error->message);
     return;
@@ -418,26 +439,195 @@ sync_rescan (WpCore * core, GAsyncResult * res, WpDefaultNodes * self)
   /* Get the metadata */
   metadata = wp_object_manager_lookup (self->metadata_om, WP_TYPE_METADATA,
       NULL);
-  if (!metadata)
+  if (!metadata || !self->nodes)
     return;
 
-  wp_trace_object (self, "re-evaluating defaults");
-  reevaluate_default_node (self, metadata, AUDIO_SINK);
-  reevaluate_default_node (self, metadata, AUDIO_SOURCE);
-  reevaluate_default_node (self, metadata, VIDEO_SOURCE);
+  dirty = self->dirty;
+  self->dirty = 0;
+
+  wp_trace_object (self, "re-evaluating defaults (mask 0x%x)", dirty);
+  for (gint i = 0; i < N_DEFAULT_NODES; i++) {
+    if (dirty & (1 << i))
+      reevaluate_default_node (self, metadata, i);
+  }
 }
 
+/* Marks the given default node types for re-evaluation; the changes are
+   accumulated until the sync that was issued for the first one completes */
 static void
-schedule_rescan (WpDefaultNodes * self)
+schedule_rescan_types (WpDefaultNodes * self, guint types)
 {
-  g_autoptr (WpCore) core = wp_object_get_core (WP_OBJECT (self));
+  g_autoptr (WpCore) core = NULL;
+
+  if (types == 0)
+    return;
+
+  self->dirty |= types;
+  if (self->rescan_pending)
+    return;
+
+  core = wp_object_get_core (WP_OBJECT (self));
   g_return_if_fail (core);
 
   wp_debug_object (self, "scheduling default nodes rescan");
+  self->rescan_pending = TRUE;
   wp_core_sync_closure (core, NULL, g_cclosure_new_object (
       G_CALLBACK (sync_rescan), G_OBJECT (self)));
 }
 
+static void
+schedule_rescan (WpDefaultNodes * self)
+{
+  schedule_rescan_types (self, (1 << N_DEFAULT_NODES) - 1);
+}
+
+static guint
+get_node_types (WpNode * node)
+{
+  const gchar *media_class = wp_pipewire_object_get_property (
+      WP_PIPEWIRE_OBJECT (node), PW_KEY_MEDIA_CLASS);
+  guint types = 0;
+
+  if (!media_class)
+    return 0;
+
+  for (gint i = 0; i < N_DEFAULT_NODES; i++) {
+    for (guint j = 0; MEDIA_CLASSES[i][j]; j++) {
+      if (!g_strcmp0 (media_class, MEDIA_CLASSES[i][j])) {
+        types |= (1 << i);
+        break;
+      }
+    }
+  }
+  return types;
+}
+
+/* Returns the types of the node that depend on ports of this direction */
+static guint
+get_port_types (NodeInfo * info, WpDirection direction)
+{
+  guint types = 0;
+
+  for (gint i = 0; i < N_DEFAULT_NODES; i++) {
+    if (PORT_DIRECTION[i] == direction)
+      types |= (1 << i);
+  }
+  return info->node ? (info->types & types) : 0;
+}
+
+static NodeInfo *
+get_node_info (WpDefaultNodes * self, guint32 id)
+{
+  NodeInfo *info = g_hash_table_lookup (self->nodes, GUINT_TO_POINTER (id));
+
+  if (!info) {
+    info = g_new0 (NodeInfo, 1);
+    info->id = id;
+    g_hash_table_insert (self->nodes, GUINT_TO_POINTER (id), info);
+  }
+  return info;
+}
+
+static void
+maybe_drop_node_info (WpDefaultNodes * self, NodeInfo * info)
+{
+  if (!info->node && info->n_ports[0] == 0 && info->n_ports[1] == 0)
+    g_hash_table_remove (self->nodes, GUINT_TO_POINTER (info->id));
+}
+
+static void
+on_node_added (WpDefaultNodes * self, WpNode * node)
+{
+  NodeInfo *info = get_node_info (self,
+      wp_proxy_get_bound_id (WP_PROXY (node)));
+
+  g_return_if_fail (info->node == NULL);
+
+  info->node = g_object_ref (node);
+  info->types = get_node_types (node);
+
+  for (gint i = 0; i < N_DEFAULT_NODES; i++) {
+    if (info->types & (1 << i))
+      g_ptr_array_add (self->defaults[i].candidates, info);
+  }
+
+  /* a node without ports cannot be picked, so nothing changes yet */
+  if (info->n_ports[WP_DIRECTION_INPUT] > 0)
+    schedule_rescan_types (self, get_port_types (info, WP_DIRECTION_INPUT));
+  if (info->n_ports[WP_DIRECTION_OUTPUT] > 0)
+    schedule_rescan_types (self, get_port_types (info, WP_DIRECTION_OUTPUT));
+}
+
+static gboolean
+node_info_has_node (gpointer key, NodeInfo * info, WpNode * node)
+{
+  return info->node == node;
+}
+
+static void
+on_node_removed (WpDefaultNodes * self, WpNode * node)
+{
+  NodeInfo *info = g_hash_table_lookup (self->nodes,
+      GUINT_TO_POINTER (wp_proxy_get_bound_id (WP_PROXY (node))));
+
+  /* the id is no longer known if the proxy was destroyed before its global */
+  if (!info || info->node != node)
+    info = g_hash_table_find (self->nodes, (GHRFunc) node_info_has_node, node);
+  if (!info)
+    return;
+
+  for (gint i = 0; i < N_DEFAULT_NODES; i++) {
+    if (info->types & (1 << i))
+      g_ptr_array_remove (self->defaults[i].candidates, info);
+  }
+  schedule_rescan_types (self, info->types);
+
+  g_clear_object (&info->node);
+  info->types = 0;
+  maybe_drop_node_info (self, info);
+}
+
+static void
+on_port_added (WpDefaultNodes * self, WpPort * port)
+{
+  const gchar *node_id_str = wp_pipewire_object_get_property (
+      WP_PIPEWIRE_OBJECT (port), PW_KEY_NODE_ID);
+  PortInfo *pinfo;
+  NodeInfo *info;
+
+  if (!node_id_str)
+    return;
+
+  pinfo = g_new0 (PortInfo, 1);
+  pinfo->node_id = (guint32) strtoul (node_id_str, NULL, 10);
+  pinfo->direction = wp_port_get_direction (port);
+  g_hash_table_insert (self->ports, port, pinfo);
+
+  /* only the first port of each direction changes the outcome */
+  info = get_node_info (self, pinfo->node_id);
+  if (info->n_ports[pinfo->direction]++ == 0)
+    schedule_rescan_types (self, get_port_types (info, pinfo->direction));
+}
+
+static void
+on_port_removed (WpDefaultNodes * self, WpPort * port)
+{
+  PortInfo *pinfo = g_hash_table_lookup (self->ports, port);
+  NodeInfo *info;
+
+  if (!pinfo)
+    return;
+
+  info = g_hash_table_lookup (self->nodes, GUINT_TO_POINTER (pinfo->node_id));
+  if (info && info->n_ports[pinfo->direction] > 0) {
+    if (--info->n_ports[pinfo->direction] == 0)
+      schedule_rescan_types (self, get_port_types (info, pinfo->direction));
+    maybe_drop_node_info (self, info);
+  }
+
+  g_hash_table_remove (self->ports, port);
+}
+
 static void
 on_metadata_changed (WpMetadata *m, guint32 subject,
     const gchar *key, const gchar *type, const gchar *value, gpointer d)
@@ -470,7 +660,7 @@ on_metadata_changed (WpMetadata *m, guint32 subject,
         self->defaults[node_t].config_value);
 
     /* schedule rescan */
-    schedule_rescan (self);
+    schedule_rescan_types (self, 1 << node_t);
 
     /* Save state after specific interval */
     timer_start (self);
@@ -485,9 +675,26 @@ on_object_added (WpObjectManager *om, WpPipewireObject *proxy, gpointer d)
   if (WP_IS_DEVICE (proxy)) {
     g_signal_connect_object (proxy, "params-changed",
         G_CALLBACK (schedule_rescan), self, G_CONNECT_SWAPPED);
+  } else if (WP_IS_NODE (proxy)) {
+    on_node_added (self, WP_NODE (proxy));
+  } else if (WP_IS_PORT (proxy)) {
+    on_port_added (self, WP_PORT (proxy));
   }
 }
 
+static void
+on_object_removed (WpObjectManager *om, WpPipewireObject *proxy, gpointer d)
+{
+  WpDefaultNodes * self = WP_DEFAULT_NODES (d);
+
+  if (WP_IS_DEVICE (proxy))
+    schedule_rescan (self);
+  else if (WP_IS_NODE (proxy))
+    on_node_removed (self, WP_NODE (proxy));
+  else if (WP_IS_PORT (proxy))
+    on_port_removed (self, WP_PORT (proxy));
+}
+
 static void
 on_metadata_added (WpObjectManager *om, WpMetadata *metadata, gpointer d)
 {
@@ -519,10 +726,14 @@ on_metadata_added (WpObjectManager *om, WpMetadata *metadata, gpointer d)
       WP_OBJECT_FEATURES_ALL);
   wp_object_manager_request_object_features (self->rescan_om, WP_TYPE_PORT,
       WP_OBJECT_FEATURES_ALL);
-  g_signal_connect_object (self->rescan_om, "objects-changed",
-      G_CALLBACK (schedule_rescan), self, G_CONNECT_SWAPPED);
   g_signal_connect_object (self->rescan_om, "object-added",
       G_CALLBACK (on_object_added), self, 0);
+  g_signal_connect_object (self->rescan_om, "object-removed",
+      G_CALLBACK (on_object_removed), self, 0);
+  /* evaluate all the defaults once the existing objects are known, which
+     also picks up the types that were marked before the metadata existed */
+  g_signal_connect_object (self->rescan_om, "installed",
+      G_CALLBACK (schedule_rescan), self, G_CONNECT_SWAPPED);
   wp_core_install_object_manager (core, self->rescan_om);
 }
 
@@ -538,6 +749,13 @@ wp_default_nodes_enable (WpPlugin * plugin, WpTransition * transition)
     load_state (self);
   }
 
+  self->nodes = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) node_info_free);
+  self->ports = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      g_free);
+  for (guint i = 0; i < N_DEFAULT_NODES; i++)
+    self->defaults[i].candidates = g_ptr_array_new ();
+
   /* Create the metadata object manager */
   self->metadata_om = wp_object_manager_new ();
   wp_object_manager_add_interest (self->metadata_om, WP_TYPE_METADATA,
@@ -568,10 +786,15 @@ wp_default_nodes_disable (WpPlugin * plugin)
 
     for (guint j = 0; j < N_PREV_CONFIGS; j++)
       g_clear_pointer (&self->defaults[i].prev_config_value[j], g_free);
+
+    g_clear_pointer (&self->defaults[i].candidates, g_ptr_array_unref);
   }
 
   g_clear_object (&self->metadata_om);
   g_clear_object (&self->rescan_om);
+  g_clear_pointer (&self->ports, g_hash_table_unref);
+  g_clear_pointer (&self->nodes, g_hash_table_unref);
+  self->dirty = 0;
   g_clear_object (&self->state);
 }
 
@@ -0,0 +1,958 @@
+/* WirePlumber
+ *
+ * Copyright © 2022 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <wp/wp.h>
+#include <spa/utils/defs.h>
+#include <spa/utils/string.h>
+#include <pipewire/keys.h>
+
+/*
+ * This plugin keeps track of the linkables and the links that the node
+ * policy (policy-node.lua) works with and maintains indexes that allow the
+ * policy to find link targets without iterating over all the linkables.
+ *
+ * It also keeps track of which stream linkables may need to be re-linked
+ * after a change in the graph (the "dirty" set), so that the policy only
+ * needs to handle the affected streams instead of rescanning everything.
+ */
+
+/* the properties of the linkables that can be used with "find-linkables" */
+static const gchar * INDEXED_PROPS[] = {
+  "node.id", "object.serial", "node.name", "object.path", "node.link-group",
+  "device.id",
+};
+
+static const gchar * DEFAULT_MEDIA_CLASSES[] = {
+  "Audio/Sink", "Audio/Source", "Video/Source",
+};
+
+struct _WpLinkingApi
+{
+  WpPlugin parent;
+
+  WpObjectManager *linkables_om;
+  WpObjectManager *links_om;
+  WpObjectManager *metadata_om;
+  guint n_pending_oms;
+  gboolean move;
+  GSource *changed_source;
+
+  /* linkable id -> WpSessionItem* */
+  GHashTable *linkables;
+  /* "direction:media.type" -> GPtrArray<WpSessionItem*>, the device
+     linkables, sorted by descending priority.session and item.plugged.usec */
+  GHashTable *targets;
+  /* "target direction:media.type" -> GHashTable<id>, the stream linkables */
+  GHashTable *streams;
+  /* property name -> GHashTable<value -> GPtrArray<WpSessionItem*>> */
+  GHashTable *props;
+  /* linkable id -> GPtrArray<WpSessionItem*>, the links of each linkable */
+  GHashTable *links;
+  /* stream ids that have a target defined in their properties */
+  GHashTable *defined_targets;
+  /* node ids that have a target defined in the "default" metadata */
+  GHashTable *metadata_targets;
+  /* the last known default node ids, for each of DEFAULT_MEDIA_CLASSES */
+  guint32 default_nodes[G_N_ELEMENTS (DEFAULT_MEDIA_CLASSES)];
+  /* ids of the stream linkables that need to be handled */
+  GHashTable *dirty;
+};
+
+enum {
+  ACTION_GET_LINKABLE,
+  ACTION_FIND_LINKABLES,
+  ACTION_GET_TARGETS,
+  ACTION_GET_PEERS,
+  ACTION_GET_LINK_STATE,
+  ACTION_LOOKUP_LINK,
+  ACTION_TAKE_DIRTY,
+  ACTION_MARK_DIRTY,
+  ACTION_MARK_ALL_DIRTY,
+  ACTION_MARK_DEVICE_DIRTY,
+  ACTION_MARK_DEFAULTS_DIRTY,
+  SIGNAL_CHANGED,
+  N_SIGNALS
+};
+
+enum {
+  PROP_0,
+  PROP_MOVE,
+};
+
+static guint signals[N_SIGNALS] = {0};
+
+G_DECLARE_FINAL_TYPE (WpLinkingApi, wp_linking_api,
+                      WP, LINKING_API, WpPlugin)
+G_DEFINE_TYPE (WpLinkingApi, wp_linking_api, WP_TYPE_PLUGIN)
+
+static void
+wp_linking_api_init (WpLinkingApi * self)
+{
+}
+
+static void load_metadata_targets (WpLinkingApi * self);
+
+static void
+wp_linking_api_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  WpLinkingApi *self = WP_LINKING_API (object);
+
+  switch (property_id) {
+  case PROP_MOVE:
+    g_value_set_boolean (value, self->move);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+static void
+wp_linking_api_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  WpLinkingApi *self = WP_LINKING_API (object);
+
+  switch (property_id) {
+  case PROP_MOVE:
+    if (self->move != g_value_get_boolean (value)) {
+      self->move = g_value_get_boolean (value);
+      load_metadata_targets (self);
+    }
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+static gboolean
+parse_bool (const gchar * str)
+{
+  return str && (!g_ascii_strcasecmp (str, "true") || spa_streq (str, "1"));
+}
+
+static gboolean
+is_stream (WpProperties * props)
+{
+  return spa_streq (wp_properties_get (props, "item.node.type"), "stream");
+}
+
+static gboolean
+is_device (WpProperties * props)
+{
+  return spa_streq (wp_properties_get (props, "item.node.type"), "device");
+}
+
+/* same as getTargetDirection() in policy-node.lua */
+static const gchar *
+get_target_direction (WpProperties * props)
+{
+  const gchar *direction = wp_properties_get (props, "item.node.direction");
+
+  if (spa_streq (direction, "output") ||
+      (spa_streq (direction, "input") &&
+          parse_bool (wp_properties_get (props, "stream.capture.sink"))))
+    return "input";
+  return "output";
+}
+
+static gchar *
+make_key (const gchar * direction, const gchar * media_type)
+{
+  return g_strdup_printf ("%s:%s", direction, media_type ? media_type : "");
+}
+
+static gchar *
+get_target_key (WpProperties * props)
+{
+  return make_key (wp_properties_get (props, "item.node.direction"),
+      wp_properties_get (props, PW_KEY_MEDIA_TYPE));
+}
+
+static gchar *
+get_stream_key (WpProperties * props)
+{
+  return make_key (get_target_direction (props),
+      wp_properties_get (props, PW_KEY_MEDIA_TYPE));
+}
+
+static guint32
+get_id (gpointer si)
+{
+  return wp_session_item_get_id (WP_SESSION_ITEM (si));
+}
+
+static gint
+compare_targets (WpSessionItem * a, WpSessionItem * b)
+{
+  g_autoptr (WpProperties) pa = wp_session_item_get_properties (a);
+  g_autoptr (WpProperties) pb = wp_session_item_get_properties (b);
+  const gchar *str;
+  gint64 prio_a = 0, prio_b = 0;
+  guint64 plugged_a = 0, plugged_b = 0;
+
+  if ((str = wp_properties_get (pa, "priority.session")))
+    prio_a = g_ascii_strtoll (str, NULL, 10);
+  if ((str = wp_properties_get (pb, "priority.session")))
+    prio_b = g_ascii_strtoll (str, NULL, 10);
+  if (prio_a != prio_b)
+    return (prio_a > prio_b) ? -1 : 1;
+
+  if ((str = wp_properties_get (pa, "item.plugged.usec")))
+    plugged_a = g_ascii_strtoull (str, NULL, 10);
+  if ((str = wp_properties_get (pb, "item.plugged.usec")))
+    plugged_b = g_ascii_strtoull (str, NULL, 10);
+  if (plugged_a != plugged_b)
+    return (plugged_a > plugged_b) ? -1 : 1;
+
+  return 0;
+}
+
+static void
+insert_target (GPtrArray * targets, WpSessionItem * si)
+{
+  guint lo = 0, hi = targets->len;
+
+  /* insert after all the targets that compare equal,
+     to keep the order in which they appeared */
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+    if (compare_targets (g_ptr_array_index (targets, mid), si) <= 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  g_ptr_array_insert (targets, lo, si);
+}
+
+static gboolean
+emit_changed (WpLinkingApi * self)
+{
+  g_clear_pointer (&self->changed_source, g_source_unref);
+  if (g_hash_table_size (self->dirty) > 0)
+    g_signal_emit (self, signals[SIGNAL_CHANGED], 0);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_changed (WpLinkingApi * self)
+{
+  g_autoptr (WpCore) core = NULL;
+
+  if (self->changed_source)
+    return;
+
+  core = wp_object_get_core (WP_OBJECT (self));
+  g_return_if_fail (core);
+  wp_core_idle_add_closure (core, &self->changed_source,
+      g_cclosure_new_object (G_CALLBACK (emit_changed), G_OBJECT (self)));
+}
+
+static void
+mark_stream_dirty (WpLinkingApi * self, guint32 id)
+{
+  g_hash_table_add (self->dirty, GUINT_TO_POINTER (id));
+  schedule_changed (self);
+}
+
+static void
+mark_streams_dirty (WpLinkingApi * self, const gchar * stream_key)
+{
+  GHashTable *streams = g_hash_table_lookup (self->streams, stream_key);
+  GHashTableIter iter;
+  gpointer id;
+
+  if (!streams)
+    return;
+
+  g_hash_table_iter_init (&iter, streams);
+  while (g_hash_table_iter_next (&iter, &id, NULL))
+    mark_stream_dirty (self, GPOINTER_TO_UINT (id));
+}
+
+static GPtrArray *
+find_linkables (WpLinkingApi * self, const gchar * prop, const gchar * value)
+{
+  GHashTable *values = g_hash_table_lookup (self->props, prop);
+  return (values && value) ? g_hash_table_lookup (values, value) : NULL;
+}
+
+/* marks the streams that may have to be re-linked after a change in
+   the given linkable */
+static void
+mark_linkable_dirty (WpLinkingApi * self, WpSessionItem * si)
+{
+  g_autoptr (WpProperties) props = wp_session_item_get_properties (si);
+  GHashTableIter iter;
+  gpointer id;
+
+  if (is_stream (props)) {
+    mark_stream_dirty (self, get_id (si));
+  } else {
+    g_autofree gchar *key = get_target_key (props);
+    mark_streams_dirty (self, key);
+  }
+
+  /* any linkable may be the explicitly defined target of a stream */
+  g_hash_table_iter_init (&iter, self->defined_targets);
+  while (g_hash_table_iter_next (&iter, &id, NULL))
+    mark_stream_dirty (self, GPOINTER_TO_UINT (id));
+
+  g_hash_table_iter_init (&iter, self->metadata_targets);
+  while (g_hash_table_iter_next (&iter, &id, NULL)) {
+    g_autofree gchar *node_id = g_strdup_printf ("%u", GPOINTER_TO_UINT (id));
+    GPtrArray *sis = find_linkables (self, "node.id", node_id);
+    for (guint i = 0; sis && i < sis->len; i++)
+      mark_stream_dirty (self, get_id (g_ptr_array_index (sis, i)));
+  }
+}
+
+static void
+mark_all_dirty (WpLinkingApi * self)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, self->linkables);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    g_autoptr (WpProperties) props = wp_session_item_get_properties (value);
+    if (is_stream (props))
+      mark_stream_dirty (self, get_id (value));
+  }
+}
+
+static void
+index_props (WpLinkingApi * self, WpSessionItem * si, WpProperties * props,
+    gboolean add)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (INDEXED_PROPS); i++) {
+    const gchar *value = wp_properties_get (props, INDEXED_PROPS[i]);
+    GHashTable *values = g_hash_table_lookup (self->props, INDEXED_PROPS[i]);
+    GPtrArray *sis;
+
+    if (!value)
+      continue;
+
+    sis = g_hash_table_lookup (values, value);
+    if (add) {
+      if (!sis) {
+        sis = g_ptr_array_new ();
+        g_hash_table_insert (values, g_strdup (value), sis);
+      }
+      g_ptr_array_add (sis, si);
+    } else if (sis) {
+      g_ptr_array_remove (sis, si);
+      if (sis->len == 0)
+        g_hash_table_remove (values, value);
+    }
+  }
+}
+
+static void
+on_linkable_added (WpObjectManager * om, WpSessionItem * si,
+    WpLinkingApi * self)
+{
+  g_autoptr (WpProperties) props = wp_session_item_get_properties (si);
+  guint32 id = get_id (si);
+
+  g_hash_table_insert (self->linkables, GUINT_TO_POINTER (id),
+      g_object_ref (si));
+  index_props (self, si, props, TRUE);
+
+  if (is_stream (props)) {
+    g_autofree gchar *key = get_stream_key (props);
+    GHashTable *streams = g_hash_table_lookup (self->streams, key);
+    if (!streams) {
+      streams = g_hash_table_new (g_direct_hash, g_direct_equal);
+      g_hash_table_insert (self->streams, g_steal_pointer (&key), streams);
+    }
+    g_hash_table_add (streams, GUINT_TO_POINTER (id));
+
+    if (wp_properties_get (props, "target.object") ||
+        wp_properties_get (props, "node.target"))
+      g_hash_table_add (self->defined_targets, GUINT_TO_POINTER (id));
+  }
+  else if (is_device (props)) {
+    g_autofree gchar *key = get_target_key (props);
+    GPtrArray *targets = g_hash_table_lookup (self->targets, key);
+    if (!targets) {
+      targets = g_ptr_array_new ();
+      g_hash_table_insert (self->targets, g_steal_pointer (&key), targets);
+    }
+    insert_target (targets, si);
+  }
+
+  wp_trace_object (self, "linkable added: " WP_OBJECT_FORMAT,
+      WP_OBJECT_ARGS (si));
+  mark_linkable_dirty (self, si);
+}
+
+static void
+on_linkable_removed (WpObjectManager * om, WpSessionItem * si,
+    WpLinkingApi * self)
+{
+  g_autoptr (WpProperties) props = wp_session_item_get_properties (si);
+  guint32 id = get_id (si);
+
+  if (!g_hash_table_contains (self->linkables, GUINT_TO_POINTER (id)))
+    return;
+
+  wp_trace_object (self, "linkable removed: " WP_OBJECT_FORMAT,
+      WP_OBJECT_ARGS (si));
+
+  index_props (self, si, props, FALSE);
+
+  if (is_stream (props)) {
+    g_autofree gchar *key = get_stream_key (props);
+    GHashTable *streams = g_hash_table_lookup (self->streams, key);
+    if (streams) {
+      g_hash_table_remove (streams, GUINT_TO_POINTER (id));
+      if (g_hash_table_size (streams) == 0)
+        g_hash_table_remove (self->streams, key);
+    }
+    g_hash_table_remove (self->defined_targets, GUINT_TO_POINTER (id));
+    g_hash_table_remove (self->dirty, GUINT_TO_POINTER (id));
+  }
+  else if (is_device (props)) {
+    g_autofree gchar *key = get_target_key (props);
+    GPtrArray *targets = g_hash_table_lookup (self->targets, key);
+    if (targets) {
+      g_ptr_array_remove (targets, si);
+      if (targets->len == 0)
+        g_hash_table_remove (self->targets, key);
+    }
+  }
+
+  if (!is_stream (props))
+    mark_linkable_dirty (self, si);
+
+  g_hash_table_remove (self->linkables, GUINT_TO_POINTER (id));
+}
+
+static guint32
+get_link_item_id (WpProperties * props, const gchar * key)
+{
+  const gchar *str = wp_properties_get (props, key);
+  guint32 id;
+  return (str && spa_atou32 (str, &id, 10)) ? id : SPA_ID_INVALID;
+}
+
+static void
+on_link_changed (WpLinkingApi * self, WpSessionItem * link, gboolean added)
+{
+  g_autoptr (WpProperties) props = wp_session_item_get_properties (link);
+  guint32 ids[2] = {
+    get_link_item_id (props, "out.item.id"),
+    get_link_item_id (props, "in.item.id"),
+  };
+  gboolean link_group = FALSE;
+
+  for (guint i = 0; i < G_N_ELEMENTS (ids); i++) {
+    gpointer key = GUINT_TO_POINTER (ids[i]);
+    GPtrArray *links = g_hash_table_lookup (self->links, key);
+    WpSessionItem *si;
+
+    if (ids[i] == SPA_ID_INVALID)
+      continue;
+
+    if (added) {
+      if (!links) {
+        links = g_ptr_array_new_with_free_func (g_object_unref);
+        g_hash_table_insert (self->links, key, links);
+      }
+      g_ptr_array_add (links, g_object_ref (link));
+    } else if (links) {
+      g_ptr_array_remove (links, link);
+      if (links->len == 0)
+        g_hash_table_remove (self->links, key);
+    }
+
+    /* the link state of a target affects the streams that may link to it */
+    si = g_hash_table_lookup (self->linkables, key);
+    if (si) {
+      g_autoptr (WpProperties) si_props = wp_session_item_get_properties (si);
+      if (wp_properties_get (si_props, "node.link-group"))
+        link_group = TRUE;
+      mark_linkable_dirty (self, si);
+    }
+  }
+
+  /* links between nodes of link groups affect which targets the streams
+     of other link groups can link to; this is rare, so keep it simple */
+  if (link_group)
+    mark_all_dirty (self);
+}
+
+static void
+on_link_added (WpObjectManager * om, WpSessionItem * link,
+    WpLinkingApi * self)
+{
+  on_link_changed (self, link, TRUE);
+}
+
+static void
+on_link_removed (WpObjectManager * om, WpSessionItem * link,
+    WpLinkingApi * self)
+{
+  on_link_changed (self, link, FALSE);
+}
+
+static void
+on_metadata_changed (WpMetadata * m, guint32 subject, const gchar * key,
+    const gchar * type, const gchar * value, WpLinkingApi * self)
+{
+  g_autofree gchar *node_id = NULL;
+  GPtrArray *sis;
+
+  /* like in policy-node.lua, metadata targets are only followed
+     when moving streams is enabled */
+  if (!self->move)
+    return;
+
+  /* a NULL key means that all the keys of the subject were removed */
+  if (key && !spa_streq (key, "target.node") &&
+      !spa_streq (key, "target.object"))
+    return;
+
+  if (value && !spa_streq (value, "-1"))
+    g_hash_table_add (self->metadata_targets, GUINT_TO_POINTER (subject));
+  else if (!key || !value)
+    g_hash_table_remove (self->metadata_targets, GUINT_TO_POINTER (subject));
+
+  node_id = g_strdup_printf ("%u", subject);
+  sis = find_linkables (self, "node.id", node_id);
+  for (guint i = 0; sis && i < sis->len; i++)
+    mark_stream_dirty (self, get_id (g_ptr_array_index (sis, i)));
+}
+
+static void
+load_metadata (WpLinkingApi * self, WpMetadata * m)
+{
+  g_autoptr (WpIterator) it = wp_metadata_new_iterator (m, PW_ID_ANY);
+  g_auto (GValue) val = G_VALUE_INIT;
+
+  for (; wp_iterator_next (it, &val); g_value_unset (&val)) {
+    guint32 subject;
+    const gchar *key, *type, *value;
+    wp_metadata_iterator_item_extract (&val, &subject, &key, &type, &value);
+    on_metadata_changed (m, subject, key, type, value, self);
+  }
+}
+
+/* called when "move" changes, to start or stop following metadata targets */
+static void
+load_metadata_targets (WpLinkingApi * self)
+{
+  g_autoptr (WpMetadata) m = NULL;
+  GHashTableIter iter;
+  gpointer id;
+
+  if (!self->metadata_om)
+    return;
+
+  /* the streams that had a metadata target may now link elsewhere */
+  g_hash_table_iter_init (&iter, self->metadata_targets);
+  while (g_hash_table_iter_next (&iter, &id, NULL)) {
+    g_autofree gchar *node_id = g_strdup_printf ("%u", GPOINTER_TO_UINT (id));
+    GPtrArray *sis = find_linkables (self, "node.id", node_id);
+    for (guint i = 0; sis && i < sis->len; i++)
+      mark_stream_dirty (self, get_id (g_ptr_array_index (sis, i)));
+  }
+  g_hash_table_remove_all (self->metadata_targets);
+
+  m = wp_object_manager_lookup (self->metadata_om, WP_TYPE_METADATA, NULL);
+  if (m)
+    load_metadata (self, m);
+}
+
+static void
+on_metadata_added (WpObjectManager * om, WpMetadata * m, WpLinkingApi * self)
+{
+  load_metadata (self, m);
+  g_signal_connect_object (m, "changed",
+      G_CALLBACK (on_metadata_changed), self, 0);
+}
+
+static void
+on_om_installed (WpObjectManager * om, WpLinkingApi * self)
+{
+  if (--self->n_pending_oms == 0)
+    wp_object_update_features (WP_OBJECT (self), WP_PLUGIN_FEATURE_ENABLED, 0);
+}
+
+static void
+wp_linking_api_enable (WpPlugin * plugin, WpTransition * transition)
+{
+  WpLinkingApi * self = WP_LINKING_API (plugin);
+  g_autoptr (WpCore) core = wp_object_get_core (WP_OBJECT (plugin));
+  g_return_if_fail (core);
+
+  self->linkables = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, g_object_unref);
+  self->targets = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_ptr_array_unref);
+  self->streams = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_hash_table_unref);
+  self->props = g_hash_table_new_full (g_str_hash, g_str_equal,
+      NULL, (GDestroyNotify) g_hash_table_unref);
+  for (guint i = 0; i < G_N_ELEMENTS (INDEXED_PROPS); i++)
+    g_hash_table_insert (self->props, (gpointer) INDEXED_PROPS[i],
+        g_hash_table_new_full (g_str_hash, g_str_equal,
+            g_free, (GDestroyNotify) g_ptr_array_unref));
+  self->links = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) g_ptr_array_unref);
+  self->defined_targets = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->metadata_targets = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->dirty = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (guint i = 0; i < G_N_ELEMENTS (DEFAULT_MEDIA_CLASSES); i++)
+    self->default_nodes[i] = SPA_ID_INVALID;
+
+  self->n_pending_oms = 3;
+
+  /* same linkables and links as the ones handled by policy-node.lua */
+  self->linkables_om = wp_object_manager_new ();
+  wp_object_manager_add_interest (self->linkables_om, WP_TYPE_SI_LINKABLE,
+      WP_CONSTRAINT_TYPE_PW_PROPERTY, "item.factory.name", "c(ss)",
+          "si-audio-adapter", "si-node",
+      WP_CONSTRAINT_TYPE_G_PROPERTY, "active-features", "!u", 0,
+      NULL);
+  g_signal_connect_object (self->linkables_om, "object-added",
+      G_CALLBACK (on_linkable_added), self, 0);
+  g_signal_connect_object (self->linkables_om, "object-removed",
+      G_CALLBACK (on_linkable_removed), self, 0);
+  g_signal_connect_object (self->linkables_om, "installed",
+      G_CALLBACK (on_om_installed), self, 0);
+  wp_core_install_object_manager (core, self->linkables_om);
+
+  self->links_om = wp_object_manager_new ();
+  wp_object_manager_add_interest (self->links_om, WP_TYPE_SI_LINK,
+      WP_CONSTRAINT_TYPE_PW_PROPERTY, "is.policy.item.link", "=b", TRUE,
+      NULL);
+  g_signal_connect_object (self->links_om, "object-added",
+      G_CALLBACK (on_link_added), self, 0);
+  g_signal_connect_object (self->links_om, "object-removed",
+      G_CALLBACK (on_link_removed), self, 0);
+  g_signal_connect_object (self->links_om, "installed",
+      G_CALLBACK (on_om_installed), self, 0);
+  wp_core_install_object_manager (core, self->links_om);
+
+  self->metadata_om = wp_object_manager_new ();
+  wp_object_manager_add_interest (self->metadata_om, WP_TYPE_METADATA,
+      WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "metadata.name", "=s", "default",
+      NULL);
+  wp_object_manager_request_object_features (self->metadata_om,
+      WP_TYPE_METADATA, WP_OBJECT_FEATURES_ALL);
+  g_signal_connect_object (self->metadata_om, "object-added",
+      G_CALLBACK (on_metadata_added), self, 0);
+  g_signal_connect_object (self->metadata_om, "installed",
+      G_CALLBACK (on_om_installed), self, 0);
+  wp_core_install_object_manager (core, self->metadata_om);
+}
+
+static void
+wp_linking_api_disable (WpPlugin * plugin)
+{
+  WpLinkingApi * self = WP_LINKING_API (plugin);
+
+  if (self->changed_source)
+    g_source_destroy (self->changed_source);
+  g_clear_pointer (&self->changed_source, g_source_unref);
+
+  g_clear_object (&self->metadata_om);
+  g_clear_object (&self->links_om);
+  g_clear_object (&self->linkables_om);
+
+  g_clear_pointer (&self->dirty, g_hash_table_unref);
+  g_clear_pointer (&self->metadata_targets, g_hash_table_unref);
+  g_clear_pointer (&self->defined_targets, g_hash_table_unref);
+  g_clear_pointer (&self->links, g_hash_table_unref);
+  g_clear_pointer (&self->props, g_hash_table_unref);
+  g_clear_pointer (&self->streams, g_hash_table_unref);
+  g_clear_pointer (&self->targets, g_hash_table_unref);
+  g_clear_pointer (&self->linkables, g_hash_table_unref);
+}
+
+static GVariant *
+ids_to_variant (GPtrArray * objects)
+{
+  g_auto (GVariantBuilder) b = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("au"));
+  for (guint i = 0; objects && i < objects->len; i++)
+    g_variant_builder_add (&b, "u", get_id (g_ptr_array_index (objects, i)));
+  return g_variant_builder_end (&b);
+}
+
+static gpointer
+wp_linking_api_get_linkable (WpLinkingApi * self, guint id)
+{
+  gpointer si = g_hash_table_lookup (self->linkables, GUINT_TO_POINTER (id));
+  return si ? g_object_ref (si) : NULL;
+}
+
+static GVariant *
+wp_linking_api_find_linkables (WpLinkingApi * self, const gchar * prop,
+    const gchar * value)
+{
+  return ids_to_variant (find_linkables (self, prop, value));
+}
+
+static GVariant *
+wp_linking_api_get_targets (WpLinkingApi * self, const gchar * direction,
+    const gchar * media_type)
+{
+  g_autofree gchar *key = make_key (direction, media_type);
+  return ids_to_variant (g_hash_table_lookup (self->targets, key));
+}
+
+static GVariant *
+wp_linking_api_get_peers (WpLinkingApi * self, guint id)
+{
+  g_auto (GVariantBuilder) b = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("au"));
+  GPtrArray *links = g_hash_table_lookup (self->links, GUINT_TO_POINTER (id));
+
+  for (guint i = 0; links && i < links->len; i++) {
+    g_autoptr (WpProperties) props =
+        wp_session_item_get_properties (g_ptr_array_index (links, i));
+    guint32 out_id = get_link_item_id (props, "out.item.id");
+    guint32 in_id = get_link_item_id (props, "in.item.id");
+    guint32 peer_id = (out_id == id) ? in_id : out_id;
+    if (peer_id != SPA_ID_INVALID)
+      g_variant_builder_add (&b, "u", peer_id);
+  }
+  return g_variant_builder_end (&b);
+}
+
+static gint
+wp_linking_api_get_link_state (WpLinkingApi * self, guint id)
+{
+  GPtrArray *links = g_hash_table_lookup (self->links, GUINT_TO_POINTER (id));
+  g_autoptr (WpProperties) props = NULL;
+
+  if (!links || links->len == 0)
+    return 0;
+
+  /* same as isLinked() in policy-node.lua, which checks the first link */
+  props = wp_session_item_get_properties (g_ptr_array_index (links, 0));
+  if (parse_bool (wp_properties_get (props, "exclusive")) ||
+      parse_bool (wp_properties_get (props, "passthrough")))
+    return 2;
+  return 1;
+}
+
+static gpointer
+wp_linking_api_lookup_link (WpLinkingApi * self, guint id, guint peer_id)
+{
+  GPtrArray *links = g_hash_table_lookup (self->links, GUINT_TO_POINTER (id));
+
+  for (guint i = 0; links && i < links->len; i++) {
+    WpSessionItem *link = g_ptr_array_index (links, i);
+    g_autoptr (WpProperties) props = wp_session_item_get_properties (link);
+    guint32 out_id = get_link_item_id (props, "out.item.id");
+    guint32 in_id = get_link_item_id (props, "in.item.id");
+    if ((out_id == id && in_id == peer_id) ||
+        (in_id == id && out_id == peer_id))
+      return g_object_ref (link);
+  }
+  return NULL;
+}
+
+static gint
+compare_ids (gconstpointer a, gconstpointer b)
+{
+  guint32 ia = *(const guint32 *) a, ib = *(const guint32 *) b;
+  return (ia > ib) - (ia < ib);
+}
+
+static GVariant *
+wp_linking_api_take_dirty (WpLinkingApi * self)
+{
+  g_autoptr (GArray) ids = g_array_sized_new (FALSE, FALSE, sizeof (guint32),
+      g_hash_table_size (self->dirty));
+  GHashTableIter iter;
+  gpointer id;
+
+  g_hash_table_iter_init (&iter, self->dirty);
+  while (g_hash_table_iter_next (&iter, &id, NULL)) {
+    guint32 v = GPOINTER_TO_UINT (id);
+    g_array_append_val (ids, v);
+  }
+  g_hash_table_remove_all (self->dirty);
+
+  /* handle the streams in the order in which they appeared */
+  g_array_sort (ids, compare_ids);
+
+  return g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32, ids->data, ids->len,
+      sizeof (guint32));
+}
+
+static void
+wp_linking_api_mark_dirty (WpLinkingApi * self, guint id)
+{
+  WpSessionItem *si =
+      g_hash_table_lookup (self->linkables, GUINT_TO_POINTER (id));
+  if (si)
+    mark_linkable_dirty (self, si);
+}
+
+static void
+wp_linking_api_mark_all_dirty (WpLinkingApi * self)
+{
+  mark_all_dirty (self);
+}
+
+static void
+wp_linking_api_mark_device_dirty (WpLinkingApi * self, guint device_id)
+{
+  g_autofree gchar *id = g_strdup_printf ("%u", device_id);
+  GPtrArray *sis = find_linkables (self, "device.id", id);
+
+  for (guint i = 0; sis && i < sis->len; i++)
+    mark_linkable_dirty (self, g_ptr_array_index (sis, i));
+}
+
+static void
+wp_linking_api_mark_defaults_dirty (WpLinkingApi * self)
+{
+  g_autoptr (WpCore) core = wp_object_get_core (WP_OBJECT (self));
+  g_autoptr (WpPlugin) default_nodes =
+      core ? wp_plugin_find (core, "default-nodes-api") : NULL;
+
+  if (!default_nodes) {
+    mark_all_dirty (self);
+    return;
+  }
+
+  /* only mark the streams of the media classes whose default changed */
+  for (guint i = 0; i < G_N_ELEMENTS (DEFAULT_MEDIA_CLASSES); i++) {
+    const gchar *media_class = DEFAULT_MEDIA_CLASSES[i];
+    guint32 id = SPA_ID_INVALID;
+
+    g_signal_emit_by_name (default_nodes, "get-default-node", media_class, &id);
+    if (id != self->default_nodes[i]) {
+      g_autofree gchar *media_type =
+          g_strndup (media_class, strchr (media_class, '/') - media_class);
+      g_autofree gchar *key = make_key (
+          g_str_has_suffix (media_class, "/Sink") ? "input" : "output",
+          media_type);
+
+      wp_debug_object (self, "default %s changed: %d -> %d", media_class,
+          self->default_nodes[i], id);
+      self->default_nodes[i] = id;
+      mark_streams_dirty (self, key);
+    }
+  }
+}
+
+static void
+wp_linking_api_class_init (WpLinkingApiClass * klass)
+{
+  GObjectClass *object_class = (GObjectClass *) klass;
+  WpPluginClass *plugin_class = (WpPluginClass *) klass;
+
+  object_class->set_property = wp_linking_api_set_property;
+  object_class->get_property = wp_linking_api_get_property;
+
+  plugin_class->enable = wp_linking_api_enable;
+  plugin_class->disable = wp_linking_api_disable;
+
+  g_object_class_install_property (object_class, PROP_MOVE,
+      g_param_spec_boolean ("move", "move",
+          "Whether target.node metadata changes move streams", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  signals[ACTION_GET_LINKABLE] = g_signal_new_class_handler (
+      "get-linkable", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_get_linkable,
+      NULL, NULL, NULL,
+      WP_TYPE_SESSION_ITEM, 1, G_TYPE_UINT);
+
+  signals[ACTION_FIND_LINKABLES] = g_signal_new_class_handler (
+      "find-linkables", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_find_linkables,
+      NULL, NULL, NULL,
+      G_TYPE_VARIANT, 2, G_TYPE_STRING, G_TYPE_STRING);
+
+  signals[ACTION_GET_TARGETS] = g_signal_new_class_handler (
+      "get-targets", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_get_targets,
+      NULL, NULL, NULL,
+      G_TYPE_VARIANT, 2, G_TYPE_STRING, G_TYPE_STRING);
+
+  signals[ACTION_GET_PEERS] = g_signal_new_class_handler (
+      "get-peers", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_get_peers,
+      NULL, NULL, NULL,
+      G_TYPE_VARIANT, 1, G_TYPE_UINT);
+
+  signals[ACTION_GET_LINK_STATE] = g_signal_new_class_handler (
+      "get-link-state", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_get_link_state,
+      NULL, NULL, NULL,
+      G_TYPE_INT, 1, G_TYPE_UINT);
+
+  signals[ACTION_LOOKUP_LINK] = g_signal_new_class_handler (
+      "lookup-link", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_lookup_link,
+      NULL, NULL, NULL,
+      WP_TYPE_SESSION_ITEM, 2, G_TYPE_UINT, G_TYPE_UINT);
+
+  signals[ACTION_TAKE_DIRTY] = g_signal_new_class_handler (
+      "take-dirty", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_take_dirty,
+      NULL, NULL, NULL,
+      G_TYPE_VARIANT, 0);
+
+  signals[ACTION_MARK_DIRTY] = g_signal_new_class_handler (
+      "mark-dirty", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_mark_dirty,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 1, G_TYPE_UINT);
+
+  signals[ACTION_MARK_ALL_DIRTY] = g_signal_new_class_handler (
+      "mark-all-dirty", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_mark_all_dirty,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 0);
+
+  signals[ACTION_MARK_DEVICE_DIRTY] = g_signal_new_class_handler (
+      "mark-device-dirty", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_mark_device_dirty,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 1, G_TYPE_UINT);
+
+  signals[ACTION_MARK_DEFAULTS_DIRTY] = g_signal_new_class_handler (
+      "mark-defaults-dirty", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      (GCallback) wp_linking_api_mark_defaults_dirty,
+      NULL, NULL, NULL,
+      G_TYPE_NONE, 0);
+
+  signals[SIGNAL_CHANGED] = g_signal_new (
+      "changed", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+}
+
+WP_PLUGIN_EXPORT gboolean
+wireplumber__module_init (WpCore * core, GVariant * args, GError ** error)
+{
+  wp_plugin_register (g_object_new (wp_linking_api_get_type (),
+          "name", "linking-api",
+          "core", core,
+          NULL));
+  return TRUE;
+}
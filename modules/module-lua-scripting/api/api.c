@@ -621,6 +621,10 @@ object_interest_new_add_constraint (lua_State *L, GType type,
       g_ptr_array_add (values, g_variant_ref_sink (tmp));
       lua_pop (L, 1);
     }
+    if (G_UNLIKELY (values->len == 0)) {
+      g_ptr_array_unref (values);
+      luaL_error (L, "Constraint: in-list requires at least one value");
+    }
     value = g_variant_new_tuple ((GVariant **) values->pdata, values->len);
     g_ptr_array_unref (values);
     break;
@@ -769,6 +773,14 @@ object_manager_activate (lua_State *L)
   return 0;
 }
 
+static int
+object_manager_set_batched (lua_State *L)
+{
+  WpObjectManager *om = wplua_checkobject (L, 1, WP_TYPE_OBJECT_MANAGER);
+  wp_object_manager_set_batched (om, lua_toboolean (L, 2));
+  return 0;
+}
+
 static int
 object_manager_get_n_objects (lua_State *L)
 {
@@ -806,6 +818,7 @@ object_manager_lookup (lua_State *L)
 
 static const luaL_Reg object_manager_methods[] = {
   { "activate", object_manager_activate },
+  { "set_batched", object_manager_set_batched },
   { "get_n_objects", object_manager_get_n_objects },
   { "iterate", object_manager_iterate },
   { "lookup", object_manager_lookup },
@@ -1427,6 +1440,49 @@ state_save (lua_State *L)
   return 2;
 }
 
+static void
+state_add_key (lua_State *L, WpProperties *props, GPtrArray *keys, int key)
+{
+  const gchar *k = lua_tostring (L, key);
+
+  /* convert only the value of this key; nil values remove it */
+  g_ptr_array_add (keys, g_strdup (k));
+  if (lua_getfield (L, 2, k) != LUA_TNIL) {
+    wp_properties_set (props, k, luaL_tolstring (L, -1, NULL));
+    lua_pop (L, 1);
+  }
+  lua_pop (L, 1);
+}
+
+static int
+state_save_keys (lua_State *L)
+{
+  WpState *state = wplua_checkobject (L, 1, WP_TYPE_STATE);
+  luaL_checktype (L, 2, LUA_TTABLE);
+  luaL_checktype (L, 3, LUA_TTABLE);
+  g_autoptr (WpProperties) props = wp_properties_new_empty ();
+  g_autoptr (GPtrArray) keys = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr (GError) error = NULL;
+  gboolean saved;
+
+  lua_pushnil (L);
+  while (lua_next (L, 3)) {
+    /* accept both arrays of keys and sets of keys */
+    if (lua_type (L, -2) == LUA_TSTRING)
+      state_add_key (L, props, keys, -2);
+    else if (lua_type (L, -1) == LUA_TSTRING)
+      state_add_key (L, props, keys, -1);
+    lua_pop (L, 1);
+  }
+  g_ptr_array_add (keys, NULL);
+
+  saved = wp_state_save_keys (state, props,
+      (const gchar * const *) keys->pdata, &error);
+  lua_pushboolean (L, saved);
+  lua_pushstring (L, error ? error->message : "");
+  return 2;
+}
+
 static int
 state_load (lua_State *L)
 {
@@ -1439,6 +1495,7 @@ state_load (lua_State *L)
 static const luaL_Reg state_methods[] = {
   { "clear", state_clear },
   { "save" , state_save },
+  { "save_keys" , state_save_keys },
   { "load" , state_load },
   { NULL, NULL }
 };
@@ -8,6 +8,9 @@
 
 #include <wp/wp.h>
 #include <wplua/wplua.h>
+#include <spa/utils/json.h>
+
+#define LAZY_JSON_METATABLE "WpSpaJson.Lazy"
 
 /* API */
 
@@ -94,37 +97,85 @@ spa_json_is_object (lua_State *L)
   return 1;
 }
 
+/* Pushes a string straight from the json buffer; only strings with escape
+ * sequences need to be decoded in a temporary buffer first */
 static void
-push_luajson (lua_State *L, WpSpaJson *json)
+push_json_string (lua_State *L, const gchar *data, gint len)
+{
+  if (spa_json_is_string (data, len)) {
+    if (!memchr (data + 1, '\\', len - 2)) {
+      lua_pushlstring (L, data + 1, len - 2);
+    } else {
+      luaL_Buffer b;
+      gchar *buf = luaL_buffinitsize (L, &b, len + 1);
+      spa_json_parse_string (data, len, buf);
+      luaL_pushresultsize (&b, strlen (buf));
+    }
+  }
+
+  /* strings without quotes are pushed as they are */
+  else {
+    lua_pushlstring (L, data, len);
+  }
+}
+
+static gboolean
+json_string_equals (const gchar *data, gint len, const gchar *str, gsize str_len)
+{
+  if (spa_json_is_string (data, len)) {
+    if (!memchr (data + 1, '\\', len - 2)) {
+      return (gsize) (len - 2) == str_len &&
+          memcmp (data + 1, str, str_len) == 0;
+    } else {
+      g_autofree gchar *decoded = g_malloc (len + 1);
+      spa_json_parse_string (data, len, decoded);
+      return strlen (decoded) == str_len && memcmp (decoded, str, str_len) == 0;
+    }
+  }
+  return (gsize) len == str_len && memcmp (data, str, str_len) == 0;
+}
+
+/* Pushes a json value that is not a container */
+static void
+push_json_scalar (lua_State *L, const gchar *data, gint len)
 {
   /* Null */
-  if (wp_spa_json_is_null (json)) {
+  if (spa_json_is_null (data, len)) {
     lua_pushnil (L);
   }
 
   /* Boolean */
-  else if (wp_spa_json_is_boolean (json)) {
-    gboolean value = FALSE;
-    g_warn_if_fail (wp_spa_json_parse_boolean (json, &value));
+  else if (spa_json_is_bool (data, len)) {
+    bool value = false;
+    g_warn_if_fail (spa_json_parse_bool (data, len, &value) >= 0);
     lua_pushboolean (L, value);
   }
 
   /* Int */
-  else if (wp_spa_json_is_int (json)) {
+  else if (spa_json_is_int (data, len)) {
     gint value = 0;
-    g_warn_if_fail (wp_spa_json_parse_int (json, &value));
+    g_warn_if_fail (spa_json_parse_int (data, len, &value) >= 0);
     lua_pushinteger (L, value);
   }
 
   /* Float */
-  else if (wp_spa_json_is_float (json)) {
+  else if (spa_json_is_float (data, len)) {
     float value = 0;
-    g_warn_if_fail (wp_spa_json_parse_float (json, &value));
+    g_warn_if_fail (spa_json_parse_float (data, len, &value) >= 0);
     lua_pushnumber (L, value);
   }
 
+  /* Otherwise always parse as String to allow parsing strings without quotes */
+  else {
+    push_json_string (L, data, len);
+  }
+}
+
+static void
+push_luajson (lua_State *L, WpSpaJson *json)
+{
   /* Array */
-  else if (wp_spa_json_is_array (json)) {
+  if (wp_spa_json_is_array (json)) {
     g_auto (GValue) item = G_VALUE_INIT;
     g_autoptr (WpIterator) it = wp_spa_json_new_iterator (json);
     guint i = 1;
@@ -143,33 +194,270 @@ push_luajson (lua_State *L, WpSpaJson *json)
     lua_newtable (L);
     for (; wp_iterator_next (it, &item); g_value_unset (&item)) {
       WpSpaJson *key = g_value_get_boxed (&item);
-      g_autofree gchar *key_str = NULL;
       WpSpaJson *value = NULL;
       g_warn_if_fail (wp_spa_json_is_string (key));
-      key_str = wp_spa_json_parse_string (key);
-      g_warn_if_fail (key_str);
+      push_json_string (L, wp_spa_json_get_data (key),
+          wp_spa_json_get_size (key));
       g_value_unset (&item);
-      if (!wp_iterator_next (it, &item))
+      if (!wp_iterator_next (it, &item)) {
+        lua_pop (L, 1);
         break;
+      }
       value = g_value_get_boxed (&item);
       push_luajson (L, value);
-      lua_setfield (L, -2, key_str);
+      lua_rawset (L, -3);
     }
   }
 
-  /* Otherwise alwyas parse as String to allow parsing strings without quotes */
   else {
-    g_autofree gchar *value = wp_spa_json_parse_string (json);
-    g_warn_if_fail (value);
-    lua_pushstring (L, value);
+    push_json_scalar (L, wp_spa_json_get_data (json),
+        wp_spa_json_get_size (json));
+  }
+}
+
+/* Lazy */
+
+typedef struct {
+  const gchar *key;
+  const gchar *value;
+  gint key_len;
+  gint value_len;
+} LazyJsonChild;
+
+/* A proxy of a json array or object that only decodes its children when
+ * they are accessed. All the proxies of a parsed json share a reference to
+ * the root json, which keeps the underlying buffer alive. Decoded children
+ * are cached in the user value of the proxy */
+typedef struct {
+  WpSpaJson *root;
+  const gchar *data;
+  gint size;
+  gboolean is_object;
+  GArray *children;
+} LazyJson;
+
+static void
+push_lazy_json (lua_State *L, WpSpaJson *root, const gchar *data, gint len)
+{
+  LazyJson *self = lua_newuserdata (L, sizeof (LazyJson));
+  self->root = wp_spa_json_ref (root);
+  self->data = data;
+  self->size = len;
+  self->is_object = spa_json_is_object (data, len);
+  self->children = NULL;
+  luaL_setmetatable (L, LAZY_JSON_METATABLE);
+}
+
+static void
+push_lazy_value (lua_State *L, WpSpaJson *root, const gchar *data, gint len)
+{
+  if (spa_json_is_array (data, len) || spa_json_is_object (data, len))
+    push_lazy_json (L, root, data, len);
+  else
+    push_json_scalar (L, data, len);
+}
+
+/* Finds the spans of all the children with a single pass over the
+ * container, without decoding them */
+static void
+lazy_json_scan (LazyJson *self)
+{
+  struct spa_json sj;
+  g_autoptr (WpSpaJson) json = NULL;
+  g_autoptr (WpSpaJsonParser) parser = NULL;
+
+  if (self->children)
+    return;
+
+  self->children = g_array_new (FALSE, FALSE, sizeof (LazyJsonChild));
+
+  spa_json_init (&sj, self->data, self->size);
+  json = wp_spa_json_new_wrap (&sj);
+  parser = self->is_object ?
+      wp_spa_json_parser_new_object (json) :
+      wp_spa_json_parser_new_array (json);
+
+  while (TRUE) {
+    g_autoptr (WpSpaJson) item = wp_spa_json_parser_get_json (parser);
+    LazyJsonChild child = { NULL, NULL, 0, 0 };
+
+    if (!item)
+      break;
+
+    if (self->is_object) {
+      child.key = wp_spa_json_get_data (item);
+      child.key_len = wp_spa_json_get_size (item);
+      g_clear_pointer (&item, wp_spa_json_unref);
+      item = wp_spa_json_parser_get_json (parser);
+      if (!item)
+        break;
+    }
+
+    child.value = wp_spa_json_get_data (item);
+    child.value_len = wp_spa_json_get_size (item);
+    g_array_append_val (self->children, child);
+  }
+}
+
+static void
+lazy_json_push_child (lua_State *L, int idx, LazyJson *self, guint i)
+{
+  LazyJsonChild *child = &g_array_index (self->children, LazyJsonChild, i);
+
+  idx = lua_absindex (L, idx);
+  if (lua_getuservalue (L, idx) != LUA_TTABLE) {
+    lua_pop (L, 1);
+    lua_createtable (L, self->children->len, 0);
+    lua_pushvalue (L, -1);
+    lua_setuservalue (L, idx);
+  }
+
+  if (lua_rawgeti (L, -1, i + 1) == LUA_TNIL) {
+    lua_pop (L, 1);
+    push_lazy_value (L, self->root, child->value, child->value_len);
+    lua_pushvalue (L, -1);
+    lua_rawseti (L, -3, i + 1);
+  }
+  lua_remove (L, -2);
+}
+
+static gint
+lazy_json_find_key (LazyJson *self, const gchar *key, gsize len)
+{
+  /* search backwards, so that duplicate keys resolve to the last value,
+   * like they do in the tables returned by the eager parser */
+  for (gint i = self->children->len - 1; i >= 0; i--) {
+    LazyJsonChild *child = &g_array_index (self->children, LazyJsonChild, i);
+    if (json_string_equals (child->key, child->key_len, key, len))
+      return i;
+  }
+  return -1;
+}
+
+static int
+lazy_json_index (lua_State *L)
+{
+  LazyJson *self = luaL_checkudata (L, 1, LAZY_JSON_METATABLE);
+  gint i = -1;
+
+  lazy_json_scan (self);
+
+  if (self->is_object) {
+    if (lua_type (L, 2) == LUA_TSTRING) {
+      size_t len = 0;
+      const gchar *key = lua_tolstring (L, 2, &len);
+      i = lazy_json_find_key (self, key, len);
+    }
+  } else {
+    int isnum = 0;
+    lua_Integer n = lua_tointegerx (L, 2, &isnum);
+    if (isnum && n >= 1 && n <= self->children->len)
+      i = n - 1;
+  }
+
+  if (i >= 0)
+    lazy_json_push_child (L, 1, self, i);
+  else
+    lua_pushnil (L);
+  return 1;
+}
+
+static int
+lazy_json_len (lua_State *L)
+{
+  LazyJson *self = luaL_checkudata (L, 1, LAZY_JSON_METATABLE);
+  lazy_json_scan (self);
+  lua_pushinteger (L, self->is_object ? 0 : self->children->len);
+  return 1;
+}
+
+static int
+lazy_json_next (lua_State *L)
+{
+  LazyJson *self = luaL_checkudata (L, 1, LAZY_JSON_METATABLE);
+  lua_Integer i = lua_tointeger (L, lua_upvalueindex (1));
+
+  lazy_json_scan (self);
+
+  for (; i < self->children->len; i++) {
+    LazyJsonChild *child = &g_array_index (self->children, LazyJsonChild, i);
+
+    /* null values are skipped, as they are not stored in eager tables */
+    if (spa_json_is_null (child->value, child->value_len))
+      continue;
+
+    lua_pushinteger (L, i + 1);
+    lua_replace (L, lua_upvalueindex (1));
+
+    if (self->is_object)
+      push_json_string (L, child->key, child->key_len);
+    else
+      lua_pushinteger (L, i + 1);
+    lazy_json_push_child (L, 1, self, i);
+    return 2;
   }
+  return 0;
+}
+
+static int
+lazy_json_pairs (lua_State *L)
+{
+  luaL_checkudata (L, 1, LAZY_JSON_METATABLE);
+  lua_pushinteger (L, 0);
+  lua_pushcclosure (L, lazy_json_next, 1);
+  lua_pushvalue (L, 1);
+  lua_pushnil (L);
+  return 3;
+}
+
+static int
+lazy_json_tostring (lua_State *L)
+{
+  LazyJson *self = luaL_checkudata (L, 1, LAZY_JSON_METATABLE);
+  lua_pushlstring (L, self->data, self->size);
+  return 1;
+}
+
+static int
+lazy_json_gc (lua_State *L)
+{
+  LazyJson *self = luaL_checkudata (L, 1, LAZY_JSON_METATABLE);
+  g_clear_pointer (&self->children, g_array_unref);
+  g_clear_pointer (&self->root, wp_spa_json_unref);
+  return 0;
 }
 
+static const luaL_Reg lazy_json_metamethods[] = {
+  { "__index", lazy_json_index },
+  { "__len", lazy_json_len },
+  { "__pairs", lazy_json_pairs },
+  { "__tostring", lazy_json_tostring },
+  { "__gc", lazy_json_gc },
+  { NULL, NULL }
+};
+
 static int
 spa_json_parse (lua_State *L)
 {
   WpSpaJson *json = wplua_checkboxed (L, 1, WP_TYPE_SPA_JSON);
-  push_luajson (L, json);
+  gboolean lazy = FALSE;
+
+  if (lua_istable (L, 2)) {
+    lua_getfield (L, 2, "lazy");
+    lazy = lua_toboolean (L, -1);
+    lua_pop (L, 1);
+  }
+
+  if (lazy) {
+    /* the proxies point into the data of the root, so it must not depend on
+       memory that it does not own, such as the string of Json.Raw */
+    g_autoptr (WpSpaJson) root = wp_spa_json_is_unique_owner (json) ?
+        wp_spa_json_ref (json) : wp_spa_json_copy (json);
+    push_lazy_value (L, root, wp_spa_json_get_data (root),
+        wp_spa_json_get_size (root));
+  } else {
+    push_luajson (L, json);
+  }
   return 1;
 }
 
@@ -232,17 +520,28 @@ spa_json_string_new (lua_State *L)
   return 1;
 }
 
+/* The builder is owned by a value on the Lua stack, so that it is also freed
+ * when an error is raised while filling it */
+static WpSpaJsonBuilder *
+push_json_builder (lua_State *L, WpSpaJsonBuilder *builder)
+{
+  wplua_pushboxed (L, WP_TYPE_SPA_JSON_BUILDER, builder);
+  return builder;
+}
+
 /* Array */
 
 static int
 spa_json_array_new (lua_State *L)
 {
-  g_autoptr (WpSpaJsonBuilder) builder = wp_spa_json_builder_new_array ();
+  WpSpaJsonBuilder *builder;
 
   luaL_checktype (L, 1, LUA_TTABLE);
+  lua_settop (L, 1);
+  builder = push_json_builder (L, wp_spa_json_builder_new_array ());
 
   lua_pushnil (L);
-  while (lua_next (L, -2)) {
+  while (lua_next (L, 1)) {
     /* We only add table values with integer keys */
     if (lua_isinteger (L, -2)) {
       switch (lua_type (L, -1)) {
@@ -264,7 +563,7 @@ spa_json_array_new (lua_State *L)
           break;
         }
         default:
-          luaL_error (L, "Json does not support lua type ",
+          luaL_error (L, "Json does not support lua type %s",
               lua_typename(L, lua_type(L, -1)));
           break;
       }
@@ -281,12 +580,14 @@ spa_json_array_new (lua_State *L)
 static int
 spa_json_object_new (lua_State *L)
 {
-  g_autoptr (WpSpaJsonBuilder) builder = wp_spa_json_builder_new_object ();
+  WpSpaJsonBuilder *builder;
 
   luaL_checktype (L, 1, LUA_TTABLE);
+  lua_settop (L, 1);
+  builder = push_json_builder (L, wp_spa_json_builder_new_object ());
 
   lua_pushnil (L);
-  while (lua_next (L, -2)) {
+  while (lua_next (L, 1)) {
     /* We only add table values with string keys */
     if (lua_type (L, -2) == LUA_TSTRING) {
       wp_spa_json_builder_add_property (builder, lua_tostring (L, -2));
@@ -310,7 +611,7 @@ spa_json_object_new (lua_State *L)
           break;
         }
         default:
-          luaL_error (L, "Json does not support lua type ",
+          luaL_error (L, "Json does not support lua type %s",
               lua_typename(L, lua_type(L, -1)));
           break;
       }
@@ -323,6 +624,193 @@ spa_json_object_new (lua_State *L)
   return 1;
 }
 
+/* Encode */
+
+#define ENCODE_MAX_DEPTH 64
+
+static gboolean
+lua_table_is_array (lua_State *L, int idx)
+{
+  gboolean ret = FALSE;
+
+  /* tables parsed from pods are marked explicitly */
+  lua_pushliteral (L, "pod_type");
+  if (lua_rawget (L, idx) == LUA_TSTRING)
+    ret = g_str_equal (lua_tostring (L, -1), "Array");
+  lua_pop (L, 1);
+
+  return ret || lua_rawlen (L, idx) > 0;
+}
+
+/* Returns an upper bound of the size of the encoded value, assuming no
+ * string needs escaping, so that the builder buffer is allocated once */
+static size_t
+estimate_encoded_size (lua_State *L, int idx, int depth)
+{
+  size_t size = 0, len = 0;
+
+  if (depth > ENCODE_MAX_DEPTH)
+    luaL_error (L, "Json.encode: table is too deep or recursive");
+
+  idx = lua_absindex (L, idx);
+  switch (lua_type (L, idx)) {
+    case LUA_TNUMBER:
+      return 32;
+    case LUA_TSTRING:
+      lua_tolstring (L, idx, &len);
+      return len + 2;
+    case LUA_TUSERDATA: {
+      WpSpaJson *json = wplua_checkboxed (L, idx, WP_TYPE_SPA_JSON);
+      return wp_spa_json_get_size (json);
+    }
+    case LUA_TTABLE:
+      luaL_checkstack (L, 3, NULL);
+      size = 2;
+      lua_pushnil (L);
+      while (lua_next (L, idx)) {
+        /* separator and key */
+        size += 2;
+        if (lua_type (L, -2) == LUA_TSTRING) {
+          lua_tolstring (L, -2, &len);
+          size += len + 3;
+        }
+        size += estimate_encoded_size (L, -1, depth + 1);
+        lua_pop (L, 1);
+      }
+      return size;
+    default:
+      return 5;
+  }
+}
+
+static void builder_add_lua_table (lua_State *L, WpSpaJsonBuilder *builder,
+    int idx, int depth);
+
+static void
+builder_add_lua_value (lua_State *L, WpSpaJsonBuilder *builder, int idx,
+    int depth)
+{
+  switch (lua_type (L, idx)) {
+    case LUA_TNIL:
+      wp_spa_json_builder_add_null (builder);
+      break;
+    case LUA_TBOOLEAN:
+      wp_spa_json_builder_add_boolean (builder, lua_toboolean (L, idx));
+      break;
+    case LUA_TNUMBER:
+      if (lua_isinteger (L, idx))
+        wp_spa_json_builder_add_int64 (builder, lua_tointeger (L, idx));
+      else
+        wp_spa_json_builder_add_double (builder, lua_tonumber (L, idx));
+      break;
+    case LUA_TSTRING:
+      wp_spa_json_builder_add_string (builder, lua_tostring (L, idx));
+      break;
+    case LUA_TUSERDATA: {
+      WpSpaJson *json = wplua_checkboxed (L, idx, WP_TYPE_SPA_JSON);
+      wp_spa_json_builder_add_json (builder, json);
+      break;
+    }
+    case LUA_TTABLE:
+      builder_add_lua_table (L, builder, idx, depth + 1);
+      break;
+    default:
+      luaL_error (L, "Json does not support lua type %s",
+          lua_typename (L, lua_type (L, idx)));
+      break;
+  }
+}
+
+static void
+builder_add_lua_table_items (lua_State *L, WpSpaJsonBuilder *builder,
+    int idx, gboolean is_array, int depth)
+{
+  luaL_checkstack (L, 3, NULL);
+
+  if (is_array) {
+    lua_Unsigned len = lua_rawlen (L, idx);
+
+    /* other than the pod_type marker, arrays can only have their sequence */
+    lua_pushnil (L);
+    while (lua_next (L, idx)) {
+      lua_pop (L, 1);
+      if (lua_isinteger (L, -1)) {
+        lua_Integer key = lua_tointeger (L, -1);
+        if (key >= 1 && (lua_Unsigned) key <= len)
+          continue;
+      } else if (lua_type (L, -1) == LUA_TSTRING &&
+          g_str_equal (lua_tostring (L, -1), "pod_type")) {
+        continue;
+      }
+      luaL_error (L, "Json.encode: table mixes a sequence with other keys");
+    }
+
+    for (lua_Unsigned i = 1; i <= len; i++) {
+      lua_rawgeti (L, idx, i);
+      builder_add_lua_value (L, builder, -1, depth);
+      lua_pop (L, 1);
+    }
+  } else {
+    /* only string keys are valid in json objects */
+    lua_pushnil (L);
+    while (lua_next (L, idx)) {
+      if (lua_type (L, -2) == LUA_TSTRING) {
+        wp_spa_json_builder_add_property (builder, lua_tostring (L, -2));
+        builder_add_lua_value (L, builder, -1, depth);
+      }
+      lua_pop (L, 1);
+    }
+  }
+}
+
+static void
+builder_add_lua_table (lua_State *L, WpSpaJsonBuilder *builder, int idx,
+    int depth)
+{
+  gboolean is_array;
+
+  if (depth > ENCODE_MAX_DEPTH)
+    luaL_error (L, "Json.encode: table is too deep or recursive");
+
+  /* nested tables are encoded straight into the parent buffer */
+  idx = lua_absindex (L, idx);
+  is_array = lua_table_is_array (L, idx);
+  if (is_array)
+    wp_spa_json_builder_open_array (builder);
+  else
+    wp_spa_json_builder_open_object (builder);
+  builder_add_lua_table_items (L, builder, idx, is_array, depth);
+  wp_spa_json_builder_close (builder);
+}
+
+/* Encodes a table with a single allocation of the json buffer, in the common
+ * case where no strings need escaping. Tables with a non-empty sequence part
+ * or with pod_type = "Array" are encoded as arrays, all others as objects.
+ * An error is raised for arrays that also have keys outside their sequence.
+ * Numbers keep their 64-bit integer or double precision */
+static int
+spa_json_encode (lua_State *L)
+{
+  WpSpaJsonBuilder *builder;
+  g_autofree gchar *data = NULL;
+  size_t size = 0;
+  gboolean is_array;
+
+  luaL_checktype (L, 1, LUA_TTABLE);
+  lua_settop (L, 1);
+
+  size = estimate_encoded_size (L, 1, 0);
+  is_array = lua_table_is_array (L, 1);
+  builder = push_json_builder (L, is_array ?
+      wp_spa_json_builder_new_array_sized (size) :
+      wp_spa_json_builder_new_object_sized (size));
+  builder_add_lua_table_items (L, builder, 1, is_array, 0);
+
+  data = wp_spa_json_builder_end_take (builder, &size);
+  lua_pushlstring (L, data, size);
+  return 1;
+}
+
 /* Init */
 
 static const luaL_Reg spa_json_methods[] = {
@@ -349,6 +837,7 @@ static const luaL_Reg spa_json_constructors[] = {
   { "String", spa_json_string_new },
   { "Array", spa_json_array_new },
   { "Object", spa_json_object_new },
+  { "encode", spa_json_encode },
   { NULL, NULL }
 };
 
@@ -359,4 +848,8 @@ wp_lua_scripting_json_init (lua_State *L)
   lua_setglobal (L, "WpSpaJson");
 
   wplua_register_type_methods (L, WP_TYPE_SPA_JSON, NULL, spa_json_methods);
+
+  luaL_newmetatable (L, LAZY_JSON_METATABLE);
+  luaL_setfuncs (L, lazy_json_metamethods, 0);
+  lua_pop (L, 1);
 }
@@ -11,6 +11,8 @@
 
 #include <spa/utils/type.h>
 
+#include <stdio.h>
+
 #define MAX_LUA_TYPES 9
 
 /* Builder */
@@ -1146,10 +1148,127 @@ push_luapod (lua_State *L, WpSpaPod *pod, WpSpaIdValue field_idval)
   }
 }
 
+static void
+push_luapod_object_keys (lua_State *L, WpSpaPod *pod, int keys_idx)
+{
+  WpSpaType type = wp_spa_pod_get_spa_type (pod);
+  WpSpaIdTable values_table = wp_spa_type_get_values_table (type);
+  WpSpaPodParseSpec *spec;
+  WpSpaPod **values;
+  const gchar **keys;
+  const gchar *id_name = NULL;
+  lua_Integer len = luaL_len (L, keys_idx);
+  guint n_keys;
+  int seen_idx, spec_idx, values_idx;
+
+  /* validate before allocating anything, as errors do not return; invalid
+     keys are script errors here, but caller bugs (criticals) for
+     wp_spa_pod_parse_spec_new_keys() */
+  lua_newtable (L);
+  seen_idx = lua_gettop (L);
+  for (lua_Integer i = 1; i <= len; i++) {
+    const gchar *key;
+    guint32 id = 0;
+
+    if (lua_rawgeti (L, keys_idx, i) != LUA_TSTRING)
+      luaL_error (L, "Property keys must be strings");
+    key = lua_tostring (L, -1);
+
+    if (g_str_has_prefix (key, "id-")) {
+      if (sscanf (key, "id-%08x", &id) != 1)
+        luaL_error (L, "Invalid property key: %s", key);
+    } else {
+      WpSpaIdValue idval = values_table ?
+          wp_spa_id_table_find_value_from_short_name (values_table, key) :
+          NULL;
+      if (!idval)
+        luaL_error (L, "Unknown property key for %s: %s",
+            wp_spa_type_name (type), key);
+      id = wp_spa_id_value_number (idval);
+    }
+
+    if (lua_rawgeti (L, seen_idx, id) != LUA_TNIL)
+      luaL_error (L, "Duplicate property key for %s: %s",
+          wp_spa_type_name (type), key);
+    lua_pop (L, 2);
+    lua_pushboolean (L, TRUE);
+    lua_rawseti (L, seen_idx, id);
+  }
+  lua_pop (L, 1);
+
+  /* the strings stay referenced by the keys table */
+  keys = g_new (const gchar *, len + 1);
+  for (lua_Integer i = 1; i <= len; i++) {
+    lua_rawgeti (L, keys_idx, i);
+    keys[i - 1] = lua_tostring (L, -1);
+    lua_pop (L, 1);
+  }
+  keys[len] = NULL;
+
+  spec = wp_spa_pod_parse_spec_new_keys (wp_spa_type_name (type), keys);
+  g_free (keys);
+  if (!spec)
+    luaL_error (L, "Invalid property keys for %s", wp_spa_type_name (type));
+
+  /* from here on, the spec and the values are owned by the Lua stack, so
+     that they are also released if push_luapod() raises an error */
+  wplua_pushboxed (L, WP_TYPE_SPA_POD_PARSE_SPEC, spec);
+  spec_idx = lua_gettop (L);
+
+  n_keys = wp_spa_pod_parse_spec_get_n_keys (spec);
+  values = g_new0 (WpSpaPod *, MAX (n_keys, 1));
+  if (!wp_spa_pod_parse_spec_collect (spec, pod, &id_name, values)) {
+    g_free (values);
+    luaL_error (L, "Could not parse %s object", wp_spa_type_name (type));
+  }
+
+  lua_createtable (L, n_keys, 0);
+  values_idx = lua_gettop (L);
+  for (guint i = 0; i < n_keys; i++) {
+    if (values[i]) {
+      wplua_pushboxed (L, WP_TYPE_SPA_POD, values[i]);
+      lua_rawseti (L, values_idx, i + 1);
+    }
+  }
+  g_free (values);
+
+  lua_newtable (L);
+  lua_pushstring (L, "Object");
+  lua_setfield (L, -2, "pod_type");
+  lua_pushstring (L, id_name);
+  lua_setfield (L, -2, "object_id");
+  lua_newtable (L);
+  for (guint i = 0; i < n_keys; i++) {
+    const gchar *key = wp_spa_pod_parse_spec_get_key (spec, i);
+    if (lua_rawgeti (L, values_idx, i + 1) != LUA_TNIL) {
+      WpSpaPod *val = wplua_toboxed (L, -1);
+      push_luapod (L, val,
+          wp_spa_id_table_find_value_from_short_name (values_table, key));
+      lua_setfield (L, -3, key);
+    }
+    lua_pop (L, 1);
+  }
+  lua_setfield (L, -2, "properties");
+
+  /* leave only the result table on the stack */
+  lua_replace (L, spec_idx);
+  lua_settop (L, spec_idx);
+}
+
 static int
 spa_pod_parse (lua_State *L)
 {
   WpSpaPod *pod = wplua_checkboxed (L, 1, WP_TYPE_SPA_POD);
+
+  /* when a list of keys is given, only those are extracted from objects */
+  if (!lua_isnoneornil (L, 2)) {
+    luaL_checktype (L, 2, LUA_TTABLE);
+    if (wp_spa_pod_is_object (pod)) {
+      push_luapod_object_keys (L, pod, 2);
+      return 1;
+    }
+  }
+
   push_luapod (L, pod, NULL);
   return 1;
 }
@@ -22,6 +22,14 @@ struct _WpLuaScriptingPlugin
 
   GPtrArray *scripts; /* element-type: WpPlugin* */
   lua_State *L;
+  /* give each script its own lua_State instead of sharing self->L */
+  gboolean isolate;
+
+  /* execution statistics of the scripts, published on request */
+  WpObjectManager *scripts_om;
+  WpImplMetadata *stats_metadata;
+  GSource *stats_source;
+  gchar *stats_request;
 };
 
 static int
@@ -103,40 +111,149 @@ wp_lua_scripting_plugin_finalize (GObject * object)
   G_OBJECT_CLASS (wp_lua_scripting_plugin_parent_class)->finalize (object);
 }
 
+static gboolean
+wp_lua_scripting_publish_stats (WpLuaScriptingPlugin * self)
+{
+  g_autoptr (WpIterator) it = NULL;
+  g_auto (GValue) item = G_VALUE_INIT;
+
+  g_clear_pointer (&self->stats_source, g_source_unref);
+  if (!self->stats_metadata || !self->scripts_om)
+    return G_SOURCE_REMOVE;
+
+  it = wp_object_manager_new_iterator (self->scripts_om);
+  for (; wp_iterator_next (it, &item); g_value_unset (&item)) {
+    GObject *script = g_value_get_object (&item);
+    g_autofree gchar *name = NULL;
+    g_autofree gchar *value = NULL;
+    guint64 calls = 0, time = 0, allocated = 0;
+
+    g_object_get (script, "name", &name, "calls", &calls, "time", &time,
+        "allocated", &allocated, NULL);
+    value = g_strdup_printf ("{ \"calls\": %" G_GUINT64_FORMAT
+        ", \"time\": %" G_GUINT64_FORMAT ", \"allocated\": %"
+        G_GUINT64_FORMAT " }", calls, time, allocated);
+    wp_metadata_set (WP_METADATA (self->stats_metadata), 0, name,
+        "Spa:String:JSON", value);
+  }
+
+  /* let the requester know that all the stats have been published */
+  wp_metadata_set (WP_METADATA (self->stats_metadata), 0, "response",
+      "Spa:String", self->stats_request);
+  return G_SOURCE_REMOVE;
+}
+
 static void
-wp_lua_scripting_plugin_enable (WpPlugin * plugin, WpTransition * transition)
+on_stats_metadata_changed (WpMetadata * m, guint32 subject,
+    const gchar * key, const gchar * type, const gchar * value,
+    WpLuaScriptingPlugin * self)
 {
-  WpLuaScriptingPlugin * self = WP_LUA_SCRIPTING_PLUGIN (plugin);
-  g_autoptr (WpCore) core = wp_object_get_core (WP_OBJECT (plugin));
-  WpCore *export_core;
+  g_autoptr (WpCore) core = NULL;
+
+  if (subject != 0 || g_strcmp0 (key, "request") != 0 || !value)
+    return;
+
+  /* publish from an idle callback, not while the metadata is emitting */
+  g_free (self->stats_request);
+  self->stats_request = g_strdup (value);
+  if (!self->stats_source) {
+    core = wp_object_get_core (WP_OBJECT (self));
+    wp_core_idle_add (core, &self->stats_source,
+        (GSourceFunc) wp_lua_scripting_publish_stats, self, NULL);
+  }
+}
+
+static void
+on_stats_metadata_activated (WpObject * m, GAsyncResult * res, gpointer data)
+{
+  g_autoptr (GError) error = NULL;
+
+  if (!wp_object_activate_finish (m, res, &error))
+    wp_message_object (m, "failed to export the script stats: %s",
+        error->message);
+}
+
+static void
+wp_lua_scripting_plugin_export_stats (WpLuaScriptingPlugin * self,
+    WpCore * core)
+{
+  self->scripts_om = wp_object_manager_new ();
+  wp_object_manager_add_interest (self->scripts_om, WP_TYPE_LUA_SCRIPT, NULL);
+  wp_core_install_object_manager (core, self->scripts_om);
+
+  self->stats_metadata = wp_impl_metadata_new_full (core, "lua-script-stats",
+      NULL);
+  g_signal_connect_object (self->stats_metadata, "changed",
+      G_CALLBACK (on_stats_metadata_changed), self, 0);
+  wp_object_activate (WP_OBJECT (self->stats_metadata),
+      WP_OBJECT_FEATURES_ALL, NULL,
+      (GAsyncReadyCallback) on_stats_metadata_activated, NULL);
+}
 
-  /* init lua engine */
-  self->L = wplua_new ();
+static lua_State *
+wp_lua_scripting_plugin_new_engine (WpLuaScriptingPlugin * self, WpCore * core)
+{
+  lua_State *L = wplua_new ();
+  WpCore *export_core;
 
-  lua_pushliteral (self->L, "wireplumber_core");
-  lua_pushlightuserdata (self->L, core);
-  lua_settable (self->L, LUA_REGISTRYINDEX);
+  lua_pushliteral (L, "wireplumber_core");
+  lua_pushlightuserdata (L, core);
+  lua_settable (L, LUA_REGISTRYINDEX);
 
   /* initialize secondary connection to pipewire */
   export_core = g_object_get_data (G_OBJECT (core), "wireplumber.export-core");
   if (export_core) {
-    lua_pushliteral (self->L, "wireplumber_export_core");
-    wplua_pushobject (self->L, g_object_ref (export_core));
-    lua_settable (self->L, LUA_REGISTRYINDEX);
+    lua_pushliteral (L, "wireplumber_export_core");
+    wplua_pushobject (L, g_object_ref (export_core));
+    lua_settable (L, LUA_REGISTRYINDEX);
   }
 
-  wp_lua_scripting_api_init (self->L);
-  wp_lua_scripting_enable_package_searcher (self->L);
-  wplua_enable_sandbox (self->L, WP_LUA_SANDBOX_ISOLATE_ENV);
+  wp_lua_scripting_api_init (L);
+  wp_lua_scripting_enable_package_searcher (L);
+  wplua_enable_sandbox (L, WP_LUA_SANDBOX_ISOLATE_ENV);
+  return L;
+}
+
+static void
+wp_lua_scripting_plugin_register_script (WpLuaScriptingPlugin * self,
+    WpCore * core, WpPlugin * script)
+{
+  if (self->isolate) {
+    g_autoptr (lua_State) L = wp_lua_scripting_plugin_new_engine (self, core);
+    g_object_set (script, "lua-engine", L, NULL);
+  } else {
+    g_object_set (script, "lua-engine", self->L, NULL);
+  }
+  wp_plugin_register (script);
+}
+
+static void
+wp_lua_scripting_plugin_enable (WpPlugin * plugin, WpTransition * transition)
+{
+  WpLuaScriptingPlugin * self = WP_LUA_SCRIPTING_PLUGIN (plugin);
+  g_autoptr (WpCore) core = wp_object_get_core (WP_OBJECT (plugin));
+  g_autoptr (WpProperties) p = wp_core_get_properties (core);
+  const gchar *str;
+
+  str = wp_properties_get (p, "wireplumber.lua.isolate-scripts");
+  self->isolate = !g_strcmp0 (str, "true");
+
+  /* init the shared lua engine, unless each script gets its own */
+  if (!self->isolate)
+    self->L = wp_lua_scripting_plugin_new_engine (self, core);
 
   /* register scripts that were queued in for loading */
   for (guint i = 0; i < self->scripts->len; i++) {
     WpPlugin *script = g_ptr_array_index (self->scripts, i);
-    g_object_set (script, "lua-engine", self->L, NULL);
-    wp_plugin_register (g_object_ref (script));
+    wp_lua_scripting_plugin_register_script (self, core,
+        g_object_ref (script));
   }
   g_ptr_array_set_size (self->scripts, 0);
 
+  /* the stats are exported only by the daemon, not by wpexec */
+  if (!g_strcmp0 (wp_properties_get (p, "wireplumber.daemon"), "true"))
+    wp_lua_scripting_plugin_export_stats (self, core);
+
   wp_object_update_features (WP_OBJECT (self), WP_PLUGIN_FEATURE_ENABLED, 0);
 }
 
@@ -144,6 +261,13 @@ static void
 wp_lua_scripting_plugin_disable (WpPlugin * plugin)
 {
   WpLuaScriptingPlugin * self = WP_LUA_SCRIPTING_PLUGIN (plugin);
+
+  if (self->stats_source)
+    g_source_destroy (self->stats_source);
+  g_clear_pointer (&self->stats_source, g_source_unref);
+  g_clear_pointer (&self->stats_request, g_free);
+  g_clear_object (&self->stats_metadata);
+  g_clear_object (&self->scripts_om);
   g_clear_pointer (&self->L, wplua_unref);
 }
 
@@ -201,9 +325,13 @@ wp_lua_scripting_plugin_load (WpComponentLoader * cl, const gchar * component,
         "arguments", args,
         NULL);
 
-    if (self->L) {
-      g_object_set (script, "lua-engine", self->L, NULL);
-      wp_plugin_register (g_steal_pointer (&script));
+    /* compile in the background while the other components are loading */
+    wp_lua_script_precompile (WP_LUA_SCRIPT (script));
+
+    if (wp_object_get_active_features (WP_OBJECT (self)) &
+            WP_PLUGIN_FEATURE_ENABLED) {
+      wp_lua_scripting_plugin_register_script (self, core,
+          g_steal_pointer (&script));
     } else {
       /* keep in a list and delay registering until the plugin is enabled */
       g_ptr_array_add (self->scripts, g_steal_pointer (&script));
@@ -18,8 +18,69 @@
  * When disabled, this class destroys the global environment that was used
  * in the Lua engine for excecuting that script, effectively destroying all
  * objects that were held in Lua as global variables.
+ * The time spent and the memory allocated while running the script and the
+ * callbacks that it registered are accounted in its WpLuaStats, which are
+ * exposed as properties.
+ * Scripts can be compiled ahead of time on a pool of worker threads, with
+ * wp_lua_script_precompile(); executing them still happens in the main
+ * context, as it calls into the WirePlumber API.
  */
 
+typedef struct {
+  gchar *filename;
+  GMutex lock;
+  GCond cond;
+  gboolean done;
+  GBytes *bytecode;
+} PrecompileJob;
+
+static void
+precompile_job_clear (PrecompileJob * job)
+{
+  g_clear_pointer (&job->filename, g_free);
+  g_clear_pointer (&job->bytecode, g_bytes_unref);
+  g_mutex_clear (&job->lock);
+  g_cond_clear (&job->cond);
+}
+
+static void
+precompile_job_unref (PrecompileJob * job)
+{
+  g_atomic_rc_box_release_full (job, (GDestroyNotify) precompile_job_clear);
+}
+
+static void
+precompile_job_run (PrecompileJob * job, gpointer data)
+{
+  g_autoptr (GError) error = NULL;
+  GBytes *bytecode = wplua_precompile_path (job->filename, &error);
+
+  /* errors are reported when the script is loaded in the main context */
+  if (!bytecode)
+    wp_debug ("failed to precompile '%s': %s", job->filename, error->message);
+
+  g_mutex_lock (&job->lock);
+  job->bytecode = bytecode;
+  job->done = TRUE;
+  g_cond_broadcast (&job->cond);
+  g_mutex_unlock (&job->lock);
+
+  precompile_job_unref (job);
+}
+
+static GThreadPool *
+get_precompile_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&pool)) {
+    GThreadPool *p = g_thread_pool_new ((GFunc) precompile_job_run, NULL,
+        g_get_num_processors (), FALSE, NULL);
+    g_once_init_leave (&pool, p);
+  }
+  return pool;
+}
+
 struct _WpLuaScript
 {
   WpPlugin parent;
@@ -27,6 +88,8 @@ struct _WpLuaScript
   lua_State *L;
   gchar *filename;
   GVariant *args;
+  WpLuaStats *stats;
+  PrecompileJob *precompile;
 };
 
 enum {
@@ -34,6 +97,9 @@ enum {
   PROP_LUA_ENGINE,
   PROP_FILENAME,
   PROP_ARGUMENTS,
+  PROP_CALLS,
+  PROP_TIME,
+  PROP_ALLOCATED,
 };
 
 G_DEFINE_TYPE (WpLuaScript, wp_lua_script, WP_TYPE_PLUGIN)
@@ -41,6 +107,7 @@ G_DEFINE_TYPE (WpLuaScript, wp_lua_script, WP_TYPE_PLUGIN)
 static void
 wp_lua_script_init (WpLuaScript * self)
 {
+  self->stats = wplua_stats_new ();
 }
 
 static void
@@ -62,6 +129,8 @@ wp_lua_script_finalize (GObject * object)
   g_clear_pointer (&self->L, wplua_unref);
   g_clear_pointer (&self->filename, g_free);
   g_clear_pointer (&self->args, g_variant_unref);
+  g_clear_pointer (&self->stats, wplua_stats_unref);
+  g_clear_pointer (&self->precompile, precompile_job_unref);
 
   G_OBJECT_CLASS (wp_lua_script_parent_class)->finalize (object);
 }
@@ -91,6 +160,72 @@ wp_lua_script_set_property (GObject * object, guint property_id,
   }
 }
 
+static void
+wp_lua_script_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  WpLuaScript *self = WP_LUA_SCRIPT (object);
+
+  switch (property_id) {
+  case PROP_CALLS:
+    g_value_set_uint64 (value, self->stats->calls);
+    break;
+  case PROP_TIME:
+    g_value_set_uint64 (value, self->stats->time);
+    break;
+  case PROP_ALLOCATED:
+    g_value_set_uint64 (value, self->stats->allocated);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+/*
+ * Starts compiling the script in a worker thread. The result is picked up
+ * when the script is enabled, or discarded if compilation failed, in which
+ * case the script is compiled again in the main context to report the error.
+ */
+void
+wp_lua_script_precompile (WpLuaScript * self)
+{
+  PrecompileJob *job;
+
+  g_return_if_fail (WP_IS_LUA_SCRIPT (self));
+  g_return_if_fail (self->precompile == NULL);
+
+  job = g_atomic_rc_box_new0 (PrecompileJob);
+  job->filename = g_strdup (self->filename);
+  g_mutex_init (&job->lock);
+  g_cond_init (&job->cond);
+  self->precompile = job;
+
+  g_thread_pool_push (get_precompile_pool (), g_atomic_rc_box_acquire (job),
+      NULL);
+}
+
+static GBytes *
+wp_lua_script_take_precompiled (WpLuaScript * self)
+{
+  PrecompileJob *job = g_steal_pointer (&self->precompile);
+  GBytes *bytecode;
+
+  if (!job)
+    return NULL;
+
+  /* if the job is still running, it will finish sooner than it would take
+     to compile the script again here */
+  g_mutex_lock (&job->lock);
+  while (!job->done)
+    g_cond_wait (&job->cond, &job->lock);
+  bytecode = g_steal_pointer (&job->bytecode);
+  g_mutex_unlock (&job->lock);
+
+  precompile_job_unref (job);
+  return bytecode;
+}
+
 static gboolean
 wp_lua_script_check_async_activation (WpLuaScript * self)
 {
@@ -205,6 +340,8 @@ wp_lua_script_enable (WpPlugin * plugin, WpTransition * transition)
 {
   WpLuaScript *self = WP_LUA_SCRIPT (plugin);
   g_autoptr (GError) error = NULL;
+  g_autoptr (GBytes) bytecode = NULL;
+  gboolean loaded;
   int top, nargs = 3;
 
   if (!self->L) {
@@ -219,8 +356,19 @@ wp_lua_script_enable (WpPlugin * plugin, WpTransition * transition)
   lua_pushlightuserdata (self->L, self);
   lua_pushlightuserdata (self->L, transition);
 
-  /* load script */
-  if (!wplua_load_path (self->L, self->filename, &error)) {
+  /* account loading and executing the script, as well as all the closures
+     that it creates, to this script */
+  wplua_stats_push (self->L, self->stats);
+
+  /* load script, preferably from the precompiled bytecode */
+  bytecode = wp_lua_script_take_precompiled (self);
+  if (bytecode)
+    loaded = wplua_load_bytecode (self->L, bytecode, self->filename, &error);
+  else
+    loaded = wplua_load_path (self->L, self->filename, &error);
+
+  if (!loaded) {
+    wplua_stats_pop (self->L);
     lua_settop (self->L, top);
     wp_transition_return_error (transition, g_steal_pointer (&error));
     return;
@@ -234,12 +382,15 @@ wp_lua_script_enable (WpPlugin * plugin, WpTransition * transition)
 
   /* execute script */
   if (!wplua_pcall (self->L, nargs, 0, &error)) {
+    wplua_stats_pop (self->L);
     lua_settop (self->L, top);
     wp_transition_return_error (transition, g_steal_pointer (&error));
     wp_lua_script_cleanup (self);
     return;
   }
 
+  wplua_stats_pop (self->L);
+
   if (!wp_lua_script_check_async_activation (self)) {
     wp_lua_script_detach_transition (self);
     wp_object_update_features (WP_OBJECT (self), WP_PLUGIN_FEATURE_ENABLED, 0);
@@ -266,6 +417,7 @@ wp_lua_script_class_init (WpLuaScriptClass * klass)
 
   object_class->finalize = wp_lua_script_finalize;
   object_class->set_property = wp_lua_script_set_property;
+  object_class->get_property = wp_lua_script_get_property;
 
   plugin_class->enable = wp_lua_script_enable;
   plugin_class->disable = wp_lua_script_disable;
@@ -282,4 +434,19 @@ wp_lua_script_class_init (WpLuaScriptClass * klass)
       g_param_spec_variant ("arguments", "arguments", "arguments",
           G_VARIANT_TYPE_VARDICT, NULL,
           G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_CALLS,
+      g_param_spec_uint64 ("calls", "calls",
+          "The number of times the script or its callbacks were called",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_TIME,
+      g_param_spec_uint64 ("time", "time",
+          "The time spent running the script and its callbacks, in usec",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_ALLOCATED,
+      g_param_spec_uint64 ("allocated", "allocated",
+          "The bytes allocated by the script and its callbacks",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
@@ -17,6 +17,8 @@ G_BEGIN_DECLS
 #define WP_TYPE_LUA_SCRIPT (wp_lua_script_get_type ())
 G_DECLARE_FINAL_TYPE (WpLuaScript, wp_lua_script, WP, LUA_SCRIPT, WpPlugin)
 
+void wp_lua_script_precompile (WpLuaScript * self);
+
 G_END_DECLS
 
 #endif
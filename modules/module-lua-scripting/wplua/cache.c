@@ -0,0 +1,263 @@
+/* WirePlumber
+ *
+ * Copyright © 2021 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "wplua.h"
+#include "private.h"
+#include <wp/wp.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+/*
+ * On-disk bytecode cache
+ *
+ * Every file loaded with wplua_load_path() is compiled and its bytecode is
+ * stored in $XDG_CACHE_HOME/wireplumber/lua, in a file named after the
+ * checksum of its absolute path. The cached file starts with a header that
+ * records the Lua version, the modification time & size of the source and
+ * the checksum of the bytecode, followed by the source path and the bytecode.
+ * Entries that do not match the source or their checksum, or that fail to
+ * load, are ignored and the source is compiled again, which also refreshes
+ * the entry.
+ *
+ * wplua_precompile_path() goes through the same steps in a private
+ * lua_State, which makes it safe to call from any thread, and returns the
+ * bytecode so that it can be loaded later with wplua_load_bytecode().
+ */
+
+#define CACHE_MAGIC "WPL2"
+
+typedef struct {
+  gchar magic[4];
+  guint32 lua_version;
+  guint64 mtime_sec;
+  guint64 size;
+  guint32 mtime_nsec;
+  guint32 path_len;
+  /* hex SHA-256 of the bytecode, not NUL-terminated; this is not part
+     of the header that is compared with the source */
+  gchar checksum[64];
+} CacheHeader;
+
+#define CACHE_HEADER_SOURCE_SIZE (G_STRUCT_OFFSET (CacheHeader, checksum))
+
+static void
+compute_checksum (gchar checksum[64], const guint8 * data, gsize len)
+{
+  g_autofree gchar *str =
+      g_compute_checksum_for_data (G_CHECKSUM_SHA256, data, len);
+  memcpy (checksum, str, 64);
+}
+
+static gboolean
+cache_header_init (CacheHeader * header, const gchar * path)
+{
+  struct stat st;
+
+  if (stat (path, &st) < 0 || !S_ISREG (st.st_mode))
+    return FALSE;
+
+  memset (header, 0, sizeof (CacheHeader));
+  memcpy (header->magic, CACHE_MAGIC, sizeof (header->magic));
+  header->lua_version = LUA_VERSION_NUM;
+  header->mtime_sec = st.st_mtim.tv_sec;
+  header->mtime_nsec = st.st_mtim.tv_nsec;
+  header->size = st.st_size;
+  header->path_len = strlen (path);
+  return TRUE;
+}
+
+gchar *
+wplua_get_cache_path (const gchar * path)
+{
+  g_autofree gchar *checksum = NULL;
+  g_autofree gchar *filename = NULL;
+
+  g_return_val_if_fail (path != NULL, NULL);
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, path, -1);
+  filename = g_strconcat (checksum, ".luac", NULL);
+  return g_build_filename (g_get_user_cache_dir (), "wireplumber", "lua",
+      filename, NULL);
+}
+
+static gboolean
+cache_load (lua_State * L, const gchar * path, const CacheHeader * expected,
+    const gchar * name)
+{
+  g_autofree gchar *cache_path = wplua_get_cache_path (path);
+  g_autofree gchar *contents = NULL;
+  gsize len = 0;
+  gsize offset = sizeof (CacheHeader) + expected->path_len;
+
+  if (!g_file_get_contents (cache_path, &contents, &len, NULL))
+    return FALSE;
+
+  if (len <= offset ||
+      memcmp (contents, expected, CACHE_HEADER_SOURCE_SIZE) != 0 ||
+      memcmp (contents + sizeof (CacheHeader), path, expected->path_len) != 0) {
+    wp_debug ("bytecode cache of '%s' is stale", path);
+    return FALSE;
+  }
+
+  /* a truncated or otherwise damaged entry must never reach lua_load */
+  {
+    gchar checksum[64];
+    compute_checksum (checksum, (const guint8 *) contents + offset,
+        len - offset);
+    if (memcmp (checksum, ((const CacheHeader *) contents)->checksum,
+            sizeof (checksum)) != 0) {
+      wp_info ("bytecode cache of '%s' is corrupt: checksum mismatch", path);
+      return FALSE;
+    }
+  }
+
+  if (luaL_loadbufferx (L, contents + offset, len - offset, name, "b")
+          != LUA_OK) {
+    wp_info ("bytecode cache of '%s' is corrupt: %s", path,
+        lua_tostring (L, -1));
+    lua_pop (L, 1);
+    return FALSE;
+  }
+
+  wp_debug ("loaded '%s' from the bytecode cache", path);
+  return TRUE;
+}
+
+static int
+cache_dump_writer (lua_State * L, const void * p, size_t size, void * data)
+{
+  g_byte_array_append ((GByteArray *) data, p, size);
+  return 0;
+}
+
+static void
+cache_store (lua_State * L, const gchar * path, const CacheHeader * header)
+{
+  g_autofree gchar *cache_path = wplua_get_cache_path (path);
+  g_autofree gchar *cache_dir = g_path_get_dirname (cache_path);
+  g_autoptr (GByteArray) data = g_byte_array_new ();
+  g_autoptr (GError) error = NULL;
+
+  g_byte_array_append (data, (const guint8 *) header, sizeof (CacheHeader));
+  g_byte_array_append (data, (const guint8 *) path, header->path_len);
+
+  if (lua_dump (L, cache_dump_writer, data, 0) != 0) {
+    wp_debug ("failed to dump the bytecode of '%s'", path);
+    return;
+  }
+
+  {
+    gsize offset = sizeof (CacheHeader) + header->path_len;
+    compute_checksum (((CacheHeader *) data->data)->checksum,
+        data->data + offset, data->len - offset);
+  }
+
+  if (g_mkdir_with_parents (cache_dir, 0700) < 0) {
+    wp_debug ("failed to create '%s': %s", cache_dir, g_strerror (errno));
+    return;
+  }
+
+  if (!g_file_set_contents (cache_path, (const gchar *) data->data, data->len,
+          &error)) {
+    wp_debug ("failed to store the bytecode of '%s': %s", path,
+        error->message);
+  }
+}
+
+gboolean
+_wplua_load_path_cached (lua_State * L, const gchar * path, GError ** error)
+{
+  g_autofree gchar *uri = NULL;
+  g_autofree gchar *name = NULL;
+  CacheHeader header;
+  gboolean cacheable;
+
+  if (!(uri = g_filename_to_uri (path, NULL, error)))
+    return FALSE;
+
+  /* the header is computed before reading the source, so that a file that
+     is modified while being loaded never gets cached with the new mtime */
+  cacheable = cache_header_init (&header, path);
+
+  name = g_path_get_basename (uri);
+  if (cacheable && cache_load (L, path, &header, name))
+    return TRUE;
+
+  if (!wplua_load_uri (L, uri, error))
+    return FALSE;
+
+  if (cacheable)
+    cache_store (L, path, &header);
+  return TRUE;
+}
+
+GBytes *
+wplua_precompile_path (const gchar * path, GError ** error)
+{
+  g_autoptr (GByteArray) data = NULL;
+  g_autofree gchar *abs_path = NULL;
+  lua_State *L;
+
+  g_return_val_if_fail (path != NULL, NULL);
+
+  /* normalized like in wplua_load_path(), to share its cache entry */
+  abs_path = g_canonicalize_filename (path, NULL);
+  path = abs_path;
+
+  /* a plain state is enough for compiling and it is not shared with
+     anything else, so this can run in any thread */
+  L = luaL_newstate ();
+  lua_atpanic (L, _wplua_panic);
+  if (!_wplua_load_path_cached (L, path, error)) {
+    lua_close (L);
+    return NULL;
+  }
+
+  data = g_byte_array_new ();
+  if (lua_dump (L, cache_dump_writer, data, 0) != 0) {
+    g_set_error (error, WP_DOMAIN_LUA, WP_LUA_ERROR_COMPILATION,
+        "Failed to dump the bytecode of '%s'", path);
+    lua_close (L);
+    return NULL;
+  }
+
+  lua_close (L);
+  return g_byte_array_free_to_bytes (g_steal_pointer (&data));
+}
+
+gboolean
+wplua_load_bytecode (lua_State * L, GBytes * bytecode, const gchar * path,
+    GError ** error)
+{
+  g_autofree gchar *abs_path = NULL;
+  g_autofree gchar *uri = NULL;
+  g_autofree gchar *name = NULL;
+  gconstpointer data;
+  gsize size;
+
+  g_return_val_if_fail (L != NULL, FALSE);
+  g_return_val_if_fail (bytecode != NULL, FALSE);
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  /* use the same chunk name as wplua_load_path() */
+  abs_path = g_canonicalize_filename (path, NULL);
+  path = abs_path;
+  if (!(uri = g_filename_to_uri (path, NULL, error)))
+    return FALSE;
+  name = g_path_get_basename (uri);
+
+  data = g_bytes_get_data (bytecode, &size);
+  if (luaL_loadbufferx (L, data, size, name, "b") != LUA_OK) {
+    g_set_error (error, WP_DOMAIN_LUA, WP_LUA_ERROR_COMPILATION,
+        "Failed to load the bytecode of '%s': %s", path,
+        lua_tostring (L, -1));
+    lua_pop (L, 1);
+    return FALSE;
+  }
+  return TRUE;
+}
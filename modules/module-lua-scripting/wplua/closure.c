@@ -63,8 +63,36 @@ struct _WpLuaClosure
   GClosure closure;
   int func_ref;
   GPtrArray *closures;
+  /* the stats of the code that created the closure, if any */
+  WpLuaStats *stats;
 };
 
+/* the WpObjectManager objects-batch signal passes arrays of objects, which
+   are given to Lua as tables; other pointer arrays are passed as boxed */
+static gboolean
+signal_has_object_arrays (gpointer invocation_hint)
+{
+  static guint objects_batch_id = 0;
+  GSignalInvocationHint *hint = invocation_hint;
+
+  if (!hint)
+    return FALSE;
+  if (G_UNLIKELY (objects_batch_id == 0))
+    objects_batch_id = g_signal_lookup ("objects-batch",
+        WP_TYPE_OBJECT_MANAGER);
+  return hint->signal_id == objects_batch_id;
+}
+
+static void
+push_object_array (lua_State *L, GPtrArray *arr)
+{
+  lua_createtable (L, arr ? arr->len : 0, 0);
+  for (guint i = 0; arr && i < arr->len; i++) {
+    wplua_pushobject (L, g_object_ref (g_ptr_array_index (arr, i)));
+    lua_rawseti (L, -2, i + 1);
+  }
+}
+
 static void
 _wplua_closure_marshal (GClosure *closure, GValue *return_value,
     guint n_param_values, const GValue *param_values,
@@ -72,7 +100,9 @@ _wplua_closure_marshal (GClosure *closure, GValue *return_value,
 {
   static int reentrant = 0;
   lua_State *L = closure->data;
-  int func_ref = ((WpLuaClosure *) closure)->func_ref;
+  WpLuaClosure *wlc = (WpLuaClosure *) closure;
+  int func_ref = wlc->func_ref;
+  gboolean object_arrays;
 
   /* invalid closure, skip it */
   if (func_ref == LUA_NOREF || func_ref == LUA_REFNIL)
@@ -86,10 +116,17 @@ _wplua_closure_marshal (GClosure *closure, GValue *return_value,
   lua_rawgeti (L, LUA_REGISTRYINDEX, func_ref);
 
   /* push arguments */
-  for (guint i = 0; i < n_param_values; i++)
-    wplua_gvalue_to_lua (L, &param_values[i]);
+  object_arrays = signal_has_object_arrays (invocation_hint);
+  for (guint i = 0; i < n_param_values; i++) {
+    if (object_arrays && G_VALUE_HOLDS (&param_values[i], G_TYPE_PTR_ARRAY))
+      push_object_array (L, g_value_get_boxed (&param_values[i]));
+    else
+      wplua_gvalue_to_lua (L, &param_values[i]);
+  }
 
   /* call in protected mode */
+  if (wlc->stats)
+    wplua_stats_push (L, wlc->stats);
   reentrant++;
   int res = _wplua_pcall (L, n_param_values, return_value ? 1 : 0);
   reentrant--;
@@ -99,6 +136,8 @@ _wplua_closure_marshal (GClosure *closure, GValue *return_value,
     wplua_lua_to_gvalue (L, -1, return_value);
     lua_pop (L, 1);
   }
+  if (wlc->stats)
+    wplua_stats_pop (L);
 
   /* clean up */
   lua_gc (L, LUA_GCCOLLECT, 0);
@@ -119,6 +158,7 @@ _wplua_closure_finalize (lua_State *L, WpLuaClosure *c)
 {
   g_ptr_array_remove_fast (c->closures, c);
   g_ptr_array_unref (c->closures);
+  g_clear_pointer (&c->stats, wplua_stats_unref);
 }
 
 GClosure *
@@ -167,6 +207,11 @@ wplua_function_to_closure (lua_State *L, int idx)
   g_ptr_array_add (store->closures, c);
   wlc->closures = g_ptr_array_ref (store->closures);
 
+  /* calls to the closure are accounted to the code that created it */
+  wlc->stats = wplua_stats_get_current (L);
+  if (wlc->stats)
+    wplua_stats_ref (wlc->stats);
+
   return c;
 }
 
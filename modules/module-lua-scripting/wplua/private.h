@@ -16,12 +16,23 @@ G_BEGIN_DECLS
 /* boxed.c */
 void _wplua_init_gboxed (lua_State *L);
 
+/* cache.c */
+gboolean _wplua_load_path_cached (lua_State * L, const gchar * path,
+    GError ** error);
+
 /* closure.c */
 void _wplua_init_closure (lua_State *L);
 
 /* object.c */
 void _wplua_init_gobject (lua_State *L);
 
+/* stats.c */
+typedef struct _WpLuaAccounting WpLuaAccounting;
+
+void _wplua_init_accounting (lua_State *L);
+WpLuaAccounting * _wplua_get_accounting (lua_State *L);
+void _wplua_accounting_free (WpLuaAccounting *self);
+
 /* userdata.c */
 GValue * _wplua_pushgvalue_userdata (lua_State * L, GType type);
 gboolean _wplua_isgvalue_userdata (lua_State *L, int idx, GType type);
@@ -31,6 +42,7 @@ int _wplua_gvalue_userdata___eq (lua_State *L);
 
 /* wplua.c */
 int _wplua_pcall (lua_State *L, int nargs, int nret);
+int _wplua_panic (lua_State *L);
 
 G_END_DECLS
 
@@ -0,0 +1,179 @@
+/* WirePlumber
+ *
+ * Copyright © 2021 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "wplua.h"
+#include "private.h"
+#include <wp/wp.h>
+
+/*
+ * Execution accounting
+ *
+ * The allocator of every lua_State is wrapped with one that counts the bytes
+ * allocated by Lua. Code that calls into Lua on behalf of someone (i.e. a
+ * script) brackets the call with wplua_stats_push() and wplua_stats_pop()
+ * and the wall clock time and the bytes allocated in between are added to
+ * the pushed WpLuaStats. Nested calls are accounted exclusively: while a
+ * nested call runs, the outer one is paused.
+ */
+
+typedef struct {
+  WpLuaStats *stats;
+  gint64 start;
+  guint64 allocated_start;
+} StatsFrame;
+
+struct _WpLuaAccounting
+{
+  lua_Alloc alloc;
+  void *alloc_ud;
+  guint64 allocated;
+  GArray *frames; /* element-type: StatsFrame */
+};
+
+static void *
+accounting_alloc (void *ud, void *ptr, size_t osize, size_t nsize)
+{
+  WpLuaAccounting *self = ud;
+
+  /* when ptr is NULL, osize is the type of the allocated object */
+  if (ptr == NULL)
+    self->allocated += nsize;
+  else if (nsize > osize)
+    self->allocated += nsize - osize;
+
+  return self->alloc (self->alloc_ud, ptr, osize, nsize);
+}
+
+void
+_wplua_init_accounting (lua_State *L)
+{
+  WpLuaAccounting *self = g_slice_new0 (WpLuaAccounting);
+
+  self->alloc = lua_getallocf (L, &self->alloc_ud);
+  self->frames = g_array_new (FALSE, FALSE, sizeof (StatsFrame));
+  lua_setallocf (L, accounting_alloc, self);
+}
+
+WpLuaAccounting *
+_wplua_get_accounting (lua_State *L)
+{
+  void *ud = NULL;
+  lua_Alloc alloc = lua_getallocf (L, &ud);
+  g_return_val_if_fail (alloc == accounting_alloc, NULL);
+  return ud;
+}
+
+/* must be called after lua_close(), which still uses the allocator */
+void
+_wplua_accounting_free (WpLuaAccounting *self)
+{
+  for (guint i = 0; i < self->frames->len; i++)
+    wplua_stats_unref (g_array_index (self->frames, StatsFrame, i).stats);
+  g_array_unref (self->frames);
+  g_slice_free (WpLuaAccounting, self);
+}
+
+WpLuaStats *
+wplua_stats_new (void)
+{
+  return g_rc_box_new0 (WpLuaStats);
+}
+
+WpLuaStats *
+wplua_stats_ref (WpLuaStats * self)
+{
+  return g_rc_box_acquire (self);
+}
+
+void
+wplua_stats_unref (WpLuaStats * self)
+{
+  g_rc_box_release (self);
+}
+
+/**
+ * wplua_stats_get_current:
+ *
+ * Returns: (transfer none) (nullable): the stats that are currently being
+ *   accounted, i.e. the ones that were pushed last with wplua_stats_push()
+ */
+WpLuaStats *
+wplua_stats_get_current (lua_State *L)
+{
+  WpLuaAccounting *self = _wplua_get_accounting (L);
+
+  if (!self || self->frames->len == 0)
+    return NULL;
+  return g_array_index (self->frames, StatsFrame,
+      self->frames->len - 1).stats;
+}
+
+static inline void
+stats_frame_charge (WpLuaAccounting *self, StatsFrame *frame, gint64 now)
+{
+  frame->stats->time += now - frame->start;
+  frame->stats->allocated += self->allocated - frame->allocated_start;
+}
+
+/**
+ * wplua_stats_push:
+ *
+ * Starts accounting the execution time and the allocations of the Lua code
+ * that runs from now on in @em stats, until wplua_stats_pop() is called.
+ * This also increments the call count of @em stats.
+ */
+void
+wplua_stats_push (lua_State *L, WpLuaStats * stats)
+{
+  WpLuaAccounting *self = _wplua_get_accounting (L);
+  gint64 now = g_get_monotonic_time ();
+  StatsFrame frame;
+
+  g_return_if_fail (self);
+
+  /* pause the outer frame */
+  if (self->frames->len > 0) {
+    stats_frame_charge (self, &g_array_index (self->frames, StatsFrame,
+        self->frames->len - 1), now);
+  }
+
+  frame.stats = wplua_stats_ref (stats);
+  frame.start = now;
+  frame.allocated_start = self->allocated;
+  g_array_append_val (self->frames, frame);
+
+  stats->calls++;
+}
+
+/**
+ * wplua_stats_pop:
+ *
+ * Stops accounting in the stats that were pushed last with wplua_stats_push()
+ * and resumes accounting in the ones that were pushed before them, if any.
+ */
+void
+wplua_stats_pop (lua_State *L)
+{
+  WpLuaAccounting *self = _wplua_get_accounting (L);
+  gint64 now = g_get_monotonic_time ();
+  StatsFrame *frame;
+
+  g_return_if_fail (self);
+  g_return_if_fail (self->frames->len > 0);
+
+  frame = &g_array_index (self->frames, StatsFrame, self->frames->len - 1);
+  stats_frame_charge (self, frame, now);
+  wplua_stats_unref (frame->stats);
+  g_array_set_size (self->frames, self->frames->len - 1);
+
+  /* resume the outer frame */
+  if (self->frames->len > 0) {
+    frame = &g_array_index (self->frames, StatsFrame, self->frames->len - 1);
+    frame->start = now;
+    frame->allocated_start = self->allocated;
+  }
+}
@@ -76,6 +76,15 @@ _wplua_pcall (lua_State *L, int nargs, int nret)
   return ret;
 }
 
+int
+_wplua_panic (lua_State *L)
+{
+  const gchar *msg = lua_tostring (L, -1);
+  wp_critical ("unprotected error in lua_State %p: %s", L,
+      msg ? msg : "(error object is not a string)");
+  return 0;
+}
+
 lua_State *
 wplua_new (void)
 {
@@ -83,12 +92,14 @@ wplua_new (void)
   lua_State *L = luaL_newstate ();
 
   wp_debug ("initializing lua_State %p", L);
+  lua_atpanic (L, _wplua_panic);
 
   if (!resource_registered) {
     _wplua_register_resource ();
     resource_registered = TRUE;
   }
 
+  _wplua_init_accounting (L);
   _wplua_openlibs (L);
   _wplua_init_gboxed (L);
   _wplua_init_gobject (L);
@@ -131,8 +142,10 @@ wplua_unref (lua_State * L)
     lua_rawsetp (L, LUA_REGISTRYINDEX, L);
     lua_pop (L, 1);
   } else {
+    WpLuaAccounting *accounting = _wplua_get_accounting (L);
     wp_debug ("closing lua_State %p", L);
     lua_close (L);
+    _wplua_accounting_free (accounting);
   }
 }
 
@@ -272,20 +285,14 @@ gboolean
 wplua_load_path (lua_State * L, const gchar *path, GError **error)
 {
   g_autofree gchar *abs_path = NULL;
-  g_autofree gchar *uri = NULL;
 
   g_return_val_if_fail (L != NULL, FALSE);
   g_return_val_if_fail (path != NULL, FALSE);
 
-  if (!g_path_is_absolute (path)) {
-    g_autofree gchar *cwd = g_get_current_dir ();
-    abs_path = g_build_filename (cwd, path, NULL);
-  }
-
-  if (!(uri = g_filename_to_uri (abs_path ? abs_path : path, NULL, error)))
-    return FALSE;
-
-  return wplua_load_uri (L, uri, error);
+  /* normalized like in wplua_precompile_path() and wplua_load_bytecode(),
+     so that they all share the same cache entry and chunk name */
+  abs_path = g_canonicalize_filename (path, NULL);
+  return _wplua_load_path_cached (L, abs_path, error);
 }
 
 gboolean
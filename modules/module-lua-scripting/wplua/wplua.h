@@ -92,9 +92,40 @@ gboolean wplua_load_buffer (lua_State * L, const gchar *buf, gsize size,
 gboolean wplua_load_uri (lua_State * L, const gchar *uri, GError **error);
 gboolean wplua_load_path (lua_State * L, const gchar *path, GError **error);
 
+gchar * wplua_get_cache_path (const gchar * path);
+GBytes * wplua_precompile_path (const gchar * path, GError ** error);
+gboolean wplua_load_bytecode (lua_State * L, GBytes * bytecode,
+    const gchar * path, GError ** error);
+
 gboolean wplua_pcall (lua_State * L, int nargs, int nres, GError **error);
 
+/**
+ * WpLuaStats:
+ *
+ * @brief Execution statistics of the Lua code that runs on behalf of
+ * someone, accounted with wplua_stats_push() and wplua_stats_pop()
+ */
+typedef struct _WpLuaStats WpLuaStats;
+struct _WpLuaStats
+{
+  /* number of times Lua was entered */
+  guint64 calls;
+  /* wall clock time spent in Lua, in microseconds */
+  guint64 time;
+  /* bytes allocated by Lua */
+  guint64 allocated;
+};
+
+WpLuaStats * wplua_stats_new (void);
+WpLuaStats * wplua_stats_ref (WpLuaStats * self);
+void wplua_stats_unref (WpLuaStats * self);
+
+WpLuaStats * wplua_stats_get_current (lua_State *L);
+void wplua_stats_push (lua_State *L, WpLuaStats * stats);
+void wplua_stats_pop (lua_State *L);
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(lua_State, wplua_unref)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(WpLuaStats, wplua_stats_unref)
 
 G_END_DECLS
 
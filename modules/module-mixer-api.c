@@ -474,9 +474,31 @@ wp_mixer_api_set_volume (WpMixerApi * self, guint32 id, GVariant * vvolume)
   }
 
   /* set param */
-  g_autoptr (WpSpaPod) props = NULL;
-  g_autoptr (WpSpaPodBuilder) b =
-      wp_spa_pod_builder_new_object ("Spa:Pod:Object:Param:Props", "Props");
+  g_autoptr (WpSpaPodBuilder) b = NULL;
+  WpPipewireObject *proxy = NULL;
+
+  if (info->device_id != SPA_ID_INVALID) {
+    proxy = wp_object_manager_lookup (self->om,
+        WP_TYPE_DEVICE, WP_CONSTRAINT_TYPE_G_PROPERTY,
+        "bound-id", "=u", info->device_id, NULL);
+    g_return_val_if_fail (proxy != NULL, FALSE);
+
+    /* the props are built in place, inside the route */
+    b = wp_spa_pod_builder_new_object ("Spa:Pod:Object:Param:Route", "Route");
+    wp_spa_pod_builder_add (b,
+        "index", "i", info->route_index,
+        "device", "i", info->route_device,
+        NULL);
+    wp_spa_pod_builder_add_property (b, "props");
+    wp_spa_pod_builder_push_object (b, "Spa:Pod:Object:Param:Props", "Props");
+  } else {
+    proxy = wp_object_manager_lookup (self->om,
+        WP_TYPE_NODE, WP_CONSTRAINT_TYPE_G_PROPERTY,
+        "bound-id", "=u", id, NULL);
+    g_return_val_if_fail (proxy != NULL, FALSE);
+
+    b = wp_spa_pod_builder_new_object ("Spa:Pod:Object:Param:Props", "Props");
+  }
 
   if (new_volume.channels > 0)
     wp_spa_pod_builder_add (b, "channelVolumes", "a",
@@ -489,28 +511,14 @@ wp_mixer_api_set_volume (WpMixerApi * self, guint32 id, GVariant * vvolume)
   if (has_mute)
     wp_spa_pod_builder_add (b, "mute", "b", mute, NULL);
 
-  props = wp_spa_pod_builder_end (b);
-
   if (info->device_id != SPA_ID_INVALID) {
-    WpPipewireObject *device = wp_object_manager_lookup (self->om,
-        WP_TYPE_DEVICE, WP_CONSTRAINT_TYPE_G_PROPERTY,
-        "bound-id", "=u", info->device_id, NULL);
-    g_return_val_if_fail (device != NULL, FALSE);
-
-    wp_pipewire_object_set_param (device, "Route", 0, wp_spa_pod_new_object (
-        "Spa:Pod:Object:Param:Route", "Route",
-        "index", "i", info->route_index,
-        "device", "i", info->route_device,
-        "props", "P", props,
-        "save", "b", true,
-        NULL));
+    wp_spa_pod_builder_pop (b);
+    wp_spa_pod_builder_add (b, "save", "b", true, NULL);
+    wp_pipewire_object_set_param (proxy, "Route", 0,
+        wp_spa_pod_builder_end (b));
   } else {
-    WpPipewireObject *node = wp_object_manager_lookup (self->om,
-        WP_TYPE_NODE, WP_CONSTRAINT_TYPE_G_PROPERTY,
-        "bound-id", "=u", id, NULL);
-    g_return_val_if_fail (node != NULL, FALSE);
-
-    wp_pipewire_object_set_param (node, "Props", 0, g_steal_pointer (&props));
+    wp_pipewire_object_set_param (proxy, "Props", 0,
+        wp_spa_pod_builder_end (b));
   }
 
   return TRUE;
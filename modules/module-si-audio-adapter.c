@@ -320,15 +320,12 @@ format_audio_raw_build (const struct spa_audio_info_raw *info)
       NULL);
 
    if (!SPA_FLAG_IS_SET (info->flags, SPA_AUDIO_FLAG_UNPOSITIONED)) {
-     /* Build the position array spa pod */
-     g_autoptr (WpSpaPodBuilder) position_builder = wp_spa_pod_builder_new_array ();
-     for (guint i = 0; i < info->channels; i++)
-       wp_spa_pod_builder_add_id (position_builder, info->position[i]);
-
-     /* Add the position property */
+     /* Add the position array in place */
      wp_spa_pod_builder_add_property (builder, "position");
-     g_autoptr (WpSpaPod) position = wp_spa_pod_builder_end (position_builder);
-     wp_spa_pod_builder_add_pod (builder, position);
+     wp_spa_pod_builder_push_array (builder);
+     for (guint i = 0; i < info->channels; i++)
+       wp_spa_pod_builder_add_id (builder, info->position[i]);
+     wp_spa_pod_builder_pop (builder);
    }
 
    return wp_spa_pod_builder_end (builder);
@@ -336,26 +333,28 @@ format_audio_raw_build (const struct spa_audio_info_raw *info)
 
 static gboolean
 parse_adapter_format (WpSpaPod *format, gint *channels,
-   WpSpaPod **position)
+    WpSpaPod **position)
 {
-  g_autoptr (WpSpaPodParser) parser = NULL;
+  static WpSpaPodParseSpec *spec = NULL;
   guint32 t = 0, s = 0, f = 0;
   gint r = 0, c = 0;
   g_autoptr (WpSpaPod) p = NULL;
 
   g_return_val_if_fail (format, FALSE);
-  parser = wp_spa_pod_parser_new_object (format, NULL);
-  g_return_val_if_fail (parser, FALSE);
-
-  if (!wp_spa_pod_parser_get (parser, "mediaType", "I", &t, NULL) ||
-      !wp_spa_pod_parser_get (parser, "mediaSubtype", "I", &s, NULL) ||
-      !wp_spa_pod_parser_get (parser, "format", "I", &f, NULL) ||
-      !wp_spa_pod_parser_get (parser, "rate", "i", &r, NULL) ||
-      !wp_spa_pod_parser_get (parser, "channels", "i", &c, NULL))
-    return FALSE;
+
+  /* resolve the keys once and get them all in a single pass */
+  if (g_once_init_enter (&spec)) {
+    WpSpaPodParseSpec *tmp = wp_spa_pod_parse_spec_new (
+        "Spa:Pod:Object:Param:Format", "mediaType", "mediaSubtype", "format",
+        "rate", "channels", "position", NULL);
+    g_once_init_leave (&spec, tmp);
+  }
+  g_return_val_if_fail (spec, FALSE);
 
   /* position is optional */
-  wp_spa_pod_parser_get (parser, "position", "P", &p, NULL);
+  if (!wp_spa_pod_parse_spec_get (spec, format, NULL,
+          "I", &t, "I", &s, "I", &f, "i", &r, "i", &c, "?P", &p, NULL))
+    return FALSE;
 
   if (channels && c != 0)
     *channels = c;
@@ -374,27 +373,6 @@ build_adapter_format (WpSiAudioAdapter * self, guint32 format, gint channels,
 
   g_return_val_if_fail (channels > 0, NULL);
 
-  /* build the position array if not given */
-  if (!position) {
-    switch (channels) {
-    case 1: {
-      g_autoptr (WpSpaPodBuilder) pos_b = wp_spa_pod_builder_new_array ();
-      wp_spa_pod_builder_add_id (pos_b, SPA_AUDIO_CHANNEL_MONO);
-      position = wp_spa_pod_builder_end (pos_b);
-      break;
-    }
-    case 2: {
-      g_autoptr (WpSpaPodBuilder) pos_b = wp_spa_pod_builder_new_array ();
-      wp_spa_pod_builder_add_id (pos_b, SPA_AUDIO_CHANNEL_FL);
-      wp_spa_pod_builder_add_id (pos_b, SPA_AUDIO_CHANNEL_FR);
-      position = wp_spa_pod_builder_end (pos_b);
-      break;
-    }
-    default:
-      break;
-    }
-  }
-
   /* build the format */
   b = wp_spa_pod_builder_new_object ("Spa:Pod:Object:Param:Format", "Format");
   wp_spa_pod_builder_add_property (b, "mediaType");
@@ -407,9 +385,22 @@ build_adapter_format (WpSiAudioAdapter * self, guint32 format, gint channels,
   wp_spa_pod_builder_add_int (b, si_audio_adapter_get_default_clock_rate (self));
   wp_spa_pod_builder_add_property (b, "channels");
   wp_spa_pod_builder_add_int (b, channels);
+
+  /* build the position array in place if not given */
   if (position) {
     wp_spa_pod_builder_add_property (b, "position");
     wp_spa_pod_builder_add_pod (b, position);
+  } else if (channels == 1) {
+    wp_spa_pod_builder_add_property (b, "position");
+    wp_spa_pod_builder_push_array (b);
+    wp_spa_pod_builder_add_id (b, SPA_AUDIO_CHANNEL_MONO);
+    wp_spa_pod_builder_pop (b);
+  } else if (channels == 2) {
+    wp_spa_pod_builder_add_property (b, "position");
+    wp_spa_pod_builder_push_array (b);
+    wp_spa_pod_builder_add_id (b, SPA_AUDIO_CHANNEL_FL);
+    wp_spa_pod_builder_add_id (b, SPA_AUDIO_CHANNEL_FR);
+    wp_spa_pod_builder_pop (b);
   }
   return wp_spa_pod_builder_end (b);
 }
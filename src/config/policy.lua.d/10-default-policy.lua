@@ -57,6 +57,9 @@ function default_policy.enable()
   -- API to access default nodes from scripts
   load_module("default-nodes-api")
 
+  -- API to find link targets and changed linkables, needed for policy-node
+  load_module("linking-api")
+
   -- API to access mixer controls, needed for volume ducking
   load_module("mixer-api")
 
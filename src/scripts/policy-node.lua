@@ -19,9 +19,116 @@ self.pending_rescan = false
 self.events_skipped = false
 self.pending_error_timer = nil
 
+-- The linking-api plugin keeps indexes of the linkables and links and tracks
+-- which linkables need to be handled after a change, so that rescans do not
+-- need to handle all the linkables. Without it, fall back to iterating the
+-- object managers.
+
+function getLinkable (id)
+  if linking_api then
+    return linking_api:call("get-linkable", id)
+  end
+  return linkables_om:lookup {
+    Constraint { "id", "=", id, type = "gobject" },
+  }
+end
+
+function findLinkables (key, value)
+  local result = {}
+  if linking_api then
+    for _, id in ipairs(linking_api:call("find-linkables", key, value)) do
+      table.insert(result, getLinkable(id))
+    end
+  else
+    for si in linkables_om:iterate { Constraint { key, "=", value } } do
+      table.insert(result, si)
+    end
+  end
+  return result
+end
+
+-- returns the device linkables of the given direction and media type,
+-- from the highest to the lowest priority
+function getTargets (direction, media_type)
+  local result = {}
+  if linking_api then
+    for _, id in ipairs(linking_api:call("get-targets", direction, media_type)) do
+      table.insert(result, getLinkable(id))
+    end
+  else
+    for si in linkables_om:iterate {
+      Constraint { "item.node.type", "=", "device" },
+      Constraint { "item.node.direction", "=", direction },
+      Constraint { "media.type", "=", media_type },
+    } do
+      table.insert(result, si)
+    end
+    local function key (si)
+      local p = si.properties
+      return tonumber(p["priority.session"]) or 0,
+          tonumber(p["item.plugged.usec"]) or 0
+    end
+    -- table.sort is not stable, keep the iteration order for equal targets
+    for i, si in ipairs(result) do
+      result[i] = { si = si, index = i }
+    end
+    table.sort(result, function (a, b)
+      local pa, ua = key(a.si)
+      local pb, ub = key(b.si)
+      if pa ~= pb then
+        return pa > pb
+      elseif ua ~= ub then
+        return ua > ub
+      end
+      return a.index < b.index
+    end)
+    for i, t in ipairs(result) do
+      result[i] = t.si
+    end
+  end
+  return result
+end
+
+-- returns the ids of the linkables that are linked with the given linkable
+function getPeers (id)
+  if linking_api then
+    return linking_api:call("get-peers", id)
+  end
+  local peers = {}
+  for silink in links_om:iterate() do
+    local out_id = tonumber(silink.properties["out.item.id"])
+    local in_id = tonumber(silink.properties["in.item.id"])
+    if out_id == id or in_id == id then
+      table.insert(peers, (out_id == id) and in_id or out_id)
+    end
+  end
+  return peers
+end
+
+function markDirty (id)
+  if linking_api then
+    linking_api:call("mark-dirty", id)
+  end
+end
+
+function markAllDirty ()
+  if linking_api then
+    linking_api:call("mark-all-dirty")
+  end
+end
+
 function rescan()
-  for si in linkables_om:iterate() do
-    handleLinkable (si)
+  if linking_api then
+    for _, id in ipairs(linking_api:call("take-dirty")) do
+      local si = getLinkable(id)
+      if si then
+        handleLinkable (si)
+      end
+    end
+  else
+    for si in linkables_om:iterate() do
+      handleLinkable (si)
+    end
   end
 end
 
@@ -105,9 +212,7 @@ function createLink (si, si_target, passthrough, exclusive)
     end
 
     for _, id in ipairs (ids) do
-      local si = linkables_om:lookup {
-        Constraint { "id", "=", id, type = "gobject" },
-      }
+      local si = getLinkable (id)
       if si then
         local node = si:get_associated_proxy ("node")
         local client_id = node.properties["client.id"]
@@ -149,6 +254,7 @@ function createLink (si, si_target, passthrough, exclusive)
       end
       Log.info (l, "activated si-standard-link")
     end
+    markDirty (si_id)
     scheduleRescan()
   end)
 end
@@ -158,6 +264,11 @@ function isLinked(si_target)
   local linked = false
   local exclusive = false
 
+  if linking_api then
+    local state = linking_api:call("get-link-state", target_id)
+    return state > 0, state > 1
+  end
+
   for l in links_om:iterate() do
     local p = l.properties
     local out_id = tonumber(p["out.item.id"])
@@ -237,20 +348,12 @@ function canLink (properties, si_target)
 
     -- make sure target is not linked with another node with same link group
     -- start by locating other nodes in the target's link-group, in opposite direction
-    for n in linkables_om:iterate {
-      Constraint { "id", "!", si_target.id, type = "gobject" },
-      Constraint { "item.node.direction", "!", target_props["item.node.direction"] },
-      Constraint { "node.link-group", "=", target_link_group },
-    } do
-      -- iterate their peers and return false if one of them cannot link
-      for silink in links_om:iterate() do
-        local out_id = tonumber(silink.properties["out.item.id"])
-        local in_id = tonumber(silink.properties["in.item.id"])
-        if out_id == n.id or in_id == n.id then
-          local peer_id = (out_id == n.id) and in_id or out_id
-          local peer = linkables_om:lookup {
-            Constraint { "id", "=", peer_id, type = "gobject" },
-          }
+    for _, n in ipairs(findLinkables("node.link-group", target_link_group)) do
+      if n.id ~= si_target.id and
+          n.properties["item.node.direction"] ~= target_props["item.node.direction"] then
+        -- iterate their peers and return false if one of them cannot link
+        for _, peer_id in ipairs(getPeers(n.id)) do
+          local peer = getLinkable(peer_id)
           if peer and not canLinkGroupCheck (link_group, peer, hops + 1) then
             return false
           end
@@ -330,22 +433,20 @@ function findDefinedTarget (properties)
   end
 
   if target_value and tonumber(target_value) then
-    local si_target = linkables_om:lookup {
-      Constraint { target_key, "=", target_value },
-    }
+    local si_target = findLinkables(target_key, target_value)[1]
     if si_target and canLink (properties, si_target) then
       return si_target, true, node_defined
     end
   end
 
   if target_value then
-    for si_target in linkables_om:iterate() do
-      local target_props = si_target.properties
-      if (target_props["node.name"] == target_value or
-          target_props["object.path"] == target_value) and
-          target_props["item.node.direction"] == target_direction and
-          canLink (properties, si_target) then
-        return si_target, true, node_defined
+    for _, key in ipairs({ "node.name", "object.path" }) do
+      for _, si_target in ipairs(findLinkables(key, target_value)) do
+        local target_props = si_target.properties
+        if target_props["item.node.direction"] == target_direction and
+            canLink (properties, si_target) then
+          return si_target, true, node_defined
+        end
       end
     end
   end
@@ -441,9 +542,7 @@ function findDefaultLinkable (si)
   local si_props = si.properties
   local target_direction = getTargetDirection(si_props)
   local def_node_id = getDefaultNode(si_props, target_direction)
-  return linkables_om:lookup {
-      Constraint { "node.id", "=", tostring(def_node_id) }
-  }
+  return findLinkables("node.id", tostring(def_node_id))[1]
 end
 
 function checkPassthroughCompatibility (si, si_target)
@@ -462,14 +561,10 @@ function findBestLinkable (si)
   local target_direction = getTargetDirection(si_props)
   local target_picked = nil
   local target_can_passthrough = false
-  local target_priority = 0
-  local target_plugged = 0
-
-  for si_target in linkables_om:iterate {
-    Constraint { "item.node.type", "=", "device" },
-    Constraint { "item.node.direction", "=", target_direction },
-    Constraint { "media.type", "=", si_props["media.type"] },
-  } do
+
+  -- the targets are sorted by priority and plugged time, so the first one
+  -- that can be linked is the best one
+  for _, si_target in ipairs(getTargets(target_direction, si_props["media.type"])) do
     local si_target_props = si_target.properties
     local si_target_node_id = si_target_props["node.id"]
     local priority = tonumber(si_target_props["priority.session"]) or 0
@@ -499,20 +594,12 @@ function findBestLinkable (si)
 
     Log.debug("... priority:"..tostring(priority)..", plugged:"..tostring(plugged))
 
-    -- (target_picked == NULL) --> make sure atleast one target is picked.
-    -- (priority > target_priority) --> pick the highest priority linkable(node)
-    -- target.
-    -- (priority == target_priority and plugged > target_plugged) --> pick the
-    -- latest connected/plugged(in time) linkable(node) target.
-    if (target_picked == nil or
-        priority > target_priority or
-        (priority == target_priority and plugged > target_plugged)) then
-          Log.debug("... picked")
-          target_picked = si_target
-          target_can_passthrough = can_passthrough
-          target_priority = priority
-          target_plugged = plugged
-    end
+    -- pick the highest priority linkable(node) target, or, if priorities are
+    -- equal, the latest connected/plugged(in time) linkable(node) target.
+    Log.debug("... picked")
+    target_picked = si_target
+    target_can_passthrough = can_passthrough
+    do break end
     ::skip_linkable::
   end
 
@@ -555,6 +642,9 @@ function findUndefinedTarget (si)
 end
 
 function lookupLink (si_id, si_target_id)
+  if linking_api then
+    return linking_api:call("lookup-link", si_id, si_target_id)
+  end
   local link = links_om:lookup {
     Constraint { "out.item.id", "=", si_id },
     Constraint { "in.item.id", "=", si_target_id }
@@ -620,6 +710,7 @@ function checkPending ()
   elseif self.events_skipped then
     Log.debug("pending linkables ready")
     self.events_skipped = false
+    markAllDirty ()
     scheduleRescan ()
     return true
   end
@@ -701,6 +792,7 @@ function handleLinkable (si)
       and not si_flags[si_id].done_waiting then
     Log.info (si, "... waiting for target")
     si_flags[si_id].done_waiting = true
+    markDirty (si_id)
     scheduleRescan()
     return
   end
@@ -833,6 +925,10 @@ function unhandleLinkable (si)
 end
 
 default_nodes = Plugin.find("default-nodes-api")
+linking_api = Plugin.find("linking-api")
+if linking_api then
+  linking_api.move = config.move
+end
 
 metadata_om = ObjectManager {
   Interest {
@@ -876,6 +972,16 @@ links_om = ObjectManager {
 -- listen for default node changes if config.follow is enabled
 if config.follow and default_nodes ~= nil then
   default_nodes:connect("changed", function ()
+    if linking_api then
+      linking_api:call("mark-defaults-dirty")
+    end
+    scheduleRescan ()
+  end)
+end
+
+-- rescan the linkables that are affected by changes in the graph
+if linking_api then
+  linking_api:connect("changed", function ()
     scheduleRescan ()
   end)
 end
@@ -989,6 +1095,11 @@ linkables_om:connect("object-added", function (om, si)
     checkFiltersPortsState (si)
   end
 
+  -- with linking-api, new linkables are handled when it emits "changed"
+  if linking_api then
+    return
+  end
+
   if si_props["item.node.type"] ~= "stream" then
     scheduleRescan ()
   else
@@ -998,11 +1109,16 @@ end)
 
 linkables_om:connect("object-removed", function (om, si)
   unhandleLinkable (si)
-  scheduleRescan ()
+  if not linking_api then
+    scheduleRescan ()
+  end
 end)
 
 devices_om:connect("object-added", function (om, device)
   device:connect("params-changed", function (d, param_name)
+    if linking_api then
+      linking_api:call("mark-device-dirty", device["bound-id"])
+    end
     scheduleRescan ()
   end)
 end)
@@ -48,6 +48,13 @@ end
 -- the state storage
 state = State("restore-stream")
 state_table = state:load()
+-- the keys of state_table that changed since the last save
+changed_keys = {}
+
+function updateState(key, value)
+  state_table[key] = value
+  changed_keys[key] = true
+end
 
 -- simple serializer {"foo", "bar"} -> "foo;bar;"
 function serializeArray(a)
@@ -96,8 +103,10 @@ function storeAfterTimeout()
     timeout_source:destroy()
   end
   timeout_source = Core.timeout_add(1000, function ()
-    local saved, err = state:save(state_table)
-    if not saved then
+    local saved, err = state:save_keys(state_table, changed_keys)
+    if saved then
+      changed_keys = {}
+    else
       Log.warning(err)
     end
     timeout_source = nil
@@ -173,7 +182,7 @@ function saveTarget(subject, target_key, type, value)
       target_name = target_node.properties["node.name"]
     end
   end
-  state_table[key_base .. ":target"] = target_name
+  updateState(key_base .. ":target", target_name)
 
   Log.info(node, "saving stream target for " ..
     tostring(stream_props["node.name"]) ..
@@ -214,42 +223,6 @@ function restoreTarget(node, target_name)
   end
 end
 
-function jsonTable(val, name)
-  local tmp = ""
-  local count = 0
-
-  if name then tmp = tmp .. string.format("%q", name) .. ": " end
-
-  if type(val) == "table" then
-    if val["pod_type"] == "Array" then
-      tmp = tmp .. "["
-      for _, v in ipairs(val) do
-	if count > 0 then tmp = tmp .. "," end
-        tmp = tmp .. jsonTable(v)
-	count = count + 1
-      end
-      tmp = tmp .. "]"
-    else
-      tmp = tmp .. "{"
-      for k, v in pairs(val) do
-	if count > 0 then tmp = tmp .. "," end
-        tmp = tmp .. jsonTable(v, k)
-	count = count + 1
-      end
-      tmp = tmp .. "}"
-    end
-  elseif type(val) == "number" then
-    tmp = tmp .. tostring(val)
-  elseif type(val) == "string" then
-    tmp = tmp .. string.format("%q", val)
-  elseif type(val) == "boolean" then
-    tmp = tmp .. (val and "true" or "false")
-  else
-    tmp = tmp .. "\"[type:" .. type(val) .. "]\""
-  end
-  return tmp
-end
-
 function moveToMetadata(key_base, metadata)
   local route_table = { }
   local count = 0
@@ -279,7 +252,7 @@ function moveToMetadata(key_base, metadata)
   end
 
   if count > 0 then
-    metadata:set(0, key, "Spa:String:JSON", jsonTable(route_table));
+    metadata:set(0, key, "Spa:String:JSON", Json.encode(route_table));
   end
 end
 
@@ -304,16 +277,16 @@ function saveStream(node)
       end
 
       if props.volume then
-        state_table[key_base .. ":volume"] = tostring(props.volume)
+        updateState(key_base .. ":volume", tostring(props.volume))
       end
       if props.mute ~= nil then
-        state_table[key_base .. ":mute"] = tostring(props.mute)
+        updateState(key_base .. ":mute", tostring(props.mute))
       end
       if props.channelVolumes then
-        state_table[key_base .. ":channelVolumes"] = serializeArray(props.channelVolumes)
+        updateState(key_base .. ":channelVolumes", serializeArray(props.channelVolumes))
       end
       if props.channelMap then
-        state_table[key_base .. ":channelMap"] = serializeArray(props.channelMap)
+        updateState(key_base .. ":channelMap", serializeArray(props.channelMap))
       end
 
       ::skip_prop::
@@ -440,16 +413,16 @@ function handleRouteSettings(subject, key, type, value)
   key_base = string.gsub(key_base, "%.", ":", 1);
 
   if vparsed.volume ~= nil then
-    state_table[key_base .. ":volume"] = tostring (vparsed.volume)
+    updateState(key_base .. ":volume", tostring (vparsed.volume))
   end
   if vparsed.mute ~= nil then
-    state_table[key_base .. ":mute"] = tostring (vparsed.mute)
+    updateState(key_base .. ":mute", tostring (vparsed.mute))
   end
   if vparsed.channels ~= nil then
-    state_table[key_base .. ":channelMap"] = serializeArray (vparsed.channels)
+    updateState(key_base .. ":channelMap", serializeArray (vparsed.channels))
   end
   if vparsed.volumes ~= nil then
-    state_table[key_base .. ":channelVolumes"] = serializeArray (vparsed.volumes)
+    updateState(key_base .. ":channelVolumes", serializeArray (vparsed.volumes))
   end
 
   storeAfterTimeout()
@@ -9,6 +9,7 @@
 #include <wp/wp.h>
 #include <stdio.h>
 #include <locale.h>
+#include <unistd.h>
 #include <spa/utils/defs.h>
 #include <pipewire/keys.h>
 #include <pipewire/extensions/session-manager/keys.h>
@@ -71,6 +72,10 @@ static struct {
     struct {
       guint64 id;
     } clear_default;
+
+    struct {
+      gchar request[32];
+    } script_stats;
   };
 } cmdline;
 
@@ -1262,6 +1267,130 @@ out:
   g_main_loop_quit (self->loop);
 }
 
+/* script-stats */
+
+typedef struct {
+  gchar *name;
+  guint64 calls;
+  guint64 time;
+  guint64 allocated;
+} ScriptStats;
+
+static void
+script_stats_free (ScriptStats * stats)
+{
+  g_free (stats->name);
+  g_slice_free (ScriptStats, stats);
+}
+
+static gint
+script_stats_compare (gconstpointer a, gconstpointer b)
+{
+  const ScriptStats *sa = *(const ScriptStats **) a;
+  const ScriptStats *sb = *(const ScriptStats **) b;
+  return (sb->time > sa->time) - (sb->time < sa->time);
+}
+
+static guint64
+parse_stats_field (WpSpaJson * json, const gchar * field)
+{
+  g_autofree gchar *str = NULL;
+  if (!wp_spa_json_object_get (json, field, "s", &str, NULL))
+    return 0;
+  return g_ascii_strtoull (str, NULL, 10);
+}
+
+static gboolean
+script_stats_prepare (WpCtl * self, GError ** error)
+{
+  wp_object_manager_add_interest (self->om, WP_TYPE_METADATA,
+      WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "metadata.name", "=s",
+      "lua-script-stats", NULL);
+  wp_object_manager_request_object_features (self->om, WP_TYPE_METADATA,
+      WP_OBJECT_FEATURES_ALL);
+  return TRUE;
+}
+
+static void
+on_script_stats_changed (WpMetadata * m, guint32 subject, const gchar * key,
+    const gchar * type, const gchar * value, WpCtl * self)
+{
+  g_autoptr (GPtrArray) stats = NULL;
+  g_autoptr (WpIterator) it = NULL;
+  g_auto (GValue) item = G_VALUE_INIT;
+  guint64 total_time = 0;
+
+  /* wait until the daemon has published all the stats */
+  if (subject != 0 || g_strcmp0 (key, "response") != 0 ||
+      g_strcmp0 (value, cmdline.script_stats.request) != 0)
+    return;
+
+  stats = g_ptr_array_new_with_free_func ((GDestroyNotify) script_stats_free);
+  it = wp_metadata_new_iterator (m, 0);
+  for (; wp_iterator_next (it, &item); g_value_unset (&item)) {
+    const gchar *k = NULL, *t = NULL, *v = NULL;
+    g_autoptr (WpSpaJson) json = NULL;
+    ScriptStats *s;
+
+    wp_metadata_iterator_item_extract (&item, NULL, &k, &t, &v);
+    if (g_strcmp0 (t, "Spa:String:JSON") != 0 || !v)
+      continue;
+
+    json = wp_spa_json_new_from_string (v);
+    if (!wp_spa_json_is_object (json))
+      continue;
+
+    s = g_slice_new0 (ScriptStats);
+    s->name = g_strdup (k);
+    s->calls = parse_stats_field (json, "calls");
+    s->time = parse_stats_field (json, "time");
+    s->allocated = parse_stats_field (json, "allocated");
+    total_time += s->time;
+    g_ptr_array_add (stats, s);
+  }
+
+  g_ptr_array_sort (stats, script_stats_compare);
+
+  printf ("%-44s %10s %12s %7s %14s\n", "Script", "Calls", "Time (ms)",
+      "Time %", "Allocated (KiB)");
+  for (guint i = 0; i < stats->len; i++) {
+    ScriptStats *s = g_ptr_array_index (stats, i);
+    printf ("%-44s %10" G_GUINT64_FORMAT " %12.3f %6.1f%% %14.1f\n",
+        s->name, s->calls, s->time / 1000.0,
+        total_time ? (100.0 * s->time / total_time) : 0.0,
+        s->allocated / 1024.0);
+  }
+
+  g_main_loop_quit (self->loop);
+}
+
+static void
+script_stats_run (WpCtl * self)
+{
+  g_autoptr (WpMetadata) m = NULL;
+
+  m = wp_object_manager_lookup (self->om, WP_TYPE_METADATA, NULL);
+  if (!m) {
+    fprintf (stderr, "Script statistics are not available; "
+        "is the WirePlumber daemon running?\n");
+    goto out;
+  }
+
+  /* ask the daemon to publish the current stats; it answers by setting the
+     "response" key to the same value after all the stats have been set */
+  g_snprintf (cmdline.script_stats.request,
+      sizeof (cmdline.script_stats.request), "%d-%" G_GINT64_FORMAT,
+      (gint) getpid (), g_get_monotonic_time ());
+  g_signal_connect (m, "changed", G_CALLBACK (on_script_stats_changed), self);
+  wp_metadata_set (m, 0, "request", "Spa:String",
+      cmdline.script_stats.request);
+  return;
+
+out:
+  self->exit_code = 3;
+  g_main_loop_quit (self->loop);
+}
+
 #define N_ENTRIES 3
 
 static const struct subcommand {
@@ -1394,6 +1523,19 @@ static const struct subcommand {
     .parse_positional = clear_default_parse_positional,
     .prepare = clear_default_prepare,
     .run = clear_default_run,
+  },
+  {
+    .name = "script-stats",
+    .positional_args = "",
+    .summary = "Displays the time spent and the memory allocated by each "
+               "Lua script of the WirePlumber daemon",
+    .description = "The time and the allocations of the callbacks that a "
+                   "script registers\nare accounted to the script; "
+                   "all values are cumulative since the script was loaded.",
+    .entries = { { NULL } },
+    .parse_positional = NULL,
+    .prepare = script_stats_prepare,
+    .run = script_stats_run,
   }
 };
 
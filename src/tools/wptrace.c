@@ -0,0 +1,253 @@
+/* WirePlumber
+ *
+ * Copyright © 2021 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <wp/private/trace-format.h>
+
+static const gchar level_names[] = "UECWMIDT";
+
+static gboolean json = FALSE;
+static gchar **files = NULL;
+
+static GOptionEntry entries[] =
+{
+  { "json", 'j', 0, G_OPTION_ARG_NONE, &json,
+    "Output in the Chrome trace event format (JSON)", NULL },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &files,
+    NULL, "FILE" },
+  { NULL }
+};
+
+typedef struct {
+  const struct wp_trace_header *header;
+  GHashTable *strings; /* id -> gchar* */
+  GPtrArray *records; /* element-type: const struct wp_trace_record* */
+} TraceFile;
+
+static const gchar *
+get_string (TraceFile * self, guint32 id)
+{
+  const gchar *str;
+
+  if (id == WP_TRACE_STRING_NONE)
+    return "";
+  str = g_hash_table_lookup (self->strings, GUINT_TO_POINTER (id));
+  return str ? str : "?";
+}
+
+static gint
+compare_records (gconstpointer a, gconstpointer b)
+{
+  const struct wp_trace_record *ra = *(const struct wp_trace_record **) a;
+  const struct wp_trace_record *rb = *(const struct wp_trace_record **) b;
+  return (ra->seq > rb->seq) - (ra->seq < rb->seq);
+}
+
+static gboolean
+trace_file_parse (TraceFile * self, const gchar * data, gsize size,
+    GError ** error)
+{
+  const struct wp_trace_header *h = (const struct wp_trace_header *) data;
+  const gchar *strings;
+  guint64 first_seq;
+  gsize offset = 0;
+
+  if (size < WP_TRACE_HEADER_SIZE ||
+      memcmp (h->magic, WP_TRACE_MAGIC, sizeof (h->magic)) != 0) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "not a WirePlumber trace file");
+    return FALSE;
+  }
+  if (h->version != WP_TRACE_VERSION) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "unsupported trace file version %u", h->version);
+    return FALSE;
+  }
+  if (h->slot_size < sizeof (struct wp_trace_record) || h->n_slots == 0 ||
+      h->strings_used > h->strings_size || size < wp_trace_file_size (h)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "the trace file is truncated or corrupt");
+    return FALSE;
+  }
+
+  self->header = h;
+
+  /* load the string table */
+  strings = (const gchar *) wp_trace_get_strings (h);
+  while (offset + sizeof (struct wp_trace_string) <= h->strings_used) {
+    const struct wp_trace_string *s =
+        (const struct wp_trace_string *) (strings + offset);
+    gsize entry_size = wp_trace_string_entry_size (s->len);
+
+    if (offset + entry_size > h->strings_used)
+      break;
+    g_hash_table_insert (self->strings, GUINT_TO_POINTER (s->id),
+        g_strndup (s->text, s->len));
+    offset += entry_size;
+  }
+
+  /* collect the records that are still in the ring, in order */
+  first_seq = (h->seq > h->n_slots) ? (h->seq - h->n_slots + 1) : 1;
+  for (guint64 i = 0; i < h->n_slots; i++) {
+    const struct wp_trace_record *r = wp_trace_get_slot (h, i);
+    if (r->seq >= first_seq && r->seq <= h->seq &&
+        r->payload_len < h->slot_size - sizeof (struct wp_trace_record))
+      g_ptr_array_add (self->records, (gpointer) r);
+  }
+  g_ptr_array_sort (self->records, compare_records);
+  return TRUE;
+}
+
+static void
+print_text (TraceFile * self)
+{
+  const struct wp_trace_header *h = self->header;
+
+  for (guint i = 0; i < self->records->len; i++) {
+    const struct wp_trace_record *r = g_ptr_array_index (self->records, i);
+    gint64 now = h->start_realtime + (r->time - h->start_monotonic);
+    time_t now_secs = (time_t) (now / G_USEC_PER_SEC);
+    struct tm now_tm;
+    gchar time_buf[128];
+
+    localtime_r (&now_secs, &now_tm);
+    strftime (time_buf, sizeof (time_buf), "%H:%M:%S", &now_tm);
+
+    printf ("%c %s.%06d %18.18s %s ",
+        level_names[MIN (r->level, sizeof (level_names) - 2)],
+        time_buf, (gint) (now % G_USEC_PER_SEC),
+        get_string (self, r->domain_id),
+        get_string (self, r->location_id));
+
+    if (r->object || r->type_id != WP_TRACE_STRING_NONE) {
+      if (r->bound_id != G_MAXUINT32)
+        printf ("<%s:%u:%p> ", get_string (self, r->type_id), r->bound_id,
+            GSIZE_TO_POINTER ((gsize) r->object));
+      else
+        printf ("<%s::%p> ", get_string (self, r->type_id),
+            GSIZE_TO_POINTER ((gsize) r->object));
+    }
+
+    printf ("%.*s%s\n", (gint) r->payload_len, r->payload,
+        (r->flags & WP_TRACE_RECORD_FLAG_TRUNCATED) ? "…" : "");
+  }
+}
+
+static void
+append_json_string (GString * out, const gchar * str, gssize len)
+{
+  const gchar *end = str + ((len < 0) ? (gssize) strlen (str) : len);
+
+  g_string_append_c (out, '"');
+  for (; str < end; str++) {
+    guchar c = *str;
+    switch (c) {
+      case '"': g_string_append (out, "\\\""); break;
+      case '\\': g_string_append (out, "\\\\"); break;
+      case '\n': g_string_append (out, "\\n"); break;
+      case '\r': g_string_append (out, "\\r"); break;
+      case '\t': g_string_append (out, "\\t"); break;
+      default:
+        if (c < 0x20)
+          g_string_append_printf (out, "\\u%04x", c);
+        else
+          g_string_append_c (out, c);
+        break;
+    }
+  }
+  g_string_append_c (out, '"');
+}
+
+static void
+print_json (TraceFile * self)
+{
+  const struct wp_trace_header *h = self->header;
+  g_autoptr (GString) out = g_string_new ("{\"traceEvents\":[");
+
+  for (guint i = 0; i < self->records->len; i++) {
+    const struct wp_trace_record *r = g_ptr_array_index (self->records, i);
+
+    if (i > 0)
+      g_string_append_c (out, ',');
+
+    g_string_append (out, "\n{\"name\":");
+    append_json_string (out, r->payload, r->payload_len);
+    g_string_append (out, ",\"cat\":");
+    append_json_string (out, get_string (self, r->domain_id), -1);
+    g_string_append_printf (out,
+        ",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":0,"
+        "\"ts\":%" G_GINT64_FORMAT ",\"args\":{\"level\":\"%c\","
+        "\"location\":",
+        r->time - h->start_monotonic,
+        level_names[MIN (r->level, sizeof (level_names) - 2)]);
+    append_json_string (out, get_string (self, r->location_id), -1);
+
+    if (r->object || r->type_id != WP_TRACE_STRING_NONE) {
+      g_string_append_printf (out, ",\"object\":\"0x%" G_GINT64_MODIFIER "x\""
+          ",\"type\":", r->object);
+      append_json_string (out, get_string (self, r->type_id), -1);
+      if (r->bound_id != G_MAXUINT32)
+        g_string_append_printf (out, ",\"bound-id\":%u", r->bound_id);
+    }
+    g_string_append (out, "}}");
+  }
+
+  g_string_append (out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fwrite (out->str, 1, out->len, stdout);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_autoptr (GOptionContext) context = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GMappedFile) mapped = NULL;
+  TraceFile trace = {0};
+
+  context = g_option_context_new ("- decode WirePlumber binary trace files");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_set_description (context,
+      "Records are printed in the same text format as the normal log, or as\n"
+      "instant events that can be loaded in chrome://tracing or Perfetto.");
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+  if (!files || g_strv_length (files) != 1) {
+    fprintf (stderr, "Exactly one trace file must be specified\n");
+    return 1;
+  }
+
+  mapped = g_mapped_file_new (files[0], FALSE, &error);
+  if (!mapped) {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+
+  trace.strings = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      g_free);
+  trace.records = g_ptr_array_new ();
+
+  if (!trace_file_parse (&trace, g_mapped_file_get_contents (mapped),
+          g_mapped_file_get_length (mapped), &error)) {
+    fprintf (stderr, "%s: %s\n", files[0], error->message);
+    return 1;
+  }
+
+  if (json)
+    print_json (&trace);
+  else
+    print_text (&trace);
+
+  g_hash_table_unref (trace.strings);
+  g_ptr_array_unref (trace.records);
+  g_strfreev (files);
+  return 0;
+}
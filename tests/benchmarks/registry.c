@@ -0,0 +1,445 @@
+/* WirePlumber
+ *
+ * Copyright © 2021 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Registry replay benchmark
+ *
+ * Populates the in-process test server with a configurable graph (using a
+ * secondary "client" core), then connects the measured core, installs a
+ * configurable number of object managers and Lua scripts on it and reports:
+ *
+ *  - the time it takes for all the Lua scripts to be enabled
+ *  - the time it takes for all the object managers to be installed
+ *  - the time it takes for the core to settle (all scripts reacted)
+ *  - the peak RSS of the process (which includes the in-process server)
+ *  - the latency percentiles of dispatching new objects to the measured core
+ */
+
+#include "../common/base-test-fixture.h"
+#include <sys/resource.h>
+
+static gint n_nodes = 200;
+static gint n_links = 0;
+static gint n_metadata = 100;
+static gint n_object_managers = 8;
+static gint n_events = 100;
+static gchar **scripts = NULL;
+static gboolean isolate_scripts = FALSE;
+
+static GOptionEntry entries[] =
+{
+  { "nodes", 'n', 0, G_OPTION_ARG_INT, &n_nodes,
+    "Number of audiotestsrc nodes (with one port each)", "N" },
+  { "links", 'l', 0, G_OPTION_ARG_INT, &n_links,
+    "Number of links (each adds a null-audio-sink node)", "N" },
+  { "metadata", 'm', 0, G_OPTION_ARG_INT, &n_metadata,
+    "Number of metadata entries", "N" },
+  { "object-managers", 'o', 0, G_OPTION_ARG_INT, &n_object_managers,
+    "Number of object managers to install", "N" },
+  { "events", 'e', 0, G_OPTION_ARG_INT, &n_events,
+    "Number of nodes to create after installation for measuring latency", "N" },
+  { "script", 's', 0, G_OPTION_ARG_FILENAME_ARRAY, &scripts,
+    "Lua script to load on the measured core (can be repeated)", "SCRIPT" },
+  { "isolate-scripts", 0, 0, G_OPTION_ARG_NONE, &isolate_scripts,
+    "Run each script in its own lua_State", NULL },
+  { NULL }
+};
+
+typedef struct {
+  WpBaseTestFixture base;
+
+  /* objects owned by the populating client */
+  GPtrArray *objects;
+  guint pending;
+  guint failed;
+
+  /* script startup measurement */
+  guint pending_scripts;
+  gint64 scripts_enabled;
+
+  /* event latency measurement */
+  GHashTable *event_times; /* node.name -> start time */
+  GArray *latencies; /* gint64, in microseconds */
+} Benchmark;
+
+static glong
+get_peak_rss_kb (void)
+{
+  struct rusage usage;
+  if (getrusage (RUSAGE_SELF, &usage) < 0)
+    return -1;
+  return usage.ru_maxrss;
+}
+
+static gint64
+percentile (GArray * values, guint pct)
+{
+  guint idx;
+  if (values->len == 0)
+    return 0;
+  idx = MIN (values->len - 1, (values->len * pct) / 100);
+  return g_array_index (values, gint64, idx);
+}
+
+static gint
+compare_int64 (gconstpointer a, gconstpointer b)
+{
+  const gint64 *x = a, *y = b;
+  return (*x > *y) - (*x < *y);
+}
+
+static void
+wait_for_pending (Benchmark * self)
+{
+  while (self->pending > 0)
+    g_main_context_iteration (self->base.context, TRUE);
+}
+
+static void
+sync_core (Benchmark * self, WpCore * core)
+{
+  wp_core_sync (core, NULL, (GAsyncReadyCallback) test_core_done_cb,
+      &self->base);
+  g_main_loop_run (self->base.loop);
+}
+
+static void
+on_object_activated (WpObject * object, GAsyncResult * res, Benchmark * self)
+{
+  g_autoptr (GError) error = NULL;
+
+  if (!wp_object_activate_finish (object, res, &error)) {
+    wp_warning_object (object, "activation failed: %s", error->message);
+    self->failed++;
+  }
+  self->pending--;
+}
+
+static void
+on_script_activated (WpObject * object, GAsyncResult * res, Benchmark * self)
+{
+  on_object_activated (object, res, self);
+  if (--self->pending_scripts == 0)
+    self->scripts_enabled = g_get_monotonic_time ();
+}
+
+static WpNode *
+create_node (Benchmark * self, const gchar * factory, const gchar * name)
+{
+  WpNode *node = wp_node_new_from_factory (self->base.client_core,
+      "spa-node-factory",
+      wp_properties_new (
+          "factory.name", factory,
+          "node.name", name,
+          NULL));
+  g_assert_nonnull (node);
+  g_ptr_array_add (self->objects, node);
+
+  self->pending++;
+  wp_object_activate (WP_OBJECT (node), WP_PIPEWIRE_OBJECT_FEATURES_MINIMAL,
+      NULL, (GAsyncReadyCallback) on_object_activated, self);
+  return node;
+}
+
+static void
+populate (Benchmark * self)
+{
+  g_autoptr (GPtrArray) sources = g_ptr_array_new ();
+  g_autoptr (GPtrArray) sinks = g_ptr_array_new ();
+
+  for (gint i = 0; i < n_nodes; i++) {
+    g_autofree gchar *name = g_strdup_printf ("audiotestsrc.%d", i);
+    g_ptr_array_add (sources, create_node (self, "audiotestsrc", name));
+  }
+  for (gint i = 0; i < n_links; i++) {
+    g_autofree gchar *name = g_strdup_printf ("null-audio-sink.%d", i);
+    g_ptr_array_add (sinks,
+        create_node (self, "support.null-audio-sink", name));
+  }
+  wait_for_pending (self);
+
+  /* link the sources with the sinks, reusing sources if there are more
+     links than nodes */
+  for (gint i = 0; i < n_links && sources->len > 0; i++) {
+    WpProxy *out = g_ptr_array_index (sources, i % sources->len);
+    WpProxy *in = g_ptr_array_index (sinks, i);
+    g_autoptr (WpProperties) props = wp_properties_new_empty ();
+    WpLink *link;
+
+    wp_properties_setf (props, "link.output.node", "%u",
+        wp_proxy_get_bound_id (out));
+    wp_properties_setf (props, "link.input.node", "%u",
+        wp_proxy_get_bound_id (in));
+
+    link = wp_link_new_from_factory (self->base.client_core, "link-factory",
+        g_steal_pointer (&props));
+    g_assert_nonnull (link);
+    g_ptr_array_add (self->objects, link);
+
+    self->pending++;
+    wp_object_activate (WP_OBJECT (link), WP_PIPEWIRE_OBJECT_FEATURES_MINIMAL,
+        NULL, (GAsyncReadyCallback) on_object_activated, self);
+  }
+  wait_for_pending (self);
+
+  /* a single metadata object with all the entries */
+  if (n_metadata > 0) {
+    WpImplMetadata *m = wp_impl_metadata_new_full (self->base.client_core,
+        "benchmark", NULL);
+    g_ptr_array_add (self->objects, m);
+
+    self->pending++;
+    wp_object_activate (WP_OBJECT (m), WP_OBJECT_FEATURES_ALL,
+        NULL, (GAsyncReadyCallback) on_object_activated, self);
+    wait_for_pending (self);
+
+    for (gint i = 0; i < n_metadata; i++) {
+      g_autofree gchar *key = g_strdup_printf ("benchmark.key.%d", i);
+      g_autofree gchar *value = g_strdup_printf ("%d", i);
+      wp_metadata_set (WP_METADATA (m), i % MAX (n_nodes, 1), key,
+          "Spa:Int", value);
+    }
+  }
+
+  sync_core (self, self->base.client_core);
+}
+
+static WpObjectManager *
+make_object_manager (guint i)
+{
+  WpObjectManager *om = wp_object_manager_new ();
+
+  /* mix the kinds of interests that the policy modules typically declare */
+  switch (i % 4) {
+    case 0:
+      wp_object_manager_add_interest (om, WP_TYPE_NODE, NULL);
+      break;
+    case 1:
+      wp_object_manager_add_interest (om, WP_TYPE_PORT, NULL);
+      wp_object_manager_add_interest (om, WP_TYPE_LINK, NULL);
+      break;
+    case 2:
+      wp_object_manager_add_interest (om, WP_TYPE_NODE,
+          WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.name", "#s",
+          "audiotestsrc.*", NULL);
+      break;
+    case 3:
+      wp_object_manager_add_interest (om, WP_TYPE_METADATA,
+          WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "metadata.name", "=s",
+          "benchmark", NULL);
+      wp_object_manager_request_object_features (om, WP_TYPE_METADATA,
+          WP_OBJECT_FEATURES_ALL);
+      break;
+  }
+  wp_object_manager_request_object_features (om, WP_TYPE_GLOBAL_PROXY,
+      WP_PIPEWIRE_OBJECT_FEATURES_MINIMAL);
+  return om;
+}
+
+static void
+on_om_installed (WpObjectManager * om, Benchmark * self)
+{
+  self->pending--;
+}
+
+static void
+load_scripts (Benchmark * self)
+{
+  g_autoptr (WpPlugin) plugin = NULL;
+  g_autoptr (GError) error = NULL;
+
+  if (!scripts || !scripts[0])
+    return;
+
+  wp_core_load_component (self->base.core,
+      "libwireplumber-module-lua-scripting", "module", NULL, &error);
+  g_assert_no_error (error);
+
+  /* queue all the scripts before enabling the plugin, like the daemon does,
+     so that they get compiled in parallel */
+  for (gchar **s = scripts; *s; s++) {
+    wp_core_load_component (self->base.core, *s, "script/lua", NULL, &error);
+    g_assert_no_error (error);
+  }
+
+  plugin = wp_plugin_find (self->base.core, "lua-scripting");
+  self->pending++;
+  wp_object_activate (WP_OBJECT (plugin), WP_PLUGIN_FEATURE_ENABLED,
+      NULL, (GAsyncReadyCallback) on_object_activated, self);
+  wait_for_pending (self);
+
+  for (gchar **s = scripts; *s; s++) {
+    g_autofree gchar *name = g_strdup_printf ("script:%s", *s);
+    g_autoptr (WpPlugin) script = NULL;
+
+    script = wp_plugin_find (self->base.core, name);
+    g_assert_nonnull (script);
+    self->pending++;
+    self->pending_scripts++;
+    wp_object_activate (WP_OBJECT (script), WP_PLUGIN_FEATURE_ENABLED,
+        NULL, (GAsyncReadyCallback) on_script_activated, self);
+  }
+}
+
+static void
+on_event_node_added (WpObjectManager * om, WpPipewireObject * node,
+    Benchmark * self)
+{
+  const gchar *name = wp_pipewire_object_get_property (node, "node.name");
+  gint64 *start = g_hash_table_lookup (self->event_times, name);
+
+  if (start) {
+    gint64 latency = g_get_monotonic_time () - *start;
+    g_array_append_val (self->latencies, latency);
+    g_hash_table_remove (self->event_times, name);
+    g_main_loop_quit (self->base.loop);
+  }
+}
+
+static void
+measure_events (Benchmark * self)
+{
+  g_autoptr (WpObjectManager) om = wp_object_manager_new ();
+
+  wp_object_manager_add_interest (om, WP_TYPE_NODE,
+      WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.name", "#s",
+      "benchmark.event.*", NULL);
+  wp_object_manager_request_object_features (om, WP_TYPE_NODE,
+      WP_PIPEWIRE_OBJECT_FEATURES_MINIMAL);
+  g_signal_connect (om, "object-added", G_CALLBACK (on_event_node_added),
+      self);
+  test_ensure_object_manager_is_installed (om, self->base.core,
+      self->base.loop);
+
+  /* create the nodes one by one, so that each latency sample measures the
+     full path from the server to the object-added signal of a loaded graph */
+  for (gint i = 0; i < n_events; i++) {
+    gchar *name = g_strdup_printf ("benchmark.event.%d", i);
+    gint64 *start = g_new (gint64, 1);
+
+    *start = g_get_monotonic_time ();
+    g_hash_table_insert (self->event_times, name, start);
+    create_node (self, "audiotestsrc", name);
+
+    if (g_hash_table_contains (self->event_times, name))
+      g_main_loop_run (self->base.loop);
+    wait_for_pending (self);
+  }
+
+  g_array_sort (self->latencies, compare_int64);
+  g_signal_handlers_disconnect_by_data (om, self);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_autoptr (GOptionContext) context = NULL;
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GPtrArray) oms = NULL;
+  Benchmark self = {0};
+  gint64 start, installed, settled;
+  glong rss_populated, rss_installed;
+
+  context = g_option_context_new ("- registry replay benchmark");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+
+  wp_init (WP_INIT_ALL);
+
+  wp_base_test_fixture_setup (&self.base,
+      WP_BASE_TEST_FLAG_CLIENT_CORE | WP_BASE_TEST_FLAG_DONT_CONNECT);
+
+  /* large graphs take longer than the watchdog of the unit tests allows */
+  g_source_destroy (self.base.timeout_source);
+
+  self.objects = g_ptr_array_new_with_free_func (g_object_unref);
+  self.event_times = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      g_free);
+  self.latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  oms = g_ptr_array_new_with_free_func (g_object_unref);
+
+  {
+    g_autoptr (WpTestServerLocker) lock =
+        wp_test_server_locker_new (&self.base.server);
+
+    g_assert_cmpint (pw_context_add_spa_lib (self.base.server.context,
+            "audiotestsrc", "audiotestsrc/libspa-audiotestsrc"), ==, 0);
+    if (!test_is_spa_lib_installed (&self.base, "audiotestsrc")) {
+      g_printerr ("The pipewire audiotestsrc factory was not found\n");
+      return 77;
+    }
+
+    g_assert_nonnull (pw_context_load_module (self.base.server.context,
+            "libpipewire-module-spa-node-factory", NULL, NULL));
+    g_assert_nonnull (pw_context_load_module (self.base.server.context,
+            "libpipewire-module-link-factory", NULL, NULL));
+  }
+
+  /* populate the server */
+  g_assert_true (wp_core_connect (self.base.client_core));
+  populate (&self);
+  rss_populated = get_peak_rss_kb ();
+
+  if (isolate_scripts)
+    wp_core_update_properties (self.base.core, wp_properties_new (
+            "wireplumber.lua.isolate-scripts", "true", NULL));
+
+  /* connect the measured core and install everything on it */
+  start = g_get_monotonic_time ();
+  g_assert_true (wp_core_connect (self.base.core));
+
+  load_scripts (&self);
+
+  for (gint i = 0; i < n_object_managers; i++) {
+    WpObjectManager *om = make_object_manager (i);
+    g_ptr_array_add (oms, om);
+
+    self.pending++;
+    g_signal_connect (om, "installed", G_CALLBACK (on_om_installed), &self);
+    wp_core_install_object_manager (self.base.core, om);
+  }
+  wait_for_pending (&self);
+  installed = g_get_monotonic_time ();
+
+  sync_core (&self, self.base.core);
+  settled = g_get_monotonic_time ();
+  rss_installed = get_peak_rss_kb ();
+
+  measure_events (&self);
+
+  g_print ("graph: %d nodes, %d ports, %d links, %d metadata entries\n",
+      n_nodes + n_links, n_nodes + n_links, n_links, n_metadata);
+  g_print ("object managers: %d, scripts: %u\n", n_object_managers,
+      scripts ? g_strv_length (scripts) : 0);
+  if (self.failed > 0)
+    g_print ("failed activations: %u\n", self.failed);
+  if (self.scripts_enabled > 0)
+    g_print ("time to scripts enabled (%s lua_State): %.3f ms\n",
+        isolate_scripts ? "isolated" : "shared",
+        (self.scripts_enabled - start) / 1000.0);
+  g_print ("time to installed: %.3f ms\n", (installed - start) / 1000.0);
+  g_print ("time to settled: %.3f ms\n", (settled - start) / 1000.0);
+  g_print ("peak rss: %ld kB populated, %ld kB installed, %ld kB final\n",
+      rss_populated, rss_installed, get_peak_rss_kb ());
+  g_print ("dispatch latency (%u events): p50 %" G_GINT64_FORMAT " us, "
+      "p90 %" G_GINT64_FORMAT " us, p99 %" G_GINT64_FORMAT " us, "
+      "max %" G_GINT64_FORMAT " us\n", self.latencies->len,
+      percentile (self.latencies, 50), percentile (self.latencies, 90),
+      percentile (self.latencies, 99), percentile (self.latencies, 100));
+
+  g_clear_pointer (&oms, g_ptr_array_unref);
+  g_clear_pointer (&self.objects, g_ptr_array_unref);
+  g_clear_pointer (&self.event_times, g_hash_table_unref);
+  g_clear_pointer (&self.latencies, g_array_unref);
+  g_strfreev (scripts);
+  wp_base_test_fixture_teardown (&self.base);
+
+  return 0;
+}
@@ -0,0 +1,62 @@
+-- WirePlumber
+--
+-- Copyright © 2021 Collabora Ltd.
+--
+-- SPDX-License-Identifier: MIT
+--
+-- A small policy-like script used by the registry benchmark: it watches
+-- nodes, ports and links and performs the kind of lookups that the real
+-- policy scripts do whenever the graph changes.
+
+nodes_om = ObjectManager {
+  Interest { type = "node" },
+}
+
+ports_om = ObjectManager {
+  Interest { type = "port" },
+}
+
+links_om = ObjectManager {
+  Interest { type = "link" },
+}
+
+local function count_node_ports (node)
+  local node_id = node["bound-id"]
+  local n = 0
+  for _ in ports_om:iterate {
+    Constraint { "node.id", "=", tostring (node_id), type = "pw-global" },
+  } do
+    n = n + 1
+  end
+  return n
+end
+
+local function count_node_links (node)
+  local node_id = node["bound-id"]
+  local n = 0
+  for _ in links_om:iterate {
+    Constraint { "link.output.node", "=", tostring (node_id), type = "pw-global" },
+  } do
+    n = n + 1
+  end
+  return n
+end
+
+nodes_om:connect("object-added", function (om, node)
+  count_node_ports (node)
+  count_node_links (node)
+end)
+
+links_om:connect("object-added", function (om, link)
+  local out_id = link.properties["link.output.node"]
+  local out_node = nodes_om:lookup {
+    Constraint { "object.id", "=", out_id, type = "pw-global" },
+  }
+  if out_node then
+    count_node_links (out_node)
+  end
+end)
+
+nodes_om:activate()
+ports_om:activate()
+links_om:activate()
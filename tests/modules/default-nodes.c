@@ -0,0 +1,166 @@
+/* WirePlumber
+ *
+ * Copyright © 2022 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "../common/base-test-fixture.h"
+
+typedef struct {
+  WpBaseTestFixture base;
+  WpPlugin *plugin;
+  WpImplMetadata *metadata;
+} TestFixture;
+
+static void
+test_default_nodes_setup (TestFixture * f, gconstpointer user_data)
+{
+  wp_base_test_fixture_setup (&f->base, WP_BASE_TEST_FLAG_CLIENT_CORE);
+
+  /* load modules */
+  {
+    g_autoptr (WpTestServerLocker) lock =
+        wp_test_server_locker_new (&f->base.server);
+
+    g_assert_cmpint (pw_context_add_spa_lib (f->base.server.context,
+            "audiotestsrc", "audiotestsrc/libspa-audiotestsrc"), ==, 0);
+    g_assert_nonnull (pw_context_load_module (f->base.server.context,
+            "libpipewire-module-spa-node-factory", NULL, NULL));
+  }
+  {
+    g_autoptr (GError) error = NULL;
+    wp_core_load_component (f->base.core,
+        "libwireplumber-module-default-nodes", "module",
+        g_variant_new_parsed ("{'use-persistent-storage': <false>}"), &error);
+    g_assert_no_error (error);
+  }
+
+  f->plugin = wp_plugin_find (f->base.core, "default-nodes");
+  g_assert_nonnull (f->plugin);
+  wp_object_activate (WP_OBJECT (f->plugin), WP_PLUGIN_FEATURE_ENABLED,
+      NULL, (GAsyncReadyCallback) test_object_activate_finish_cb, f);
+  g_main_loop_run (f->base.loop);
+
+  f->metadata = wp_impl_metadata_new_full (f->base.core, "default", NULL);
+  g_assert_nonnull (f->metadata);
+  wp_object_activate (WP_OBJECT (f->metadata), WP_OBJECT_FEATURES_ALL,
+      NULL, (GAsyncReadyCallback) test_object_activate_finish_cb, f);
+  g_main_loop_run (f->base.loop);
+}
+
+static void
+test_default_nodes_teardown (TestFixture * f, gconstpointer user_data)
+{
+  g_clear_object (&f->metadata);
+  g_clear_object (&f->plugin);
+  wp_base_test_fixture_teardown (&f->base);
+}
+
+static WpNode *
+create_source (TestFixture * f, const gchar * name, const gchar * priority)
+{
+  WpNode *node = wp_node_new_from_factory (f->base.client_core,
+      "spa-node-factory",
+      wp_properties_new (
+          "factory.name", "audiotestsrc",
+          "node.name", name,
+          "media.class", "Audio/Source",
+          "priority.session", priority,
+          NULL));
+  g_assert_nonnull (node);
+  wp_object_activate (WP_OBJECT (node), WP_OBJECT_FEATURES_ALL,
+      NULL, (GAsyncReadyCallback) test_object_activate_finish_cb, f);
+  g_main_loop_run (f->base.loop);
+  return node;
+}
+
+static gchar *
+get_default_source (TestFixture * f)
+{
+  const gchar *value = wp_metadata_find (WP_METADATA (f->metadata), 0,
+      "default.audio.source", NULL);
+  g_autoptr (WpSpaJson) json = NULL;
+  gchar *name = NULL;
+
+  if (!value)
+    return NULL;
+
+  json = wp_spa_json_new_from_string (value);
+  g_assert_true (wp_spa_json_object_get (json, "name", "s", &name, NULL));
+  return name;
+}
+
+/* the defaults are re-evaluated asynchronously; the fixture's timeout fails
+   the test if the expected node is never selected */
+static void
+wait_for_default_source (TestFixture * f, const gchar * expected)
+{
+  for (;;) {
+    g_autofree gchar *name = get_default_source (f);
+    if (!g_strcmp0 (name, expected))
+      break;
+    g_main_context_iteration (f->base.context, TRUE);
+  }
+}
+
+static void
+set_configured_source (TestFixture * f, const gchar * name)
+{
+  g_autofree gchar *value = g_strdup_printf ("{ \"name\": \"%s\" }", name);
+
+  wp_metadata_set (WP_METADATA (f->metadata), 0,
+      "default.configured.audio.source", "Spa:String:JSON", value);
+}
+
+static void
+test_default_nodes_selection (TestFixture * f, gconstpointer user_data)
+{
+  g_autoptr (WpNode) low = NULL;
+  g_autoptr (WpNode) high = NULL;
+
+  if (!test_is_spa_lib_installed (&f->base, "audiotestsrc")) {
+    g_test_skip ("The pipewire audiotestsrc factory was not found");
+    return;
+  }
+
+  /* the only source is the default */
+  low = create_source (f, "source.low", "100");
+  wait_for_default_source (f, "source.low");
+
+  /* a source with a higher priority takes over when it is added */
+  high = create_source (f, "source.high", "200");
+  wait_for_default_source (f, "source.high");
+
+  /* and hands back over when it is removed */
+  g_clear_object (&high);
+  wait_for_default_source (f, "source.low");
+
+  high = create_source (f, "source.high", "200");
+  wait_for_default_source (f, "source.high");
+
+  /* a configured source wins over the priority */
+  set_configured_source (f, "source.low");
+  wait_for_default_source (f, "source.low");
+  set_configured_source (f, "source.high");
+  wait_for_default_source (f, "source.high");
+
+  /* the default is unset when there are no sources left */
+  g_clear_object (&high);
+  wait_for_default_source (f, "source.low");
+  g_clear_object (&low);
+  wait_for_default_source (f, NULL);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  wp_init (WP_INIT_ALL);
+
+  g_test_add ("/modules/default-nodes/selection", TestFixture, NULL,
+      test_default_nodes_setup, test_default_nodes_selection,
+      test_default_nodes_teardown);
+
+  return g_test_run ();
+}
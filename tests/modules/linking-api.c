@@ -0,0 +1,231 @@
+/* WirePlumber
+ *
+ * Copyright © 2022 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "../common/base-test-fixture.h"
+
+typedef struct {
+  WpBaseTestFixture base;
+  WpPlugin *api;
+  WpImplMetadata *metadata;
+} TestFixture;
+
+static void
+test_linking_api_setup (TestFixture * f, gconstpointer user_data)
+{
+  wp_base_test_fixture_setup (&f->base, 0);
+
+  /* load modules */
+  {
+    g_autoptr (WpTestServerLocker) lock =
+        wp_test_server_locker_new (&f->base.server);
+
+    g_assert_cmpint (pw_context_add_spa_lib (f->base.server.context,
+            "audiotestsrc", "audiotestsrc/libspa-audiotestsrc"), ==, 0);
+    g_assert_nonnull (pw_context_load_module (f->base.server.context,
+            "libpipewire-module-adapter", NULL, NULL));
+  }
+  {
+    g_autoptr (GError) error = NULL;
+    wp_core_load_component (f->base.core,
+        "libwireplumber-module-si-audio-adapter", "module", NULL, &error);
+    g_assert_no_error (error);
+
+    wp_core_load_component (f->base.core,
+        "libwireplumber-module-linking-api", "module", NULL, &error);
+    g_assert_no_error (error);
+  }
+
+  f->api = wp_plugin_find (f->base.core, "linking-api");
+  g_assert_nonnull (f->api);
+  wp_object_activate (WP_OBJECT (f->api), WP_PLUGIN_FEATURE_ENABLED,
+      NULL, (GAsyncReadyCallback) test_object_activate_finish_cb, f);
+  g_main_loop_run (f->base.loop);
+
+  f->metadata = wp_impl_metadata_new_full (f->base.core, "default", NULL);
+  g_assert_nonnull (f->metadata);
+  wp_object_activate (WP_OBJECT (f->metadata), WP_OBJECT_FEATURES_ALL,
+      NULL, (GAsyncReadyCallback) test_object_activate_finish_cb, f);
+  g_main_loop_run (f->base.loop);
+}
+
+static void
+test_linking_api_teardown (TestFixture * f, gconstpointer user_data)
+{
+  g_clear_object (&f->metadata);
+  g_clear_object (&f->api);
+  wp_base_test_fixture_teardown (&f->base);
+}
+
+static void
+sync_core (TestFixture * f)
+{
+  wp_core_sync (f->base.core, NULL, (GAsyncReadyCallback) test_core_done_cb,
+      &f->base);
+  g_main_loop_run (f->base.loop);
+}
+
+static WpSessionItem *
+load_linkable (TestFixture * f, const gchar * factory,
+    const gchar * media_class, const gchar * type, const gchar * direction)
+{
+  g_autoptr (WpNode) node = NULL;
+  g_autoptr (WpSessionItem) adapter = NULL;
+
+  node = wp_node_new_from_factory (f->base.core,
+      "adapter",
+      wp_properties_new (
+          "factory.name", factory,
+          "node.name", factory,
+          "media.class", media_class,
+          "audio.channels", "2",
+          "audio.position", "[ FL, FR ]",
+          NULL));
+  g_assert_nonnull (node);
+  wp_object_activate (WP_OBJECT (node), WP_OBJECT_FEATURES_ALL,
+      NULL, (GAsyncReadyCallback) test_object_activate_finish_cb, f);
+  g_main_loop_run (f->base.loop);
+
+  adapter = wp_session_item_make (f->base.core, "si-audio-adapter");
+  g_assert_nonnull (adapter);
+
+  /* configure with the properties that create-item.lua would set */
+  {
+    WpProperties *props = wp_properties_new_empty ();
+    wp_properties_setf (props, "item.node", "%p", node);
+    wp_properties_setf (props, "node.id", "%u",
+        wp_proxy_get_bound_id (WP_PROXY (node)));
+    wp_properties_set (props, "media.class", media_class);
+    wp_properties_set (props, "media.type", "Audio");
+    wp_properties_set (props, "item.node.type", type);
+    wp_properties_set (props, "item.node.direction", direction);
+    g_assert_true (wp_session_item_configure (adapter, props));
+  }
+
+  wp_object_activate (WP_OBJECT (adapter), WP_SESSION_ITEM_FEATURE_ACTIVE,
+      NULL, (GAsyncReadyCallback) test_object_activate_finish_cb, f);
+  g_main_loop_run (f->base.loop);
+
+  wp_session_item_register (g_object_ref (adapter));
+  sync_core (f);
+
+  return g_steal_pointer (&adapter);
+}
+
+static gboolean
+take_dirty (TestFixture * f, guint32 id)
+{
+  g_autoptr (GVariant) dirty = NULL;
+  const guint32 *ids;
+  gsize n_ids = 0;
+  gboolean found = FALSE;
+
+  g_signal_emit_by_name (f->api, "take-dirty", &dirty);
+  g_assert_nonnull (dirty);
+
+  ids = g_variant_get_fixed_array (dirty, &n_ids, sizeof (guint32));
+  for (gsize i = 0; i < n_ids; i++)
+    found |= (ids[i] == id);
+  return found;
+}
+
+static void
+test_linking_api_target_metadata (TestFixture * f, gconstpointer user_data)
+{
+  gboolean move = GPOINTER_TO_UINT (user_data);
+  g_autoptr (WpSessionItem) stream = NULL;
+  guint32 stream_id, node_id;
+
+  if (!test_is_spa_lib_installed (&f->base, "audiotestsrc")) {
+    g_test_skip ("The pipewire audiotestsrc factory was not found");
+    return;
+  }
+
+  g_object_set (f->api, "move", move, NULL);
+
+  stream = load_linkable (f, "audiotestsrc", "Stream/Output/Audio", "stream",
+      "output");
+  stream_id = wp_session_item_get_id (stream);
+  node_id = wp_session_item_get_associated_proxy_id (stream, WP_TYPE_NODE);
+
+  /* new streams need to be linked */
+  g_assert_true (take_dirty (f, stream_id));
+  g_assert_false (take_dirty (f, stream_id));
+
+  /* changing the target only re-links the stream if moving is enabled */
+  wp_metadata_set (WP_METADATA (f->metadata), node_id, "target.node",
+      "Spa:Id", "1000");
+  sync_core (f);
+  g_assert_cmpint (take_dirty (f, stream_id), ==, move);
+
+  wp_metadata_set (WP_METADATA (f->metadata), node_id, "target.node",
+      NULL, NULL);
+  sync_core (f);
+  g_assert_cmpint (take_dirty (f, stream_id), ==, move);
+
+  /* other keys never affect linking */
+  wp_metadata_set (WP_METADATA (f->metadata), node_id, "other.key",
+      NULL, "1");
+  sync_core (f);
+  g_assert_false (take_dirty (f, stream_id));
+}
+
+static void
+test_linking_api_target_added (TestFixture * f, gconstpointer user_data)
+{
+  gboolean move = GPOINTER_TO_UINT (user_data);
+  g_autoptr (WpSessionItem) stream = NULL;
+  g_autoptr (WpSessionItem) sink = NULL;
+  guint32 stream_id;
+
+  if (!test_is_spa_lib_installed (&f->base, "audiotestsrc")) {
+    g_test_skip ("The pipewire audiotestsrc factory was not found");
+    return;
+  }
+  if (!test_is_spa_lib_installed (&f->base, "support.null-audio-sink")) {
+    g_test_skip ("The pipewire null-audio-sink factory was not found");
+    return;
+  }
+
+  g_object_set (f->api, "move", move, NULL);
+
+  stream = load_linkable (f, "audiotestsrc", "Stream/Output/Audio", "stream",
+      "output");
+  stream_id = wp_session_item_get_id (stream);
+  g_assert_true (take_dirty (f, stream_id));
+
+  /* a new target for the stream re-links it, regardless of "move" */
+  sink = load_linkable (f, "support.null-audio-sink", "Audio/Sink", "device",
+      "input");
+  g_assert_true (take_dirty (f, stream_id));
+
+  /* and so does its removal */
+  wp_session_item_remove (sink);
+  sync_core (f);
+  g_assert_true (take_dirty (f, stream_id));
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  wp_init (WP_INIT_ALL);
+
+  g_test_add ("/modules/linking-api/target-metadata/move", TestFixture,
+      GUINT_TO_POINTER (TRUE), test_linking_api_setup,
+      test_linking_api_target_metadata, test_linking_api_teardown);
+  g_test_add ("/modules/linking-api/target-metadata/no-move", TestFixture,
+      GUINT_TO_POINTER (FALSE), test_linking_api_setup,
+      test_linking_api_target_metadata, test_linking_api_teardown);
+  g_test_add ("/modules/linking-api/target-added/move", TestFixture,
+      GUINT_TO_POINTER (TRUE), test_linking_api_setup,
+      test_linking_api_target_added, test_linking_api_teardown);
+  g_test_add ("/modules/linking-api/target-added/no-move", TestFixture,
+      GUINT_TO_POINTER (FALSE), test_linking_api_setup,
+      test_linking_api_target_added, test_linking_api_teardown);
+
+  return g_test_run ();
+}
@@ -132,6 +132,92 @@ test_core_clone (TestFixture *f, gconstpointer data)
   g_assert_false (wp_core_is_connected (clone));
 }
 
+static void
+test_core_replay_node_activated (WpObject * object, GAsyncResult * res,
+    guint * pending)
+{
+  g_autoptr (GError) error = NULL;
+  g_assert_true (wp_object_activate_finish (object, res, &error));
+  g_assert_no_error (error);
+  (*pending)--;
+}
+
+static void
+test_core_registry_replay (TestFixture *f, gconstpointer data)
+{
+  const guint n_nodes = g_test_perf () ? 1000 : 50;
+  const guint n_rounds = g_test_perf () ? 20 : 3;
+  g_autoptr (GPtrArray) nodes = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr (WpCore) clone = NULL;
+  guint pending = 0;
+  gdouble elapsed;
+
+  /* load audiotestsrc on the server side */
+  {
+    g_autoptr (WpTestServerLocker) lock =
+        wp_test_server_locker_new (&f->base.server);
+
+    g_assert_cmpint (pw_context_add_spa_lib (f->base.server.context,
+            "audiotestsrc", "audiotestsrc/libspa-audiotestsrc"), ==, 0);
+    if (!test_is_spa_lib_installed (&f->base, "audiotestsrc")) {
+      g_test_skip ("The pipewire audiotestsrc factory was not found");
+      return;
+    }
+
+    g_assert_nonnull (pw_context_load_module (f->base.server.context,
+            "libpipewire-module-spa-node-factory", NULL, NULL));
+  }
+
+  /* populate the server with nodes and ports from another connection */
+  clone = wp_core_clone (f->base.core);
+  g_assert_true (wp_core_connect (clone));
+
+  for (guint i = 0; i < n_nodes; i++) {
+    g_autofree gchar *name = g_strdup_printf ("replay.%u", i);
+    WpNode *node = wp_node_new_from_factory (clone, "spa-node-factory",
+        wp_properties_new (
+            "factory.name", "audiotestsrc",
+            "node.name", name,
+            NULL));
+    g_assert_nonnull (node);
+    g_ptr_array_add (nodes, node);
+
+    pending++;
+    wp_object_activate (WP_OBJECT (node), WP_PIPEWIRE_OBJECT_FEATURES_MINIMAL,
+        NULL, (GAsyncReadyCallback) test_core_replay_node_activated, &pending);
+  }
+  while (pending > 0)
+    g_main_context_iteration (f->base.context, TRUE);
+
+  /* every connection replays all the globals through the registry */
+  g_test_timer_start ();
+
+  for (guint r = 0; r < n_rounds; r++) {
+    g_assert_true (wp_core_connect (f->base.core));
+    wp_core_sync (f->base.core, NULL,
+        (GAsyncReadyCallback) test_core_done_cb, &f->base);
+    g_main_loop_run (f->base.loop);
+
+    if (r < n_rounds - 1)
+      wp_core_disconnect (f->base.core);
+  }
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed,
+      "replayed a registry with %u nodes %u times in %f s",
+      n_nodes, n_rounds, elapsed);
+
+  /* the replayed globals were resolved to the right proxy types */
+  wp_object_manager_add_interest (f->om, WP_TYPE_NODE,
+      WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.name", "#s", "replay.*",
+      NULL);
+  wp_object_manager_add_interest (f->om, WP_TYPE_PORT, NULL);
+  test_ensure_object_manager_is_installed (f->om, f->base.core, f->base.loop);
+  g_assert_cmpuint (wp_object_manager_get_n_objects (f->om), >=, n_nodes * 2);
+
+  wp_core_disconnect (clone);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -144,6 +230,8 @@ main (gint argc, gchar *argv[])
       test_core_setup, test_core_client_disconnected, test_core_teardown);
   g_test_add ("/wp/core/cline", TestFixture, NULL,
       test_core_setup, test_core_clone, test_core_teardown);
+  g_test_add ("/wp/core/registry-replay", TestFixture, NULL,
+      test_core_setup, test_core_registry_replay, test_core_teardown);
 
   return g_test_run ();
 }
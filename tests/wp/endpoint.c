@@ -172,6 +172,7 @@ typedef struct {
   WpProxy *proxy_endpoint;
 
   gint n_events;
+  gint n_updates;
 
 } TestEndpointFixture;
 
@@ -282,6 +283,31 @@ test_endpoint_params_changed (WpPipewireObject * proxy,
     g_main_loop_quit (fixture->base.loop);
 }
 
+static void
+test_endpoint_params_updated (WpPipewireObject * proxy,
+    const gchar * param_name, GVariant * indices,
+    TestEndpointFixture *fixture)
+{
+  guint32 index = G_MAXUINT32;
+
+  if (g_strcmp0 (param_name, "Props") != 0)
+    return;
+
+  /* there is only one Props param, so it is always the one that changed */
+  g_assert_true (g_variant_is_of_type (indices, G_VARIANT_TYPE ("au")));
+  g_assert_cmpuint (g_variant_n_children (indices), ==, 1);
+  g_variant_get_child (indices, 0, "u", &index);
+  g_assert_cmpuint (index, ==, 0);
+  fixture->n_updates++;
+}
+
+static void
+test_endpoint_notify_param_info (WpPipewireObject * proxy, GParamSpec * param,
+    TestEndpointFixture *fixture)
+{
+  g_main_loop_quit (fixture->base.loop);
+}
+
 static void
 test_endpoint_notify_properties (WpEndpoint * endpoint, GParamSpec * param,
     TestEndpointFixture *fixture)
@@ -523,9 +549,12 @@ test_endpoint_with_props (TestEndpointFixture *fixture, gconstpointer data)
       (GCallback) test_endpoint_params_changed, fixture);
   g_signal_connect (endpoint->node, "params-changed",
       (GCallback) test_endpoint_params_changed, fixture);
+  g_signal_connect (fixture->proxy_endpoint, "params-updated",
+      (GCallback) test_endpoint_params_updated, fixture);
 
   /* change control on the proxy */
   fixture->n_events = 0;
+  fixture->n_updates = 0;
   wp_pipewire_object_set_param (WP_PIPEWIRE_OBJECT (fixture->proxy_endpoint),
       "Props", 0,
       wp_spa_pod_new_object ("Spa:Pod:Object:Param:Props", "Props",
@@ -534,6 +563,7 @@ test_endpoint_with_props (TestEndpointFixture *fixture, gconstpointer data)
   /* run until the change is on all sides */
   g_main_loop_run (fixture->base.loop);
   g_assert_cmpint (fixture->n_events, ==, 3);
+  g_assert_cmpint (fixture->n_updates, ==, 1);
 
   /* verify the value change on all sides */
   {
@@ -601,6 +631,40 @@ test_endpoint_with_props (TestEndpointFixture *fixture, gconstpointer data)
     g_assert_cmpint (boolean_value, ==, FALSE);
   }
 
+  /* enumerating the same params again emits neither signal on the proxy;
+     the impl announces a Props change without changing anything, which
+     makes the proxy enumerate them again */
+  {
+    gulong id;
+
+    g_signal_handlers_block_by_func (fixture->impl_endpoint,
+        test_endpoint_params_changed, fixture);
+    g_signal_handlers_block_by_func (endpoint->node,
+        test_endpoint_params_changed, fixture);
+    id = g_signal_connect (fixture->proxy_endpoint, "notify::param-info",
+        (GCallback) test_endpoint_notify_param_info, fixture);
+
+    fixture->n_events = 0;
+    fixture->n_updates = 0;
+    g_signal_emit_by_name (endpoint->node, "params-changed", "Props");
+
+    /* run until the proxy has the new param info; it requests the params
+       before notifying, so they have arrived after a sync */
+    g_main_loop_run (fixture->base.loop);
+    g_signal_handler_disconnect (fixture->proxy_endpoint, id);
+    wp_core_sync (fixture->base.client_core, NULL,
+        (GAsyncReadyCallback) test_core_done_cb, &fixture->base);
+    g_main_loop_run (fixture->base.loop);
+
+    g_assert_cmpint (fixture->n_events, ==, 0);
+    g_assert_cmpint (fixture->n_updates, ==, 0);
+
+    g_signal_handlers_unblock_by_func (fixture->impl_endpoint,
+        test_endpoint_params_changed, fixture);
+    g_signal_handlers_unblock_by_func (endpoint->node,
+        test_endpoint_params_changed, fixture);
+  }
+
   /* change control on the impl */
   fixture->n_events = 0;
   wp_pipewire_object_set_param (WP_PIPEWIRE_OBJECT (fixture->impl_endpoint),
@@ -0,0 +1,334 @@
+/* WirePlumber
+ *
+ * Copyright © 2021 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <wp/wp.h>
+#include <wp/private/trace-format.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#define N_THREADS 4
+#define N_MESSAGES 1000
+
+typedef struct {
+  gchar *path;
+  gint fd;
+  gint saved_fd;
+} StderrCapture;
+
+static void
+stderr_capture_begin (StderrCapture * c)
+{
+  g_autoptr (GError) error = NULL;
+
+  c->fd = g_file_open_tmp ("wp-log-XXXXXX", &c->path, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (c->fd, >=, 0);
+
+  fflush (stderr);
+  c->saved_fd = dup (STDERR_FILENO);
+  g_assert_cmpint (dup2 (c->fd, STDERR_FILENO), ==, STDERR_FILENO);
+}
+
+static gchar *
+stderr_capture_end (StderrCapture * c)
+{
+  gchar *contents = NULL;
+
+  fflush (stderr);
+  g_assert_cmpint (dup2 (c->saved_fd, STDERR_FILENO), ==, STDERR_FILENO);
+  close (c->saved_fd);
+  close (c->fd);
+
+  g_assert_true (g_file_get_contents (c->path, &contents, NULL, NULL));
+  g_remove (c->path);
+  g_clear_pointer (&c->path, g_free);
+  return contents;
+}
+
+static gpointer
+log_thread_func (gpointer data)
+{
+  guint id = GPOINTER_TO_UINT (data);
+
+  for (guint i = 0; i < N_MESSAGES; i++)
+    wp_message ("async test message %u:%u", id, i);
+  return NULL;
+}
+
+static guint
+parse_dropped (const gchar * line)
+{
+  const gchar *end = strstr (line, " log messages were dropped");
+  const gchar *start = end;
+
+  if (!end)
+    return 0;
+  while (start > line && g_ascii_isdigit (*(start - 1)))
+    start--;
+  return (guint) g_ascii_strtoull (start, NULL, 10);
+}
+
+static void
+test_log_async (void)
+{
+  StderrCapture capture = {0};
+  GThread *threads[N_THREADS];
+  g_autofree gchar *output = NULL;
+  g_auto (GStrv) lines = NULL;
+  gint last[N_THREADS];
+  guint n_received = 0, n_dropped = 0;
+  gboolean found_sync = FALSE;
+
+  stderr_capture_begin (&capture);
+
+  wp_log_set_async (TRUE);
+  for (guint t = 0; t < N_THREADS; t++)
+    threads[t] = g_thread_new ("log-test", log_thread_func,
+        GUINT_TO_POINTER (t));
+  for (guint t = 0; t < N_THREADS; t++)
+    g_thread_join (threads[t]);
+
+  /* disabling flushes everything that is pending */
+  wp_log_set_async (FALSE);
+  wp_message ("sync test message");
+
+  output = stderr_capture_end (&capture);
+  lines = g_strsplit (output, "\n", -1);
+
+  for (guint t = 0; t < N_THREADS; t++)
+    last[t] = -1;
+
+  for (gchar **l = lines; *l; l++) {
+    const gchar *msg = strstr (*l, "async test message ");
+    guint id, i;
+
+    if (msg && sscanf (msg, "async test message %u:%u", &id, &i) == 2) {
+      /* messages of each thread appear in order, without duplicates */
+      g_assert_cmpuint (id, <, N_THREADS);
+      g_assert_cmpint ((gint) i, >, last[id]);
+      last[id] = i;
+      n_received++;
+    }
+    else if (strstr (*l, "sync test message")) {
+      /* the synchronous message is written after the asynchronous ones */
+      g_assert_cmpuint (n_received + n_dropped, ==, N_THREADS * N_MESSAGES);
+      found_sync = TRUE;
+    }
+    else {
+      n_dropped += parse_dropped (*l);
+    }
+  }
+
+  g_assert_true (found_sync);
+  g_assert_cmpuint (n_received + n_dropped, ==, N_THREADS * N_MESSAGES);
+}
+
+static void
+test_log_async_fatal (void)
+{
+  if (g_test_subprocess ()) {
+    wp_log_set_async (TRUE);
+    for (guint i = 0; i < 100; i++)
+      wp_message ("pending test message %u", i);
+
+    /* aborts right after logging */
+    wp_log_structured_standard (NULL, G_LOG_LEVEL_ERROR | G_LOG_FLAG_FATAL,
+        __FILE__, G_STRINGIFY (__LINE__), G_STRFUNC, 0, NULL,
+        "fatal test message");
+    return;
+  }
+
+  /* the pending messages are written before the fatal one */
+  g_test_trap_subprocess (NULL, 0, 0);
+  g_test_trap_assert_failed ();
+  g_test_trap_assert_stderr (
+      "*pending test message 0\n*pending test message 99\n*fatal test message*");
+}
+
+static void
+log_domain_message (const gchar * domain, guint i)
+{
+  wp_log_structured_standard (domain, G_LOG_LEVEL_DEBUG, __FILE__,
+      G_STRINGIFY (__LINE__), G_STRFUNC, 0, NULL, "filter test %s %u",
+      domain, i);
+}
+
+static void
+test_log_category_filter (void)
+{
+  static const gchar *domains[] = {
+    "wp-registry", "wp-node", "wp-core", "m-default-nodes",
+    "script/policy-node", "script/restore-stream", "pw.context", "pw.link",
+  };
+  const guint n_rounds = g_test_perf () ? 200000 : 1000;
+  StderrCapture capture = {0};
+  g_autofree gchar *output = NULL;
+  gdouble elapsed;
+
+  stderr_capture_begin (&capture);
+
+  /* only enable a couple of categories */
+  wp_log_set_level ("D:wp-registry,script/*");
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_rounds; i++)
+    log_domain_message (domains[i % G_N_ELEMENTS (domains)], i);
+  elapsed = g_test_timer_elapsed ();
+
+  /* the cached verdicts must be dropped when the level changes */
+  wp_log_set_level ("D:wp-node");
+  log_domain_message ("wp-node", n_rounds);
+  log_domain_message ("wp-registry", n_rounds);
+
+  wp_log_set_level (g_getenv ("WIREPLUMBER_DEBUG"));
+  output = stderr_capture_end (&capture);
+
+  g_test_minimized_result (elapsed, "filtered %u messages in %f s",
+      n_rounds, elapsed);
+
+  g_assert_nonnull (strstr (output, "filter test wp-registry 0\n"));
+  g_assert_nonnull (strstr (output, "filter test script/policy-node 4\n"));
+  g_assert_nonnull (strstr (output, "filter test script/restore-stream 5\n"));
+  g_assert_null (strstr (output, "filter test wp-node 1\n"));
+  g_assert_null (strstr (output, "filter test m-default-nodes 3\n"));
+  g_assert_null (strstr (output, "filter test pw.context 6\n"));
+
+  {
+    g_autofree gchar *enabled = g_strdup_printf ("filter test wp-node %u\n",
+        n_rounds);
+    g_autofree gchar *disabled = g_strdup_printf (
+        "filter test wp-registry %u\n", n_rounds);
+    g_assert_nonnull (strstr (output, enabled));
+    g_assert_null (strstr (output, disabled));
+  }
+}
+
+static void
+log_trace_message (GObject * object, guint i)
+{
+  wp_log_structured_standard ("wp-trace-test", G_LOG_LEVEL_DEBUG, __FILE__,
+      G_STRINGIFY (__LINE__), G_STRFUNC, G_OBJECT_TYPE (object), object,
+      "trace test message %u", i);
+}
+
+static const gchar *
+find_trace_string (const struct wp_trace_header * h, guint32 id, gsize * len)
+{
+  const gchar *strings = (const gchar *) wp_trace_get_strings (h);
+  gsize offset = 0;
+
+  while (offset < h->strings_used) {
+    const struct wp_trace_string *s =
+        (const struct wp_trace_string *) (strings + offset);
+    if (s->id == id) {
+      *len = s->len;
+      return s->text;
+    }
+    offset += wp_trace_string_entry_size (s->len);
+  }
+  return NULL;
+}
+
+static void
+test_log_trace (void)
+{
+  const guint n_messages = g_test_perf () ? 100000 : 1000;
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GObject) object = g_object_new (G_TYPE_OBJECT, NULL);
+  g_autoptr (GMappedFile) mapped = NULL;
+  g_autofree gchar *dir = g_dir_make_tmp ("wp-trace-XXXXXX", NULL);
+  g_autofree gchar *path = g_build_filename (dir, "trace", NULL);
+  g_autofree gchar *output = NULL;
+  g_autofree gchar *expected = NULL;
+  StderrCapture capture = {0};
+  const struct wp_trace_header *h;
+  const struct wp_trace_record *r;
+  const gchar *str;
+  gsize len = 0;
+  gdouble text_time, trace_time;
+
+  g_assert_nonnull (dir);
+  wp_log_set_level ("D");
+
+  /* the text writer, for comparison */
+  stderr_capture_begin (&capture);
+  g_test_timer_start ();
+  for (guint i = 0; i < n_messages; i++)
+    log_trace_message (object, i);
+  text_time = g_test_timer_elapsed ();
+  output = stderr_capture_end (&capture);
+  g_assert_nonnull (strstr (output, "trace test message 0\n"));
+  g_clear_pointer (&output, g_free);
+
+  /* the trace sink; nothing must be written to stderr */
+  g_assert_true (wp_log_set_trace_file (path, 0, &error));
+  g_assert_no_error (error);
+
+  stderr_capture_begin (&capture);
+  g_test_timer_start ();
+  for (guint i = 0; i < n_messages; i++)
+    log_trace_message (object, i);
+  trace_time = g_test_timer_elapsed ();
+  output = stderr_capture_end (&capture);
+  g_assert_null (strstr (output, "trace test message"));
+
+  g_assert_true (wp_log_set_trace_file (NULL, 0, NULL));
+  wp_log_set_level (g_getenv ("WIREPLUMBER_DEBUG"));
+
+  g_test_message ("%u messages: text %f s, trace %f s", n_messages,
+      text_time, trace_time);
+  g_test_minimized_result (trace_time, "traced %u messages in %f s",
+      n_messages, trace_time);
+
+  /* verify the file */
+  mapped = g_mapped_file_new (path, FALSE, &error);
+  g_assert_no_error (error);
+  h = (const struct wp_trace_header *) g_mapped_file_get_contents (mapped);
+  g_assert_cmpuint (g_mapped_file_get_length (mapped), >=,
+      wp_trace_file_size (h));
+  g_assert_cmpmem (h->magic, sizeof (h->magic), WP_TRACE_MAGIC,
+      sizeof (h->magic));
+  g_assert_cmpuint (h->version, ==, WP_TRACE_VERSION);
+  g_assert_cmpuint (h->seq, ==, n_messages);
+
+  /* the last record is always in the ring */
+  r = wp_trace_get_slot (h, h->seq - 1);
+  g_assert_cmpuint (r->seq, ==, n_messages);
+  g_assert_cmpuint (r->level, ==, 6); /* D */
+  g_assert_cmpuint (r->object, ==, (guint64) (guintptr) object);
+  g_assert_cmpuint (r->bound_id, ==, G_MAXUINT32);
+  g_assert_false (r->flags & WP_TRACE_RECORD_FLAG_TRUNCATED);
+
+  expected = g_strdup_printf ("trace test message %u", n_messages - 1);
+  g_assert_cmpmem (r->payload, r->payload_len, expected, strlen (expected));
+
+  str = find_trace_string (h, r->domain_id, &len);
+  g_assert_cmpmem (str, len, "wp-trace-test", strlen ("wp-trace-test"));
+  str = find_trace_string (h, r->type_id, &len);
+  g_assert_cmpmem (str, len, "GObject", strlen ("GObject"));
+  str = find_trace_string (h, r->location_id, &len);
+  g_assert_nonnull (str);
+  g_assert_nonnull (g_strstr_len (str, len, "log_trace_message"));
+
+  g_clear_pointer (&mapped, g_mapped_file_unref);
+  g_remove (path);
+  g_rmdir (dir);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  wp_init (WP_INIT_ALL);
+
+  g_test_add_func ("/wp/log/async", test_log_async);
+  g_test_add_func ("/wp/log/async-fatal", test_log_async_fatal);
+  g_test_add_func ("/wp/log/category-filter", test_log_category_filter);
+  g_test_add_func ("/wp/log/trace", test_log_trace);
+
+  return g_test_run ();
+}
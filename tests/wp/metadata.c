@@ -454,6 +454,111 @@ test_metadata_basic (TestFixture *fixture, gconstpointer data)
   g_assert_null (fixture->proxy_metadata);
 }
 
+static void
+test_metadata_large (TestFixture *fixture, gconstpointer data)
+{
+  const guint n_entries = g_test_perf () ? 10000 : 1000;
+  const guint n_subjects = 100;
+  g_autoptr (WpMetadata) metadata = NULL;
+  g_autoptr (GPtrArray) keys = g_ptr_array_new_with_free_func (g_free);
+  gdouble elapsed;
+
+  /* local metadata implementation, changes are applied synchronously */
+  metadata = WP_METADATA (wp_impl_metadata_new (fixture->base.core));
+  g_assert_nonnull (metadata);
+
+  for (guint i = 0; i < n_entries; i++)
+    g_ptr_array_add (keys, g_strdup_printf ("key.%u", i));
+
+  /* set */
+  g_test_timer_start ();
+  for (guint i = 0; i < n_entries; i++)
+    wp_metadata_set (metadata, i % n_subjects, g_ptr_array_index (keys, i),
+        "Spa:Int", "1");
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "set %u entries in %f s",
+      n_entries, elapsed);
+
+  /* find */
+  g_test_timer_start ();
+  for (guint i = 0; i < n_entries; i++) {
+    const gchar *type = NULL;
+    const gchar *value = wp_metadata_find (metadata, i % n_subjects,
+        g_ptr_array_index (keys, i), &type);
+    g_assert_cmpstr (value, ==, "1");
+    g_assert_cmpstr (type, ==, "Spa:Int");
+  }
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "found %u entries in %f s",
+      n_entries, elapsed);
+
+  g_assert_null (wp_metadata_find (metadata, 1, "key.0", NULL));
+
+  /* updating a value keeps the iteration order */
+  wp_metadata_set (metadata, 0, "key.0", NULL, "2");
+  {
+    g_autoptr (WpIterator) it = wp_metadata_new_iterator (metadata, PW_ID_ANY);
+    g_auto (GValue) val = G_VALUE_INIT;
+    guint subject = -1, i = 0;
+    const gchar *key = NULL, *value = NULL;
+
+    for (; wp_iterator_next (it, &val); g_value_unset (&val), i++) {
+      wp_metadata_iterator_item_extract (&val, &subject, &key, NULL, &value);
+      g_assert_cmpuint (subject, ==, i % n_subjects);
+      g_assert_cmpstr (key, ==, g_ptr_array_index (keys, i));
+      g_assert_cmpstr (value, ==, (i == 0) ? "2" : "1");
+    }
+    g_assert_cmpuint (i, ==, n_entries);
+  }
+  {
+    g_autoptr (WpIterator) it = wp_metadata_new_iterator (metadata, 3);
+    g_auto (GValue) val = G_VALUE_INIT;
+    guint subject = -1, i = 3;
+    const gchar *key = NULL;
+
+    for (; wp_iterator_next (it, &val); g_value_unset (&val), i += n_subjects) {
+      wp_metadata_iterator_item_extract (&val, &subject, &key, NULL, NULL);
+      g_assert_cmpuint (subject, ==, 3);
+      g_assert_cmpstr (key, ==, g_ptr_array_index (keys, i));
+    }
+    g_assert_cmpuint (i, ==, n_entries + 3);
+  }
+
+  /* unset a single key */
+  wp_metadata_set (metadata, 1, "key.1", NULL, NULL);
+  g_assert_null (wp_metadata_find (metadata, 1, "key.1", NULL));
+  g_assert_nonnull (wp_metadata_find (metadata, 1, "key.101", NULL));
+
+  /* find a key in any subject */
+  {
+    const gchar *type = NULL;
+    const gchar *value = wp_metadata_find (metadata, PW_ID_ANY, "key.102",
+        &type);
+    g_assert_cmpstr (value, ==, "1");
+    g_assert_cmpstr (type, ==, "Spa:Int");
+    g_assert_cmpstr (wp_metadata_find (metadata, PW_ID_ANY, "key.0", NULL),
+        ==, "2");
+    g_assert_null (wp_metadata_find (metadata, PW_ID_ANY, "key.1", NULL));
+    g_assert_null (wp_metadata_find (metadata, PW_ID_ANY, "no.such.key",
+        NULL));
+  }
+
+  /* clear all subjects */
+  g_test_timer_start ();
+  for (guint i = 0; i < n_subjects; i++)
+    wp_metadata_set (metadata, i, NULL, NULL, NULL);
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "cleared %u subjects in %f s",
+      n_subjects, elapsed);
+
+  {
+    g_autoptr (WpIterator) it = wp_metadata_new_iterator (metadata, PW_ID_ANY);
+    g_auto (GValue) val = G_VALUE_INIT;
+    g_assert_false (wp_iterator_next (it, &val));
+  }
+  g_assert_null (wp_metadata_find (metadata, 0, "key.0", NULL));
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -462,6 +567,8 @@ main (gint argc, gchar *argv[])
 
   g_test_add ("/wp/metadata/basic", TestFixture, NULL,
       test_metadata_setup, test_metadata_basic, test_metadata_teardown);
+  g_test_add ("/wp/metadata/large", TestFixture, NULL,
+      test_metadata_setup, test_metadata_large, test_metadata_teardown);
 
   return g_test_run ();
 }
@@ -869,6 +869,89 @@ test_object_interest_validate (TestFixture * f, gconstpointer data)
   i = wp_object_interest_new (WP_TYPE_NODE,
       WP_CONSTRAINT_TYPE_PW_PROPERTY, "object.id", "~(iu)", -10, 20, NULL);
   TEST_EXPECT_VALIDATION_ERROR (i);
+
+  /* empty list */
+  i = wp_object_interest_new (WP_TYPE_NODE,
+      WP_CONSTRAINT_TYPE_PW_PROPERTY, "object.id", "c()", NULL);
+  TEST_EXPECT_VALIDATION_ERROR (i);
+}
+
+static void
+test_object_interest_perf (TestFixture * f, gconstpointer data)
+{
+  const guint n_objects = g_test_perf () ? 10000 : 1000;
+  const guint n_rounds = g_test_perf () ? 100 : 10;
+  g_autoptr (GPtrArray) objects =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) wp_properties_unref);
+  g_autoptr (WpObjectInterest) i = NULL;
+  g_autoptr (GError) error = NULL;
+  guint n_matches = 0, expected = 0;
+  gdouble elapsed;
+
+  for (guint n = 0; n < n_objects; n++) {
+    g_autoptr (WpProperties) props = wp_properties_new (
+        "media.class", (n % 2) ? "Audio/Sink" : "Stream/Output/Audio",
+        "audio.channel", (n % 3) ? "FL" : "LFE",
+        "format.dsp", "32 bit float mono audio",
+        NULL);
+    wp_properties_setf (props, "object.id", "%u", n);
+    wp_properties_setf (props, "device.profile", "%u", n % 8);
+    wp_properties_setf (props, "priority.session", "%u", n % 1000);
+    g_ptr_array_add (objects, g_steal_pointer (&props));
+
+    if ((n % 2) && (n % 3) && (n % 8) < 6 && (n % 1000) >= 100)
+      expected++;
+  }
+
+  i = wp_object_interest_new (WP_TYPE_PROPERTIES,
+      WP_CONSTRAINT_TYPE_PW_PROPERTY, "object.id", "+",
+      WP_CONSTRAINT_TYPE_PW_PROPERTY, "format.dsp", "#s", "*float*audio",
+      WP_CONSTRAINT_TYPE_PW_PROPERTY, "audio.channel", "c(sssss)",
+          "MONO", "FL", "FR", "RL", "RR",
+      WP_CONSTRAINT_TYPE_PW_PROPERTY, "device.profile", "c(uuuuuu)",
+          0, 1, 2, 3, 4, 5,
+      WP_CONSTRAINT_TYPE_PW_PROPERTY, "priority.session", "~(ii)", 100, 999,
+      WP_CONSTRAINT_TYPE_PW_PROPERTY, "media.class", "=s", "Audio/Sink",
+      NULL);
+  g_assert_true (wp_object_interest_validate (i, &error));
+  g_assert_no_error (error);
+
+  /* match properties */
+  g_test_timer_start ();
+  for (guint r = 0; r < n_rounds; r++) {
+    n_matches = 0;
+    for (guint n = 0; n < n_objects; n++) {
+      if (wp_object_interest_matches (i, g_ptr_array_index (objects, n)))
+        n_matches++;
+    }
+  }
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "matched %u properties %u times in %f s",
+      n_objects, n_rounds, elapsed);
+  g_assert_cmpuint (n_matches, ==, expected);
+
+  g_clear_pointer (&i, wp_object_interest_unref);
+
+  /* match GObject properties */
+  i = wp_object_interest_new (TEST_TYPE_A,
+      WP_CONSTRAINT_TYPE_G_PROPERTY, "test-string", "c(sss)",
+          "success", "toast", "test",
+      WP_CONSTRAINT_TYPE_G_PROPERTY, "test-int", "~(ii)", -50, 0,
+      WP_CONSTRAINT_TYPE_G_PROPERTY, "test-boolean", "=b", TRUE,
+      NULL);
+  g_assert_true (wp_object_interest_validate (i, &error));
+  g_assert_no_error (error);
+
+  n_matches = 0;
+  g_test_timer_start ();
+  for (guint n = 0; n < n_objects * n_rounds; n++) {
+    if (wp_object_interest_matches (i, f->object))
+      n_matches++;
+  }
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "matched an object %u times in %f s",
+      n_objects * n_rounds, elapsed);
+  g_assert_cmpuint (n_matches, ==, n_objects * n_rounds);
 }
 
 int
@@ -931,5 +1014,11 @@ main (int argc, char *argv[])
       test_object_interest_validate,
       test_object_interest_teardown);
 
+  g_test_add ("/wp/object-interest/perf",
+      TestFixture, NULL,
+      test_object_interest_setup,
+      test_object_interest_perf,
+      test_object_interest_teardown);
+
   return g_test_run ();
 }
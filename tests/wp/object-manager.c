@@ -158,6 +158,332 @@ test_om_iterate_remove (TestFixture *f, gconstpointer user_data)
       WP_CONSTRAINT_TYPE_PW_PROPERTY, "property1", "=s", "1234", NULL));
 }
 
+static void
+test_om_interest_index (TestFixture *f, gconstpointer user_data)
+{
+  static const gchar *media_classes[] = {
+    "Audio/Sink", "Audio/Source", "Stream/Output/Audio", "Stream/Input/Audio",
+  };
+  const guint n_objects = g_test_perf () ? 1000 : 100;
+  const guint n_managers = g_test_perf () ? 200 : 20;
+  g_autoptr (GPtrArray) oms = g_ptr_array_new_with_free_func (g_object_unref);
+  gdouble elapsed;
+
+  /* install managers with all the kinds of interests that can be indexed */
+  for (guint i = 0; i < n_managers; i++) {
+    WpObjectManager *om = wp_object_manager_new ();
+
+    switch (i % 4) {
+    case 0:
+      wp_object_manager_add_interest (om, WP_TYPE_SESSION_ITEM,
+          WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.id", "=u", i,
+          NULL);
+      break;
+    case 1:
+      wp_object_manager_add_interest (om, WP_TYPE_SESSION_ITEM,
+          WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "media.class", "=s",
+          media_classes[(i / 4) % 4],
+          NULL);
+      break;
+    case 2:
+      wp_object_manager_add_interest (om, WP_TYPE_PLUGIN, NULL);
+      break;
+    case 3:
+      wp_object_manager_add_interest (om, si_dummy_get_type (),
+          WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.id", "~(uu)", 0, 9,
+          NULL);
+      break;
+    }
+
+    wp_core_install_object_manager (f->base.core, om);
+    g_ptr_array_add (oms, om);
+  }
+
+  g_test_timer_start ();
+
+  for (guint i = 0; i < n_objects; i++) {
+    WpSessionItem *si = NULL;
+    g_autofree gchar *id = g_strdup_printf ("%u", i);
+
+    si = g_object_new (si_dummy_get_type (), "core", f->base.core, NULL);
+    g_assert_true (wp_session_item_configure (si,
+        wp_properties_new (
+            "node.id", id,
+            "media.class", media_classes[i % 4],
+            NULL)));
+    wp_session_item_register (si);
+  }
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed,
+      "dispatched %u objects to %u object managers in %f s",
+      n_objects, n_managers, elapsed);
+
+  for (guint i = 0; i < n_managers; i++) {
+    WpObjectManager *om = g_ptr_array_index (oms, i);
+    guint expected = 0;
+
+    switch (i % 4) {
+    case 0: expected = 1; break;
+    case 1: expected = n_objects / 4; break;
+    case 2: expected = 0; break;
+    case 3: expected = 10; break;
+    }
+    g_assert_cmpuint (wp_object_manager_get_n_objects (om), ==, expected);
+  }
+}
+
+static void
+on_object_not_reached (WpObjectManager *om, GObject *object,
+    gpointer data)
+{
+  g_assert_not_reached ();
+}
+
+static void
+on_objects_batch (WpObjectManager *om, GPtrArray *added, GPtrArray *removed,
+    guint *counts)
+{
+  counts[0]++;
+  counts[1] += added->len;
+  counts[2] += removed->len;
+
+  for (guint i = 0; i < removed->len; i++)
+    g_assert_true (TEST_IS_SI_DUMMY (g_ptr_array_index (removed, i)));
+}
+
+static void
+on_objects_changed_quit (WpObjectManager *om, TestFixture *f)
+{
+  g_main_loop_quit (f->base.loop);
+}
+
+static void
+test_om_batched (TestFixture *f, gconstpointer user_data)
+{
+  const guint n_objects = g_test_perf () ? 1000 : 20;
+  g_autoptr (WpObjectManager) om = NULL;
+  g_autoptr (GPtrArray) items = g_ptr_array_new ();
+  guint counts[3] = { 0 };
+  WpSessionItem *si = NULL;
+
+  om = wp_object_manager_new ();
+  wp_object_manager_add_interest (om, si_dummy_get_type (), NULL);
+  wp_object_manager_set_batched (om, TRUE);
+  g_signal_connect (om, "object-added",
+      G_CALLBACK (on_object_not_reached), NULL);
+  g_signal_connect (om, "object-removed",
+      G_CALLBACK (on_object_not_reached), NULL);
+  g_signal_connect (om, "objects-batch", G_CALLBACK (on_objects_batch), counts);
+  test_ensure_object_manager_is_installed (om, f->base.core, f->base.loop);
+  g_assert_cmpuint (counts[0], ==, 0);
+
+  g_signal_connect (om, "objects-changed",
+      G_CALLBACK (on_objects_changed_quit), f);
+
+  /* register all objects; one batch is delivered for all of them */
+  for (guint i = 0; i < n_objects; i++) {
+    g_autofree gchar *id = g_strdup_printf ("%u", i);
+
+    si = g_object_new (si_dummy_get_type (), "core", f->base.core, NULL);
+    g_assert_true (wp_session_item_configure (si,
+        wp_properties_new ("node.id", id, NULL)));
+    wp_session_item_register (si);
+    g_ptr_array_add (items, si);
+  }
+
+  /* an object that is added and removed before the batch is delivered
+     does not appear in it */
+  si = g_object_new (si_dummy_get_type (), "core", f->base.core, NULL);
+  g_assert_true (wp_session_item_configure (si,
+      wp_properties_new ("node.id", "transient", NULL)));
+  wp_session_item_register (si);
+  wp_session_item_remove (si);
+
+  g_main_loop_run (f->base.loop);
+  g_assert_cmpuint (counts[0], ==, 1);
+  g_assert_cmpuint (counts[1], ==, n_objects);
+  g_assert_cmpuint (counts[2], ==, 0);
+  g_assert_cmpuint (wp_object_manager_get_n_objects (om), ==, n_objects);
+
+  /* remove half of them */
+  for (guint i = 0; i < n_objects / 2; i++)
+    wp_session_item_remove (g_ptr_array_index (items, i));
+
+  g_main_loop_run (f->base.loop);
+  g_assert_cmpuint (counts[0], ==, 2);
+  g_assert_cmpuint (counts[1], ==, n_objects);
+  g_assert_cmpuint (counts[2], ==, n_objects / 2);
+  g_assert_cmpuint (wp_object_manager_get_n_objects (om), ==,
+      n_objects - n_objects / 2);
+}
+
+static void
+test_om_lookup_nodes_activated (WpObject * object, GAsyncResult * res,
+    guint * pending)
+{
+  g_autoptr (GError) error = NULL;
+  g_assert_true (wp_object_activate_finish (object, res, &error));
+  g_assert_no_error (error);
+  (*pending)--;
+}
+
+static void
+test_om_lookup_index (TestFixture *f, gconstpointer user_data)
+{
+  const guint n_nodes = g_test_perf () ? 1000 : 50;
+  const guint n_rounds = g_test_perf () ? 100 : 10;
+  g_autoptr (GPtrArray) nodes = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr (WpObjectManager) om = NULL;
+  guint pending = 0;
+  gdouble elapsed;
+
+  /* load audiotestsrc on the server side */
+  {
+    g_autoptr (WpTestServerLocker) lock =
+        wp_test_server_locker_new (&f->base.server);
+
+    g_assert_cmpint (pw_context_add_spa_lib (f->base.server.context,
+            "audiotestsrc", "audiotestsrc/libspa-audiotestsrc"), ==, 0);
+    if (!test_is_spa_lib_installed (&f->base, "audiotestsrc")) {
+      g_test_skip ("The pipewire audiotestsrc factory was not found");
+      return;
+    }
+
+    g_assert_nonnull (pw_context_load_module (f->base.server.context,
+            "libpipewire-module-spa-node-factory", NULL, NULL));
+  }
+
+  /* create the nodes on the client core */
+  for (guint i = 0; i < n_nodes; i++) {
+    g_autofree gchar *name = g_strdup_printf ("audiotestsrc.%u", i);
+    WpNode *node = wp_node_new_from_factory (f->base.client_core,
+        "spa-node-factory",
+        wp_properties_new (
+            "factory.name", "audiotestsrc",
+            "node.name", name,
+            NULL));
+    g_assert_nonnull (node);
+    g_ptr_array_add (nodes, node);
+
+    pending++;
+    wp_object_activate (WP_OBJECT (node), WP_PIPEWIRE_OBJECT_FEATURES_MINIMAL,
+        NULL, (GAsyncReadyCallback) test_om_lookup_nodes_activated, &pending);
+  }
+  while (pending > 0)
+    g_main_context_iteration (f->base.context, TRUE);
+
+  /* ensure the base core is in sync */
+  wp_core_sync (f->base.client_core, NULL,
+      (GAsyncReadyCallback) test_core_done_cb, f);
+  g_main_loop_run (f->base.loop);
+  wp_core_sync (f->base.core, NULL, (GAsyncReadyCallback) test_core_done_cb, f);
+  g_main_loop_run (f->base.loop);
+
+  om = wp_object_manager_new ();
+  wp_object_manager_add_interest (om, WP_TYPE_NODE,
+      WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.name", "#s",
+      "audiotestsrc.*", NULL);
+  wp_object_manager_add_index_key (om, "node.name");
+  test_ensure_object_manager_is_installed (om, f->base.core, f->base.loop);
+  g_assert_cmpuint (wp_object_manager_get_n_objects (om), ==, n_nodes);
+
+  g_test_timer_start ();
+
+  for (guint r = 0; r < n_rounds; r++) {
+    for (guint i = 0; i < nodes->len; i++) {
+      WpNode *node = g_ptr_array_index (nodes, i);
+      guint32 id = wp_proxy_get_bound_id (WP_PROXY (node));
+      g_autofree gchar *name = g_strdup_printf ("audiotestsrc.%u", i);
+      g_autoptr (WpNode) by_id = NULL;
+      g_autoptr (WpNode) by_object_id = NULL;
+      g_autoptr (WpNode) by_name = NULL;
+
+      by_id = wp_object_manager_lookup (om, WP_TYPE_NODE,
+          WP_CONSTRAINT_TYPE_G_PROPERTY, "bound-id", "=u", id, NULL);
+      g_assert_nonnull (by_id);
+      g_assert_cmpuint (wp_proxy_get_bound_id (WP_PROXY (by_id)), ==, id);
+
+      by_object_id = wp_object_manager_lookup (om, WP_TYPE_GLOBAL_PROXY,
+          WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "object.id", "=u", id, NULL);
+      g_assert_true (by_object_id == by_id);
+
+      by_name = wp_object_manager_lookup (om, WP_TYPE_NODE,
+          WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.name", "=s", name,
+          NULL);
+      g_assert_true (by_name == by_id);
+    }
+  }
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "looked up %u nodes %u times in %f s",
+      n_nodes, n_rounds, elapsed);
+
+  /* lookups by object.serial and with additional constraints */
+  {
+    g_autoptr (WpNode) node = wp_object_manager_lookup (om, WP_TYPE_NODE,
+        WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.name", "=s",
+        "audiotestsrc.0", NULL);
+    g_autoptr (WpProperties) props = NULL;
+    g_autoptr (WpNode) by_serial = NULL;
+    const gchar *serial;
+
+    g_assert_nonnull (node);
+    props = wp_global_proxy_get_global_properties (WP_GLOBAL_PROXY (node));
+    serial = wp_properties_get (props, "object.serial");
+    g_assert_nonnull (serial);
+
+    by_serial = wp_object_manager_lookup (om, WP_TYPE_NODE,
+        WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "object.serial", "=s", serial,
+        NULL);
+    g_assert_true (by_serial == node);
+
+    g_assert_null (wp_object_manager_lookup (om, WP_TYPE_NODE,
+        WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.name", "=s",
+        "audiotestsrc.0",
+        WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.name", "=s",
+        "audiotestsrc.1", NULL));
+    g_assert_null (wp_object_manager_lookup (om, WP_TYPE_NODE,
+        WP_CONSTRAINT_TYPE_PW_GLOBAL_PROPERTY, "node.name", "=s",
+        "audiotestsrc.none", NULL));
+  }
+
+  /* destroy half of the nodes; they must disappear from the indexes */
+  {
+    g_autoptr (GArray) removed_ids =
+        g_array_new (FALSE, FALSE, sizeof (guint32));
+
+    for (guint i = 0; i < n_nodes / 2; i++) {
+      guint32 id = wp_proxy_get_bound_id (g_ptr_array_index (nodes, i));
+      g_array_append_val (removed_ids, id);
+    }
+    g_ptr_array_remove_range (nodes, 0, n_nodes / 2);
+
+    wp_core_sync (f->base.client_core, NULL,
+        (GAsyncReadyCallback) test_core_done_cb, f);
+    g_main_loop_run (f->base.loop);
+    wp_core_sync (f->base.core, NULL,
+        (GAsyncReadyCallback) test_core_done_cb, f);
+    g_main_loop_run (f->base.loop);
+
+    g_assert_cmpuint (wp_object_manager_get_n_objects (om), ==,
+        n_nodes - n_nodes / 2);
+
+    for (guint i = 0; i < removed_ids->len; i++) {
+      g_assert_null (wp_object_manager_lookup (om, WP_TYPE_NODE,
+          WP_CONSTRAINT_TYPE_G_PROPERTY, "bound-id", "=u",
+          g_array_index (removed_ids, guint32, i), NULL));
+    }
+    for (guint i = 0; i < nodes->len; i++) {
+      WpNode *node = g_ptr_array_index (nodes, i);
+      g_autoptr (WpNode) found = wp_object_manager_lookup (om, WP_TYPE_NODE,
+          WP_CONSTRAINT_TYPE_G_PROPERTY, "bound-id", "=u",
+          wp_proxy_get_bound_id (WP_PROXY (node)), NULL);
+      g_assert_nonnull (found);
+    }
+  }
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -168,6 +494,12 @@ main (gint argc, gchar *argv[])
       test_om_setup, test_om_interest_on_pw_props, test_om_teardown);
   g_test_add ("/wp/om/iterate_remove", TestFixture, NULL,
       test_om_setup, test_om_iterate_remove, test_om_teardown);
+  g_test_add ("/wp/om/interest-index", TestFixture, NULL,
+      test_om_setup, test_om_interest_index, test_om_teardown);
+  g_test_add ("/wp/om/batched", TestFixture, NULL,
+      test_om_setup, test_om_batched, test_om_teardown);
+  g_test_add ("/wp/om/lookup-index", TestFixture, NULL,
+      test_om_setup, test_om_lookup_index, test_om_teardown);
 
   return g_test_run ();
 }
@@ -167,6 +167,70 @@ test_properties_iterate (void)
   g_assert_cmpint (i, ==, 5);
 }
 
+static void
+test_properties_lookup (void)
+{
+  const guint n_keys = 48;
+  const guint n_rounds = g_test_perf () ? 200000 : 1000;
+  g_autoptr (WpProperties) p = wp_properties_new_empty ();
+  g_autoptr (WpProperties) pw = NULL;
+  g_autoptr (WpProperties) pattern = NULL;
+  g_autoptr (GPtrArray) keys = g_ptr_array_new_with_free_func (g_free);
+  struct pw_properties *pw_props;
+  gdouble indexed, linear;
+  guint found = 0;
+
+  /* a property set as big as the ones of a typical alsa node */
+  for (guint i = 0; i < n_keys; i++) {
+    gchar *key = g_strdup_printf ("node.test.property-%u", i);
+    g_autofree gchar *value = g_strdup_printf ("value%u", i);
+    wp_properties_set (p, key, value);
+    g_ptr_array_add (keys, key);
+  }
+
+  /* lookups work before & after modifications */
+  g_assert_cmpstr (wp_properties_get (p, "node.test.property-7"), ==,
+      "value7");
+  g_assert_cmpstr (wp_properties_get (p, "nonexistent"), ==, NULL);
+  wp_properties_set (p, "node.test.property-7", "changed");
+  wp_properties_set (p, "node.test.property-8", NULL);
+  wp_properties_set (p, "nonexistent", "exists");
+  g_assert_cmpstr (wp_properties_get (p, "node.test.property-7"), ==,
+      "changed");
+  g_assert_cmpstr (wp_properties_get (p, "node.test.property-8"), ==, NULL);
+  g_assert_cmpstr (wp_properties_get (p, "nonexistent"), ==, "exists");
+  wp_properties_set (p, "node.test.property-7", "value7");
+  wp_properties_set (p, "node.test.property-8", "value8");
+  wp_properties_set (p, "nonexistent", NULL);
+
+  pattern = wp_properties_new ("node.test.property-40", "value4*",
+      "node.test.property-2", "value2", NULL);
+  g_assert_true (wp_properties_matches (p, pattern));
+
+  /* a wrapped pw_properties may change externally, so it is never indexed;
+     use it as the reference for the linear search */
+  pw_props = wp_properties_to_pw_properties (p);
+  pw = wp_properties_new_wrap (pw_props);
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_rounds; i++)
+    found += !!wp_properties_get (pw, g_ptr_array_index (keys, i % n_keys));
+  linear = g_test_timer_elapsed ();
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_rounds; i++)
+    found += !!wp_properties_get (p, g_ptr_array_index (keys, i % n_keys));
+  indexed = g_test_timer_elapsed ();
+
+  g_assert_cmpuint (found, ==, 2 * n_rounds);
+  g_test_message ("%u lookups in %u keys: linear %f s, indexed %f s",
+      n_rounds, n_keys, linear, indexed);
+  g_test_minimized_result (indexed, "indexed lookups in %f s", indexed);
+
+  g_clear_pointer (&pw, wp_properties_unref);
+  pw_properties_free (pw_props);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -180,6 +244,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/wp/properties/take", test_properties_take);
   g_test_add_func ("/wp/properties/to_pw_props", test_properties_to_pw_props);
   g_test_add_func ("/wp/properties/iterate", test_properties_iterate);
+  g_test_add_func ("/wp/properties/lookup", test_properties_lookup);
 
   return g_test_run ();
 }
@@ -200,6 +200,107 @@ test_node (TestFixture *f, gconstpointer data)
   g_main_loop_run (f->base.loop);
 }
 
+typedef struct {
+  TestFixture *f;
+  guint pending;
+} NodePortsData;
+
+static void
+test_node_ports_activated (WpObject * object, GAsyncResult * res,
+    NodePortsData * data)
+{
+  g_autoptr (GError) error = NULL;
+  g_assert_true (wp_object_activate_finish (object, res, &error));
+  g_assert_no_error (error);
+
+  if (--data->pending == 0)
+    g_main_loop_quit (data->f->base.loop);
+}
+
+static void
+test_node_ports (TestFixture *f, gconstpointer data)
+{
+  const guint n_nodes = g_test_perf () ? 2000 : 50;
+  g_autoptr (GPtrArray) nodes = g_ptr_array_new_with_free_func (g_object_unref);
+  NodePortsData d = { f, 0 };
+  gdouble elapsed;
+
+  /* load audiotestsrc on the server side */
+  {
+    g_autoptr (WpTestServerLocker) lock =
+        wp_test_server_locker_new (&f->base.server);
+
+    g_assert_cmpint (pw_context_add_spa_lib (f->base.server.context,
+            "audiotestsrc", "audiotestsrc/libspa-audiotestsrc"), ==, 0);
+    if (!test_is_spa_lib_installed (&f->base, "audiotestsrc")) {
+      g_test_skip ("The pipewire audiotestsrc factory was not found");
+      return;
+    }
+
+    g_assert_nonnull (pw_context_load_module (f->base.server.context,
+            "libpipewire-module-spa-node-factory", NULL, NULL));
+  }
+
+  /* create nodes with one port each */
+  for (guint i = 0; i < n_nodes; i++) {
+    g_autofree gchar *name = g_strdup_printf ("audiotestsrc.%u", i);
+    WpNode *node = wp_node_new_from_factory (f->base.core,
+        "spa-node-factory",
+        wp_properties_new (
+            "factory.name", "audiotestsrc",
+            "node.name", name,
+            NULL));
+    g_assert_nonnull (node);
+    g_ptr_array_add (nodes, node);
+
+    d.pending++;
+    wp_object_activate (WP_OBJECT (node), WP_PIPEWIRE_OBJECT_FEATURES_MINIMAL,
+        NULL, (GAsyncReadyCallback) test_node_ports_activated, &d);
+  }
+  g_main_loop_run (f->base.loop);
+
+  /* enable the ports of all nodes */
+  g_test_timer_start ();
+
+  for (guint i = 0; i < nodes->len; i++) {
+    d.pending++;
+    wp_object_activate (g_ptr_array_index (nodes, i), WP_NODE_FEATURE_PORTS,
+        NULL, (GAsyncReadyCallback) test_node_ports_activated, &d);
+  }
+  g_main_loop_run (f->base.loop);
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed,
+      "enabled ports on %u nodes in %f s", n_nodes, elapsed);
+
+  for (guint i = 0; i < nodes->len; i++) {
+    WpNode *node = g_ptr_array_index (nodes, i);
+    g_autoptr (WpPort) port = wp_node_lookup_port (node, NULL);
+    g_assert_cmpuint (wp_node_get_n_ports (node), ==, 1);
+    g_assert_nonnull (port);
+
+    /* the ports are fully prepared by the time the feature is enabled */
+    g_assert_cmphex (wp_object_get_active_features (WP_OBJECT (port)), ==,
+        wp_object_get_supported_features (WP_OBJECT (port)));
+  }
+
+  /* destroy half of the nodes, which also removes their ports */
+  g_test_timer_start ();
+
+  g_ptr_array_remove_range (nodes, 0, n_nodes / 2);
+  wp_core_sync (f->base.core, NULL, (GAsyncReadyCallback) test_core_done_cb, f);
+  g_main_loop_run (f->base.loop);
+
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed,
+      "removed %u nodes with their ports in %f s", n_nodes / 2, elapsed);
+
+  for (guint i = 0; i < nodes->len; i++) {
+    WpNode *node = g_ptr_array_index (nodes, i);
+    g_assert_cmpuint (wp_node_get_n_ports (node), ==, 1);
+  }
+}
+
 static void
 activate_error_cb (WpObject * object, GAsyncResult * res,
     WpBaseTestFixture * f)
@@ -295,6 +396,8 @@ main (gint argc, gchar *argv[])
       test_proxy_setup, test_proxy_basic, test_proxy_teardown);
   g_test_add ("/wp/proxy/node", TestFixture, NULL,
       test_proxy_setup, test_node, test_proxy_teardown);
+  g_test_add ("/wp/proxy/node-ports", TestFixture, NULL,
+      test_proxy_setup, test_node_ports, test_proxy_teardown);
   g_test_add ("/wp/proxy/link_error", TestFixture, NULL,
       test_proxy_setup, test_link_error, test_proxy_teardown);
   g_test_add ("/wp/proxy/enum_params_error", TestFixture, NULL,
@@ -7,6 +7,7 @@
  */
 
 #include <wp/wp.h>
+#include <math.h>
 
 static void
 test_spa_json_basic (void)
@@ -1255,6 +1256,90 @@ test_spa_json_to_string (void)
   }
 }
 
+static void
+test_spa_json_builder_nested_take (void)
+{
+  {
+    g_autoptr (WpSpaJsonBuilder) b = wp_spa_json_builder_new_object_sized (128);
+    g_autofree gchar *str = NULL;
+    size_t size = 0;
+
+    wp_spa_json_builder_add_property (b, "name");
+    wp_spa_json_builder_add_string (b, "wp");
+    wp_spa_json_builder_add_property (b, "volumes");
+    wp_spa_json_builder_open_array (b);
+    wp_spa_json_builder_add_int (b, 1);
+    wp_spa_json_builder_add_int (b, 2);
+    wp_spa_json_builder_close (b);
+    wp_spa_json_builder_add_property (b, "route");
+    wp_spa_json_builder_open_object (b);
+    wp_spa_json_builder_add_property (b, "mute");
+    wp_spa_json_builder_add_boolean (b, FALSE);
+    wp_spa_json_builder_add_property (b, "channels");
+    wp_spa_json_builder_open_array (b);
+    wp_spa_json_builder_add_string (b, "FL");
+    wp_spa_json_builder_close (b);
+    wp_spa_json_builder_close (b);
+    wp_spa_json_builder_add_property (b, "last");
+    wp_spa_json_builder_add_null (b);
+
+    str = wp_spa_json_builder_end_take (b, &size);
+    g_assert_cmpstr (str, ==, "{\"name\":\"wp\", \"volumes\":[1, 2], "
+        "\"route\":{\"mute\":false, \"channels\":[\"FL\"]}, \"last\":null}");
+    g_assert_cmpuint (size, ==, strlen (str));
+
+    g_autoptr (WpSpaJson) json = wp_spa_json_new_from_string (str);
+    g_autoptr (WpSpaJson) route = NULL;
+    g_autofree gchar *name = NULL;
+    gboolean mute = TRUE;
+    g_assert_true (wp_spa_json_object_get (json,
+        "name", "s", &name,
+        "route", "J", &route,
+        NULL));
+    g_assert_cmpstr (name, ==, "wp");
+    g_assert_true (wp_spa_json_object_get (route, "mute", "b", &mute, NULL));
+    g_assert_false (mute);
+  }
+
+  /* the buffer grows past the initial size and open containers are closed
+     when ending */
+  {
+    g_autoptr (WpSpaJsonBuilder) b = wp_spa_json_builder_new_array ();
+    g_autofree gchar *str = NULL;
+    size_t size = 0;
+
+    wp_spa_json_builder_open_array (b);
+    for (gint i = 0; i < 100; i++)
+      wp_spa_json_builder_add_int (b, i);
+    wp_spa_json_builder_open_object (b);
+
+    str = wp_spa_json_builder_end_take (b, &size);
+    g_assert_cmpuint (size, ==, strlen (str));
+    g_assert_true (g_str_has_prefix (str, "[[0, 1, 2, "));
+    g_assert_true (g_str_has_suffix (str, ", 98, 99, {}]]"));
+  }
+}
+
+static void
+test_spa_json_builder_full_precision (void)
+{
+  g_autoptr (WpSpaJsonBuilder) b = wp_spa_json_builder_new_array ();
+  g_autofree gchar *str = NULL;
+  size_t size = 0;
+
+  wp_spa_json_builder_add_int64 (b, G_MAXINT64);
+  wp_spa_json_builder_add_int64 (b, G_MININT64);
+  wp_spa_json_builder_add_double (b, 0.1);
+  wp_spa_json_builder_add_double (b, 1.0);
+  wp_spa_json_builder_add_double (b, 1e20);
+  wp_spa_json_builder_add_double (b, INFINITY);
+
+  str = wp_spa_json_builder_end_take (b, &size);
+  g_assert_cmpstr (str, ==, "[9223372036854775807, -9223372036854775808, "
+      "0.10000000000000001, 1.0, 1e+20, null]");
+  g_assert_cmpuint (size, ==, strlen (str));
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -1272,6 +1357,10 @@ main (int argc, char *argv[])
   g_test_add_func ("/wp/spa-json/ownership", test_spa_json_ownership);
   g_test_add_func ("/wp/spa-json/spa-format", test_spa_json_spa_format);
   g_test_add_func ("/wp/spa-json/to-string", test_spa_json_to_string);
+  g_test_add_func ("/wp/spa-json/builder-nested-take",
+      test_spa_json_builder_nested_take);
+  g_test_add_func ("/wp/spa-json/builder-full-precision",
+      test_spa_json_builder_full_precision);
 
   return g_test_run ();
 }
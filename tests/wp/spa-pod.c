@@ -7,6 +7,8 @@
  */
 
 #include <wp/wp.h>
+#include <wp/private/spa-pod-private.h>
+#include <spa/pod/pod.h>
 
 static void
 test_spa_pod_basic (void)
@@ -1073,6 +1075,503 @@ test_spa_pod_port_config (void)
   g_assert_nonnull (pod);
 }
 
+static void
+test_spa_pod_named_lookup (void)
+{
+  const guint n_rounds = g_test_perf () ? 100000 : 1000;
+  gdouble elapsed;
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_rounds; i++) {
+    g_autoptr (WpSpaPod) props = NULL;
+    g_autoptr (WpSpaPod) route = NULL;
+    const char *id_name = NULL, *name = NULL;
+    const char *direction = NULL, *available = NULL;
+    gboolean mute = TRUE;
+    float volume = 0.0;
+    gint32 index = -1, device = -1, priority = 0;
+
+    props = wp_spa_pod_new_object (
+        "Spa:Pod:Object:Param:Props", "Props",
+        "mute", "b", FALSE,
+        "volume", "f", 0.5,
+        NULL);
+    route = wp_spa_pod_new_object (
+        "Spa:Pod:Object:Param:Route", "Route",
+        "index", "i", 1,
+        "direction", "K", "Output",
+        "device", "i", 2,
+        "name", "s", "analog-output-speaker",
+        "priority", "i", 100,
+        "available", "K", "yes",
+        "props", "P", props,
+        NULL);
+
+    g_assert_true (wp_spa_pod_get_object (props, &id_name,
+        "mute", "b", &mute,
+        "volume", "f", &volume,
+        NULL));
+    g_assert_true (wp_spa_pod_get_object (route, &id_name,
+        "index", "i", &index,
+        "direction", "K", &direction,
+        "device", "i", &device,
+        "name", "s", &name,
+        "priority", "i", &priority,
+        "available", "K", &available,
+        NULL));
+
+    g_assert_cmpstr (id_name, ==, "Route");
+    g_assert_false (mute);
+    g_assert_cmpint (index, ==, 1);
+    g_assert_cmpstr (direction, ==, "Output");
+    g_assert_cmpint (device, ==, 2);
+    g_assert_cmpint (priority, ==, 100);
+    g_assert_cmpstr (available, ==, "yes");
+  }
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed,
+      "built and parsed %u Props/Route pairs in %f s", n_rounds, elapsed);
+}
+
+static void
+test_spa_pod_parse_spec (void)
+{
+  const guint n_rounds = g_test_perf () ? 100000 : 1000;
+  g_autoptr (WpSpaPodParseSpec) spec = NULL;
+  g_autoptr (WpSpaPodParseSpec) all = NULL;
+  g_autoptr (WpSpaPod) route = NULL;
+  g_autoptr (WpSpaPod) props = NULL;
+  gdouble elapsed;
+
+  props = wp_spa_pod_new_object (
+      "Spa:Pod:Object:Param:Props", "Props",
+      "mute", "b", TRUE,
+      NULL);
+  route = wp_spa_pod_new_object (
+      "Spa:Pod:Object:Param:Route", "Route",
+      "index", "i", 1,
+      "direction", "K", "Output",
+      "device", "i", 2,
+      "name", "s", "analog-output-speaker",
+      "priority", "i", 100,
+      "available", "K", "yes",
+      "props", "P", props,
+      NULL);
+
+  /* keys are given in a different order than in the pod */
+  spec = wp_spa_pod_parse_spec_new ("Spa:Pod:Object:Param:Route",
+      "props", "available", "priority", "name", "device", "direction",
+      "index", "info", NULL);
+  g_assert_nonnull (spec);
+  g_assert_cmpuint (wp_spa_pod_parse_spec_get_n_keys (spec), ==, 8);
+  g_assert_cmpstr (wp_spa_pod_parse_spec_get_key (spec, 1), ==, "available");
+
+  /* specs only parse objects of their own type */
+  g_assert_false (wp_spa_pod_parse_spec_get (spec, props, NULL, NULL));
+
+  /* non-optional missing keys fail */
+  {
+    g_autoptr (WpSpaPod) p = NULL, info = NULL;
+    const char *available = NULL, *name = NULL, *direction = NULL;
+    gint32 priority = 0, device = -1, index = -1;
+
+    g_assert_false (wp_spa_pod_parse_spec_get (spec, route, NULL,
+        "P", &p, "K", &available, "i", &priority, "s", &name, "i", &device,
+        "K", &direction, "i", &index, "P", &info, NULL));
+  }
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_rounds; i++) {
+    g_autoptr (WpSpaPod) p = NULL, info = NULL;
+    const char *id_name = NULL, *available = NULL, *name = NULL;
+    const char *direction = NULL;
+    gint32 priority = 0, device = -1, index = -1;
+    gboolean mute = FALSE;
+
+    g_assert_true (wp_spa_pod_parse_spec_get (spec, route, &id_name,
+        "P", &p, "K", &available, "i", &priority, "s", &name, "i", &device,
+        "K", &direction, "i", &index, "?P", &info, NULL));
+
+    g_assert_cmpstr (id_name, ==, "Route");
+    g_assert_cmpint (index, ==, 1);
+    g_assert_cmpstr (direction, ==, "Output");
+    g_assert_cmpint (device, ==, 2);
+    g_assert_cmpstr (name, ==, "analog-output-speaker");
+    g_assert_cmpint (priority, ==, 100);
+    g_assert_cmpstr (available, ==, "yes");
+    g_assert_null (info);
+    g_assert_nonnull (p);
+    g_assert_true (wp_spa_pod_get_object (p, NULL, "mute", "b", &mute, NULL));
+    g_assert_true (mute);
+  }
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed,
+      "parsed %u Route objects with a spec in %f s", n_rounds, elapsed);
+
+  /* a spec without keys covers all the properties of the type */
+  all = wp_spa_pod_parse_spec_new_keys ("Spa:Pod:Object:Param:Route", NULL);
+  g_assert_nonnull (all);
+  {
+    guint n_keys = wp_spa_pod_parse_spec_get_n_keys (all);
+    g_autofree WpSpaPod **values = g_new0 (WpSpaPod *, n_keys);
+    const char *id_name = NULL;
+    guint n_found = 0;
+
+    g_assert_cmpuint (n_keys, >=, 7);
+    g_assert_true (wp_spa_pod_parse_spec_collect (all, route, &id_name,
+        values));
+    g_assert_cmpstr (id_name, ==, "Route");
+
+    for (guint i = 0; i < n_keys; i++) {
+      const char *key = wp_spa_pod_parse_spec_get_key (all, i);
+      if (!values[i])
+        continue;
+      n_found++;
+      if (!g_strcmp0 (key, "name")) {
+        const char *name = NULL;
+        g_assert_true (wp_spa_pod_get_string (values[i], &name));
+        g_assert_cmpstr (name, ==, "analog-output-speaker");
+      }
+      g_clear_pointer (&values[i], wp_spa_pod_unref);
+    }
+    g_assert_cmpuint (n_found, ==, 7);
+  }
+}
+
+/* invalid keys are caller bugs, reported with a critical, so each case runs
+   in a subprocess */
+static void
+test_spa_pod_parse_spec_invalid (gconstpointer data)
+{
+  const gchar *name = data;
+
+  if (g_test_subprocess ()) {
+    WpSpaIdTable table = wp_spa_type_get_values_table (
+        wp_spa_type_from_name ("Spa:Pod:Object:Param:Route"));
+    g_autofree gchar *index_id = g_strdup_printf ("id-%08x",
+        wp_spa_id_value_number (
+            wp_spa_id_table_find_value_from_short_name (table, "index")));
+    g_autoptr (WpSpaPodParseSpec) spec = NULL;
+
+    if (!g_strcmp0 (name, "unknown"))
+      spec = wp_spa_pod_parse_spec_new ("Spa:Pod:Object:Param:Route",
+          "index", "no-such-key", NULL);
+    else if (!g_strcmp0 (name, "invalid-id"))
+      spec = wp_spa_pod_parse_spec_new ("Spa:Pod:Object:Param:Route",
+          "index", "id-zz", NULL);
+    else if (!g_strcmp0 (name, "duplicate"))
+      spec = wp_spa_pod_parse_spec_new ("Spa:Pod:Object:Param:Route",
+          "index", "name", "index", NULL);
+    else if (!g_strcmp0 (name, "duplicate-id"))
+      spec = wp_spa_pod_parse_spec_new ("Spa:Pod:Object:Param:Route",
+          "index", index_id, NULL);
+    else if (!g_strcmp0 (name, "duplicate-many"))
+      spec = wp_spa_pod_parse_spec_new ("Spa:Pod:Object:Param:Route",
+          "index", "direction", "device", "name", "priority", "available",
+          "props", "info", "profiles", "index", NULL);
+    g_assert_null (spec);
+    return;
+  }
+
+  g_test_trap_subprocess (NULL, 0, 0);
+  g_test_trap_assert_failed ();
+  if (g_str_has_prefix (name, "duplicate"))
+    g_test_trap_assert_stderr ("*duplicate property key for*");
+  else if (!g_strcmp0 (name, "unknown"))
+    g_test_trap_assert_stderr ("*unknown property key for*no-such-key*");
+  else
+    g_test_trap_assert_stderr ("*invalid property key: id-zz*");
+}
+
+static WpSpaPod *
+build_volume_route (const float volumes[8])
+{
+  g_autoptr (WpSpaPodBuilder) b =
+      wp_spa_pod_builder_new_object ("Spa:Pod:Object:Param:Route", "Route");
+
+  wp_spa_pod_builder_add (b,
+      "index", "i", 1,
+      "device", "i", 2,
+      NULL);
+  wp_spa_pod_builder_add_property (b, "props");
+  wp_spa_pod_builder_push_object (b, "Spa:Pod:Object:Param:Props", "Props");
+  wp_spa_pod_builder_add (b, "channelVolumes", "a",
+      sizeof (float), SPA_TYPE_Float, 8, volumes,
+      "mute", "b", FALSE,
+      NULL);
+  wp_spa_pod_builder_pop (b);
+  wp_spa_pod_builder_add (b, "save", "b", TRUE, NULL);
+  return wp_spa_pod_builder_end (b);
+}
+
+static void
+test_spa_pod_builder_nested (void)
+{
+  const guint n_rounds = g_test_perf () ? 100000 : 1000;
+  const float volumes[8] = { 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8 };
+  gdouble elapsed;
+
+  /* a route with nested props, built in one builder, is the same as one
+     built from separately built pods */
+  {
+    g_autoptr (WpSpaPodBuilder) b = NULL;
+    g_autoptr (WpSpaPodBuilder) pos_b = NULL;
+    g_autoptr (WpSpaPod) position = NULL;
+    g_autoptr (WpSpaPod) props = NULL;
+    g_autoptr (WpSpaPod) expected = NULL;
+    g_autoptr (WpSpaPod) route = NULL;
+    g_autoptr (WpSpaPod) nested = NULL;
+    const struct spa_pod *p1, *p2;
+    gboolean mute = FALSE;
+
+    pos_b = wp_spa_pod_builder_new_array ();
+    wp_spa_pod_builder_add_id (pos_b, 3);
+    wp_spa_pod_builder_add_id (pos_b, 4);
+    position = wp_spa_pod_builder_end (pos_b);
+    props = wp_spa_pod_new_object (
+        "Spa:Pod:Object:Param:Props", "Props",
+        "mute", "b", TRUE,
+        "channelMap", "P", position,
+        NULL);
+    expected = wp_spa_pod_new_object (
+        "Spa:Pod:Object:Param:Route", "Route",
+        "index", "i", 1,
+        "props", "P", props,
+        "save", "b", TRUE,
+        NULL);
+
+    b = wp_spa_pod_builder_new_object ("Spa:Pod:Object:Param:Route", "Route");
+    wp_spa_pod_builder_add (b, "index", "i", 1, NULL);
+    wp_spa_pod_builder_add_property (b, "props");
+    wp_spa_pod_builder_push_object (b, "Spa:Pod:Object:Param:Props", "Props");
+    wp_spa_pod_builder_add (b, "mute", "b", TRUE, NULL);
+    wp_spa_pod_builder_add_property (b, "channelMap");
+    wp_spa_pod_builder_push_array (b);
+    wp_spa_pod_builder_add_id (b, 3);
+    wp_spa_pod_builder_add_id (b, 4);
+    wp_spa_pod_builder_pop (b);
+    wp_spa_pod_builder_pop (b);
+    wp_spa_pod_builder_add (b, "save", "b", TRUE, NULL);
+    route = wp_spa_pod_builder_end (b);
+
+    p1 = wp_spa_pod_get_spa_pod (expected);
+    p2 = wp_spa_pod_get_spa_pod (route);
+    g_assert_cmpmem (p1, SPA_POD_SIZE (p1), p2, SPA_POD_SIZE (p2));
+
+    g_assert_true (wp_spa_pod_get_object (route, NULL,
+        "props", "P", &nested,
+        NULL));
+    g_assert_true (wp_spa_pod_get_object (nested, NULL,
+        "mute", "b", &mute,
+        NULL));
+    g_assert_true (mute);
+  }
+
+  /* pods that do not fit in the initial buffer grow it */
+  {
+    g_autoptr (WpSpaPodBuilder) b = wp_spa_pod_builder_new_struct ();
+    g_autoptr (WpSpaPod) pod = NULL;
+    g_autoptr (WpIterator) it = NULL;
+    g_auto (GValue) item = G_VALUE_INIT;
+    gint32 n = 0;
+
+    wp_spa_pod_builder_push_struct (b);
+    for (gint32 i = 0; i < 1000; i++)
+      wp_spa_pod_builder_add_int (b, i);
+    wp_spa_pod_builder_pop (b);
+    pod = wp_spa_pod_builder_end (b);
+
+    it = wp_spa_pod_new_iterator (pod);
+    g_assert_true (wp_iterator_next (it, &item));
+    {
+      WpSpaPod *inner = g_value_get_boxed (&item);
+      g_autoptr (WpIterator) inner_it = wp_spa_pod_new_iterator (inner);
+      g_auto (GValue) v = G_VALUE_INIT;
+      g_assert_true (wp_spa_pod_is_struct (inner));
+      for (; wp_iterator_next (inner_it, &v); g_value_unset (&v)) {
+        gint32 value = -1;
+        g_assert_true (wp_spa_pod_get_int (g_value_get_boxed (&v), &value));
+        g_assert_cmpint (value, ==, n++);
+      }
+    }
+    g_assert_cmpint (n, ==, 1000);
+  }
+
+  /* nesting deeper than the inline frames of the builder */
+  {
+    const guint depth = 10;
+    g_autoptr (WpSpaPodBuilder) b = wp_spa_pod_builder_new_struct ();
+    g_autoptr (WpSpaPod) expected = NULL;
+    g_autoptr (WpSpaPod) pod = NULL;
+    const struct spa_pod *p1, *p2;
+
+    /* build the same pod from the inside out, one builder per level */
+    expected = wp_spa_pod_new_int (42);
+    for (guint i = 0; i <= depth; i++) {
+      g_autoptr (WpSpaPodBuilder) level = wp_spa_pod_builder_new_struct ();
+      wp_spa_pod_builder_add_int (level, i);
+      wp_spa_pod_builder_add_pod (level, expected);
+      g_clear_pointer (&expected, wp_spa_pod_unref);
+      expected = wp_spa_pod_builder_end (level);
+    }
+
+    wp_spa_pod_builder_add_int (b, depth);
+    for (guint i = 0; i < depth; i++) {
+      wp_spa_pod_builder_push_struct (b);
+      wp_spa_pod_builder_add_int (b, depth - i - 1);
+    }
+    wp_spa_pod_builder_add_int (b, 42);
+    for (guint i = 0; i < depth; i++)
+      wp_spa_pod_builder_pop (b);
+    pod = wp_spa_pod_builder_end (b);
+
+    p1 = wp_spa_pod_get_spa_pod (expected);
+    p2 = wp_spa_pod_get_spa_pod (pod);
+    g_assert_cmpmem (p1, SPA_POD_SIZE (p1), p2, SPA_POD_SIZE (p2));
+  }
+
+  /* the pods of a volume change on a device route */
+  g_test_timer_start ();
+  for (guint i = 0; i < n_rounds; i++) {
+    g_autoptr (WpSpaPod) route = build_volume_route (volumes);
+    g_assert_nonnull (route);
+  }
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed,
+      "built %u Route pods with nested Props in %f s", n_rounds, elapsed);
+}
+
+static void
+test_spa_pod_raw_builder (void)
+{
+  const guint n_pods = 40;
+  g_autoptr (GPtrArray) expected =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) wp_spa_pod_unref);
+  g_autoptr (GPtrArray) pods = NULL;
+  gsize total = 0;
+
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+  {
+    g_autoptr (WpSpaPodBuilder) b = wp_spa_pod_builder_new_raw ();
+
+    /* strings of all lengths modulo 8 and ints, which are padded when
+       written in the buffer; together they do not fit in the inline one */
+    for (guint i = 0; i < n_pods; i++) {
+      WpSpaPod *pod;
+      if (i % 2) {
+        g_autofree gchar *str = g_strnfill (i % 8 + 1, 'a' + i % 26);
+        pod = wp_spa_pod_new_string (str);
+      } else {
+        pod = wp_spa_pod_new_int (i);
+      }
+      wp_spa_pod_builder_append_spa_pod (b, wp_spa_pod_get_spa_pod (pod));
+      total += SPA_ROUND_UP_N (SPA_POD_SIZE (wp_spa_pod_get_spa_pod (pod)), 8);
+      g_ptr_array_add (expected, pod);
+    }
+    g_assert_cmpuint (total, >, 256);
+    g_assert_cmpuint (wp_spa_pod_builder_get_n_pods (b), ==, n_pods);
+
+    pods = wp_spa_pod_builder_end_pods (b);
+  }
+  G_GNUC_END_IGNORE_DEPRECATIONS
+
+  /* the pods outlive the builder and are walked at the padded offsets */
+  g_assert_nonnull (pods);
+  g_assert_cmpuint (pods->len, ==, n_pods);
+  for (guint i = 0; i < n_pods; i++) {
+    WpSpaPod *pod = g_ptr_array_index (pods, i);
+    g_assert_true (wp_spa_pod_equal (pod, g_ptr_array_index (expected, i)));
+    g_assert_cmpuint (GPOINTER_TO_SIZE (wp_spa_pod_get_spa_pod (pod)) % 8,
+        ==, 0);
+  }
+
+  /* a pod that is kept alive alone keeps the data of the others too */
+  {
+    g_autoptr (WpSpaPod) last =
+        wp_spa_pod_ref (g_ptr_array_index (pods, n_pods - 1));
+    const gchar *str = NULL;
+
+    g_clear_pointer (&pods, g_ptr_array_unref);
+    g_assert_true (wp_spa_pod_get_string (last, &str));
+    g_assert_cmpstr (str, ==, "nnnnnnnn");
+  }
+}
+
+static void
+test_spa_pod_copy (void)
+{
+  const float volumes[8] = { 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8 };
+
+  /* copies have their own data, of the same size as the original */
+  {
+    WpSpaPod *route = build_volume_route (volumes);
+    const struct spa_pod *p = wp_spa_pod_get_spa_pod (route);
+    const guint32 size = SPA_POD_SIZE (p);
+    g_autoptr (WpSpaPod) copy = wp_spa_pod_copy (route);
+    g_autoptr (WpSpaPod) props = NULL;
+    g_autoptr (WpSpaPod) props_copy = NULL;
+    const struct spa_pod *c = wp_spa_pod_get_spa_pod (copy);
+    gint32 index = -1;
+    gboolean mute = TRUE;
+
+    g_assert_true (c != p);
+    g_assert_cmpuint (SPA_POD_SIZE (c), ==, size);
+    g_assert_cmpmem (c, SPA_POD_SIZE (c), p, size);
+    g_assert_true (wp_spa_pod_is_unique_owner (copy));
+
+    /* copies of nested values only contain the value */
+    g_assert_true (wp_spa_pod_get_object (route, NULL,
+        "props", "P", &props,
+        NULL));
+    props_copy = wp_spa_pod_copy (props);
+    g_assert_cmpuint (SPA_POD_SIZE (wp_spa_pod_get_spa_pod (props_copy)), ==,
+        SPA_POD_SIZE (wp_spa_pod_get_spa_pod (props)));
+    g_assert_cmpuint (SPA_POD_SIZE (wp_spa_pod_get_spa_pod (props_copy)), <,
+        size);
+
+    /* and they outlive the original */
+    g_clear_pointer (&props, wp_spa_pod_unref);
+    wp_spa_pod_unref (route);
+    g_assert_true (wp_spa_pod_get_object (copy, NULL,
+        "index", "i", &index,
+        NULL));
+    g_assert_cmpint (index, ==, 1);
+    g_assert_true (wp_spa_pod_get_object (props_copy, NULL,
+        "mute", "b", &mute,
+        NULL));
+    g_assert_false (mute);
+  }
+
+  /* strings and bytes are allocated with the exact size of their pod */
+  {
+    g_autoptr (WpSpaPod) str = wp_spa_pod_new_string ("abc");
+    g_autoptr (WpSpaPod) empty = wp_spa_pod_new_string (NULL);
+    g_autoptr (WpSpaPod) bytes = wp_spa_pod_new_bytes ("\x01\x02\x03", 3);
+    const char *value = NULL;
+    gconstpointer data = NULL;
+    guint32 len = 0;
+
+    g_assert_cmpuint (SPA_POD_SIZE (wp_spa_pod_get_spa_pod (str)), ==,
+        sizeof (struct spa_pod) + 4);
+    g_assert_true (wp_spa_pod_get_string (str, &value));
+    g_assert_cmpstr (value, ==, "abc");
+
+    g_assert_cmpuint (SPA_POD_SIZE (wp_spa_pod_get_spa_pod (empty)), ==,
+        sizeof (struct spa_pod) + 1);
+    g_assert_true (wp_spa_pod_get_string (empty, &value));
+    g_assert_cmpstr (value, ==, "");
+
+    g_assert_cmpuint (SPA_POD_SIZE (wp_spa_pod_get_spa_pod (bytes)), ==,
+        sizeof (struct spa_pod) + 3);
+    g_assert_true (wp_spa_pod_get_bytes (bytes, &data, &len));
+    g_assert_cmpuint (len, ==, 3);
+    g_assert_cmpmem (data, len, "\x01\x02\x03", 3);
+  }
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -1088,6 +1587,21 @@ main (int argc, char *argv[])
   g_test_add_func ("/wp/spa-pod/iterator", test_spa_pod_iterator);
   g_test_add_func ("/wp/spa-pod/unique-owner", test_spa_pod_unique_owner);
   g_test_add_func ("/wp/spa-pod/port-config", test_spa_pod_port_config);
+  g_test_add_func ("/wp/spa-pod/named-lookup", test_spa_pod_named_lookup);
+  g_test_add_func ("/wp/spa-pod/parse-spec", test_spa_pod_parse_spec);
+  g_test_add_data_func ("/wp/spa-pod/parse-spec-invalid/unknown", "unknown",
+      test_spa_pod_parse_spec_invalid);
+  g_test_add_data_func ("/wp/spa-pod/parse-spec-invalid/invalid-id",
+      "invalid-id", test_spa_pod_parse_spec_invalid);
+  g_test_add_data_func ("/wp/spa-pod/parse-spec-invalid/duplicate",
+      "duplicate", test_spa_pod_parse_spec_invalid);
+  g_test_add_data_func ("/wp/spa-pod/parse-spec-invalid/duplicate-id",
+      "duplicate-id", test_spa_pod_parse_spec_invalid);
+  g_test_add_data_func ("/wp/spa-pod/parse-spec-invalid/duplicate-many",
+      "duplicate-many", test_spa_pod_parse_spec_invalid);
+  g_test_add_func ("/wp/spa-pod/builder-nested", test_spa_pod_builder_nested);
+  g_test_add_func ("/wp/spa-pod/raw-builder", test_spa_pod_raw_builder);
+  g_test_add_func ("/wp/spa-pod/copy", test_spa_pod_copy);
 
   return g_test_run ();
 }
@@ -6,6 +6,7 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <stdio.h>
 #include <wp/wp.h>
 
 static void
@@ -202,6 +203,260 @@ test_state_escaped (void)
   wp_state_clear (state);
 }
 
+static void
+test_state_journal (void)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (WpState) state = wp_state_new ("journal");
+  g_autoptr (WpProperties) props = wp_properties_new_empty ();
+  g_autofree gchar *journal = NULL;
+  g_assert_nonnull (state);
+
+  journal = g_strconcat (wp_state_get_location (state), ".journal", NULL);
+
+  /* Save */
+  wp_properties_set (props, "key1", "value1");
+  wp_properties_set (props, "key2", "value2");
+  g_assert_true (wp_state_save (state, props, &error));
+  g_assert_no_error (error);
+  g_assert_false (g_file_test (journal, G_FILE_TEST_EXISTS));
+
+  /* Save keys */
+  {
+    const gchar *keys[] = { "key1", "key2", "key 3", "\tkey\n4", NULL };
+    wp_properties_set (props, "key1", "new-value1");
+    wp_properties_set (props, "key2", NULL);
+    wp_properties_set (props, "key 3", "value 3");
+    wp_properties_set (props, "\tkey\n4", "line1\nline2\t\\");
+    g_assert_true (wp_state_save_keys (state, props, keys, &error));
+    g_assert_no_error (error);
+    g_assert_true (g_file_test (journal, G_FILE_TEST_EXISTS));
+  }
+
+  /* Load */
+  {
+    g_autoptr (WpState) other = wp_state_new ("journal");
+    g_autoptr (WpProperties) loaded = wp_state_load (other);
+    g_assert_nonnull (loaded);
+    g_assert_cmpstr (wp_properties_get (loaded, "key1"), ==, "new-value1");
+    g_assert_null (wp_properties_get (loaded, "key2"));
+    g_assert_cmpstr (wp_properties_get (loaded, "key 3"), ==, "value 3");
+    g_assert_cmpstr (wp_properties_get (loaded, "\tkey\n4"), ==,
+        "line1\nline2\t\\");
+  }
+
+  /* Grow the journal until it is compacted */
+  for (guint i = 0; g_file_test (journal, G_FILE_TEST_EXISTS); i++) {
+    g_autofree gchar *key = g_strdup_printf ("key.%u", i);
+    const gchar *keys[] = { key, NULL };
+    g_assert_cmpuint (i, <, 10000);
+    wp_properties_set (props, key, "some-value-to-fill-the-journal");
+    g_assert_true (wp_state_save_keys (state, props, keys, &error));
+    g_assert_no_error (error);
+  }
+
+  /* Load compacted */
+  {
+    g_autoptr (WpProperties) loaded = wp_state_load (state);
+    g_autoptr (WpIterator) it = wp_properties_new_iterator (props);
+    g_auto (GValue) item = G_VALUE_INIT;
+    guint n_items = 0;
+
+    g_assert_nonnull (loaded);
+    for (; wp_iterator_next (it, &item); g_value_unset (&item), n_items++) {
+      WpPropertiesItem *pi = g_value_get_boxed (&item);
+      g_assert_cmpstr (wp_properties_get (loaded,
+              wp_properties_item_get_key (pi)), ==,
+          wp_properties_item_get_value (pi));
+    }
+    g_assert_cmpuint (wp_properties_get_count (loaded), ==, n_items);
+  }
+
+  wp_state_clear (state);
+  g_assert_false (g_file_test (journal, G_FILE_TEST_EXISTS));
+}
+
+static void
+test_state_journal_partial (void)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (WpState) state = wp_state_new ("journal-partial");
+  g_autoptr (WpProperties) props = wp_properties_new_empty ();
+  g_autofree gchar *journal = NULL;
+  g_assert_nonnull (state);
+
+  journal = g_strconcat (wp_state_get_location (state), ".journal", NULL);
+
+  wp_properties_set (props, "key1", "value1");
+  wp_properties_set (props, "key2", "value2");
+  g_assert_true (wp_state_save (state, props, &error));
+  g_assert_no_error (error);
+
+  /* only the changed keys need to be passed */
+  {
+    g_autoptr (WpProperties) changed = wp_properties_new_empty ();
+    const gchar *keys[] = { "key1", NULL };
+    wp_properties_set (changed, "key1", "new-value1");
+    g_assert_true (wp_state_save_keys (state, changed, keys, &error));
+    g_assert_no_error (error);
+  }
+
+  /* simulate an entry that was interrupted while being written */
+  {
+    FILE *f = fopen (journal, "a");
+    g_assert_nonnull (f);
+    g_assert_cmpint (fputs ("S\tkey3\tpart", f), >=, 0);
+    g_assert_cmpint (fclose (f), ==, 0);
+  }
+
+  /* new entries are not appended to the partial one */
+  {
+    g_autoptr (WpState) other = wp_state_new ("journal-partial");
+    g_autoptr (WpProperties) changed = wp_properties_new_empty ();
+    const gchar *keys[] = { "key4", NULL };
+    wp_properties_set (changed, "key4", "value4");
+    g_assert_true (wp_state_save_keys (other, changed, keys, &error));
+    g_assert_no_error (error);
+  }
+
+  {
+    g_autoptr (WpProperties) loaded = wp_state_load (state);
+    g_assert_cmpstr (wp_properties_get (loaded, "key1"), ==, "new-value1");
+    g_assert_cmpstr (wp_properties_get (loaded, "key2"), ==, "value2");
+    g_assert_null (wp_properties_get (loaded, "key3"));
+    g_assert_cmpstr (wp_properties_get (loaded, "key4"), ==, "value4");
+  }
+
+  /* compacting keeps the keys that were not passed */
+  for (guint i = 0; g_file_test (journal, G_FILE_TEST_EXISTS); i++) {
+    g_autoptr (WpProperties) changed = wp_properties_new_empty ();
+    g_autofree gchar *key = g_strdup_printf ("key.%u", i);
+    const gchar *keys[] = { key, NULL };
+    g_assert_cmpuint (i, <, 10000);
+    wp_properties_set (changed, key, "some-value-to-fill-the-journal");
+    g_assert_true (wp_state_save_keys (state, changed, keys, &error));
+    g_assert_no_error (error);
+  }
+
+  {
+    g_autoptr (WpProperties) loaded = wp_state_load (state);
+    g_assert_cmpstr (wp_properties_get (loaded, "key1"), ==, "new-value1");
+    g_assert_cmpstr (wp_properties_get (loaded, "key2"), ==, "value2");
+    g_assert_cmpstr (wp_properties_get (loaded, "key4"), ==, "value4");
+    g_assert_cmpstr (wp_properties_get (loaded, "key.0"), ==,
+        "some-value-to-fill-the-journal");
+  }
+
+  wp_state_clear (state);
+}
+
+static void
+test_state_journal_stale (void)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (WpState) state = wp_state_new ("journal-stale");
+  g_autoptr (WpProperties) props = wp_properties_new_empty ();
+  g_autofree gchar *journal = NULL;
+  g_autofree gchar *old_journal = NULL;
+  gsize old_journal_len = 0;
+  g_assert_nonnull (state);
+
+  journal = g_strconcat (wp_state_get_location (state), ".journal", NULL);
+
+  wp_properties_set (props, "key1", "value1");
+  g_assert_true (wp_state_save (state, props, &error));
+  g_assert_no_error (error);
+  {
+    const gchar *keys[] = { "key1", NULL };
+    wp_properties_set (props, "key1", "journal-value1");
+    g_assert_true (wp_state_save_keys (state, props, keys, &error));
+    g_assert_no_error (error);
+  }
+  g_assert_true (g_file_get_contents (journal, &old_journal, &old_journal_len,
+          NULL));
+
+  /* simulate a full save that was interrupted before removing the journal */
+  wp_properties_set (props, "key1", "new-value1");
+  g_assert_true (wp_state_save (state, props, &error));
+  g_assert_no_error (error);
+  g_assert_false (g_file_test (journal, G_FILE_TEST_EXISTS));
+  g_assert_true (g_file_set_contents (journal, old_journal, old_journal_len,
+          NULL));
+
+  /* the old journal is not replayed over the newer state file */
+  {
+    g_autoptr (WpState) other = wp_state_new ("journal-stale");
+    g_autoptr (WpProperties) loaded = wp_state_load (other);
+    g_assert_cmpstr (wp_properties_get (loaded, "key1"), ==, "new-value1");
+    g_assert_false (g_file_test (journal, G_FILE_TEST_EXISTS));
+  }
+
+  /* and new entries are not appended to it either */
+  g_assert_true (g_file_set_contents (journal, old_journal, old_journal_len,
+          NULL));
+  {
+    g_autoptr (WpState) other = wp_state_new ("journal-stale");
+    g_autoptr (WpProperties) changed = wp_properties_new_empty ();
+    const gchar *keys[] = { "key2", NULL };
+    wp_properties_set (changed, "key2", "value2");
+    g_assert_true (wp_state_save_keys (other, changed, keys, &error));
+    g_assert_no_error (error);
+  }
+  {
+    g_autoptr (WpState) other = wp_state_new ("journal-stale");
+    g_autoptr (WpProperties) loaded = wp_state_load (other);
+    g_assert_cmpstr (wp_properties_get (loaded, "key1"), ==, "new-value1");
+    g_assert_cmpstr (wp_properties_get (loaded, "key2"), ==, "value2");
+  }
+
+  wp_state_clear (state);
+}
+
+static void
+test_state_journal_perf (void)
+{
+  const guint n_keys = g_test_perf () ? 10000 : 1000;
+  const guint n_saves = 100;
+  g_autoptr (GError) error = NULL;
+  g_autoptr (WpState) state = wp_state_new ("journal-perf");
+  g_autoptr (WpProperties) props = wp_properties_new_empty ();
+  gdouble elapsed;
+
+  for (guint i = 0; i < n_keys; i++) {
+    g_autofree gchar *key = g_strdup_printf ("Output/Audio:media.role:%u", i);
+    wp_properties_set (props, key, "0.500000");
+  }
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_saves; i++) {
+    wp_properties_setf (props, "Output/Audio:media.role:0", "%u", i);
+    g_assert_true (wp_state_save (state, props, &error));
+    g_assert_no_error (error);
+  }
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed,
+      "%u full saves of %u keys in %f s", n_saves, n_keys, elapsed);
+
+  g_test_timer_start ();
+  for (guint i = 0; i < n_saves; i++) {
+    const gchar *keys[] = { "Output/Audio:media.role:0", NULL };
+    wp_properties_setf (props, keys[0], "%u", i);
+    g_assert_true (wp_state_save_keys (state, props, keys, &error));
+    g_assert_no_error (error);
+  }
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed,
+      "%u incremental saves of %u keys in %f s", n_saves, n_keys, elapsed);
+
+  {
+    g_autoptr (WpProperties) loaded = wp_state_load (state);
+    g_assert_cmpstr (wp_properties_get (loaded, "Output/Audio:media.role:0"),
+        ==, "99");
+  }
+
+  wp_state_clear (state);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -212,6 +467,10 @@ main (int argc, char *argv[])
   g_test_add_func ("/wp/state/empty", test_state_empty);
   g_test_add_func ("/wp/state/spaces", test_state_spaces);
   g_test_add_func ("/wp/state/escaped", test_state_escaped);
+  g_test_add_func ("/wp/state/journal", test_state_journal);
+  g_test_add_func ("/wp/state/journal-partial", test_state_journal_partial);
+  g_test_add_func ("/wp/state/journal-stale", test_state_journal_stale);
+  g_test_add_func ("/wp/state/journal-perf", test_state_journal_perf);
 
   return g_test_run ();
 }
@@ -0,0 +1,108 @@
+-- Scalars are returned as they are
+assert (Json.Null ():parse { lazy = true } == nil)
+assert (Json.Boolean (true):parse { lazy = true })
+assert (Json.Int (3):parse { lazy = true } == 3)
+assert (Json.String ("wireplumber"):parse { lazy = true } == "wireplumber")
+
+-- Array
+json = Json.Raw ("[\"foo\", bar, 3, 1.5, true, null, [1, 2]]")
+val = json:parse { lazy = true }
+assert (type (val) == "userdata")
+assert (#val == 7)
+assert (val[1] == "foo")
+assert (val[2] == "bar")
+assert (val[3] == 3)
+assert (val[4] > 1.49 and val[4] < 1.51)
+assert (val[5] == true)
+assert (val[6] == nil)
+assert (val[7][1] == 1)
+assert (val[7][2] == 2)
+assert (val[7] == val[7])
+assert (val[0] == nil)
+assert (val[8] == nil)
+assert (val.foo == nil)
+count = 0
+for i, v in ipairs (val) do
+  count = count + 1
+end
+assert (count == 5)
+assert (tostring (val[7]) == "[1, 2]")
+
+-- Object
+json = Json.Raw ("{\"name\": \"wireplumber\", version: [0, 4, 7], " ..
+    "\"esc\\\"aped\": \"a\\\"b\", \"none\": null, " ..
+    "\"nested\": {\"key\": \"value\"}, \"dup\": 1, \"dup\": 2}")
+val = json:parse { lazy = true }
+assert (val.name == "wireplumber")
+assert (val.version[1] == 0)
+assert (val.version[3] == 7)
+assert (#val.version == 3)
+assert (val["esc\"aped"] == "a\"b")
+assert (val.none == nil)
+assert (val.nested.key == "value")
+assert (val.dup == 2)
+assert (val.missing == nil)
+assert (val[1] == nil)
+keys = {}
+for k, v in pairs (val) do
+  keys[k] = v
+end
+assert (keys.name == "wireplumber")
+assert (keys.version == val.version)
+assert (keys["esc\"aped"] == "a\"b")
+assert (keys.none == nil)
+assert (keys.nested.key == "value")
+
+-- The proxies keep the json they were parsed from alive
+val = Json.Raw ("{\"a\": {\"b\": [\"c\"]}}"):parse { lazy = true }
+assert (val.a.b[1] == "c")
+
+-- The eager path decodes the same values
+val = json:parse ()
+assert (type (val) == "table")
+assert (val.name == "wireplumber")
+assert (val["esc\"aped"] == "a\"b")
+assert (val.nested.key == "value")
+assert (val.dup == 2)
+
+-- The proxies do not depend on the string they were parsed from
+do
+  local parts = {}
+  for i = 1, 10 do
+    parts[i] = string.format ("{\"id\": %d, \"inner\": {\"name\": " ..
+        "\"node-%d\", \"ports\": [%d, %d]}}", i, i, i * 2, i * 2 + 1)
+  end
+  val = Json.Raw ("[" .. table.concat (parts, ", ") .. "]"):parse { lazy = true }
+end
+collectgarbage ()
+collectgarbage ()
+-- reuse the memory of the collected strings
+filler = {}
+for i = 1, 100 do
+  filler[i] = string.rep (string.char (65 + i % 26), 64 + i)
+end
+for i = 1, 10 do
+  assert (val[i].id == i)
+  assert (val[i].inner.name == "node-" .. i)
+  assert (val[i].inner.ports[2] == i * 2 + 1)
+end
+filler = nil
+
+-- A large document gives the same values with both paths
+entries = {}
+for i = 1, 200 do
+  entries[i] = string.format ("{\"name\": \"Output/Audio:%d\", " ..
+      "\"volume\": %d.5, \"mute\": false, " ..
+      "\"channels\": [\"FL\", \"FR\", \"FC\", \"LFE\", \"RL\", \"RR\"], " ..
+      "\"volumes\": [1.0, 1.0, 1.0, 1.0, 1.0, 1.0], " ..
+      "\"target\": \"alsa_output.pci-0000_00_1f.3.analog-stereo\"}", i, i)
+end
+json = Json.Raw ("[" .. table.concat (entries, ", ") .. "]")
+
+for _, opts in ipairs ({ {}, { lazy = true } }) do
+  val = json:parse (opts)
+  assert (#val == 200)
+  assert (val[100].name == "Output/Audio:100")
+  assert (val[150].channels[2] == "FR")
+  assert (val[200].target == "alsa_output.pci-0000_00_1f.3.analog-stereo")
+end
@@ -186,3 +186,40 @@ assert (val.name == "wireplumber")
 assert (val.version[1] == 0)
 assert (val.version[2] == 4)
 assert (val.version[3] == 7)
+
+-- Encode
+str = Json.encode {
+  volume = 0.5,
+  mute = false,
+  name = "out\"put",
+  volumes = { 0.25, 0.75 },
+  channels = { "FL", "FR", pod_type = "Array" },
+  empty = { pod_type = "Array" },
+  route = { index = 3, props = Json.Raw ("{\"key\": \"value\"}") },
+}
+val = Json.Raw (str):parse ()
+assert (val.volume > 0.49 and val.volume < 0.51)
+assert (val.mute == false)
+assert (val.name == "out\"put")
+assert (#val.volumes == 2)
+assert (val.volumes[2] > 0.74 and val.volumes[2] < 0.76)
+assert (val.channels[1] == "FL")
+assert (val.channels[2] == "FR")
+assert (val.channels.pod_type == nil)
+assert (#val.empty == 0)
+assert (val.route.index == 3)
+assert (val.route.props.key == "value")
+
+str = Json.encode { 1, "two", { 3 } }
+assert (str == "[1, \"two\", [3]]")
+
+-- numbers keep their full precision
+str = Json.encode { 9007199254740993, 0.1, 1.0 }
+assert (str == "[9007199254740993, 0.10000000000000001, 1.0]")
+str = Json.encode { math.maxinteger }
+assert (str == "[" .. tostring (math.maxinteger) .. "]")
+
+-- a sequence can not be mixed with other keys
+assert (not pcall (Json.encode, { 1, 2, key = "value" }))
+assert (not pcall (Json.encode, { 1, 2, { 3, key = "value" } }))
+assert (not pcall (Json.encode, { 1, 2, function () end }))
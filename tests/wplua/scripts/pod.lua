@@ -249,3 +249,38 @@ assert (val.properties["id-02000000"].properties.device == "my-sub-device")
 assert (val.properties["id-02000000"].properties["id-03000000"] == true)
 assert (val.properties["id-02000000"].properties["id-04000000"] == "string")
 assert (pod:get_type_name() == "Spa:Pod:Object:Param:Props")
+
+-- Object with selected keys
+pod = Pod.Object {
+  "Spa:Pod:Object:Param:Route", "Route",
+  index = 1,
+  direction = "Output",
+  device = 2,
+  name = "analog-output-speaker",
+  priority = 100,
+  available = "yes",
+  props = Pod.Object {
+    "Spa:Pod:Object:Param:Props", "Props",
+    mute = false,
+  }
+}
+val = pod:parse { "available", "name", "props", "info" }
+assert (val.pod_type == "Object")
+assert (val.object_id == "Route")
+assert (val.properties.available == "yes")
+assert (val.properties.name == "analog-output-speaker")
+assert (val.properties.props.properties.mute == false)
+assert (val.properties.info == nil)
+assert (val.properties.index == nil)
+assert (val.properties.priority == nil)
+local ok, err = pcall (function () return pod:parse { "no-such-key" } end)
+assert (not ok and err:find ("Unknown property key", 1, true))
+ok, err = pcall (function () return pod:parse { "name", "name" } end)
+assert (not ok and err:find ("Duplicate property key", 1, true))
+ok, err = pcall (function () return pod:parse { "id-zz" } end)
+assert (not ok and err:find ("Invalid property key", 1, true))
+assert (not pcall (function () return pod:parse { "name", 1 } end))
+
+-- Keys are ignored for pods that are not objects
+pod = Pod.Int (7)
+assert (pod:parse { "index" } == 7)
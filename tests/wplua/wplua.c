@@ -9,6 +9,7 @@
 #include "lua.h"
 #include <wplua/wplua.h>
 #include <wp/wp.h>
+#include <glib/gstdio.h>
 
 enum {
   PROP_0,
@@ -702,6 +703,236 @@ test_wplua_script_arguments ()
   wplua_unref (L);
 }
 
+static gint
+load_path_and_call (const gchar * path)
+{
+  g_autoptr (GError) error = NULL;
+  lua_State *L = wplua_new ();
+  gint ret;
+
+  g_assert_true (wplua_load_path (L, path, &error));
+  g_assert_no_error (error);
+  g_assert_true (wplua_pcall (L, 0, 1, &error));
+  g_assert_no_error (error);
+  ret = lua_tointeger (L, -1);
+  lua_pop (L, 1);
+
+  wplua_unref (L);
+  return ret;
+}
+
+static void
+write_script (const gchar * path, guint n_functions, gint result)
+{
+  g_autoptr (GString) code = g_string_new (NULL);
+  g_autoptr (GError) error = NULL;
+
+  for (guint i = 0; i < n_functions; i++) {
+    g_string_append_printf (code,
+        "local function f%u (t)\n"
+        "  local r = {}\n"
+        "  for k, v in pairs (t) do r[k .. '.%u'] = v * %u end\n"
+        "  return r\n"
+        "end\n", i, i, i);
+  }
+  g_string_append_printf (code, "return %d\n", result);
+
+  g_assert_true (g_file_set_contents (path, code->str, code->len, &error));
+  g_assert_no_error (error);
+}
+
+static void
+test_wplua_bytecode_cache ()
+{
+  const guint n_functions = g_test_perf () ? 150 : 20;
+  const guint n_rounds = g_test_perf () ? 100 : 5;
+  g_autofree gchar *dir = g_dir_make_tmp ("wplua-XXXXXX", NULL);
+  g_autofree gchar *path = g_build_filename (dir, "cached.lua", NULL);
+  g_autofree gchar *cache_path = wplua_get_cache_path (path);
+  g_autofree gchar *contents = NULL;
+  gsize len = 0, corrupt_len = 0;
+  gdouble cold, warm;
+
+  g_assert_nonnull (dir);
+  write_script (path, n_functions, 42);
+
+  /* cold loads: the source is compiled and the cache is written */
+  g_test_timer_start ();
+  for (guint i = 0; i < n_rounds; i++) {
+    g_remove (cache_path);
+    g_assert_cmpint (load_path_and_call (path), ==, 42);
+  }
+  cold = g_test_timer_elapsed ();
+  g_assert_true (g_file_test (cache_path, G_FILE_TEST_IS_REGULAR));
+
+  /* warm loads: the bytecode is loaded from the cache */
+  g_test_timer_start ();
+  for (guint i = 0; i < n_rounds; i++)
+    g_assert_cmpint (load_path_and_call (path), ==, 42);
+  warm = g_test_timer_elapsed ();
+
+  g_test_message ("loaded %u times: cold %f s, warm %f s", n_rounds, cold,
+      warm);
+  g_test_minimized_result (warm, "warm loads in %f s", warm);
+
+  /* a changed source invalidates the cache */
+  write_script (path, n_functions + 1, 43);
+  g_assert_cmpint (load_path_and_call (path), ==, 43);
+  g_assert_cmpint (load_path_and_call (path), ==, 43);
+
+  /* a corrupt entry falls back to the source and is replaced */
+  g_assert_true (g_file_get_contents (cache_path, &contents, &len, NULL));
+  g_assert_true (g_file_set_contents (cache_path, contents, len / 2, NULL));
+  g_assert_cmpint (load_path_and_call (path), ==, 43);
+  g_clear_pointer (&contents, g_free);
+  g_assert_true (g_file_get_contents (cache_path, &contents, &corrupt_len,
+          NULL));
+  g_assert_cmpuint (corrupt_len, ==, len);
+  g_assert_cmpint (load_path_and_call (path), ==, 43);
+
+  /* so does an entry with damaged bytecode that still matches the header;
+     it is detected by its checksum and rewritten from the source */
+  {
+    g_autofree gchar *damaged = g_memdup (contents, len);
+    g_autofree gchar *rewritten = NULL;
+    gsize rewritten_len = 0;
+
+    damaged[len - 2] ^= 0xff;
+    g_assert_true (g_file_set_contents (cache_path, damaged, len, NULL));
+    g_assert_cmpint (load_path_and_call (path), ==, 43);
+    g_assert_true (g_file_get_contents (cache_path, &rewritten,
+            &rewritten_len, NULL));
+    g_assert_cmpmem (rewritten, rewritten_len, contents, len);
+  }
+
+  g_remove (cache_path);
+  g_remove (path);
+  g_rmdir (dir);
+}
+
+static gpointer
+precompile_thread (const gchar * path)
+{
+  return wplua_precompile_path (path, NULL);
+}
+
+static void
+test_wplua_precompile ()
+{
+  g_autofree gchar *dir = g_dir_make_tmp ("wplua-XXXXXX", NULL);
+  g_autofree gchar *path = g_build_filename (dir, "precompiled.lua", NULL);
+  g_autofree gchar *cache_path = wplua_get_cache_path (path);
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GBytes) bytecode = NULL;
+  GThread *threads[4];
+  lua_State *L;
+
+  g_assert_nonnull (dir);
+  write_script (path, 20, 44);
+
+  /* compile concurrently from several threads */
+  for (guint i = 0; i < G_N_ELEMENTS (threads); i++)
+    threads[i] = g_thread_new ("precompile", (GThreadFunc) precompile_thread,
+        path);
+  for (guint i = 0; i < G_N_ELEMENTS (threads); i++) {
+    GBytes *b = g_thread_join (threads[i]);
+    g_assert_nonnull (b);
+    if (!bytecode)
+      bytecode = b;
+    else
+      g_bytes_unref (b);
+  }
+  g_assert_true (g_file_test (cache_path, G_FILE_TEST_IS_REGULAR));
+
+  /* the bytecode runs in a different state than the one that compiled it */
+  L = wplua_new ();
+  g_assert_true (wplua_load_bytecode (L, bytecode, path, &error));
+  g_assert_no_error (error);
+  g_assert_true (wplua_pcall (L, 0, 1, &error));
+  g_assert_no_error (error);
+  g_assert_cmpint (lua_tointeger (L, -1), ==, 44);
+  lua_pop (L, 1);
+  wplua_unref (L);
+
+  /* paths are normalized, so that precompiling and loading share the same
+     cache entry however the script is referred to */
+  {
+    g_autofree gchar *base = g_path_get_basename (dir);
+    g_autofree gchar *other = g_build_filename (dir, "..", base, ".",
+        "precompiled.lua", NULL);
+    g_autoptr (GBytes) b = NULL;
+
+    g_remove (cache_path);
+    b = wplua_precompile_path (other, &error);
+    g_assert_no_error (error);
+    g_assert_nonnull (b);
+    g_assert_true (g_file_test (cache_path, G_FILE_TEST_IS_REGULAR));
+  }
+
+  /* compilation errors are reported */
+  g_assert_true (g_file_set_contents (path, "return (", -1, NULL));
+  g_assert_null (wplua_precompile_path (path, &error));
+  g_assert_error (error, WP_DOMAIN_LUA, WP_LUA_ERROR_COMPILATION);
+
+  g_remove (cache_path);
+  g_remove (path);
+  g_rmdir (dir);
+}
+
+static void
+test_wplua_stats ()
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (WpLuaStats) outer = wplua_stats_new ();
+  g_autoptr (WpLuaStats) inner = wplua_stats_new ();
+  GClosure *closure;
+  guint64 allocated;
+  lua_State *L = wplua_new ();
+
+  const gchar code[] =
+    "function f()\n"
+    "  local t = {}\n"
+    "  for i = 1, 1000 do t[i] = tostring(i) end\n"
+    "end\n";
+  test_load_and_call (L, code, sizeof (code) - 1, 0, 0, &error);
+  g_assert_no_error (error);
+  g_assert_null (wplua_stats_get_current (L));
+
+  /* the closure is accounted to the stats that are current when it is made */
+  wplua_stats_push (L, inner);
+  g_assert_true (wplua_stats_get_current (L) == inner);
+  lua_getglobal (L, "f");
+  closure = wplua_function_to_closure (L, -1);
+  g_closure_ref (closure);
+  g_closure_sink (closure);
+  lua_pop (L, 1);
+  wplua_stats_pop (L);
+  g_assert_null (wplua_stats_get_current (L));
+  g_assert_cmpuint (inner->calls, ==, 1);
+
+  allocated = inner->allocated;
+  g_closure_invoke (closure, NULL, 0, NULL, NULL);
+  g_assert_cmpuint (inner->calls, ==, 2);
+  g_assert_cmpuint (inner->allocated, >, allocated + 1000);
+
+  /* nested calls are accounted exclusively */
+  allocated = inner->allocated;
+  wplua_stats_push (L, outer);
+  g_closure_invoke (closure, NULL, 0, NULL, NULL);
+  g_assert_true (wplua_stats_get_current (L) == outer);
+  wplua_stats_pop (L);
+  g_assert_cmpuint (outer->calls, ==, 1);
+  g_assert_cmpuint (inner->calls, ==, 3);
+  g_assert_cmpuint (inner->allocated, >, allocated + 1000);
+  g_assert_cmpuint (outer->allocated, <, inner->allocated - allocated);
+  g_assert_null (wplua_stats_get_current (L));
+
+  wplua_unref (L);
+
+  g_assert_true (closure->is_invalid);
+  g_closure_unref (closure);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -721,6 +952,9 @@ main (gint argc, gchar *argv[])
   g_test_add_func ("/wplua/convert/wp_properties",
       test_wplua_convert_wp_properties);
   g_test_add_func ("/wplua/script_arguments", test_wplua_script_arguments);
+  g_test_add_func ("/wplua/bytecode_cache", test_wplua_bytecode_cache);
+  g_test_add_func ("/wplua/precompile", test_wplua_precompile);
+  g_test_add_func ("/wplua/stats", test_wplua_stats);
 
   return g_test_run ();
 }